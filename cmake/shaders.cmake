@@ -53,14 +53,20 @@ function(target_add_shaders tgt)
           "$<$<BOOL:${incl_dirs}>:-I$<JOIN:${incl_dirs},;-I>>"
           "$<$<CONFIG:Debug>:-g>"
           -V
+          # The same environment as shaderc in ShaderHotReloader, etna needs Vulkan 1.3 anyway
+          --target-env vulkan1.3
           ${input_path}
           -o ${output_path}
         VERBATIM
         COMMAND_EXPAND_LISTS
         DEPENDS ${input_path})
     list(APPEND SPIRV_BINARY_FILES ${output_path})
+    list(APPEND shader_sources ${input_path})
   endforeach(glsl_path)
 
+  # Lets ShaderHotReloader recompile shaders at runtime exactly the way we do here
+  list(JOIN shader_sources "|" shader_sources)
+
   set(custom_target_name "${tgt}_shaders")
 
   if(TARGET ${custom_target_name})
@@ -73,6 +79,8 @@ function(target_add_shaders tgt)
     add_custom_target(${custom_target_name} DEPENDS ${SPIRV_BINARY_FILES})
     add_dependencies(${tgt} ${custom_target_name})
     add_compile_definitions(${tgt}
-      PRIVATE $<UPPER_CASE:${tgt}>_SHADERS_ROOT="${shader_binaries_dir}")
+      PRIVATE $<UPPER_CASE:${tgt}>_SHADERS_ROOT="${shader_binaries_dir}"
+      $<UPPER_CASE:${tgt}>_SHADER_SOURCES="${shader_sources}"
+      $<UPPER_CASE:${tgt}>_SHADER_INCLUDE_DIRS="$<JOIN:${incl_dirs},|>")
   endif()
 endfunction()
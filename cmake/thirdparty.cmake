@@ -13,7 +13,8 @@ CPMAddPackage(
 )
 
 # Cross-platform 3D graphics
-find_package(Vulkan 1.3.275 REQUIRED)
+# shaderc is only used for hot-reloading shaders and is not shipped by every distro
+find_package(Vulkan 1.3.275 REQUIRED OPTIONAL_COMPONENTS shaderc_combined)
 
 # Dear ImGui -- easiest way to do GUI
 CPMAddPackage(
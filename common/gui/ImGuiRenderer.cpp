@@ -12,14 +12,14 @@ void ImGuiRenderer::enableImGuiForWindow(GLFWwindow* window)
   ImGui_ImplGlfw_InitForVulkan(window, true);
 }
 
-ImGuiRenderer::ImGuiRenderer(vk::Format target_format)
+ImGuiRenderer::ImGuiRenderer(vk::Format target_format, vk::PipelineCache pipeline_cache)
 {
   createDescriptorPool();
 
   context = ImGui::CreateContext();
   ImGui::SetCurrentContext(context);
 
-  initImGui(target_format);
+  initImGui(target_format, pipeline_cache);
 
   IMGUI_CHECKVERSION();
 }
@@ -59,7 +59,7 @@ void ImGuiRenderer::createDescriptorPool()
     etna::unwrap_vk_result(etna::get_context().getDevice().createDescriptorPoolUnique(info));
 }
 
-void ImGuiRenderer::initImGui(vk::Format a_target_format)
+void ImGuiRenderer::initImGui(vk::Format a_target_format, vk::PipelineCache pipeline_cache)
 {
   const auto& ctx = etna::get_context();
 
@@ -78,7 +78,7 @@ void ImGuiRenderer::initImGui(vk::Format a_target_format)
     .ImageCount =
       std::max(static_cast<uint32_t>(ctx.getMainWorkCount().multiBufferingCount()), uint32_t{2}),
     .MSAASamples = VkSampleCountFlagBits::VK_SAMPLE_COUNT_1_BIT,
-    .PipelineCache = VK_NULL_HANDLE,
+    .PipelineCache = static_cast<VkPipelineCache>(pipeline_cache),
     .Subpass = 0,
     .UseDynamicRendering = true,
     .PipelineRenderingCreateInfo =
@@ -105,10 +105,20 @@ void ImGuiRenderer::initImGui(vk::Format a_target_format)
 
 void ImGuiRenderer::nextFrame()
 {
-  ImGui_ImplVulkan_NewFrame();
+  nextRendererFrame();
+  nextPlatformFrame();
+}
+
+void ImGuiRenderer::nextPlatformFrame()
+{
   ImGui_ImplGlfw_NewFrame();
 }
 
+void ImGuiRenderer::nextRendererFrame()
+{
+  ImGui_ImplVulkan_NewFrame();
+}
+
 void ImGuiRenderer::render(
   vk::CommandBuffer cmd_buf,
   vk::Rect2D rect,
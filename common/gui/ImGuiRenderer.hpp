@@ -14,9 +14,14 @@ class ImGuiRenderer
 public:
   static void enableImGuiForWindow(GLFWwindow* window);
 
-  explicit ImGuiRenderer(vk::Format target_format);
+  explicit ImGuiRenderer(vk::Format target_format, vk::PipelineCache pipeline_cache = {});
 
+  // Both halves of starting a new ImGui frame, for apps that render on the main thread
   void nextFrame();
+  // Polls the window through GLFW, must be called from the main thread
+  static void nextPlatformFrame();
+  // The rest of the new frame, can be called from a render thread
+  void nextRendererFrame();
 
   void render(
     vk::CommandBuffer cmd_buf,
@@ -31,7 +36,7 @@ private:
   vk::UniqueDescriptorPool descriptorPool;
   ImGuiContext* context;
 
-  void initImGui(vk::Format target_format);
+  void initImGui(vk::Format target_format, vk::PipelineCache pipeline_cache);
   void cleanupImGui();
   void createDescriptorPool();
 };
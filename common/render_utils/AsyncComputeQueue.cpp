@@ -0,0 +1,68 @@
+#include "AsyncComputeQueue.hpp"
+
+#include <etna/Etna.hpp>
+#include <etna/GlobalContext.hpp>
+#include <tracy/Tracy.hpp>
+
+
+AsyncComputeQueue::AsyncComputeQueue()
+  : frames{etna::get_context().getMainWorkCount(), [](std::size_t) {
+             return FrameCommands{
+               .pool = etna::unwrap_vk_result(
+                 etna::get_context().getDevice().createCommandPoolUnique(
+                   vk::CommandPoolCreateInfo{
+                     .flags = vk::CommandPoolCreateFlagBits::eTransient,
+                     .queueFamilyIndex = etna::get_context().getQueueFamilyIdx(),
+                   })),
+               .buffers = {},
+               .used = 0,
+             };
+           }}
+{
+}
+
+void AsyncComputeQueue::beginFrame()
+{
+  ZoneScoped;
+
+  // Etna's frame fence covers all earlier submissions to its queue, ours included
+  auto& frame = frames.get();
+  ETNA_CHECK_VK_RESULT(etna::get_context().getDevice().resetCommandPool(frame.pool.get()));
+  frame.used = 0;
+}
+
+vk::CommandBuffer AsyncComputeQueue::beginCommands()
+{
+  auto& frame = frames.get();
+  if (frame.used == frame.buffers.size())
+  {
+    auto newBuffers = etna::unwrap_vk_result(
+      etna::get_context().getDevice().allocateCommandBuffersUnique(vk::CommandBufferAllocateInfo{
+        .commandPool = frame.pool.get(),
+        .level = vk::CommandBufferLevel::ePrimary,
+        .commandBufferCount = 1,
+      }));
+    frame.buffers.push_back(std::move(newBuffers.front()));
+  }
+
+  auto cmdBuf = frame.buffers[frame.used++].get();
+  ETNA_CHECK_VK_RESULT(cmdBuf.begin(vk::CommandBufferBeginInfo{
+    .flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit,
+  }));
+  return cmdBuf;
+}
+
+void AsyncComputeQueue::submit(vk::CommandBuffer cmd_buf)
+{
+  ZoneScoped;
+
+  ETNA_CHECK_VK_RESULT(cmd_buf.end());
+
+  const vk::CommandBufferSubmitInfo cmdInfo{.commandBuffer = cmd_buf};
+  ETNA_CHECK_VK_RESULT(etna::get_context().getQueue().submit2(
+    {vk::SubmitInfo2{
+      .commandBufferInfoCount = 1,
+      .pCommandBufferInfos = &cmdInfo,
+    }},
+    {}));
+}
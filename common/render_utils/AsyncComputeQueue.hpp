@@ -0,0 +1,47 @@
+#pragma once
+
+#include <vector>
+
+#include <etna/Vulkan.hpp>
+#include <etna/GpuSharedResource.hpp>
+
+
+/**
+ * Submission point for compute work that is independent from graphics within a frame,
+ * e.g. culling, Hi-Z or ray marching. The work is recorded into its own command buffers
+ * and submitted ahead of the frame's graphics commands, so the driver can start on it
+ * while the graphics commands are still being recorded.
+ *
+ * NOTE: etna only creates a single universal queue, so everything goes there and is
+ * ordered by etna's barriers, no semaphores or queue family ownership transfers needed.
+ * Running on a dedicated compute queue needs a context that creates one first.
+ */
+class AsyncComputeQueue
+{
+public:
+  AsyncComputeQueue();
+
+  AsyncComputeQueue(const AsyncComputeQueue&) = delete;
+  AsyncComputeQueue& operator=(const AsyncComputeQueue&) = delete;
+
+  // Resets command buffers of the current frame in flight. Must be called
+  // once per frame after etna's frame fence was waited on.
+  void beginFrame();
+
+  // Returns a command buffer that is already begun
+  vk::CommandBuffer beginCommands();
+
+  // Ends and submits the command buffer. Graphics work submitted afterwards
+  // sees its results through regular barriers.
+  void submit(vk::CommandBuffer cmd_buf);
+
+private:
+  struct FrameCommands
+  {
+    vk::UniqueCommandPool pool;
+    std::vector<vk::UniqueCommandBuffer> buffers;
+    std::size_t used = 0;
+  };
+
+  etna::GpuSharedResource<FrameCommands> frames;
+};
@@ -0,0 +1,110 @@
+#include "BenchmarkRecorder.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <numeric>
+
+#include <etna/Assert.hpp>
+
+
+// Nearest-rank percentile of a sorted range
+static float percentile(std::span<const float> sorted, float p)
+{
+  const auto rank = static_cast<std::size_t>(std::ceil(p * static_cast<float>(sorted.size())));
+  return sorted[std::clamp<std::size_t>(rank, 1, sorted.size()) - 1];
+}
+
+static BenchmarkRecorder::Stats compute_series_stats(
+  const std::string& name, std::vector<float> values)
+{
+  BenchmarkRecorder::Stats stats{.name = name, .samples = values.size()};
+  if (values.empty())
+    return stats;
+
+  std::sort(values.begin(), values.end());
+  stats.min = values.front();
+  stats.max = values.back();
+  stats.avg =
+    std::accumulate(values.begin(), values.end(), 0.0f) / static_cast<float>(values.size());
+  stats.p50 = percentile(values, 0.50f);
+  stats.p95 = percentile(values, 0.95f);
+  stats.p99 = percentile(values, 0.99f);
+  return stats;
+}
+
+void BenchmarkRecorder::addCpuFrame(float frame_ms)
+{
+  cpuFrames.samples.push_back(frame_ms);
+}
+
+void BenchmarkRecorder::addGpuFrame(std::span<const GpuTimestampProfiler::ZoneTime> zones)
+{
+  // A series gets a single sample per frame, even if the zone was recorded several times
+  ++gpuFrameCount;
+  for (const auto& zone : zones)
+  {
+    auto& series = getSeries(zone.name);
+    if (series.lastFrame != gpuFrameCount)
+    {
+      series.samples.push_back(0);
+      series.lastFrame = gpuFrameCount;
+    }
+    series.samples.back() += zone.ms;
+  }
+}
+
+BenchmarkRecorder::Series& BenchmarkRecorder::getSeries(const char* name)
+{
+  auto it = std::find_if(
+    gpuZones.begin(), gpuZones.end(), [name](const Series& series) { return series.name == name; });
+  if (it != gpuZones.end())
+    return *it;
+
+  gpuZones.push_back(Series{.name = name, .samples = {}, .lastFrame = 0});
+  return gpuZones.back();
+}
+
+std::vector<BenchmarkRecorder::Stats> BenchmarkRecorder::computeStats() const
+{
+  std::vector<Stats> result;
+  result.reserve(gpuZones.size() + 1);
+  result.push_back(compute_series_stats(cpuFrames.name, cpuFrames.samples));
+  for (const auto& series : gpuZones)
+    result.push_back(compute_series_stats("gpu_" + series.name, series.samples));
+  return result;
+}
+
+void BenchmarkRecorder::write(const std::filesystem::path& path) const
+{
+  if (path.has_parent_path())
+    std::filesystem::create_directories(path.parent_path());
+
+  std::ofstream file{path};
+  ETNA_VERIFYF(file.is_open(), "Unable to open {} for writing!", path.string());
+
+  const auto stats = computeStats();
+
+  if (path.extension() == ".json")
+  {
+    file << "{\n  \"unit\": \"ms\",\n  \"zones\": [\n";
+    for (std::size_t i = 0; i < stats.size(); ++i)
+    {
+      const auto& s = stats[i];
+      file << "    {\"name\": \"" << s.name << "\", \"samples\": " << s.samples
+           << ", \"min\": " << s.min << ", \"avg\": " << s.avg << ", \"p50\": " << s.p50
+           << ", \"p95\": " << s.p95 << ", \"p99\": " << s.p99 << ", \"max\": " << s.max << "}"
+           << (i + 1 < stats.size() ? ",\n" : "\n");
+    }
+    file << "  ]\n}\n";
+  }
+  else
+  {
+    file << "name,samples,min_ms,avg_ms,p50_ms,p95_ms,p99_ms,max_ms\n";
+    for (const auto& s : stats)
+      file << s.name << ',' << s.samples << ',' << s.min << ',' << s.avg << ',' << s.p50 << ','
+           << s.p95 << ',' << s.p99 << ',' << s.max << '\n';
+  }
+
+  spdlog::info("Wrote benchmark results to {}", path.string());
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <filesystem>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "render_utils/GpuTimestampProfiler.hpp"
+
+
+/**
+ * Collects per-frame CPU and GPU timings during a benchmark run and
+ * summarizes them into percentiles. GPU zones with the same name within
+ * a single frame (e.g. a pass executed per shadow cascade) are summed up.
+ */
+class BenchmarkRecorder
+{
+public:
+  struct Stats
+  {
+    std::string name;
+    std::size_t samples = 0;
+    float min = 0;
+    float avg = 0;
+    float p50 = 0;
+    float p95 = 0;
+    float p99 = 0;
+    float max = 0;
+  };
+
+  void addCpuFrame(float frame_ms);
+  void addGpuFrame(std::span<const GpuTimestampProfiler::ZoneTime> zones);
+
+  // The CPU frame time comes first, GPU zones follow in order of first appearance
+  std::vector<Stats> computeStats() const;
+
+  // The format is picked by the extension: .json, or CSV for anything else
+  void write(const std::filesystem::path& path) const;
+
+private:
+  struct Series
+  {
+    std::string name;
+    std::vector<float> samples;
+    // GPU zones only, the frame the last sample belongs to
+    std::size_t lastFrame = 0;
+  };
+
+  Series& getSeries(const char* name);
+
+private:
+  Series cpuFrames{.name = "cpu_frame", .samples = {}, .lastFrame = 0};
+  std::vector<Series> gpuZones;
+  std::size_t gpuFrameCount = 0;
+};
@@ -0,0 +1,326 @@
+#include "ComputePrimitives.hpp"
+
+#include <algorithm>
+#include <string>
+
+#include <etna/Etna.hpp>
+#include <etna/GlobalContext.hpp>
+#include <etna/PipelineManager.hpp>
+
+
+static std::uint32_t div_up(std::uint32_t value, std::uint32_t divisor)
+{
+  return (value + divisor - 1) / divisor;
+}
+
+static bool supports_subgroup_arithmetic()
+{
+  const auto properties =
+    etna::get_context()
+      .getPhysicalDevice()
+      .getProperties2<vk::PhysicalDeviceProperties2, vk::PhysicalDeviceSubgroupProperties>();
+  const auto& subgroup = properties.get<vk::PhysicalDeviceSubgroupProperties>();
+  return (subgroup.supportedStages & vk::ShaderStageFlagBits::eCompute) &&
+    (subgroup.supportedOperations & vk::SubgroupFeatureFlagBits::eArithmetic);
+}
+
+// Makes everything written so far visible to the next dispatch or a readback
+static void storage_barrier(
+  vk::CommandBuffer cmd_buf,
+  vk::PipelineStageFlags2 src_stages = vk::PipelineStageFlagBits2::eComputeShader,
+  vk::AccessFlags2 src_access = vk::AccessFlagBits2::eShaderStorageWrite)
+{
+  vk::MemoryBarrier2 barrier{
+    .srcStageMask = src_stages,
+    .srcAccessMask = src_access,
+    .dstStageMask = vk::PipelineStageFlagBits2::eComputeShader |
+      vk::PipelineStageFlagBits2::eTransfer,
+    .dstAccessMask = vk::AccessFlagBits2::eShaderStorageRead |
+      vk::AccessFlagBits2::eShaderStorageWrite | vk::AccessFlagBits2::eTransferRead,
+  };
+  cmd_buf.pipelineBarrier2(vk::DependencyInfo{
+    .memoryBarrierCount = 1,
+    .pMemoryBarriers = &barrier,
+  });
+}
+
+// Covers the rare empty inputs, where there's nothing to dispatch
+static void fill_zero(vk::CommandBuffer cmd_buf, const etna::Buffer& buffer)
+{
+  cmd_buf.fillBuffer(buffer.get(), 0, sizeof(std::uint32_t), 0);
+  storage_barrier(
+    cmd_buf, vk::PipelineStageFlagBits2::eTransfer, vk::AccessFlagBits2::eTransferWrite);
+}
+
+static etna::ComputePipeline create_pipeline(const char* program, bool subgroups)
+{
+  if (etna::get_program_id(program) == etna::ShaderProgramId::Invalid)
+  {
+    const std::string binary =
+      std::string{RENDER_UTILS_SHADERS_ROOT} + program + (subgroups ? "_subgroup" : "");
+    etna::create_program(program, {binary + ".comp.spv"});
+  }
+
+  return etna::get_context().getPipelineManager().createComputePipeline(program, {});
+}
+
+ComputePrimitives::ComputePrimitives(CreateInfo info)
+  : maxCount{info.maxCount}
+  , subgroups{supports_subgroup_arithmetic()}
+{
+  auto& ctx = etna::get_context();
+
+  reducePipeline = create_pipeline("primitives_reduce", subgroups);
+  scanPipeline = create_pipeline("primitives_scan", subgroups);
+  scanAddPipeline = create_pipeline("primitives_scan_add", false);
+  compactPipeline = create_pipeline("primitives_compact", false);
+  radixCountPipeline = create_pipeline("primitives_radix_count", false);
+  radixScatterPipeline = create_pipeline("primitives_radix_scatter", subgroups);
+
+  const auto createStorage = [&ctx](std::uint32_t count, const std::string& name) {
+    return ctx.createBuffer(etna::Buffer::CreateInfo{
+      .size = std::max(count, 1u) * sizeof(std::uint32_t),
+      .bufferUsage = vk::BufferUsageFlagBits::eStorageBuffer,
+      .memoryUsage = VMA_MEMORY_USAGE_GPU_ONLY,
+      .name = name,
+    });
+  };
+
+  const std::uint32_t maxGroups = div_up(maxCount, PRIMITIVES_BLOCK_SIZE);
+
+  // Radix sort scans per-digit counts of all blocks, which might outnumber the elements
+  std::uint32_t levelCount = std::max(maxCount, PRIMITIVES_RADIX_SIZE * maxGroups);
+  do
+  {
+    levelCount = div_up(levelCount, PRIMITIVES_BLOCK_SIZE);
+    const auto index = std::to_string(levels.size());
+    levels.push_back(ScanLevel{
+      .sums = createStorage(levelCount, "primitives_sums" + index),
+      .offsets = createStorage(levelCount, "primitives_offsets" + index),
+    });
+  } while (levelCount > 1);
+
+  scratchKeys = createStorage(maxCount, "primitives_scratch_keys");
+  digitCounts = createStorage(PRIMITIVES_RADIX_SIZE * maxGroups, "primitives_digit_counts");
+  digitOffsets = createStorage(PRIMITIVES_RADIX_SIZE * maxGroups, "primitives_digit_offsets");
+
+  spdlog::info(
+    "Compute primitives: {} elements max, subgroup arithmetic {}",
+    maxCount,
+    subgroups ? "on" : "off");
+}
+
+void ComputePrimitives::dispatch(
+  vk::CommandBuffer cmd_buf,
+  const etna::ComputePipeline& pipeline,
+  const char* program,
+  std::vector<etna::Binding> bindings,
+  PrimitivesParams params)
+{
+  auto info = etna::get_shader_program(program);
+  auto set =
+    etna::create_descriptor_set(info.getDescriptorLayoutId(0), cmd_buf, std::move(bindings));
+  vk::DescriptorSet vkSet = set.getVkSet();
+
+  cmd_buf.bindPipeline(vk::PipelineBindPoint::eCompute, pipeline.getVkPipeline());
+  cmd_buf.bindDescriptorSets(
+    vk::PipelineBindPoint::eCompute, pipeline.getVkPipelineLayout(), 0, 1, &vkSet, 0, nullptr);
+  cmd_buf.pushConstants(
+    pipeline.getVkPipelineLayout(), vk::ShaderStageFlagBits::eCompute, 0, sizeof(params), &params);
+
+  etna::flush_barriers(cmd_buf);
+
+  const std::uint32_t groupsX =
+    std::min<std::uint32_t>(params.groupCount, PRIMITIVES_MAX_GROUPS_X);
+  cmd_buf.dispatch(groupsX, div_up(params.groupCount, groupsX), 1);
+
+  storage_barrier(cmd_buf);
+}
+
+void ComputePrimitives::reduce(
+  vk::CommandBuffer cmd_buf,
+  const etna::Buffer& input,
+  const etna::Buffer& result,
+  std::uint32_t count)
+{
+  ETNA_VERIFYF(count <= maxCount, "{} elements don't fit into {}", count, maxCount);
+  if (count == 0)
+  {
+    fill_zero(cmd_buf, result);
+    return;
+  }
+
+  // Every pass leaves a partial sum per block, until a single block is left
+  const etna::Buffer* current = &input;
+  for (std::size_t level = 0;; ++level)
+  {
+    const std::uint32_t groups = div_up(count, PRIMITIVES_BLOCK_SIZE);
+    const etna::Buffer& target = groups == 1 ? result : levels[level].sums;
+    dispatch(
+      cmd_buf,
+      reducePipeline,
+      "primitives_reduce",
+      {
+        etna::Binding{0, current->genBinding()},
+        etna::Binding{1, target.genBinding()},
+      },
+      PrimitivesParams{.count = count, .groupCount = groups, .shift = 0, .hasValues = 0});
+
+    if (groups == 1)
+      break;
+    current = &target;
+    count = groups;
+  }
+}
+
+void ComputePrimitives::exclusiveScan(
+  vk::CommandBuffer cmd_buf,
+  const etna::Buffer& input,
+  const etna::Buffer& output,
+  std::uint32_t count)
+{
+  ETNA_VERIFYF(count <= maxCount, "{} elements don't fit into {}", count, maxCount);
+  if (count != 0)
+    scanLevel(cmd_buf, input, output, count, 0);
+}
+
+void ComputePrimitives::scanLevel(
+  vk::CommandBuffer cmd_buf,
+  const etna::Buffer& input,
+  const etna::Buffer& output,
+  std::uint32_t count,
+  std::size_t level)
+{
+  const std::uint32_t groups = div_up(count, PRIMITIVES_BLOCK_SIZE);
+  const PrimitivesParams params{.count = count, .groupCount = groups, .shift = 0, .hasValues = 0};
+
+  dispatch(
+    cmd_buf,
+    scanPipeline,
+    "primitives_scan",
+    {
+      etna::Binding{0, input.genBinding()},
+      etna::Binding{1, output.genBinding()},
+      etna::Binding{2, levels[level].sums.genBinding()},
+    },
+    params);
+
+  // Offsets within the only block are already global
+  if (groups == 1)
+    return;
+
+  scanLevel(cmd_buf, levels[level].sums, levels[level].offsets, groups, level + 1);
+
+  dispatch(
+    cmd_buf,
+    scanAddPipeline,
+    "primitives_scan_add",
+    {
+      etna::Binding{0, output.genBinding()},
+      etna::Binding{1, levels[level].offsets.genBinding()},
+    },
+    params);
+}
+
+void ComputePrimitives::compact(
+  vk::CommandBuffer cmd_buf,
+  const etna::Buffer& values,
+  const etna::Buffer& flags,
+  const etna::Buffer& output,
+  const etna::Buffer& output_count,
+  std::uint32_t count)
+{
+  ETNA_VERIFYF(count <= maxCount, "{} elements don't fit into {}", count, maxCount);
+  if (count == 0)
+  {
+    fill_zero(cmd_buf, output_count);
+    return;
+  }
+
+  exclusiveScan(cmd_buf, flags, scratchKeys, count);
+
+  dispatch(
+    cmd_buf,
+    compactPipeline,
+    "primitives_compact",
+    {
+      etna::Binding{0, values.genBinding()},
+      etna::Binding{1, flags.genBinding()},
+      etna::Binding{2, scratchKeys.genBinding()},
+      etna::Binding{3, output.genBinding()},
+      etna::Binding{4, output_count.genBinding()},
+    },
+    PrimitivesParams{
+      .count = count,
+      .groupCount = div_up(count, PRIMITIVES_BLOCK_SIZE),
+      .shift = 0,
+      .hasValues = 0,
+    });
+}
+
+void ComputePrimitives::radixSort(
+  vk::CommandBuffer cmd_buf,
+  const etna::Buffer& keys,
+  const etna::Buffer* values,
+  std::uint32_t count)
+{
+  ETNA_VERIFYF(count <= maxCount, "{} elements don't fit into {}", count, maxCount);
+  if (count == 0)
+    return;
+
+  if (values != nullptr && !scratchValues.get())
+    scratchValues = etna::get_context().createBuffer(etna::Buffer::CreateInfo{
+      .size = std::max(maxCount, 1u) * sizeof(std::uint32_t),
+      .bufferUsage = vk::BufferUsageFlagBits::eStorageBuffer,
+      .memoryUsage = VMA_MEMORY_USAGE_GPU_ONLY,
+      .name = "primitives_scratch_values",
+    });
+
+  const std::uint32_t groups = div_up(count, PRIMITIVES_BLOCK_SIZE);
+
+  // An even number of passes, so that the result ends up where it started
+  static_assert(32 % (2 * PRIMITIVES_RADIX_BITS) == 0);
+  for (std::uint32_t shift = 0; shift < 32; shift += PRIMITIVES_RADIX_BITS)
+  {
+    const bool fromScratch = (shift / PRIMITIVES_RADIX_BITS) % 2 == 1;
+    const etna::Buffer& keysIn = fromScratch ? scratchKeys : keys;
+    const etna::Buffer& keysOut = fromScratch ? keys : scratchKeys;
+    // Without values, keys are bound in their place and never touched
+    const etna::Buffer& valuesIn =
+      values == nullptr ? keysIn : (fromScratch ? scratchValues : *values);
+    const etna::Buffer& valuesOut =
+      values == nullptr ? keysOut : (fromScratch ? *values : scratchValues);
+
+    const PrimitivesParams params{
+      .count = count,
+      .groupCount = groups,
+      .shift = shift,
+      .hasValues = values != nullptr ? 1u : 0u,
+    };
+
+    dispatch(
+      cmd_buf,
+      radixCountPipeline,
+      "primitives_radix_count",
+      {
+        etna::Binding{0, keysIn.genBinding()},
+        etna::Binding{1, digitCounts.genBinding()},
+      },
+      params);
+
+    scanLevel(cmd_buf, digitCounts, digitOffsets, PRIMITIVES_RADIX_SIZE * groups, 0);
+
+    dispatch(
+      cmd_buf,
+      radixScatterPipeline,
+      "primitives_radix_scatter",
+      {
+        etna::Binding{0, keysIn.genBinding()},
+        etna::Binding{1, valuesIn.genBinding()},
+        etna::Binding{2, keysOut.genBinding()},
+        etna::Binding{3, valuesOut.genBinding()},
+        etna::Binding{4, digitOffsets.genBinding()},
+      },
+      params);
+  }
+}
@@ -0,0 +1,111 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <etna/Vulkan.hpp>
+#include <etna/Buffer.hpp>
+#include <etna/ComputePipeline.hpp>
+#include <etna/DescriptorSet.hpp>
+
+#include "shaders/ComputePrimitives.h"
+
+
+/**
+ * Device-wide parallel primitives over buffers of 32-bit unsigned integers:
+ * reduction, exclusive scan, stream compaction and LSD radix sort, the building
+ * blocks of GPU culling, sorting and the like. Everything is recorded into the
+ * caller's command buffer. Inputs must already be visible to compute shaders,
+ * results are made visible to compute shaders and transfers before returning.
+ * Subgroup arithmetic is used when the device supports it in compute shaders.
+ */
+class ComputePrimitives
+{
+public:
+  struct CreateInfo
+  {
+    // Scratch memory is allocated up front for inputs of at most this many elements
+    std::uint32_t maxCount;
+  };
+
+  explicit ComputePrimitives(CreateInfo info);
+
+  ComputePrimitives(const ComputePrimitives&) = delete;
+  ComputePrimitives& operator=(const ComputePrimitives&) = delete;
+
+  // Sum of the elements modulo 2^32, written to the first element of result
+  void reduce(
+    vk::CommandBuffer cmd_buf,
+    const etna::Buffer& input,
+    const etna::Buffer& result,
+    std::uint32_t count);
+
+  // output[i] = input[0] + ... + input[i - 1], the buffers must not alias
+  void exclusiveScan(
+    vk::CommandBuffer cmd_buf,
+    const etna::Buffer& input,
+    const etna::Buffer& output,
+    std::uint32_t count);
+
+  // Copies values with a flag of 1 to the beginning of output in their original order,
+  // flags must be either 0 or 1. The number of copied values goes to output_count.
+  void compact(
+    vk::CommandBuffer cmd_buf,
+    const etna::Buffer& values,
+    const etna::Buffer& flags,
+    const etna::Buffer& output,
+    const etna::Buffer& output_count,
+    std::uint32_t count);
+
+  // Stable in-place sort of keys, values (if any) are moved along with their keys
+  void radixSort(
+    vk::CommandBuffer cmd_buf,
+    const etna::Buffer& keys,
+    const etna::Buffer* values,
+    std::uint32_t count);
+
+  bool usesSubgroups() const { return subgroups; }
+  std::uint32_t getMaxCount() const { return maxCount; }
+
+private:
+  struct ScanLevel
+  {
+    // Totals of blocks of the previous level, and their exclusive scan
+    etna::Buffer sums;
+    etna::Buffer offsets;
+  };
+
+  void dispatch(
+    vk::CommandBuffer cmd_buf,
+    const etna::ComputePipeline& pipeline,
+    const char* program,
+    std::vector<etna::Binding> bindings,
+    PrimitivesParams params);
+
+  void scanLevel(
+    vk::CommandBuffer cmd_buf,
+    const etna::Buffer& input,
+    const etna::Buffer& output,
+    std::uint32_t count,
+    std::size_t level);
+
+private:
+  std::uint32_t maxCount;
+  bool subgroups = false;
+
+  etna::ComputePipeline reducePipeline;
+  etna::ComputePipeline scanPipeline;
+  etna::ComputePipeline scanAddPipeline;
+  etna::ComputePipeline compactPipeline;
+  etna::ComputePipeline radixCountPipeline;
+  etna::ComputePipeline radixScatterPipeline;
+
+  std::vector<ScanLevel> levels;
+
+  // Flag offsets of compaction, or the other half of radix sort's ping-pong
+  etna::Buffer scratchKeys;
+  // Allocated by the first sort that has values
+  etna::Buffer scratchValues;
+  etna::Buffer digitCounts;
+  etna::Buffer digitOffsets;
+};
@@ -0,0 +1,166 @@
+#include "ComputeVariantCache.hpp"
+
+#include <algorithm>
+#include <fstream>
+
+#include <etna/Etna.hpp>
+#include <etna/GlobalContext.hpp>
+#include <tracy/Tracy.hpp>
+
+
+static std::vector<std::uint32_t> read_spirv(const std::filesystem::path& path)
+{
+  std::ifstream file{path, std::ios::binary | std::ios::ate};
+  ETNA_VERIFYF(file.is_open(), "Unable to open {}", path.string());
+
+  const auto size = static_cast<std::size_t>(file.tellg());
+  ETNA_VERIFYF(size % sizeof(std::uint32_t) == 0, "{} is not a SPIR-V binary", path.string());
+
+  std::vector<std::uint32_t> result(size / sizeof(std::uint32_t));
+  file.seekg(0);
+  file.read(reinterpret_cast<char*>(result.data()), static_cast<std::streamsize>(size));
+  return result;
+}
+
+ComputeVariantCache::ComputeVariantCache(CreateInfo info)
+  : programName{std::move(info.programName)}
+  , spirvPath{std::move(info.spirvPath)}
+  , pipelineCache{info.pipelineCache}
+{
+  const auto code = read_spirv(spirvPath);
+  shader = etna::unwrap_vk_result(
+    etna::get_context().getDevice().createShaderModuleUnique(vk::ShaderModuleCreateInfo{
+      .codeSize = code.size() * sizeof(std::uint32_t),
+      .pCode = code.data(),
+    }));
+  layout = etna::get_shader_program(programName.c_str()).getPipelineLayout();
+
+  compiler = std::thread([this]() { compileLoop(); });
+}
+
+ComputeVariantCache::~ComputeVariantCache()
+{
+  {
+    std::lock_guard lock{mutex};
+    stop = true;
+  }
+  wakeUp.notify_one();
+  compiler.join();
+}
+
+vk::Pipeline ComputeVariantCache::get(const Constants& constants)
+{
+  std::lock_guard lock{mutex};
+
+  auto [it, inserted] = variants.try_emplace(constants);
+  if (inserted)
+  {
+    it->second.pending = true;
+    queue.push_back(constants);
+    wakeUp.notify_one();
+  }
+  return it->second.pipeline.get();
+}
+
+vk::Pipeline ComputeVariantCache::getBlocking(const Constants& constants)
+{
+  std::unique_lock lock{mutex};
+
+  auto it = variants.find(constants);
+  if (it != variants.end())
+  {
+    // Either it is queued or being compiled right now, in both cases compiling it here
+    // would waste time, so the background thread is told to prioritize it instead.
+    if (std::erase(queue, constants) != 0)
+      queue.push_front(constants);
+    wakeUp.notify_one();
+    compiled.wait(lock, [&it]() { return !it->second.pending; });
+    return it->second.pipeline.get();
+  }
+
+  // Pending but not queued, so that nobody else schedules it meanwhile
+  variants[constants].pending = true;
+
+  lock.unlock();
+  auto pipeline = compile(constants);
+  lock.lock();
+
+  auto& variant = variants.at(constants);
+  variant.pipeline = std::move(pipeline);
+  variant.pending = false;
+  compiled.notify_all();
+  return variant.pipeline.get();
+}
+
+std::size_t ComputeVariantCache::getReadyCount() const
+{
+  std::lock_guard lock{mutex};
+  return static_cast<std::size_t>(
+    std::ranges::count_if(variants, [](const auto& entry) { return !entry.second.pending; }));
+}
+
+std::size_t ComputeVariantCache::getPendingCount() const
+{
+  std::lock_guard lock{mutex};
+  return static_cast<std::size_t>(
+    std::ranges::count_if(variants, [](const auto& entry) { return entry.second.pending; }));
+}
+
+vk::UniquePipeline ComputeVariantCache::compile(const Constants& constants) const
+{
+  ZoneScoped;
+
+  std::vector<vk::SpecializationMapEntry> entries;
+  entries.reserve(constants.size());
+  for (std::uint32_t i = 0; i < constants.size(); ++i)
+    entries.push_back(vk::SpecializationMapEntry{
+      .constantID = i,
+      .offset = i * static_cast<std::uint32_t>(sizeof(std::uint32_t)),
+      .size = sizeof(std::uint32_t),
+    });
+
+  const vk::SpecializationInfo specialization{
+    .mapEntryCount = static_cast<std::uint32_t>(entries.size()),
+    .pMapEntries = entries.data(),
+    .dataSize = constants.size() * sizeof(std::uint32_t),
+    .pData = constants.data(),
+  };
+
+  return etna::unwrap_vk_result(etna::get_context().getDevice().createComputePipelineUnique(
+    pipelineCache,
+    vk::ComputePipelineCreateInfo{
+      .stage =
+        vk::PipelineShaderStageCreateInfo{
+          .stage = vk::ShaderStageFlagBits::eCompute,
+          .module = shader.get(),
+          .pName = "main",
+          .pSpecializationInfo = &specialization,
+        },
+      .layout = layout,
+    }));
+}
+
+void ComputeVariantCache::compileLoop()
+{
+  tracy::SetThreadName("Variant compiler");
+
+  std::unique_lock lock{mutex};
+  while (true)
+  {
+    wakeUp.wait(lock, [this]() { return stop || !queue.empty(); });
+    if (stop)
+      return;
+
+    auto constants = std::move(queue.front());
+    queue.pop_front();
+
+    lock.unlock();
+    auto pipeline = compile(constants);
+    lock.lock();
+
+    auto& variant = variants.at(constants);
+    variant.pipeline = std::move(pipeline);
+    variant.pending = false;
+    compiled.notify_all();
+  }
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <etna/Vulkan.hpp>
+
+
+/**
+ * Compute pipelines of a single etna program, specialized with different sets of
+ * specialization constants. Quality knobs (iteration counts, optional features,
+ * workgroup sizes) become compile time constants for the driver without writing
+ * a shader permutation for each of them. All variants share the program's pipeline
+ * layout, so descriptor sets created for the program work with any of them.
+ * Variants are compiled lazily on a background thread, until a variant is ready
+ * the caller is expected to keep using a pipeline it already has.
+ */
+class ComputeVariantCache
+{
+public:
+  // The value at index i goes to the constant with constant_id = i
+  using Constants = std::vector<std::uint32_t>;
+
+  struct CreateInfo
+  {
+    // Must have been created with etna::create_program beforehand
+    std::string programName;
+    // The program's compute shader
+    std::filesystem::path spirvPath;
+    vk::PipelineCache pipelineCache = {};
+  };
+
+  explicit ComputeVariantCache(CreateInfo info);
+  ~ComputeVariantCache();
+
+  ComputeVariantCache(const ComputeVariantCache&) = delete;
+  ComputeVariantCache& operator=(const ComputeVariantCache&) = delete;
+
+  // Returns a null handle while the variant is being compiled, schedules compilation if needed
+  vk::Pipeline get(const Constants& constants);
+  // Compiles the variant on the calling thread unless it is already available
+  vk::Pipeline getBlocking(const Constants& constants);
+
+  std::size_t getReadyCount() const;
+  std::size_t getPendingCount() const;
+
+private:
+  struct Variant
+  {
+    vk::UniquePipeline pipeline;
+    bool pending = false;
+  };
+
+  vk::UniquePipeline compile(const Constants& constants) const;
+  void compileLoop();
+
+private:
+  std::string programName;
+  std::filesystem::path spirvPath;
+  vk::PipelineCache pipelineCache;
+  vk::UniqueShaderModule shader;
+  // Etna owns the layout, variants only borrow it
+  vk::PipelineLayout layout;
+
+  mutable std::mutex mutex;
+  std::condition_variable wakeUp;
+  // Signaled whenever a variant finishes compiling
+  std::condition_variable compiled;
+  std::map<Constants, Variant> variants;
+  std::deque<Constants> queue;
+  bool stop = false;
+
+  std::thread compiler;
+};
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include <etna/GlobalContext.hpp>
+
+
+/**
+ * Keeps GPU resources that were replaced on the CPU side alive until frames in flight
+ * that might still reference them are done, so that replacing them never requires
+ * waiting for the device to become idle.
+ * Frames are counted by nextFrame() calls, which must be made once per GPU frame
+ * after the frame slot that is about to be reused has been waited on.
+ */
+template <class T>
+class DeferredDeletionQueue
+{
+public:
+  void retire(T resource) { retired.emplace_back(frameIndex, std::move(resource)); }
+
+  void nextFrame()
+  {
+    ++frameIndex;
+
+    // After multiBufferingCount frames the GPU is guaranteed to be done with old resources
+    const auto framesInFlight = etna::get_context().getMainWorkCount().multiBufferingCount();
+    std::erase_if(retired, [this, framesInFlight](const auto& entry) {
+      return entry.first + framesInFlight < frameIndex;
+    });
+  }
+
+  // Only safe when the device is known to be idle
+  void clear() { retired.clear(); }
+
+  std::size_t size() const { return retired.size(); }
+
+private:
+  // Resources tagged with the frame they were retired on
+  std::vector<std::pair<std::uint64_t, T>> retired;
+  std::uint64_t frameIndex = 0;
+};
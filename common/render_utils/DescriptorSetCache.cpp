@@ -0,0 +1,214 @@
+#include "DescriptorSetCache.hpp"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <variant>
+
+#include <etna/Etna.hpp>
+#include <etna/GlobalContext.hpp>
+#include <tracy/Tracy.hpp>
+
+
+// Texture arrays take a lot of image descriptors per set, everything else only a few
+static constexpr std::uint32_t IMAGE_DESCRIPTORS_PER_SET = 64;
+static constexpr std::uint32_t OTHER_DESCRIPTORS_PER_SET = 8;
+
+template <class T>
+static std::uint64_t handle_bits(T handle)
+{
+  return std::bit_cast<std::uint64_t>(static_cast<typename T::CType>(handle));
+}
+
+std::size_t DescriptorSetCache::KeyHash::operator()(const std::vector<std::uint64_t>& key) const
+{
+  // FNV-1a over whole words, handles are random enough for that
+  std::uint64_t result = 14695981039346656037ull;
+  for (const auto word : key)
+    result = (result ^ word) * 1099511628211ull;
+  return static_cast<std::size_t>(result);
+}
+
+DescriptorSetCache::DescriptorSetCache(CreateInfo info)
+  : setsPerPool{info.setsPerPool}
+  , maxUnusedFrames{std::max(
+      info.maxUnusedFrames,
+      static_cast<std::uint32_t>(
+        etna::get_context().getMainWorkCount().multiBufferingCount()))}
+{
+  createPool();
+}
+
+void DescriptorSetCache::beginFrame()
+{
+  ZoneScoped;
+
+  ++frame;
+  writeCount = 0;
+
+  // Sets last used more than maxUnusedFrames ago can't be referenced by frames in flight
+  const auto old = [this](const Entry& entry) { return entry.lastUsed + maxUnusedFrames < frame; };
+
+  std::erase_if(sets, [this, &old](const auto& item) {
+    if (!old(item.second))
+      return false;
+    release(item.second);
+    return true;
+  });
+  std::erase_if(forgotten, [this, &old](const Entry& entry) {
+    if (!old(entry))
+      return false;
+    release(entry);
+    return true;
+  });
+}
+
+vk::DescriptorSet DescriptorSetCache::get(
+  etna::DescriptorLayoutId layout, std::span<const etna::Binding> bindings, std::uint64_t version)
+{
+  std::vector<std::uint64_t> key;
+  key.reserve(2 + 5 * bindings.size());
+  key.push_back(static_cast<std::uint64_t>(layout));
+  key.push_back(version);
+  for (const auto& binding : bindings)
+  {
+    key.push_back(std::uint64_t{binding.binding} << 32 | binding.arrayElem);
+    if (const auto* image = std::get_if<etna::ImageBinding>(&binding.resources))
+    {
+      const auto& descriptor = image->descriptor_info;
+      key.push_back(handle_bits(descriptor.sampler));
+      key.push_back(handle_bits(descriptor.imageView));
+      key.push_back(static_cast<std::uint64_t>(descriptor.imageLayout));
+    }
+    else
+    {
+      const auto& descriptor = std::get<etna::BufferBinding>(binding.resources).descriptor_info;
+      key.push_back(handle_bits(descriptor.buffer));
+      key.push_back(descriptor.offset);
+      key.push_back(descriptor.range);
+    }
+  }
+
+  if (auto it = sets.find(key); it != sets.end())
+  {
+    it->second.lastUsed = frame;
+    return it->second.set;
+  }
+
+  ZoneScopedN("writeDescriptorSet");
+
+  Entry entry{.lastUsed = frame};
+  entry.set = allocate(layout, entry.pool);
+  write(entry.set, layout, bindings);
+  sets.emplace(std::move(key), entry);
+
+  return entry.set;
+}
+
+void DescriptorSetCache::invalidate()
+{
+  for (auto& [key, entry] : sets)
+  {
+    // Might have been used by the current frame
+    entry.lastUsed = frame;
+    forgotten.push_back(entry);
+  }
+  sets.clear();
+}
+
+vk::DescriptorSet DescriptorSetCache::allocate(etna::DescriptorLayoutId layout, std::size_t& pool)
+{
+  auto& ctx = etna::get_context();
+  const vk::DescriptorSetLayout vkLayout = ctx.getDescriptorSetLayouts().getVkLayout(layout);
+
+  // Freed sets leave holes in older pools, so those are tried first
+  for (pool = 0;; ++pool)
+  {
+    const bool fresh = pool == pools.size();
+    if (fresh)
+      createPool();
+
+    vk::DescriptorSet set;
+    const vk::DescriptorSetAllocateInfo info{
+      .descriptorPool = pools[pool].get(),
+      .descriptorSetCount = 1,
+      .pSetLayouts = &vkLayout,
+    };
+    const auto result = ctx.getDevice().allocateDescriptorSets(&info, &set);
+    if (result == vk::Result::eSuccess)
+      return set;
+
+    const bool full =
+      result == vk::Result::eErrorOutOfPoolMemory || result == vk::Result::eErrorFragmentedPool;
+    ETNA_VERIFYF(
+      full && !fresh,
+      "Unable to allocate a descriptor set with layout {}: {}",
+      static_cast<std::uint32_t>(layout),
+      vk::to_string(result));
+  }
+}
+
+void DescriptorSetCache::createPool()
+{
+  using Sz = vk::DescriptorPoolSize;
+  const std::array sizes{
+    Sz{vk::DescriptorType::eSampler, setsPerPool * OTHER_DESCRIPTORS_PER_SET},
+    Sz{vk::DescriptorType::eCombinedImageSampler, setsPerPool * IMAGE_DESCRIPTORS_PER_SET},
+    Sz{vk::DescriptorType::eSampledImage, setsPerPool * IMAGE_DESCRIPTORS_PER_SET},
+    Sz{vk::DescriptorType::eStorageImage, setsPerPool * OTHER_DESCRIPTORS_PER_SET},
+    Sz{vk::DescriptorType::eUniformBuffer, setsPerPool * OTHER_DESCRIPTORS_PER_SET},
+    Sz{vk::DescriptorType::eStorageBuffer, setsPerPool * OTHER_DESCRIPTORS_PER_SET},
+  };
+
+  pools.push_back(etna::unwrap_vk_result(
+    etna::get_context().getDevice().createDescriptorPoolUnique(vk::DescriptorPoolCreateInfo{
+      .flags = vk::DescriptorPoolCreateFlagBits::eFreeDescriptorSet,
+      .maxSets = setsPerPool,
+      .poolSizeCount = static_cast<std::uint32_t>(sizes.size()),
+      .pPoolSizes = sizes.data(),
+    })));
+}
+
+void DescriptorSetCache::write(
+  vk::DescriptorSet set, etna::DescriptorLayoutId layout, std::span<const etna::Binding> bindings)
+{
+  const auto& layoutInfo = etna::get_context().getDescriptorSetLayouts().getLayoutInfo(layout);
+
+  // Writes point into these, so they must not reallocate
+  std::vector<vk::DescriptorImageInfo> images;
+  std::vector<vk::DescriptorBufferInfo> buffers;
+  images.reserve(bindings.size());
+  buffers.reserve(bindings.size());
+
+  std::vector<vk::WriteDescriptorSet> writes;
+  writes.reserve(bindings.size());
+  for (const auto& binding : bindings)
+  {
+    vk::WriteDescriptorSet write{
+      .dstSet = set,
+      .dstBinding = binding.binding,
+      .dstArrayElement = binding.arrayElem,
+      .descriptorCount = 1,
+      .descriptorType = layoutInfo.getBinding(binding.binding).descriptorType,
+    };
+    if (const auto* image = std::get_if<etna::ImageBinding>(&binding.resources))
+    {
+      images.push_back(image->descriptor_info);
+      write.pImageInfo = &images.back();
+    }
+    else
+    {
+      buffers.push_back(std::get<etna::BufferBinding>(binding.resources).descriptor_info);
+      write.pBufferInfo = &buffers.back();
+    }
+    writes.push_back(write);
+  }
+
+  etna::get_context().getDevice().updateDescriptorSets(writes, {});
+  writeCount += static_cast<std::uint32_t>(writes.size());
+}
+
+void DescriptorSetCache::release(const Entry& entry)
+{
+  etna::get_context().getDevice().freeDescriptorSets(pools[entry.pool].get(), {entry.set});
+}
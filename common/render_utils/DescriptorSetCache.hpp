@@ -0,0 +1,92 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <unordered_map>
+#include <vector>
+
+#include <etna/Vulkan.hpp>
+#include <etna/DescriptorSet.hpp>
+
+
+/**
+ * Descriptor sets that outlive the frame. etna::create_descriptor_set allocates and writes
+ * a new set every time, even when the very same resources are bound frame after frame.
+ * Here a set is looked up by its layout and bindings (descriptor handles, offsets, ranges
+ * and layouts), so that it is only written the first time a combination shows up.
+ * Sets that were not requested for a while are freed once no frame in flight uses them.
+ *
+ * Handles of destroyed resources may be reused for new ones, so a set must not be looked
+ * up by handles that belonged to a resource which was recreated since. Callers either call
+ * invalidate after recreating resources, or pass a version that changes whenever one of
+ * the bound resources might have been recreated.
+ *
+ * Unlike etna::create_descriptor_set no barriers are recorded, bound images must already be
+ * in the right state, e.g. because frame graph passes declare what they sample.
+ */
+class DescriptorSetCache
+{
+public:
+  struct CreateInfo
+  {
+    // Sets per descriptor pool, more pools are created when one runs out
+    std::uint32_t setsPerPool = 256;
+    // Sets not requested for this many frames are freed
+    std::uint32_t maxUnusedFrames = 8;
+  };
+
+  explicit DescriptorSetCache(CreateInfo info);
+
+  DescriptorSetCache(const DescriptorSetCache&) = delete;
+  DescriptorSetCache& operator=(const DescriptorSetCache&) = delete;
+
+  // Must be called once per frame after the frame's fence was waited on
+  void beginFrame();
+
+  // Writes descriptors only if the same layout, bindings and version weren't requested before
+  vk::DescriptorSet get(
+    etna::DescriptorLayoutId layout,
+    std::span<const etna::Binding> bindings,
+    std::uint64_t version = 0);
+
+  // Forgets all sets, e.g. after resources bound to them were recreated.
+  // Frames in flight may keep using them.
+  void invalidate();
+
+  // Descriptors written during the current frame, 0 once nothing changes between frames
+  std::uint32_t getWriteCount() const { return writeCount; }
+  std::size_t getSetCount() const { return sets.size(); }
+
+private:
+  struct KeyHash
+  {
+    std::size_t operator()(const std::vector<std::uint64_t>& key) const;
+  };
+
+  struct Entry
+  {
+    vk::DescriptorSet set;
+    std::size_t pool = 0;
+    std::uint64_t lastUsed = 0;
+  };
+
+  vk::DescriptorSet allocate(etna::DescriptorLayoutId layout, std::size_t& pool);
+  void createPool();
+  void write(
+    vk::DescriptorSet set,
+    etna::DescriptorLayoutId layout,
+    std::span<const etna::Binding> bindings);
+  void release(const Entry& entry);
+
+private:
+  std::uint32_t setsPerPool;
+  std::uint32_t maxUnusedFrames;
+
+  std::vector<vk::UniqueDescriptorPool> pools;
+  std::unordered_map<std::vector<std::uint64_t>, Entry, KeyHash> sets;
+  // Invalidated sets, freed once frames in flight are done with them
+  std::vector<Entry> forgotten;
+
+  std::uint64_t frame = 0;
+  std::uint32_t writeCount = 0;
+};
@@ -0,0 +1,50 @@
+#include "DynamicResolutionController.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+
+DynamicResolutionController::DynamicResolutionController(CreateInfo info)
+  : targetMs{info.targetMs}
+  , minScale{info.minScale}
+  , maxScale{info.maxScale}
+  , responsiveness{info.responsiveness}
+  , deadZone{info.deadZone}
+  , scale{info.maxScale}
+{
+}
+
+void DynamicResolutionController::update(float pass_ms)
+{
+  if (pass_ms <= 0)
+    return;
+
+  // Single frames spike all the time, reacting to them would make the image pulse
+  smoothedMs = smoothedMs == 0 ? pass_ms : std::lerp(smoothedMs, pass_ms, 0.1f);
+
+  if (!enabled || std::abs(smoothedMs / targetMs - 1.0f) < deadZone)
+    return;
+
+  // Time scales with the pixel count, i.e. with the square of the scale
+  const float ideal = std::clamp(scale * std::sqrt(targetMs / smoothedMs), minScale, maxScale);
+  const float newScale = std::lerp(scale, ideal, responsiveness);
+
+  // Measurements taken at the old scale would keep pushing in the same direction otherwise
+  smoothedMs *= (newScale * newScale) / (scale * scale);
+  scale = newScale;
+}
+
+glm::uvec2 DynamicResolutionController::getResolution(
+  glm::uvec2 full_resolution, std::uint32_t granularity) const
+{
+  const glm::vec2 scaled = glm::vec2(full_resolution) * scale;
+  glm::uvec2 result = glm::uvec2(glm::ceil(scaled / float(granularity))) * granularity;
+  return glm::min(glm::max(result, glm::uvec2(granularity)), full_resolution);
+}
+
+void DynamicResolutionController::setEnabled(bool value)
+{
+  enabled = value;
+  if (!enabled)
+    scale = maxScale;
+}
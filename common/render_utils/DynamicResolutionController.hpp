@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstdint>
+
+#include <glm/glm.hpp>
+
+
+/**
+ * Picks the render resolution scale of a GPU-bound pass so that its time stays around
+ * a target. The cost of the pass is assumed to be proportional to its pixel count, and
+ * measurements are expected to lag behind by a few frames, so the controller smooths
+ * them and only closes part of the gap every update.
+ */
+class DynamicResolutionController
+{
+public:
+  struct CreateInfo
+  {
+    float targetMs = 8.0f;
+    float minScale = 0.5f;
+    float maxScale = 1.0f;
+    // Part of the gap to the ideal scale that is closed on every update
+    float responsiveness = 0.2f;
+    // Relative deviation from the target that is tolerated without changing the scale
+    float deadZone = 0.05f;
+  };
+
+  explicit DynamicResolutionController(CreateInfo info);
+
+  // Feeds a new measurement of the pass time at the current scale
+  void update(float pass_ms);
+
+  float getScale() const { return scale; }
+  float getSmoothedMs() const { return smoothedMs; }
+
+  // Scaled resolution, rounded up to a multiple of `granularity` to avoid partial workgroups
+  glm::uvec2 getResolution(glm::uvec2 full_resolution, std::uint32_t granularity = 8) const;
+
+  float getTargetMs() const { return targetMs; }
+  void setTargetMs(float target_ms) { targetMs = target_ms; }
+
+  // A disabled controller keeps the maximum scale
+  bool isEnabled() const { return enabled; }
+  void setEnabled(bool value);
+
+private:
+  float targetMs;
+  float minScale;
+  float maxScale;
+  float responsiveness;
+  float deadZone;
+
+  bool enabled = true;
+  float scale;
+  float smoothedMs = 0;
+};
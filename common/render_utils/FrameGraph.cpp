@@ -0,0 +1,635 @@
+#include "FrameGraph.hpp"
+
+#include <algorithm>
+#include <array>
+
+#include <etna/Etna.hpp>
+#include <etna/GlobalContext.hpp>
+#include <tracy/Tracy.hpp>
+
+
+namespace
+{
+
+struct AccessState
+{
+  vk::PipelineStageFlags2 stages;
+  vk::AccessFlags2 access;
+  vk::ImageLayout layout;
+};
+
+AccessState get_access_state(FrameGraph::Access access)
+{
+  // Indexed by FrameGraph::Access
+  constexpr std::array STATES{
+    AccessState{
+      vk::PipelineStageFlagBits2::eColorAttachmentOutput,
+      vk::AccessFlagBits2::eColorAttachmentRead | vk::AccessFlagBits2::eColorAttachmentWrite,
+      vk::ImageLayout::eColorAttachmentOptimal},
+    AccessState{
+      vk::PipelineStageFlagBits2::eEarlyFragmentTests |
+        vk::PipelineStageFlagBits2::eLateFragmentTests,
+      vk::AccessFlagBits2::eDepthStencilAttachmentRead |
+        vk::AccessFlagBits2::eDepthStencilAttachmentWrite,
+      vk::ImageLayout::eDepthStencilAttachmentOptimal},
+    AccessState{
+      vk::PipelineStageFlagBits2::eFragmentShader | vk::PipelineStageFlagBits2::eComputeShader,
+      vk::AccessFlagBits2::eShaderSampledRead,
+      vk::ImageLayout::eShaderReadOnlyOptimal},
+    AccessState{
+      vk::PipelineStageFlagBits2::eTransfer,
+      vk::AccessFlagBits2::eTransferRead,
+      vk::ImageLayout::eTransferSrcOptimal},
+    AccessState{
+      vk::PipelineStageFlagBits2::eTransfer,
+      vk::AccessFlagBits2::eTransferWrite,
+      vk::ImageLayout::eTransferDstOptimal},
+  };
+  return STATES[static_cast<std::size_t>(access)];
+}
+
+bool is_read_only(vk::AccessFlags2 access)
+{
+  constexpr vk::AccessFlags2 WRITE_ACCESS = vk::AccessFlagBits2::eColorAttachmentWrite |
+    vk::AccessFlagBits2::eDepthStencilAttachmentWrite | vk::AccessFlagBits2::eTransferWrite |
+    vk::AccessFlagBits2::eShaderWrite | vk::AccessFlagBits2::eShaderStorageWrite |
+    vk::AccessFlagBits2::eMemoryWrite;
+  return !(access & WRITE_ACCESS);
+}
+
+vk::ImageAspectFlags get_aspect(vk::Format format)
+{
+  switch (format)
+  {
+  case vk::Format::eD16Unorm:
+  case vk::Format::eX8D24UnormPack32:
+  case vk::Format::eD32Sfloat:
+    return vk::ImageAspectFlagBits::eDepth;
+  case vk::Format::eD16UnormS8Uint:
+  case vk::Format::eD24UnormS8Uint:
+  case vk::Format::eD32SfloatS8Uint:
+    return vk::ImageAspectFlagBits::eDepth | vk::ImageAspectFlagBits::eStencil;
+  default:
+    return vk::ImageAspectFlagBits::eColor;
+  }
+}
+
+} // namespace
+
+FrameGraph::PassBuilder::PassBuilder(FrameGraph& frame_graph, std::size_t pass_index)
+  : graph{frame_graph}
+  , passIndex{pass_index}
+{
+}
+
+void FrameGraph::PassBuilder::read(ImageHandle image, Access access)
+{
+  graph.addUse(passIndex, image, access, false);
+}
+
+void FrameGraph::PassBuilder::write(ImageHandle image, Access access)
+{
+  graph.addUse(passIndex, image, access, true);
+}
+
+void FrameGraph::PassBuilder::colorAttachment(ImageHandle image, AttachmentParams params)
+{
+  // Loading previous contents means we depend on whoever wrote them
+  if (params.loadOp == vk::AttachmentLoadOp::eLoad)
+    read(image, Access::ColorAttachment);
+  write(image, Access::ColorAttachment);
+  graph.passes[passIndex].colorAttachments.push_back(Attachment{image, params});
+}
+
+void FrameGraph::PassBuilder::depthAttachment(ImageHandle image, AttachmentParams params)
+{
+  if (params.loadOp == vk::AttachmentLoadOp::eLoad)
+    read(image, Access::DepthAttachment);
+  write(image, Access::DepthAttachment);
+  graph.passes[passIndex].depthAttachment = Attachment{image, params};
+}
+
+void FrameGraph::PassBuilder::useSecondaryCommandBuffers()
+{
+  graph.passes[passIndex].secondaryContents = true;
+}
+
+FrameGraph::FrameGraph() = default;
+
+FrameGraph::~FrameGraph() = default;
+
+void FrameGraph::beginFrame()
+{
+  resources.clear();
+  passes.clear();
+  culledPassCount = 0;
+
+  // A frame graph frame always corresponds to a GPU frame
+  retiredTransients.nextFrame();
+}
+
+FrameGraph::ImageHandle FrameGraph::importImage(
+  const char* name, const etna::Image& image, vk::Extent2D extent, vk::ImageAspectFlags aspect)
+{
+  resources.push_back(Resource{
+    .name = name,
+    .extent = extent,
+    .aspect = aspect,
+    .etnaImage = &image,
+    .image = image.get(),
+    .view = image.getView({}),
+  });
+  return ImageHandle{static_cast<std::uint32_t>(resources.size() - 1)};
+}
+
+FrameGraph::ImageHandle FrameGraph::importImage(
+  const char* name,
+  vk::Image image,
+  vk::ImageView view,
+  vk::Extent2D extent,
+  vk::ImageAspectFlags aspect)
+{
+  resources.push_back(Resource{
+    .name = name,
+    .extent = extent,
+    .aspect = aspect,
+    .image = image,
+    .view = view,
+  });
+  return ImageHandle{static_cast<std::uint32_t>(resources.size() - 1)};
+}
+
+FrameGraph::ImageHandle FrameGraph::createImage(const TransientImageInfo& info)
+{
+  resources.push_back(Resource{
+    .name = info.name,
+    .extent = info.extent,
+    .aspect = get_aspect(info.format),
+    .transientInfo = info,
+  });
+  return ImageHandle{static_cast<std::uint32_t>(resources.size() - 1)};
+}
+
+void FrameGraph::addPass(const char* name, SetupFunc setup, ExecuteFunc execute)
+{
+  passes.push_back(Pass{.name = name, .execute = std::move(execute)});
+
+  PassBuilder builder{*this, passes.size() - 1};
+  setup(builder);
+}
+
+void FrameGraph::addUse(std::size_t pass_index, ImageHandle image, Access access, bool write)
+{
+  ETNA_VERIFYF(image.index < resources.size(), "Invalid image handle used in a frame graph!");
+  passes[pass_index].uses.push_back(ResourceUse{image, access, write});
+}
+
+void FrameGraph::execute(vk::CommandBuffer cmd_buf)
+{
+  ZoneScoped;
+
+  cullPasses();
+  allocateTransients();
+
+  for (auto& pass : passes)
+    if (pass.alive)
+    {
+      // NOTE: timestamps can't be written inside of rendering with secondary
+      // contents, so the zone has to wrap the whole pass.
+      GpuTimestampProfiler::Scope gpuZone{profiler, cmd_buf, pass.name};
+      recordPass(cmd_buf, pass);
+    }
+}
+
+void FrameGraph::cullPasses()
+{
+  // Writes to imported images are visible outside of the graph, hence are always needed.
+  // Everything else is needed only if a pass that is needed reads it.
+  std::vector<bool> needed(resources.size(), false);
+  for (std::size_t i = 0; i < resources.size(); ++i)
+    needed[i] = !resources[i].transientInfo.has_value();
+
+  for (auto it = passes.rbegin(); it != passes.rend(); ++it)
+  {
+    it->alive = std::any_of(it->uses.begin(), it->uses.end(), [&needed](const ResourceUse& use) {
+      return use.write && needed[use.image.index];
+    });
+
+    if (!it->alive)
+    {
+      ++culledPassCount;
+      continue;
+    }
+
+    for (const auto& use : it->uses)
+      if (!use.write)
+        needed[use.image.index] = true;
+  }
+}
+
+void FrameGraph::allocateTransients()
+{
+  ZoneScoped;
+
+  // Lifetimes of transient images in terms of alive passes
+  std::vector<std::size_t> firstUse(resources.size(), std::numeric_limits<std::size_t>::max());
+  std::vector<std::size_t> lastUse(resources.size(), 0);
+  for (std::size_t passIdx = 0; passIdx < passes.size(); ++passIdx)
+  {
+    if (!passes[passIdx].alive)
+      continue;
+    for (const auto& use : passes[passIdx].uses)
+    {
+      firstUse[use.image.index] = std::min(firstUse[use.image.index], passIdx);
+      lastUse[use.image.index] = std::max(lastUse[use.image.index], passIdx);
+    }
+  }
+
+  std::vector<std::size_t> transientResources;
+  for (std::size_t i = 0; i < resources.size(); ++i)
+    if (resources[i].transientInfo.has_value() && firstUse[i] <= lastUse[i])
+      transientResources.push_back(i);
+
+  // Absolute pass indices change whenever some unrelated pass is added or removed, so
+  // lifetimes are compressed to their relative order, which is all that matters for aliasing.
+  std::vector<std::size_t> endpoints;
+  for (auto resIdx : transientResources)
+  {
+    endpoints.push_back(firstUse[resIdx]);
+    endpoints.push_back(lastUse[resIdx]);
+  }
+  std::sort(endpoints.begin(), endpoints.end());
+  endpoints.erase(std::unique(endpoints.begin(), endpoints.end()), endpoints.end());
+  const auto rank = [&endpoints](std::size_t pass) {
+    return static_cast<std::size_t>(
+      std::lower_bound(endpoints.begin(), endpoints.end(), pass) - endpoints.begin());
+  };
+
+  std::vector<TransientKey> key;
+  key.reserve(transientResources.size());
+  for (auto resIdx : transientResources)
+  {
+    const auto& info = *resources[resIdx].transientInfo;
+    key.push_back(TransientKey{
+      .extent = info.extent,
+      .format = info.format,
+      .usage = info.imageUsage,
+      .firstUse = rank(firstUse[resIdx]),
+      .lastUse = rank(lastUse[resIdx]),
+    });
+  }
+
+  if (key != transients.key)
+  {
+    retiredTransients.retire(std::move(transients));
+    transients = createTransients(std::move(key));
+  }
+
+  for (std::size_t i = 0; i < transientResources.size(); ++i)
+  {
+    resources[transientResources[i]].transientIndex = i;
+
+    auto& image = transients.images[i];
+    image.touched = false;
+    image.layout = vk::ImageLayout::eUndefined;
+  }
+}
+
+FrameGraph::TransientAllocation FrameGraph::createTransients(std::vector<TransientKey> key)
+{
+  ZoneScoped;
+
+  auto& ctx = etna::get_context();
+  auto device = ctx.getDevice();
+
+  TransientAllocation result;
+  result.images.resize(key.size());
+
+  std::vector<vk::MemoryRequirements> requirements(key.size());
+  for (std::size_t i = 0; i < key.size(); ++i)
+  {
+    result.images[i].image = etna::unwrap_vk_result(device.createImageUnique(vk::ImageCreateInfo{
+      .imageType = vk::ImageType::e2D,
+      .format = key[i].format,
+      .extent = vk::Extent3D{key[i].extent.width, key[i].extent.height, 1},
+      .mipLevels = 1,
+      .arrayLayers = 1,
+      .samples = vk::SampleCountFlagBits::e1,
+      .tiling = vk::ImageTiling::eOptimal,
+      .usage = key[i].usage,
+      .sharingMode = vk::SharingMode::eExclusive,
+      .initialLayout = vk::ImageLayout::eUndefined,
+    }));
+    requirements[i] = device.getImageMemoryRequirements(result.images[i].image.get());
+    result.images[i].size = requirements[i].size;
+  }
+
+  // Greedy placement, biggest images first. Every block remembers which memory ranges are
+  // occupied during which part of the frame, an image can go into a range that is either
+  // free or only used by images that are dead by the time this one is needed.
+  struct Placement
+  {
+    vk::DeviceSize offset;
+    vk::DeviceSize size;
+    std::size_t firstUse;
+    std::size_t lastUse;
+  };
+  std::vector<std::vector<Placement>> placements;
+
+  std::vector<std::size_t> order(key.size());
+  for (std::size_t i = 0; i < order.size(); ++i)
+    order[i] = i;
+  std::sort(order.begin(), order.end(), [&requirements](std::size_t a, std::size_t b) {
+    return requirements[a].size > requirements[b].size;
+  });
+
+  std::vector<vk::DeviceSize> offsets(key.size(), 0);
+  for (auto imgIdx : order)
+  {
+    const auto& req = requirements[imgIdx];
+
+    const auto overlaps = [&key, imgIdx](const Placement& other) {
+      return other.firstUse <= key[imgIdx].lastUse && key[imgIdx].firstUse <= other.lastUse;
+    };
+
+    bool placed = false;
+    for (std::size_t blockIdx = 0; blockIdx < result.blocks.size() && !placed; ++blockIdx)
+    {
+      auto& block = result.blocks[blockIdx];
+      if ((block.memoryTypeBits & req.memoryTypeBits) == 0)
+        continue;
+
+      // Try right after every range that is alive at the same time as we are, and at the start
+      std::vector<vk::DeviceSize> candidates{0};
+      for (const auto& other : placements[blockIdx])
+        if (overlaps(other))
+          candidates.push_back(other.offset + other.size);
+
+      for (auto candidate : candidates)
+      {
+        const vk::DeviceSize offset =
+          (candidate + req.alignment - 1) / req.alignment * req.alignment;
+        if (offset + req.size > block.size)
+          continue;
+
+        const bool free = std::none_of(
+          placements[blockIdx].begin(),
+          placements[blockIdx].end(),
+          [&](const Placement& other) {
+            return overlaps(other) && other.offset < offset + req.size &&
+              offset < other.offset + other.size;
+          });
+        if (!free)
+          continue;
+
+        block.memoryTypeBits &= req.memoryTypeBits;
+        placements[blockIdx].push_back(
+          Placement{offset, req.size, key[imgIdx].firstUse, key[imgIdx].lastUse});
+        result.images[imgIdx].block = blockIdx;
+        offsets[imgIdx] = offset;
+        placed = true;
+        break;
+      }
+    }
+
+    if (!placed)
+    {
+      result.blocks.push_back(MemoryBlock{
+        .size = req.size,
+        .memoryTypeBits = req.memoryTypeBits,
+      });
+      placements.push_back({Placement{0, req.size, key[imgIdx].firstUse, key[imgIdx].lastUse}});
+      result.images[imgIdx].block = result.blocks.size() - 1;
+    }
+  }
+
+  const auto memoryProperties = ctx.getPhysicalDevice().getMemoryProperties();
+  for (auto& block : result.blocks)
+  {
+    std::uint32_t memoryType = std::numeric_limits<std::uint32_t>::max();
+    for (std::uint32_t i = 0; i < memoryProperties.memoryTypeCount; ++i)
+      if ((block.memoryTypeBits & (1u << i)) != 0 &&
+          (memoryProperties.memoryTypes[i].propertyFlags &
+           vk::MemoryPropertyFlagBits::eDeviceLocal))
+      {
+        memoryType = i;
+        break;
+      }
+    ETNA_VERIFYF(
+      memoryType != std::numeric_limits<std::uint32_t>::max(),
+      "No device local memory type suitable for transient images!");
+
+    block.memory = etna::unwrap_vk_result(device.allocateMemoryUnique(vk::MemoryAllocateInfo{
+      .allocationSize = block.size,
+      .memoryTypeIndex = memoryType,
+    }));
+  }
+
+  for (std::size_t i = 0; i < key.size(); ++i)
+    for (std::size_t j = 0; j < key.size(); ++j)
+      if (i != j && result.images[i].block == result.images[j].block &&
+          offsets[i] < offsets[j] + requirements[j].size &&
+          offsets[j] < offsets[i] + requirements[i].size)
+        result.images[i].aliases.push_back(j);
+
+  for (std::size_t i = 0; i < key.size(); ++i)
+  {
+    auto& image = result.images[i];
+    ETNA_CHECK_VK_RESULT(device.bindImageMemory(
+      image.image.get(), result.blocks[image.block].memory.get(), offsets[i]));
+
+    image.view = etna::unwrap_vk_result(device.createImageViewUnique(vk::ImageViewCreateInfo{
+      .image = image.image.get(),
+      .viewType = vk::ImageViewType::e2D,
+      .format = key[i].format,
+      .subresourceRange =
+        {
+          .aspectMask = get_aspect(key[i].format),
+          .baseMipLevel = 0,
+          .levelCount = 1,
+          .baseArrayLayer = 0,
+          .layerCount = 1,
+        },
+    }));
+  }
+
+  result.key = std::move(key);
+  return result;
+}
+
+void FrameGraph::recordPass(vk::CommandBuffer cmd_buf, Pass& pass)
+{
+  ZoneTransientN(passZone, pass.name, true);
+
+  // Barriers for imported images are handed over to etna, transient ones are ours
+
+  std::vector<vk::ImageMemoryBarrier2> transientBarriers;
+  for (const auto& use : pass.uses)
+  {
+    const auto& resource = resources[use.image.index];
+    const auto state = get_access_state(use.access);
+
+    if (!resource.transientInfo.has_value())
+    {
+      etna::set_state(
+        cmd_buf, resource.image, state.stages, state.access, state.layout, resource.aspect);
+      continue;
+    }
+
+    auto& image = transients.images[*resource.transientIndex];
+
+    // Reads of the same image in the same layout don't need to wait for each other
+    const bool needsBarrier = !image.touched || image.layout != state.layout ||
+      !is_read_only(image.access) || !is_read_only(state.access);
+
+    // The first use in a frame waits for whoever used this memory last: the images aliasing
+    // it earlier this frame, or any of them and this same image last frame. Images that
+    // haven't been touched yet still hold their accesses from the previous frame.
+    vk::PipelineStageFlags2 srcStages = image.stages;
+    vk::AccessFlags2 srcAccess = image.access;
+    if (!image.touched)
+      for (auto aliasIdx : image.aliases)
+      {
+        srcStages |= transients.images[aliasIdx].stages;
+        srcAccess |= transients.images[aliasIdx].access;
+      }
+
+    if (needsBarrier)
+      transientBarriers.push_back(vk::ImageMemoryBarrier2{
+        .srcStageMask = srcStages,
+        .srcAccessMask = srcAccess,
+        .dstStageMask = state.stages,
+        .dstAccessMask = state.access,
+        // Contents of aliased memory are garbage, so we discard them
+        .oldLayout = image.touched ? image.layout : vk::ImageLayout::eUndefined,
+        .newLayout = state.layout,
+        .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .image = image.image.get(),
+        .subresourceRange =
+          {
+            .aspectMask = resource.aspect,
+            .baseMipLevel = 0,
+            .levelCount = 1,
+            .baseArrayLayer = 0,
+            .layerCount = 1,
+          },
+      });
+
+    image.touched = true;
+    image.layout = state.layout;
+    image.stages = needsBarrier ? state.stages : image.stages | state.stages;
+    image.access = needsBarrier ? state.access : image.access | state.access;
+  }
+
+  etna::flush_barriers(cmd_buf);
+  if (!transientBarriers.empty())
+    cmd_buf.pipelineBarrier2(vk::DependencyInfo{
+      .imageMemoryBarrierCount = static_cast<std::uint32_t>(transientBarriers.size()),
+      .pImageMemoryBarriers = transientBarriers.data(),
+    });
+
+  if (pass.colorAttachments.empty() && !pass.depthAttachment.has_value())
+  {
+    pass.execute(cmd_buf);
+    return;
+  }
+
+  const auto makeAttachmentInfo = [this](const Attachment& attachment, vk::ImageLayout layout) {
+    return vk::RenderingAttachmentInfo{
+      .imageView = getAttachmentView(attachment),
+      .imageLayout = layout,
+      .loadOp = attachment.params.loadOp,
+      .storeOp = attachment.params.storeOp,
+      .clearValue = attachment.params.clearValue,
+    };
+  };
+
+  std::vector<vk::RenderingAttachmentInfo> colorInfos;
+  colorInfos.reserve(pass.colorAttachments.size());
+  for (const auto& attachment : pass.colorAttachments)
+    colorInfos.push_back(makeAttachmentInfo(attachment, vk::ImageLayout::eColorAttachmentOptimal));
+
+  std::optional<vk::RenderingAttachmentInfo> depthInfo;
+  if (pass.depthAttachment.has_value())
+    depthInfo =
+      makeAttachmentInfo(*pass.depthAttachment, vk::ImageLayout::eDepthStencilAttachmentOptimal);
+
+  const auto& firstAttachment =
+    pass.colorAttachments.empty() ? *pass.depthAttachment : pass.colorAttachments.front();
+  const vk::Rect2D renderArea{{0, 0}, resources[firstAttachment.image.index].extent};
+
+  cmd_buf.beginRendering(vk::RenderingInfo{
+    .flags = pass.secondaryContents ? vk::RenderingFlagBits::eContentsSecondaryCommandBuffers
+                                    : vk::RenderingFlags{},
+    .renderArea = renderArea,
+    .layerCount = 1,
+    .colorAttachmentCount = static_cast<std::uint32_t>(colorInfos.size()),
+    .pColorAttachments = colorInfos.data(),
+    .pDepthAttachment = depthInfo.has_value() ? &*depthInfo : nullptr,
+  });
+
+  // Secondary buffers have to set these themselves
+  if (!pass.secondaryContents)
+  {
+    cmd_buf.setViewport(
+      0,
+      {vk::Viewport{
+        .x = 0.0f,
+        .y = 0.0f,
+        .width = static_cast<float>(renderArea.extent.width),
+        .height = static_cast<float>(renderArea.extent.height),
+        .minDepth = 0.0f,
+        .maxDepth = 1.0f,
+      }});
+    cmd_buf.setScissor(0, {renderArea});
+  }
+
+  pass.execute(cmd_buf);
+
+  cmd_buf.endRendering();
+}
+
+vk::ImageView FrameGraph::getAttachmentView(const Attachment& attachment) const
+{
+  const auto& resource = resources[attachment.image.index];
+  if (resource.etnaImage != nullptr)
+    return resource.etnaImage->getView(attachment.params.view);
+  return getView(attachment.image);
+}
+
+vk::Image FrameGraph::getImage(ImageHandle handle) const
+{
+  const auto& resource = resources[handle.index];
+  if (!resource.transientInfo.has_value())
+    return resource.image;
+  if (!resource.transientIndex.has_value())
+    return {};
+  return transients.images[*resource.transientIndex].image.get();
+}
+
+vk::ImageView FrameGraph::getView(ImageHandle handle) const
+{
+  const auto& resource = resources[handle.index];
+  if (!resource.transientInfo.has_value())
+    return resource.view;
+  if (!resource.transientIndex.has_value())
+    return {};
+  return transients.images[*resource.transientIndex].view.get();
+}
+
+vk::DeviceSize FrameGraph::getTransientMemorySize() const
+{
+  vk::DeviceSize result = 0;
+  for (const auto& block : transients.blocks)
+    result += block.size;
+  return result;
+}
+
+vk::DeviceSize FrameGraph::getTransientImagesSize() const
+{
+  vk::DeviceSize result = 0;
+  for (const auto& image : transients.images)
+    result += image.size;
+  return result;
+}
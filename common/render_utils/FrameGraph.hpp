@@ -0,0 +1,231 @@
+#pragma once
+
+#include <cstdint>
+#include <limits>
+#include <optional>
+#include <vector>
+
+#include <etna/Vulkan.hpp>
+#include <etna/Image.hpp>
+#include <function2/function2.hpp>
+
+#include "render_utils/DeferredDeletionQueue.hpp"
+#include "render_utils/GpuTimestampProfiler.hpp"
+
+
+/**
+ * A tiny frame graph. Passes are re-declared every frame together with the images they
+ * read and write, and the graph takes care of:
+ *  - barriers, which are batched into a single flush before every pass;
+ *  - culling of passes whose results are never used;
+ *  - beginning and ending dynamic rendering for passes with attachments;
+ *  - allocating transient images, which share memory if their lifetimes don't overlap.
+ *
+ * Passes are executed in declaration order, the graph never reorders them.
+ * Imported images (swapchain, caches that live across frames, etc.) go through etna's
+ * state tracking, so they can be used freely outside of the graph too. Transient images
+ * are invisible to etna, hence they can only be used as attachments and for transfers.
+ */
+class FrameGraph
+{
+public:
+  struct ImageHandle
+  {
+    std::uint32_t index = std::numeric_limits<std::uint32_t>::max();
+  };
+
+  enum class Access
+  {
+    ColorAttachment,
+    DepthAttachment,
+    Sampled,
+    TransferSrc,
+    TransferDst,
+  };
+
+  struct TransientImageInfo
+  {
+    vk::Extent2D extent = {};
+    const char* name = "";
+    vk::Format format = vk::Format::eUndefined;
+    vk::ImageUsageFlags imageUsage = {};
+  };
+
+  struct AttachmentParams
+  {
+    vk::AttachmentLoadOp loadOp = vk::AttachmentLoadOp::eClear;
+    vk::AttachmentStoreOp storeOp = vk::AttachmentStoreOp::eStore;
+    vk::ClearValue clearValue = {};
+    // Only used for images imported from etna, e.g. to render into a single layer
+    etna::Image::ViewParams view = {};
+  };
+
+  class PassBuilder
+  {
+    friend class FrameGraph;
+
+  public:
+    void read(ImageHandle image, Access access);
+    void write(ImageHandle image, Access access);
+
+    void sample(ImageHandle image) { read(image, Access::Sampled); }
+    void colorAttachment(ImageHandle image, AttachmentParams params = {});
+    void depthAttachment(ImageHandle image, AttachmentParams params = {});
+
+    // The pass will only call vkCmdExecuteCommands inside of the rendering scope
+    void useSecondaryCommandBuffers();
+
+  private:
+    PassBuilder(FrameGraph& frame_graph, std::size_t pass_index);
+
+    FrameGraph& graph;
+    std::size_t passIndex;
+  };
+
+  using SetupFunc = fu2::function_view<void(PassBuilder& builder)>;
+  // Called inside of the rendering scope if the pass has attachments
+  using ExecuteFunc = fu2::unique_function<void(vk::CommandBuffer cmd_buf)>;
+
+  FrameGraph();
+  ~FrameGraph();
+
+  FrameGraph(const FrameGraph&) = delete;
+  FrameGraph& operator=(const FrameGraph&) = delete;
+
+  // Forgets all passes and resources of the previous frame.
+  // Transient images are kept alive and are reused when possible.
+  void beginFrame();
+
+  ImageHandle importImage(
+    const char* name, const etna::Image& image, vk::Extent2D extent, vk::ImageAspectFlags aspect);
+  ImageHandle importImage(
+    const char* name,
+    vk::Image image,
+    vk::ImageView view,
+    vk::Extent2D extent,
+    vk::ImageAspectFlags aspect);
+
+  ImageHandle createImage(const TransientImageInfo& info);
+
+  void addPass(const char* name, SetupFunc setup, ExecuteFunc execute);
+
+  // Culls unused passes, allocates transient images and records all passes into cmd_buf
+  void execute(vk::CommandBuffer cmd_buf);
+
+  // Every pass that is executed gets a GPU zone named after it, barriers included
+  void setProfiler(GpuTimestampProfiler* value) { profiler = value; }
+
+  // Only valid during execute
+  vk::Image getImage(ImageHandle handle) const;
+  vk::ImageView getView(ImageHandle handle) const;
+
+  // Total size of memory backing transient images and how much it would've been without aliasing
+  vk::DeviceSize getTransientMemorySize() const;
+  vk::DeviceSize getTransientImagesSize() const;
+  std::size_t getCulledPassCount() const { return culledPassCount; }
+
+private:
+  struct Resource
+  {
+    const char* name;
+    vk::Extent2D extent;
+    vk::ImageAspectFlags aspect;
+
+    // Imported images only
+    const etna::Image* etnaImage = nullptr;
+    vk::Image image;
+    vk::ImageView view;
+
+    // Transient images only
+    std::optional<TransientImageInfo> transientInfo;
+    // Index into transients.images, set when the graph is executed
+    std::optional<std::size_t> transientIndex;
+  };
+
+  struct ResourceUse
+  {
+    ImageHandle image;
+    Access access;
+    bool write;
+  };
+
+  struct Attachment
+  {
+    ImageHandle image;
+    AttachmentParams params;
+  };
+
+  struct Pass
+  {
+    const char* name;
+    std::vector<ResourceUse> uses;
+    std::vector<Attachment> colorAttachments;
+    std::optional<Attachment> depthAttachment;
+    bool secondaryContents = false;
+    ExecuteFunc execute;
+    bool alive = true;
+  };
+
+  // Uniquely identifies the set of transient images in a frame and how their lifetimes overlap
+  struct TransientKey
+  {
+    vk::Extent2D extent;
+    vk::Format format;
+    vk::ImageUsageFlags usage;
+    std::size_t firstUse;
+    std::size_t lastUse;
+
+    bool operator==(const TransientKey&) const = default;
+  };
+
+  struct MemoryBlock
+  {
+    vk::UniqueDeviceMemory memory;
+    vk::DeviceSize size = 0;
+    std::uint32_t memoryTypeBits = 0;
+  };
+
+  struct TransientImage
+  {
+    vk::UniqueImage image;
+    vk::UniqueImageView view;
+    std::size_t block = 0;
+    vk::DeviceSize size = 0;
+    // Other images that share some of this image's memory
+    std::vector<std::size_t> aliases;
+
+    // State within the current frame, stages and access are kept from the previous frame
+    // until the image is touched
+    bool touched = false;
+    vk::ImageLayout layout = vk::ImageLayout::eUndefined;
+    vk::PipelineStageFlags2 stages = vk::PipelineStageFlagBits2::eNone;
+    vk::AccessFlags2 access = vk::AccessFlagBits2::eNone;
+  };
+
+  struct TransientAllocation
+  {
+    std::vector<TransientKey> key;
+    // NOTE: blocks are declared first so that images are destroyed before their memory
+    std::vector<MemoryBlock> blocks;
+    std::vector<TransientImage> images;
+  };
+
+  void cullPasses();
+  void allocateTransients();
+  TransientAllocation createTransients(std::vector<TransientKey> key);
+  void recordPass(vk::CommandBuffer cmd_buf, Pass& pass);
+  void addUse(std::size_t pass_index, ImageHandle image, Access access, bool write);
+
+  vk::ImageView getAttachmentView(const Attachment& attachment) const;
+
+private:
+  std::vector<Resource> resources;
+  std::vector<Pass> passes;
+  std::size_t culledPassCount = 0;
+  GpuTimestampProfiler* profiler = nullptr;
+
+  TransientAllocation transients;
+
+  // Allocations that might still be in use by the GPU
+  DeferredDeletionQueue<TransientAllocation> retiredTransients;
+};
@@ -0,0 +1,83 @@
+#include "FrameRingAllocator.hpp"
+
+#include <etna/GlobalContext.hpp>
+
+
+FrameRingAllocator::FrameRingAllocator(CreateInfo info)
+  : name{info.name}
+  , sizePerFrame{info.sizePerFrame}
+  , fixedSizePerFrame{info.fixedSizePerFrame}
+  , regions{etna::get_context().getMainWorkCount(), [&info](std::size_t i) {
+              return Region{.offset = i * info.sizePerFrame, .used = info.fixedSizePerFrame};
+            }}
+{
+  ETNA_VERIFYF(
+    fixedSizePerFrame <= sizePerFrame,
+    "Frame ring allocator '{}' can't reserve {} fixed bytes out of {} per frame!",
+    name,
+    fixedSizePerFrame,
+    sizePerFrame);
+
+  auto& ctx = etna::get_context();
+
+  const auto limits = ctx.getPhysicalDevice().getProperties().limits;
+  uniformAlignment = limits.minUniformBufferOffsetAlignment;
+  storageAlignment = limits.minStorageBufferOffsetAlignment;
+
+  buffer = ctx.createBuffer(etna::Buffer::CreateInfo{
+    .size = sizePerFrame * ctx.getMainWorkCount().multiBufferingCount(),
+    .bufferUsage = vk::BufferUsageFlagBits::eUniformBuffer |
+      vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eIndirectBuffer |
+      vk::BufferUsageFlagBits::eTransferSrc,
+    .memoryUsage = VMA_MEMORY_USAGE_CPU_ONLY,
+    .name = info.name,
+  });
+
+  // Stays mapped for the whole lifetime of the allocator
+  buffer.map();
+}
+
+void FrameRingAllocator::beginFrame()
+{
+  regions.get().used = fixedSizePerFrame;
+}
+
+FrameRingAllocator::Allocation FrameRingAllocator::getFixed(vk::DeviceSize size)
+{
+  ETNA_VERIFYF(
+    size <= fixedSizePerFrame,
+    "Frame ring allocator '{}' reserves {} fixed bytes per frame, {} don't fit!",
+    name,
+    fixedSizePerFrame,
+    size);
+
+  const auto& region = regions.get();
+  return Allocation{
+    .buffer = buffer.get(),
+    .offset = region.offset,
+    .size = size,
+    .data = reinterpret_cast<std::byte*>(buffer.data()) + region.offset,
+  };
+}
+
+FrameRingAllocator::Allocation FrameRingAllocator::allocate(
+  vk::DeviceSize size, vk::DeviceSize alignment)
+{
+  auto& region = regions.get();
+
+  const vk::DeviceSize offset = (region.used + alignment - 1) / alignment * alignment;
+  ETNA_VERIFYF(
+    offset + size <= sizePerFrame,
+    "Frame ring allocator '{}' is out of memory, {} bytes per frame is not enough!",
+    name,
+    sizePerFrame);
+
+  region.used = offset + size;
+
+  return Allocation{
+    .buffer = buffer.get(),
+    .offset = region.offset + offset,
+    .size = size,
+    .data = reinterpret_cast<std::byte*>(buffer.data()) + region.offset + offset,
+  };
+}
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <cstring>
+#include <span>
+
+#include <etna/Buffer.hpp>
+#include <etna/GpuSharedResource.hpp>
+
+
+/**
+ * Linear allocator for data that the CPU produces every frame and the GPU consumes
+ * during the same frame: uniforms, instance data, indirect arguments, staging for copies.
+ * A single persistently mapped buffer is split into a region per frame in flight, so
+ * writing this frame's data can never race with the GPU reading data of previous frames,
+ * and a region is only reused after etna has waited for the fence of its frame.
+ */
+class FrameRingAllocator
+{
+public:
+  struct CreateInfo
+  {
+    // How much data a single frame can allocate
+    vk::DeviceSize sizePerFrame = 0;
+    // Reserved at the start of every frame's region for data rewritten every frame,
+    // e.g. per-frame uniforms. Its offset only depends on the frame slot, so descriptor
+    // sets binding it stay the same no matter what else the frame allocates.
+    vk::DeviceSize fixedSizePerFrame = 0;
+    const char* name = "frame_ring";
+  };
+
+  struct Allocation
+  {
+    vk::Buffer buffer;
+    vk::DeviceSize offset = 0;
+    vk::DeviceSize size = 0;
+    std::byte* data = nullptr;
+  };
+
+  explicit FrameRingAllocator(CreateInfo info);
+
+  FrameRingAllocator(const FrameRingAllocator&) = delete;
+  FrameRingAllocator& operator=(const FrameRingAllocator&) = delete;
+
+  // Must be called once per frame after the frame's fence was waited on,
+  // i.e. after acquiring the frame's command buffer.
+  void beginFrame();
+
+  Allocation allocate(vk::DeviceSize size, vk::DeviceSize alignment);
+
+  Allocation allocateUniform(vk::DeviceSize size) { return allocate(size, uniformAlignment); }
+  Allocation allocateStorage(vk::DeviceSize size) { return allocate(size, storageAlignment); }
+  // Source data for vkCmdCopyBuffer and friends
+  Allocation allocateStaging(vk::DeviceSize size) { return allocate(size, 16); }
+
+  // The first `size` bytes of the fixed part of the current frame's region,
+  // see CreateInfo::fixedSizePerFrame
+  Allocation getFixed(vk::DeviceSize size);
+
+  template <class T>
+  Allocation uploadFixed(const T& value)
+  {
+    auto result = getFixed(sizeof(T));
+    std::memcpy(result.data, &value, sizeof(T));
+    return result;
+  }
+
+  template <class T>
+  Allocation uploadUniform(const T& value)
+  {
+    auto result = allocateUniform(sizeof(T));
+    std::memcpy(result.data, &value, sizeof(T));
+    return result;
+  }
+
+  template <class T>
+  Allocation uploadStorage(std::span<const T> values)
+  {
+    auto result = allocateStorage(values.size_bytes());
+    std::memcpy(result.data, values.data(), values.size_bytes());
+    return result;
+  }
+
+  // For binding allocations to descriptor sets
+  const etna::Buffer& getBuffer() const { return buffer; }
+  etna::BufferBinding genBinding(const Allocation& allocation) const
+  {
+    return buffer.genBinding(allocation.offset, allocation.size);
+  }
+
+  // Bytes allocated during the current frame
+  vk::DeviceSize getUsedSize() const { return regions.get().used; }
+  vk::DeviceSize getSizePerFrame() const { return sizePerFrame; }
+
+private:
+  struct Region
+  {
+    vk::DeviceSize offset = 0;
+    vk::DeviceSize used = 0;
+  };
+
+  const char* name;
+  vk::DeviceSize sizePerFrame;
+  vk::DeviceSize fixedSizePerFrame;
+  vk::DeviceSize uniformAlignment;
+  vk::DeviceSize storageAlignment;
+
+  etna::Buffer buffer;
+  etna::GpuSharedResource<Region> regions;
+};
@@ -0,0 +1,112 @@
+#include "GpuTimestampProfiler.hpp"
+
+#include <etna/Etna.hpp>
+#include <etna/GlobalContext.hpp>
+
+
+GpuTimestampProfiler::GpuTimestampProfiler(std::uint32_t max_zones_per_frame)
+  : maxZones{max_zones_per_frame}
+  , frames{etna::get_context().getMainWorkCount(), [max_zones_per_frame](std::size_t) {
+             return FrameQueries{
+               .pool = etna::unwrap_vk_result(
+                 etna::get_context().getDevice().createQueryPoolUnique(vk::QueryPoolCreateInfo{
+                   .queryType = vk::QueryType::eTimestamp,
+                   .queryCount = 2 * max_zones_per_frame,
+                 })),
+               .names = {},
+             };
+           }}
+{
+  auto& ctx = etna::get_context();
+
+  const auto limits = ctx.getPhysicalDevice().getProperties().limits;
+  const auto families = ctx.getPhysicalDevice().getQueueFamilyProperties();
+  const std::uint32_t validBits = families[ctx.getQueueFamilyIdx()].timestampValidBits;
+
+  supported = validBits != 0 && limits.timestampPeriod > 0;
+  nsPerTick = limits.timestampPeriod;
+  if (validBits < 64)
+    validBitsMask = (std::uint64_t{1} << validBits) - 1;
+
+  scratch.resize(2 * maxZones);
+}
+
+void GpuTimestampProfiler::beginFrame(vk::CommandBuffer cmd_buf)
+{
+  if (!supported)
+    return;
+
+  auto& frame = frames.get();
+  readBack(frame);
+
+  frame.names.clear();
+  cmd_buf.resetQueryPool(frame.pool.get(), 0, 2 * maxZones);
+}
+
+std::uint32_t GpuTimestampProfiler::beginZone(vk::CommandBuffer cmd_buf, const char* name)
+{
+  auto& frame = frames.get();
+  if (!supported || frame.names.size() == maxZones)
+    return maxZones;
+
+  const auto zone = static_cast<std::uint32_t>(frame.names.size());
+  frame.names.push_back(name);
+  cmd_buf.writeTimestamp2(vk::PipelineStageFlagBits2::eAllCommands, frame.pool.get(), 2 * zone);
+  return zone;
+}
+
+void GpuTimestampProfiler::endZone(vk::CommandBuffer cmd_buf, std::uint32_t zone)
+{
+  // Zones that didn't fit are silently dropped
+  if (zone == maxZones)
+    return;
+
+  cmd_buf.writeTimestamp2(
+    vk::PipelineStageFlagBits2::eAllCommands, frames.get().pool.get(), 2 * zone + 1);
+}
+
+void GpuTimestampProfiler::readBack(FrameQueries& frame)
+{
+  if (frame.names.empty())
+    return;
+
+  const auto queryCount = static_cast<std::uint32_t>(2 * frame.names.size());
+
+  // The frame's fence was already waited on, so eNotReady means that a zone was never closed
+  const auto result = etna::get_context().getDevice().getQueryPoolResults(
+    frame.pool.get(),
+    0,
+    queryCount,
+    queryCount * sizeof(std::uint64_t),
+    scratch.data(),
+    sizeof(std::uint64_t),
+    vk::QueryResultFlagBits::e64);
+  if (result != vk::Result::eSuccess)
+    return;
+
+  results.clear();
+  for (std::size_t i = 0; i < frame.names.size(); ++i)
+  {
+    const std::uint64_t ticks = (scratch[2 * i + 1] - scratch[2 * i]) & validBitsMask;
+    results.push_back(ZoneTime{
+      .name = frame.names[i],
+      .ms = static_cast<float>(static_cast<double>(ticks) * nsPerTick / 1e6),
+    });
+  }
+  ++resultsVersion;
+}
+
+GpuTimestampProfiler::Scope::Scope(
+  GpuTimestampProfiler* a_profiler, vk::CommandBuffer cmd_buf, const char* name)
+  : profiler{a_profiler}
+  , cmdBuf{cmd_buf}
+{
+  if (profiler != nullptr)
+    zone = profiler->beginZone(cmdBuf, name);
+}
+
+GpuTimestampProfiler::Scope::~Scope()
+{
+  if (profiler != nullptr)
+    profiler->endZone(cmdBuf, zone);
+}
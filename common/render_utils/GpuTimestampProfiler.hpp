@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include <etna/Vulkan.hpp>
+#include <etna/GpuSharedResource.hpp>
+
+
+/**
+ * Measures GPU time of named zones with timestamp queries and makes the results
+ * available to the application itself. ETNA_PROFILE_GPU zones only ever reach Tracy,
+ * so anything that wants to act on GPU timings (benchmarks, auto-tuning) uses this.
+ * Results of a frame are read back when its slot is reused, i.e. they lag behind
+ * by the number of frames in flight.
+ */
+class GpuTimestampProfiler
+{
+public:
+  struct ZoneTime
+  {
+    // Must outlive the profiler, string literals are the intended use
+    const char* name;
+    float ms;
+  };
+
+  explicit GpuTimestampProfiler(std::uint32_t max_zones_per_frame = 64);
+
+  GpuTimestampProfiler(const GpuTimestampProfiler&) = delete;
+  GpuTimestampProfiler& operator=(const GpuTimestampProfiler&) = delete;
+
+  // Must be called after the current frame's fence was waited on and before any zones
+  void beginFrame(vk::CommandBuffer cmd_buf);
+
+  // Zones may nest, but must not be open across frames
+  std::uint32_t beginZone(vk::CommandBuffer cmd_buf, const char* name);
+  void endZone(vk::CommandBuffer cmd_buf, std::uint32_t zone);
+
+  // Zones of the most recent finished frame in the order they were opened
+  std::span<const ZoneTime> getResults() const { return results; }
+  // Incremented every time new results are read back
+  std::uint64_t getResultsVersion() const { return resultsVersion; }
+
+  bool isSupported() const { return supported; }
+
+  class Scope
+  {
+  public:
+    // A null profiler makes the scope a no-op
+    Scope(GpuTimestampProfiler* profiler, vk::CommandBuffer cmd_buf, const char* name);
+    ~Scope();
+
+    Scope(const Scope&) = delete;
+    Scope& operator=(const Scope&) = delete;
+
+  private:
+    GpuTimestampProfiler* profiler;
+    vk::CommandBuffer cmdBuf;
+    std::uint32_t zone = 0;
+  };
+
+private:
+  struct FrameQueries
+  {
+    vk::UniqueQueryPool pool;
+    std::vector<const char*> names;
+  };
+
+  void readBack(FrameQueries& frame);
+
+private:
+  std::uint32_t maxZones;
+  bool supported = false;
+  float nsPerTick = 1;
+  std::uint64_t validBitsMask = ~std::uint64_t{0};
+
+  etna::GpuSharedResource<FrameQueries> frames;
+
+  std::vector<ZoneTime> results;
+  std::uint64_t resultsVersion = 0;
+  std::vector<std::uint64_t> scratch;
+};
@@ -0,0 +1,161 @@
+#include "HeadlessFrameDelivery.hpp"
+
+#include <limits>
+
+#include <etna/Etna.hpp>
+#include <etna/GlobalContext.hpp>
+#include <stb_image_write.h>
+#include <tracy/Tracy.hpp>
+
+#include "render_utils/HostReadback.hpp"
+
+
+HeadlessFrameDelivery::HeadlessFrameDelivery(CreateInfo info)
+  : resolution{info.resolution}
+  , format{info.format}
+  , slots{etna::get_context().getMainWorkCount(), [](std::size_t) {
+            auto device = etna::get_context().getDevice();
+
+            FrameSlot slot;
+            slot.pool = etna::unwrap_vk_result(device.createCommandPoolUnique(
+              vk::CommandPoolCreateInfo{
+                .flags = vk::CommandPoolCreateFlagBits::eResetCommandBuffer,
+                .queueFamilyIndex = etna::get_context().getQueueFamilyIdx(),
+              }));
+            auto buffers = etna::unwrap_vk_result(
+              device.allocateCommandBuffersUnique(vk::CommandBufferAllocateInfo{
+                .commandPool = slot.pool.get(),
+                .level = vk::CommandBufferLevel::ePrimary,
+                .commandBufferCount = 1,
+              }));
+            slot.cmdBuf = std::move(buffers.front());
+            // Signaled so that the very first acquire doesn't wait forever
+            slot.done = etna::unwrap_vk_result(device.createFenceUnique(
+              vk::FenceCreateInfo{.flags = vk::FenceCreateFlagBits::eSignaled}));
+            return slot;
+          }}
+{
+  colorImage = etna::get_context().createImage(etna::Image::CreateInfo{
+    .extent = vk::Extent3D{resolution.x, resolution.y, 1},
+    .name = "headless_color",
+    .format = format,
+    .imageUsage =
+      vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eTransferSrc,
+  });
+}
+
+HeadlessFrameDelivery::~HeadlessFrameDelivery()
+{
+  finish();
+}
+
+vk::CommandBuffer HeadlessFrameDelivery::acquireNext()
+{
+  ZoneScoped;
+
+  auto device = etna::get_context().getDevice();
+  auto& slot = slots.get();
+
+  ETNA_CHECK_VK_RESULT(
+    device.waitForFences({slot.done.get()}, VK_TRUE, std::numeric_limits<std::uint64_t>::max()));
+
+  std::erase_if(pendingDumps, [this, &slot](PendingDump& dump) {
+    if (dump.frameDone != slot.done.get())
+      return false;
+    writeDump(dump);
+    return true;
+  });
+
+  ETNA_CHECK_VK_RESULT(device.resetFences({slot.done.get()}));
+  ETNA_CHECK_VK_RESULT(slot.cmdBuf->reset());
+  return slot.cmdBuf.get();
+}
+
+void HeadlessFrameDelivery::recordDump(vk::CommandBuffer cmd_buf, std::filesystem::path path)
+{
+  PendingDump dump{
+    .readback =
+      create_readback_buffer(vk::DeviceSize{resolution.x} * resolution.y * 4, "headless_readback"),
+    .path = std::move(path),
+    .frameDone = slots.get().done.get(),
+  };
+
+  etna::set_state(
+    cmd_buf,
+    colorImage.get(),
+    vk::PipelineStageFlagBits2::eTransfer,
+    vk::AccessFlagBits2::eTransferRead,
+    vk::ImageLayout::eTransferSrcOptimal,
+    vk::ImageAspectFlagBits::eColor);
+  etna::flush_barriers(cmd_buf);
+
+  const vk::BufferImageCopy region{
+    .bufferOffset = 0,
+    .bufferRowLength = 0,
+    .bufferImageHeight = 0,
+    .imageSubresource =
+      {
+        .aspectMask = vk::ImageAspectFlagBits::eColor,
+        .mipLevel = 0,
+        .baseArrayLayer = 0,
+        .layerCount = 1,
+      },
+    .imageOffset = {0, 0, 0},
+    .imageExtent = {resolution.x, resolution.y, 1},
+  };
+  cmd_buf.copyImageToBuffer(
+    colorImage.get(), vk::ImageLayout::eTransferSrcOptimal, dump.readback.get(), {region});
+
+  make_writes_host_visible(cmd_buf);
+
+  pendingDumps.push_back(std::move(dump));
+}
+
+void HeadlessFrameDelivery::submit(vk::CommandBuffer cmd_buf)
+{
+  ZoneScoped;
+
+  const vk::CommandBufferSubmitInfo cmdInfo{.commandBuffer = cmd_buf};
+  const vk::SubmitInfo2 submitInfo{
+    .commandBufferInfoCount = 1,
+    .pCommandBufferInfos = &cmdInfo,
+  };
+  ETNA_CHECK_VK_RESULT(
+    etna::get_context().getQueue().submit2({submitInfo}, slots.get().done.get()));
+}
+
+void HeadlessFrameDelivery::finish()
+{
+  ZoneScoped;
+
+  ETNA_CHECK_VK_RESULT(etna::get_context().getDevice().waitIdle());
+  for (auto& dump : pendingDumps)
+    writeDump(dump);
+  pendingDumps.clear();
+}
+
+void HeadlessFrameDelivery::writeDump(PendingDump& dump)
+{
+  ZoneScoped;
+
+  const auto& path = dump.path;
+  if (path.has_parent_path())
+    std::filesystem::create_directories(path.parent_path());
+
+  // NOTE: sRGB formats store already encoded values, which is exactly what PNG expects.
+  // BGRA formats would need a swizzle here, but we always pick the format ourselves.
+  const auto* pixels = reinterpret_cast<const unsigned char*>(dump.readback.map());
+  const int written = stbi_write_png(
+    path.string().c_str(),
+    static_cast<int>(resolution.x),
+    static_cast<int>(resolution.y),
+    4,
+    pixels,
+    static_cast<int>(resolution.x * 4));
+  dump.readback.unmap();
+
+  if (written == 0)
+    spdlog::error("Failed to write a frame to {}", path.string());
+  else
+    spdlog::info("Wrote a frame to {}", path.string());
+}
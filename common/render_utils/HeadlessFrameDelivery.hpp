@@ -0,0 +1,78 @@
+#pragma once
+
+#include <filesystem>
+#include <vector>
+
+#include <etna/Vulkan.hpp>
+#include <etna/Image.hpp>
+#include <etna/Buffer.hpp>
+#include <etna/GpuSharedResource.hpp>
+#include <glm/glm.hpp>
+
+
+/**
+ * Replacement for etna::Window + etna::PerFrameCmdMgr when there is no window at all,
+ * e.g. on CI machines with a software rasterizer. Frames are rendered into an offscreen
+ * color image and can optionally be read back and written to disk as PNG files.
+ * Requires neither GLFW nor VK_KHR_swapchain.
+ */
+class HeadlessFrameDelivery
+{
+public:
+  struct CreateInfo
+  {
+    glm::uvec2 resolution = {};
+    vk::Format format = vk::Format::eR8G8B8A8Srgb;
+  };
+
+  explicit HeadlessFrameDelivery(CreateInfo info);
+  // Waits for all frames in flight and writes out the remaining dumps
+  ~HeadlessFrameDelivery();
+
+  HeadlessFrameDelivery(const HeadlessFrameDelivery&) = delete;
+  HeadlessFrameDelivery& operator=(const HeadlessFrameDelivery&) = delete;
+
+  // Waits until the GPU is done with the previous frame that used the current slot,
+  // writes out its dumps if any were requested and returns a reset command buffer.
+  vk::CommandBuffer acquireNext();
+
+  // Copies the color image into a host-visible buffer, which is written to `path`
+  // once the frame is finished. Must be recorded after the frame was rendered.
+  void recordDump(vk::CommandBuffer cmd_buf, std::filesystem::path path);
+
+  void submit(vk::CommandBuffer cmd_buf);
+
+  // Waits for the GPU to finish all submitted frames and writes out their dumps
+  void finish();
+
+  const etna::Image& getColorImage() const { return colorImage; }
+  vk::Format getFormat() const { return format; }
+  glm::uvec2 getResolution() const { return resolution; }
+
+private:
+  struct FrameSlot
+  {
+    vk::UniqueCommandPool pool;
+    vk::UniqueCommandBuffer cmdBuf;
+    vk::UniqueFence done;
+  };
+
+  // Dumps are rare, so every one of them simply gets its own buffer
+  struct PendingDump
+  {
+    etna::Buffer readback;
+    std::filesystem::path path;
+    // Fence of the frame that the dump was recorded into
+    vk::Fence frameDone;
+  };
+
+  void writeDump(PendingDump& dump);
+
+private:
+  glm::uvec2 resolution;
+  vk::Format format;
+  etna::Image colorImage;
+
+  etna::GpuSharedResource<FrameSlot> slots;
+  std::vector<PendingDump> pendingDumps;
+};
@@ -0,0 +1,272 @@
+#include "HeightmapGenerator.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+
+#include <etna/Etna.hpp>
+#include <etna/GlobalContext.hpp>
+#include <etna/PipelineManager.hpp>
+#include <tracy/Tracy.hpp>
+
+
+// Rows are handed to workers in bands of this many
+static constexpr std::uint32_t ROWS_PER_TASK = 8;
+// Texels of a row that are summed up at once, small enough for the sums to stay in L1
+static constexpr std::uint32_t TEXELS_PER_CHUNK = 256;
+// Texels that go through perlin_lanes together, a single AVX2 register of 32-bit integers
+static constexpr std::uint32_t LANES = 8;
+
+// Everything below mirrors heightmap.comp operation by operation, keep them in sync
+
+static std::uint32_t lowbias32(std::uint32_t h)
+{
+  h ^= h >> 16;
+  h *= 0x7FEB352Du;
+  h ^= h >> 15;
+  h *= 0x846CA68Bu;
+  h ^= h >> 16;
+  return h;
+}
+
+// Dot product of a diagonal gradient picked by the hash with the offset to the corner
+static std::int32_t corner_dot(std::uint32_t hash, std::int32_t dx, std::int32_t dy)
+{
+  const auto signX = -static_cast<std::int32_t>(hash & 1u);
+  const auto signY = -static_cast<std::int32_t>((hash >> 1) & 1u);
+  return ((dx ^ signX) - signX) + ((dy ^ signY) - signY);
+}
+
+// 6t^5 - 15t^4 + 10t^3
+static std::int32_t fade(std::int32_t t)
+{
+  const std::int32_t t2 = (t * t) >> HEIGHTMAP_FRACTION_BITS;
+  const std::int32_t t3 = (t2 * t) >> HEIGHTMAP_FRACTION_BITS;
+  const std::int32_t inner =
+    (((6 * t - 15 * HEIGHTMAP_ONE) * t) >> HEIGHTMAP_FRACTION_BITS) + 10 * HEIGHTMAP_ONE;
+  return (t3 * inner) >> HEIGHTMAP_FRACTION_BITS;
+}
+
+static std::int32_t lerp_fixed(std::int32_t a, std::int32_t b, std::int32_t t)
+{
+  return a + (((b - a) * t) >> HEIGHTMAP_FRACTION_BITS);
+}
+
+// Position of a texel within its lattice cell, in fixed point
+static std::int32_t cell_fraction(std::uint32_t coord, std::uint32_t cell_bits)
+{
+  const std::uint32_t inCell = coord & ((1u << cell_bits) - 1u);
+  return static_cast<std::int32_t>(inCell << (HEIGHTMAP_FRACTION_BITS - cell_bits));
+}
+
+// Hashes of the two lattice rows around the texel row, the same for a whole row of texels
+struct LatticeRows
+{
+  std::uint32_t cellBits;
+  std::uint32_t row0;
+  std::uint32_t row1;
+  std::int32_t fy;
+  std::int32_t v;
+};
+
+static LatticeRows lattice_rows(
+  std::uint32_t seed, std::uint32_t base_cell_bits, std::uint32_t octave, std::uint32_t y)
+{
+  const std::uint32_t cellBits = base_cell_bits - octave;
+  const std::uint32_t cellY = y >> cellBits;
+  const std::uint32_t octaveSeed = seed + octave * 0x9E3779B9u;
+  const std::int32_t fy = cell_fraction(y, cellBits);
+  return LatticeRows{
+    .cellBits = cellBits,
+    .row0 = lowbias32(cellY ^ octaveSeed),
+    .row1 = lowbias32((cellY + 1u) ^ octaveSeed),
+    .fy = fy,
+    .v = fade(fy),
+  };
+}
+
+static std::int32_t perlin(const LatticeRows& rows, std::uint32_t x)
+{
+  const std::uint32_t cellX = x >> rows.cellBits;
+  const std::int32_t fx = cell_fraction(x, rows.cellBits);
+  const std::int32_t gx = fx - HEIGHTMAP_ONE;
+  const std::int32_t gy = rows.fy - HEIGHTMAP_ONE;
+
+  const std::int32_t d00 = corner_dot(lowbias32(cellX ^ rows.row0), fx, rows.fy);
+  const std::int32_t d10 = corner_dot(lowbias32((cellX + 1u) ^ rows.row0), gx, rows.fy);
+  const std::int32_t d01 = corner_dot(lowbias32(cellX ^ rows.row1), fx, gy);
+  const std::int32_t d11 = corner_dot(lowbias32((cellX + 1u) ^ rows.row1), gx, gy);
+
+  const std::int32_t u = fade(fx);
+  return lerp_fixed(lerp_fixed(d00, d10, u), lerp_fixed(d01, d11, u), rows.v);
+}
+
+// perlin for LANES consecutive texels starting at x, shifted and added to sums.
+// Every loop here has a fixed trip count and no dependencies between lanes, which
+// compilers vectorize even at -O2, unlike a loop over the whole row.
+static void perlin_lanes(
+  const LatticeRows& rows, std::uint32_t x, std::uint32_t shift, std::int32_t* sums)
+{
+  std::array<std::uint32_t, LANES> cellX;
+  std::array<std::int32_t, LANES> fx;
+  for (std::uint32_t i = 0; i < LANES; ++i)
+  {
+    cellX[i] = (x + i) >> rows.cellBits;
+    fx[i] = cell_fraction(x + i, rows.cellBits);
+  }
+
+  const std::int32_t gy = rows.fy - HEIGHTMAP_ONE;
+  std::array<std::int32_t, LANES> bottom;
+  std::array<std::int32_t, LANES> top;
+  for (std::uint32_t i = 0; i < LANES; ++i)
+  {
+    const std::int32_t gx = fx[i] - HEIGHTMAP_ONE;
+    const std::int32_t d00 = corner_dot(lowbias32(cellX[i] ^ rows.row0), fx[i], rows.fy);
+    const std::int32_t d10 = corner_dot(lowbias32((cellX[i] + 1u) ^ rows.row0), gx, rows.fy);
+    const std::int32_t d01 = corner_dot(lowbias32(cellX[i] ^ rows.row1), fx[i], gy);
+    const std::int32_t d11 = corner_dot(lowbias32((cellX[i] + 1u) ^ rows.row1), gx, gy);
+
+    const std::int32_t u = fade(fx[i]);
+    bottom[i] = lerp_fixed(d00, d10, u);
+    top[i] = lerp_fixed(d01, d11, u);
+  }
+
+  for (std::uint32_t i = 0; i < LANES; ++i)
+    sums[i] += lerp_fixed(bottom[i], top[i], rows.v) << shift;
+}
+
+HeightmapGenerator::HeightmapGenerator(CreateInfo info)
+  : seed{info.seed}
+  , octaves{info.octaves}
+  , baseCellBits{info.baseCellBits}
+  // A single octave is within 2^(FRACTION_BITS + 1), see corner_dot
+  , scale{std::ldexp(1.0f, -static_cast<int>(HEIGHTMAP_FRACTION_BITS + 1 + info.octaves))}
+{
+  ETNA_VERIFYF(
+    octaves >= 1 && octaves <= HEIGHTMAP_MAX_OCTAVES,
+    "A heightmap can have 1 to {} octaves, not {}",
+    HEIGHTMAP_MAX_OCTAVES,
+    octaves);
+  ETNA_VERIFYF(
+    baseCellBits <= HEIGHTMAP_FRACTION_BITS && baseCellBits + 1 >= octaves,
+    "Cells of {} octaves can't start at 2^{} texels",
+    octaves,
+    baseCellBits);
+
+  if (etna::get_program_id("heightmap") == etna::ShaderProgramId::Invalid)
+    etna::create_program("heightmap", {RENDER_UTILS_SHADERS_ROOT "heightmap.comp.spv"});
+  pipeline = etna::get_context().getPipelineManager().createComputePipeline("heightmap", {});
+}
+
+float HeightmapGenerator::sample(glm::uvec2 texel) const
+{
+  std::int32_t sum = 0;
+  for (std::uint32_t octave = 0; octave < octaves; ++octave)
+    sum += perlin(lattice_rows(seed, baseCellBits, octave, texel.y), texel.x)
+      << (octaves - 1 - octave);
+  return static_cast<float>(sum) * scale;
+}
+
+void HeightmapGenerator::generateRow(
+  glm::uvec2 start, std::uint32_t count, std::int32_t* sums) const
+{
+  std::fill_n(sums, count, 0);
+
+  // Octaves are the outer loop, so that lattice rows are hashed once per row and octave
+  for (std::uint32_t octave = 0; octave < octaves; ++octave)
+  {
+    const LatticeRows rows = lattice_rows(seed, baseCellBits, octave, start.y);
+    const std::uint32_t shift = octaves - 1 - octave;
+    std::uint32_t i = 0;
+    for (; i + LANES <= count; i += LANES)
+      perlin_lanes(rows, start.x + i, shift, sums + i);
+    for (; i < count; ++i)
+      sums[i] += perlin(rows, start.x + i) << shift;
+  }
+}
+
+void HeightmapGenerator::generate(
+  WorkerPool& workers, Region region, std::span<float> heights) const
+{
+  ZoneScoped;
+
+  ETNA_VERIFYF(
+    heights.size() >= std::size_t{region.extent.x} * region.extent.y,
+    "{} heights don't fit a {}x{} region",
+    heights.size(),
+    region.extent.x,
+    region.extent.y);
+
+  const std::uint32_t taskCount = (region.extent.y + ROWS_PER_TASK - 1) / ROWS_PER_TASK;
+  workers.parallelFor(taskCount, [&](std::size_t task, std::size_t) {
+    ZoneScopedN("generateHeights");
+
+    std::array<std::int32_t, TEXELS_PER_CHUNK> sums;
+    const auto firstRow = static_cast<std::uint32_t>(task) * ROWS_PER_TASK;
+    const std::uint32_t lastRow = std::min(firstRow + ROWS_PER_TASK, region.extent.y);
+    for (std::uint32_t y = firstRow; y < lastRow; ++y)
+      for (std::uint32_t x = 0; x < region.extent.x; x += TEXELS_PER_CHUNK)
+      {
+        const std::uint32_t count = std::min(TEXELS_PER_CHUNK, region.extent.x - x);
+        generateRow(region.origin + glm::uvec2{x, y}, count, sums.data());
+
+        float* row = heights.data() + std::size_t{y} * region.extent.x + x;
+        for (std::uint32_t i = 0; i < count; ++i)
+          row[i] = static_cast<float>(sums[i]) * scale;
+      }
+  });
+}
+
+void HeightmapGenerator::generate(
+  vk::CommandBuffer cmd_buf, const etna::Image& target, Region region) const
+{
+  if (region.extent.x == 0 || region.extent.y == 0)
+    return;
+
+  // The shader doesn't check image bounds, writes outside of it are silently dropped
+  const vk::Extent3D targetExtent = target.getExtent();
+  ETNA_VERIFYF(
+    std::uint64_t{region.origin.x} + region.extent.x <= targetExtent.width &&
+      std::uint64_t{region.origin.y} + region.extent.y <= targetExtent.height,
+    "A {}x{} region at ({}, {}) doesn't fit a {}x{} image",
+    region.extent.x,
+    region.extent.y,
+    region.origin.x,
+    region.origin.y,
+    targetExtent.width,
+    targetExtent.height);
+
+  auto info = etna::get_shader_program("heightmap");
+  auto set = etna::create_descriptor_set(
+    info.getDescriptorLayoutId(0),
+    cmd_buf,
+    {etna::Binding{0, target.genBinding({}, vk::ImageLayout::eGeneral)}});
+  vk::DescriptorSet vkSet = set.getVkSet();
+
+  const HeightmapParams params = makeParams(region);
+
+  cmd_buf.bindPipeline(vk::PipelineBindPoint::eCompute, pipeline.getVkPipeline());
+  cmd_buf.bindDescriptorSets(
+    vk::PipelineBindPoint::eCompute, pipeline.getVkPipelineLayout(), 0, 1, &vkSet, 0, nullptr);
+  cmd_buf.pushConstants(
+    pipeline.getVkPipelineLayout(), vk::ShaderStageFlagBits::eCompute, 0, sizeof(params), &params);
+
+  etna::flush_barriers(cmd_buf);
+
+  cmd_buf.dispatch(
+    (region.extent.x + HEIGHTMAP_GROUP_SIZE - 1) / HEIGHTMAP_GROUP_SIZE,
+    (region.extent.y + HEIGHTMAP_GROUP_SIZE - 1) / HEIGHTMAP_GROUP_SIZE,
+    1);
+}
+
+HeightmapParams HeightmapGenerator::makeParams(Region region) const
+{
+  return HeightmapParams{
+    .origin = region.origin,
+    .extent = region.extent,
+    .seed = seed,
+    .octaves = octaves,
+    .baseCellBits = baseCellBits,
+    .scale = scale,
+  };
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+
+#include <glm/glm.hpp>
+#include <etna/Vulkan.hpp>
+#include <etna/ComputePipeline.hpp>
+#include <etna/Image.hpp>
+
+#include "threading/WorkerPool.hpp"
+#include "shaders/Heightmap.h"
+
+
+/**
+ * Multi-octave Perlin noise heightmaps, e.g. for terrain. The same heights can be generated
+ * on the CPU with all cores, or on the GPU into an R32_SFLOAT storage image, and both give
+ * bit exact results: noise is computed in fixed point (see Heightmap.h), so that there is
+ * nothing for compilers and drivers to round differently. Heights only depend on the
+ * absolute texel, so any region can be regenerated on its own, e.g. after editing the seed
+ * of a part of the map or when a clipmap scrolls, and it matches the whole map exactly.
+ */
+class HeightmapGenerator
+{
+public:
+  struct CreateInfo
+  {
+    std::uint32_t seed = 1;
+    // At most HEIGHTMAP_MAX_OCTAVES
+    std::uint32_t octaves = 8;
+    // The lattice cell of the first octave is 2^baseCellBits texels large, at most
+    // HEIGHTMAP_FRACTION_BITS. The cell of the last octave should be a few texels at least,
+    // as noise is zero at lattice corners.
+    std::uint32_t baseCellBits = 10;
+  };
+
+  struct Region
+  {
+    glm::uvec2 origin{0, 0};
+    glm::uvec2 extent{0, 0};
+  };
+
+  explicit HeightmapGenerator(CreateInfo info);
+
+  HeightmapGenerator(const HeightmapGenerator&) = delete;
+  HeightmapGenerator& operator=(const HeightmapGenerator&) = delete;
+
+  // Height of a single texel in (-1, 1), the straightforward scalar version
+  float sample(glm::uvec2 texel) const;
+
+  // Heights of the region row by row, rows are split between the workers
+  void generate(WorkerPool& workers, Region region, std::span<float> heights) const;
+
+  // Records a dispatch that writes the same heights to texels [origin, origin + extent) of
+  // the target, which must have storage usage. It's left in the general layout.
+  void generate(vk::CommandBuffer cmd_buf, const etna::Image& target, Region region) const;
+
+private:
+  HeightmapParams makeParams(Region region) const;
+  // Fixed point sum of all octaves for `count` consecutive texels of a row
+  void generateRow(glm::uvec2 start, std::uint32_t count, std::int32_t* sums) const;
+
+private:
+  std::uint32_t seed;
+  std::uint32_t octaves;
+  std::uint32_t baseCellBits;
+  float scale;
+
+  etna::ComputePipeline pipeline;
+};
@@ -0,0 +1,29 @@
+#include "HostReadback.hpp"
+
+#include <etna/GlobalContext.hpp>
+
+
+etna::Buffer create_readback_buffer(vk::DeviceSize size, const char* name)
+{
+  return etna::get_context().createBuffer(etna::Buffer::CreateInfo{
+    .size = size,
+    .bufferUsage = vk::BufferUsageFlagBits::eTransferDst,
+    .memoryUsage = VMA_MEMORY_USAGE_CPU_ONLY,
+    .name = name,
+  });
+}
+
+void make_writes_host_visible(
+  vk::CommandBuffer cmd_buf, vk::PipelineStageFlags2 src_stages, vk::AccessFlags2 src_access)
+{
+  const vk::MemoryBarrier2 barrier{
+    .srcStageMask = src_stages,
+    .srcAccessMask = src_access,
+    .dstStageMask = vk::PipelineStageFlagBits2::eHost,
+    .dstAccessMask = vk::AccessFlagBits2::eHostRead,
+  };
+  cmd_buf.pipelineBarrier2(vk::DependencyInfo{
+    .memoryBarrierCount = 1,
+    .pMemoryBarriers = &barrier,
+  });
+}
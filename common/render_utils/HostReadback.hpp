@@ -0,0 +1,20 @@
+#pragma once
+
+#include <etna/Vulkan.hpp>
+#include <etna/Buffer.hpp>
+
+
+// Results of GPU work are read back on the host through buffers made by create_readback_buffer,
+// with make_writes_host_visible recorded after the copies into them and a fence waited on.
+
+// Transfer destination in host coherent memory. VMA only guarantees coherency for CPU_ONLY,
+// GPU_TO_CPU memory might be cached but not coherent, which would need vmaInvalidateAllocation
+// before every read, and etna::Buffer doesn't expose its allocation.
+etna::Buffer create_readback_buffer(vk::DeviceSize size, const char* name);
+
+// Fences only make writes available to the device, not to the host,
+// so even coherent memory needs this before the host reads it.
+void make_writes_host_visible(
+  vk::CommandBuffer cmd_buf,
+  vk::PipelineStageFlags2 src_stages = vk::PipelineStageFlagBits2::eTransfer,
+  vk::AccessFlags2 src_access = vk::AccessFlagBits2::eTransferWrite);
@@ -0,0 +1,101 @@
+#include "PersistentPipelineCache.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <span>
+#include <vector>
+
+#include <etna/Etna.hpp>
+#include <etna/GlobalContext.hpp>
+#include <tracy/Tracy.hpp>
+
+
+static std::vector<std::byte> read_file(const std::filesystem::path& path)
+{
+  std::ifstream file{path, std::ios::binary | std::ios::ate};
+  if (!file.is_open())
+    return {};
+
+  std::vector<std::byte> result(static_cast<std::size_t>(file.tellg()));
+  file.seekg(0);
+  file.read(reinterpret_cast<char*>(result.data()), static_cast<std::streamsize>(result.size()));
+  return file ? result : std::vector<std::byte>{};
+}
+
+// Drivers are supposed to reject incompatible data themselves, but some of them crash instead
+static bool is_compatible(std::span<const std::byte> data)
+{
+  VkPipelineCacheHeaderVersionOne header;
+  if (data.size() < sizeof(header))
+    return false;
+  std::memcpy(&header, data.data(), sizeof(header));
+
+  const auto props = etna::get_context().getPhysicalDevice().getProperties();
+  return header.headerSize >= sizeof(header) &&
+    header.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+    header.vendorID == props.vendorID && header.deviceID == props.deviceID &&
+    std::equal(
+      std::begin(header.pipelineCacheUUID),
+      std::end(header.pipelineCacheUUID),
+      props.pipelineCacheUUID.begin());
+}
+
+PersistentPipelineCache::PersistentPipelineCache(std::filesystem::path a_path)
+  : path{std::move(a_path)}
+{
+  ZoneScoped;
+
+  auto data = read_file(path);
+  if (!data.empty() && !is_compatible(data))
+  {
+    spdlog::info("Pipeline cache {} was created by a different device, ignoring it", path.string());
+    data.clear();
+  }
+
+  cache = etna::unwrap_vk_result(
+    etna::get_context().getDevice().createPipelineCacheUnique(vk::PipelineCacheCreateInfo{
+      .initialDataSize = data.size(),
+      .pInitialData = data.data(),
+    }));
+  loadedSize = data.size();
+}
+
+PersistentPipelineCache::~PersistentPipelineCache()
+{
+  save();
+}
+
+void PersistentPipelineCache::save() const
+{
+  ZoneScoped;
+
+  auto device = etna::get_context().getDevice();
+
+  std::size_t size = 0;
+  ETNA_CHECK_VK_RESULT(device.getPipelineCacheData(cache.get(), &size, nullptr));
+  std::vector<std::byte> data(size);
+  ETNA_CHECK_VK_RESULT(device.getPipelineCacheData(cache.get(), &size, data.data()));
+  data.resize(size);
+
+  if (path.has_parent_path())
+    std::filesystem::create_directories(path.parent_path());
+
+  // Written to a temporary file first, so that a crash mid-write can't leave a corrupt cache
+  auto tmpPath = path;
+  tmpPath += ".tmp";
+  {
+    std::ofstream file{tmpPath, std::ios::binary | std::ios::trunc};
+    if (!file.is_open())
+    {
+      spdlog::warn("Unable to save pipeline cache to {}", path.string());
+      return;
+    }
+    file.write(reinterpret_cast<const char*>(data.data()), static_cast<std::streamsize>(size));
+  }
+
+  std::error_code ec;
+  std::filesystem::rename(tmpPath, path, ec);
+  if (ec)
+    spdlog::warn("Unable to save pipeline cache to {}: {}", path.string(), ec.message());
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <filesystem>
+
+#include <etna/Vulkan.hpp>
+
+
+/**
+ * A VkPipelineCache that survives application restarts. The cache is loaded from
+ * `path` on creation, and its contents are thrown away if they were produced by a
+ * different device or driver, as reported by the cache header. It is saved back to
+ * the same path on destruction. Pass get() to every pipeline creation that allows it.
+ */
+class PersistentPipelineCache
+{
+public:
+  explicit PersistentPipelineCache(std::filesystem::path path);
+  ~PersistentPipelineCache();
+
+  PersistentPipelineCache(const PersistentPipelineCache&) = delete;
+  PersistentPipelineCache& operator=(const PersistentPipelineCache&) = delete;
+
+  vk::PipelineCache get() const { return cache.get(); }
+
+  // Whether valid data was found on disk at startup
+  bool wasLoaded() const { return loadedSize != 0; }
+  std::size_t getLoadedSize() const { return loadedSize; }
+
+  void save() const;
+
+private:
+  std::filesystem::path path;
+  vk::UniquePipelineCache cache;
+  std::size_t loadedSize = 0;
+};
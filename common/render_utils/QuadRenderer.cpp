@@ -6,10 +6,13 @@
 #include <etna/PipelineManager.hpp>
 #include <etna/DescriptorSet.hpp>
 
+#include <vector>
+
 
 QuadRenderer::QuadRenderer(CreateInfo info)
 {
   rect = info.rect;
+  descriptorCache = info.descriptorCache;
 
   programId = etna::get_program_id("quad_renderer");
 
@@ -18,6 +21,8 @@ QuadRenderer::QuadRenderer(CreateInfo info)
       "quad_renderer",
       {RENDER_UTILS_SHADERS_ROOT "quad.vert.spv", RENDER_UTILS_SHADERS_ROOT "quad.frag.spv"});
 
+  // NOTE: etna's PipelineManager can't be given a VkPipelineCache,
+  // so PersistentPipelineCache doesn't help with this pipeline.
   auto& pipelineManager = etna::get_context().getPipelineManager();
   pipeline = pipelineManager.createGraphicsPipeline(
     "quad_renderer",
@@ -34,14 +39,19 @@ void QuadRenderer::render(
   vk::Image target_image,
   vk::ImageView target_image_view,
   const etna::Image& tex_to_draw,
-  const etna::Sampler& sampler)
+  const etna::Sampler& sampler,
+  etna::Image::ViewParams view_params)
 {
   auto programInfo = etna::get_shader_program(programId);
-  auto set = etna::create_descriptor_set(
-    programInfo.getDescriptorLayoutId(0),
-    cmd_buf,
-    {etna::Binding{
-      0, tex_to_draw.genBinding(sampler.get(), vk::ImageLayout::eShaderReadOnlyOptimal)}});
+  const auto layoutId = programInfo.getDescriptorLayoutId(0);
+  std::vector bindings{etna::Binding{
+    0,
+    tex_to_draw.genBinding(sampler.get(), vk::ImageLayout::eShaderReadOnlyOptimal, view_params)}};
+
+  // The cache doesn't record barriers, the texture is expected to be readable already
+  const vk::DescriptorSet set = descriptorCache != nullptr
+    ? descriptorCache->get(layoutId, bindings)
+    : etna::create_descriptor_set(layoutId, cmd_buf, std::move(bindings)).getVkSet();
 
   etna::RenderTargetState renderTargets(
     cmd_buf,
@@ -51,7 +61,7 @@ void QuadRenderer::render(
 
   cmd_buf.bindPipeline(vk::PipelineBindPoint::eGraphics, pipeline.getVkPipeline());
   cmd_buf.bindDescriptorSets(
-    vk::PipelineBindPoint::eGraphics, pipeline.getVkPipelineLayout(), 0, {set.getVkSet()}, {});
+    vk::PipelineBindPoint::eGraphics, pipeline.getVkPipelineLayout(), 0, {set}, {});
 
   cmd_buf.draw(3, 1, 0, 0);
 }
@@ -5,6 +5,8 @@
 #include <etna/Image.hpp>
 #include <etna/Sampler.hpp>
 
+#include "DescriptorSetCache.hpp"
+
 
 /**
  * Simple class for displaying a texture on the screen for debug purposes.
@@ -16,6 +18,8 @@ public:
   {
     vk::Format format = vk::Format::eUndefined;
     vk::Rect2D rect = {};
+    // Keeps the set around between frames if set, it's created anew every frame otherwise
+    DescriptorSetCache* descriptorCache = nullptr;
   };
 
   explicit QuadRenderer(CreateInfo info);
@@ -26,12 +30,14 @@ public:
     vk::Image target_image,
     vk::ImageView target_image_view,
     const etna::Image& tex_to_draw,
-    const etna::Sampler& sampler);
+    const etna::Sampler& sampler,
+    etna::Image::ViewParams view_params = {});
 
 private:
   etna::GraphicsPipeline pipeline;
   etna::ShaderProgramId programId;
   vk::Rect2D rect{};
+  DescriptorSetCache* descriptorCache = nullptr;
 
   QuadRenderer(const QuadRenderer&) = delete;
   QuadRenderer& operator=(const QuadRenderer&) = delete;
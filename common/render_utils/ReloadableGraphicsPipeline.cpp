@@ -0,0 +1,211 @@
+#include "ReloadableGraphicsPipeline.hpp"
+
+#include <array>
+#include <chrono>
+#include <fstream>
+#include <optional>
+#include <utility>
+
+#include <etna/Etna.hpp>
+#include <etna/GlobalContext.hpp>
+#include <tracy/Tracy.hpp>
+
+
+static std::vector<std::uint32_t> read_spirv(const std::filesystem::path& path)
+{
+  std::ifstream file{path, std::ios::binary | std::ios::ate};
+  if (!file.is_open())
+    return {};
+
+  const auto size = static_cast<std::size_t>(file.tellg());
+  if (size % sizeof(std::uint32_t) != 0)
+    return {};
+
+  std::vector<std::uint32_t> result(size / sizeof(std::uint32_t));
+  file.seekg(0);
+  file.read(reinterpret_cast<char*>(result.data()), static_cast<std::streamsize>(size));
+  return file ? result : std::vector<std::uint32_t>{};
+}
+
+// simple.vert.spv -> vertex
+static std::optional<vk::ShaderStageFlagBits> get_stage(const std::filesystem::path& path)
+{
+  const auto ext = path.stem().extension();
+  if (ext == ".vert")
+    return vk::ShaderStageFlagBits::eVertex;
+  if (ext == ".tesc")
+    return vk::ShaderStageFlagBits::eTessellationControl;
+  if (ext == ".tese")
+    return vk::ShaderStageFlagBits::eTessellationEvaluation;
+  if (ext == ".geom")
+    return vk::ShaderStageFlagBits::eGeometry;
+  if (ext == ".frag")
+    return vk::ShaderStageFlagBits::eFragment;
+  return std::nullopt;
+}
+
+ReloadableGraphicsPipeline::ReloadableGraphicsPipeline(CreateInfo create_info)
+  : info{std::move(create_info)}
+  // Etna owns the layout, we only borrow it
+  , layout{etna::get_shader_program(info.programName.c_str()).getPipelineLayout()}
+{
+  pipeline = build();
+  ETNA_VERIFYF(pipeline, "Unable to build a pipeline for {}!", info.programName);
+}
+
+void ReloadableGraphicsPipeline::rebuildAsync()
+{
+  if (rebuild.valid())
+  {
+    rebuildAgain = true;
+    return;
+  }
+
+  rebuild = std::async(std::launch::async, [this]() { return build(); });
+}
+
+bool ReloadableGraphicsPipeline::update()
+{
+  retired.nextFrame();
+
+  if (!rebuild.valid() || rebuild.wait_for(std::chrono::seconds{0}) != std::future_status::ready)
+    return false;
+
+  auto rebuilt = rebuild.get();
+  if (std::exchange(rebuildAgain, false))
+    rebuildAsync();
+
+  // Errors were already reported, the old pipeline simply stays
+  if (!rebuilt)
+    return false;
+
+  retired.retire(std::exchange(pipeline, std::move(rebuilt)));
+  return true;
+}
+
+vk::UniquePipeline ReloadableGraphicsPipeline::build() const
+{
+  ZoneScoped;
+
+  auto device = etna::get_context().getDevice();
+
+  std::vector<vk::UniqueShaderModule> modules;
+  std::vector<vk::PipelineShaderStageCreateInfo> stages;
+  for (const auto& path : info.spirvPaths)
+  {
+    const auto stage = get_stage(path);
+    const auto code = read_spirv(path);
+    if (!stage.has_value() || code.empty())
+    {
+      spdlog::error("Unable to load shader stage {}", path.string());
+      return {};
+    }
+
+    auto module = device.createShaderModuleUnique(vk::ShaderModuleCreateInfo{
+      .codeSize = code.size() * sizeof(std::uint32_t),
+      .pCode = code.data(),
+    });
+    if (module.result != vk::Result::eSuccess)
+    {
+      spdlog::error("Unable to create a shader module from {}", path.string());
+      return {};
+    }
+    modules.push_back(std::move(module.value));
+
+    stages.push_back(vk::PipelineShaderStageCreateInfo{
+      .stage = *stage,
+      .module = modules.back().get(),
+      .pName = "main",
+    });
+  }
+
+  const vk::VertexInputBindingDescription vertexBinding{
+    .binding = 0,
+    .stride = info.vertexInput.stride,
+    .inputRate = vk::VertexInputRate::eVertex,
+  };
+  std::vector<vk::VertexInputAttributeDescription> vertexAttributes;
+  for (const auto& attribute : info.vertexInput.attributes)
+    vertexAttributes.push_back(vk::VertexInputAttributeDescription{
+      .location = static_cast<std::uint32_t>(vertexAttributes.size()),
+      .binding = 0,
+      .format = attribute.format,
+      .offset = attribute.offset,
+    });
+  const vk::PipelineVertexInputStateCreateInfo vertexInput{
+    .vertexBindingDescriptionCount = 1,
+    .pVertexBindingDescriptions = &vertexBinding,
+    .vertexAttributeDescriptionCount = static_cast<std::uint32_t>(vertexAttributes.size()),
+    .pVertexAttributeDescriptions = vertexAttributes.data(),
+  };
+
+  const vk::PipelineInputAssemblyStateCreateInfo inputAssembly{
+    .topology = vk::PrimitiveTopology::eTriangleList,
+  };
+
+  // Viewport and scissor are set by etna::RenderTargetState
+  const vk::PipelineViewportStateCreateInfo viewport{
+    .viewportCount = 1,
+    .scissorCount = 1,
+  };
+  const std::array dynamicStates{vk::DynamicState::eViewport, vk::DynamicState::eScissor};
+  const vk::PipelineDynamicStateCreateInfo dynamicState{
+    .dynamicStateCount = static_cast<std::uint32_t>(dynamicStates.size()),
+    .pDynamicStates = dynamicStates.data(),
+  };
+
+  const vk::PipelineMultisampleStateCreateInfo multisample{
+    .rasterizationSamples = vk::SampleCountFlagBits::e1,
+  };
+
+  // The same depth state etna uses by default
+  const bool hasDepth = info.depthAttachmentFormat != vk::Format::eUndefined;
+  const vk::PipelineDepthStencilStateCreateInfo depth{
+    .depthTestEnable = hasDepth ? VK_TRUE : VK_FALSE,
+    .depthWriteEnable = hasDepth ? VK_TRUE : VK_FALSE,
+    .depthCompareOp = vk::CompareOp::eLessOrEqual,
+    .maxDepthBounds = 1.0f,
+  };
+
+  const std::vector<vk::PipelineColorBlendAttachmentState> blendAttachments(
+    info.colorAttachmentFormats.size(),
+    vk::PipelineColorBlendAttachmentState{
+      .blendEnable = VK_FALSE,
+      .colorWriteMask = vk::ColorComponentFlagBits::eR | vk::ColorComponentFlagBits::eG |
+        vk::ColorComponentFlagBits::eB | vk::ColorComponentFlagBits::eA,
+    });
+  const vk::PipelineColorBlendStateCreateInfo blending{
+    .attachmentCount = static_cast<std::uint32_t>(blendAttachments.size()),
+    .pAttachments = blendAttachments.data(),
+  };
+
+  const vk::PipelineRenderingCreateInfo rendering{
+    .colorAttachmentCount = static_cast<std::uint32_t>(info.colorAttachmentFormats.size()),
+    .pColorAttachmentFormats = info.colorAttachmentFormats.data(),
+    .depthAttachmentFormat = info.depthAttachmentFormat,
+  };
+
+  auto result = device.createGraphicsPipelineUnique(
+    info.pipelineCache,
+    vk::GraphicsPipelineCreateInfo{
+      .pNext = &rendering,
+      .stageCount = static_cast<std::uint32_t>(stages.size()),
+      .pStages = stages.data(),
+      .pVertexInputState = &vertexInput,
+      .pInputAssemblyState = &inputAssembly,
+      .pViewportState = &viewport,
+      .pRasterizationState = &info.rasterizationConfig,
+      .pMultisampleState = &multisample,
+      .pDepthStencilState = &depth,
+      .pColorBlendState = &blending,
+      .pDynamicState = &dynamicState,
+      .layout = layout,
+    });
+  if (result.result != vk::Result::eSuccess)
+  {
+    spdlog::error(
+      "Unable to build a pipeline for {}: {}", info.programName, vk::to_string(result.result));
+    return {};
+  }
+  return std::move(result.value);
+}
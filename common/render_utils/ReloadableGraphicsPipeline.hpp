@@ -0,0 +1,72 @@
+#pragma once
+
+#include <filesystem>
+#include <future>
+#include <string>
+#include <vector>
+
+#include <etna/Vulkan.hpp>
+#include <etna/VertexInput.hpp>
+
+#include "render_utils/DeferredDeletionQueue.hpp"
+
+
+/**
+ * A graphics pipeline that is built by us instead of etna's PipelineManager, so that it can
+ * be rebuilt on a background thread when its SPIR-V changes and swapped in at a frame
+ * boundary without waiting for the GPU. The pipeline layout is borrowed from the etna
+ * program, so descriptor sets created through etna keep working with any rebuild.
+ * NOTE: for the same reason, changing the resource interface of the shaders still requires
+ * a restart. Only a single vertex buffer binding and opaque color attachments are supported.
+ */
+class ReloadableGraphicsPipeline
+{
+public:
+  struct CreateInfo
+  {
+    // Must have been created with etna::create_program beforehand
+    std::string programName;
+    // A binary per stage, the stage is taken from the name, e.g. simple.vert.spv
+    std::vector<std::filesystem::path> spirvPaths;
+    etna::VertexByteStreamFormatDescription vertexInput;
+    vk::PipelineRasterizationStateCreateInfo rasterizationConfig;
+    std::vector<vk::Format> colorAttachmentFormats;
+    vk::Format depthAttachmentFormat = vk::Format::eUndefined;
+    vk::PipelineCache pipelineCache = {};
+  };
+
+  // The first pipeline is built right away on the calling thread
+  explicit ReloadableGraphicsPipeline(CreateInfo info);
+  // Waits for a rebuild in progress. NOTE: the GPU must be done with the pipeline.
+  ~ReloadableGraphicsPipeline() = default;
+
+  ReloadableGraphicsPipeline(const ReloadableGraphicsPipeline&) = delete;
+  ReloadableGraphicsPipeline& operator=(const ReloadableGraphicsPipeline&) = delete;
+
+  // Builds a new pipeline from the SPIR-V currently on disk on a background thread
+  void rebuildAsync();
+
+  // Must be called once per frame, after the frame slot that is about to be reused has been
+  // waited on. Swaps in a finished rebuild and returns true if there was one, the old
+  // pipeline is destroyed once frames in flight are done with it.
+  bool update();
+
+  vk::Pipeline getVkPipeline() const { return pipeline.get(); }
+  vk::PipelineLayout getVkPipelineLayout() const { return layout; }
+
+private:
+  // Returns a null pipeline if any stage can't be loaded or the driver rejects it
+  vk::UniquePipeline build() const;
+
+private:
+  // Never changes after construction, builds on other threads read it
+  CreateInfo info;
+  vk::PipelineLayout layout;
+
+  vk::UniquePipeline pipeline;
+  DeferredDeletionQueue<vk::UniquePipeline> retired;
+
+  std::future<vk::UniquePipeline> rebuild;
+  // Another rebuild was asked for while one was running, the sources might have changed since
+  bool rebuildAgain = false;
+};
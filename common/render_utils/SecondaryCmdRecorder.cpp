@@ -0,0 +1,107 @@
+#include "SecondaryCmdRecorder.hpp"
+
+#include <etna/Etna.hpp>
+#include <etna/GlobalContext.hpp>
+#include <tracy/Tracy.hpp>
+
+
+SecondaryCmdRecorder::SecondaryCmdRecorder(WorkerPool& worker_pool)
+  : workers{worker_pool}
+  , framePools{etna::get_context().getMainWorkCount(), [&worker_pool](std::size_t) {
+                 auto device = etna::get_context().getDevice();
+                 std::vector<ThreadCmdPool> pools(worker_pool.threadCount());
+                 for (auto& pool : pools)
+                   pool.pool = etna::unwrap_vk_result(
+                     device.createCommandPoolUnique(vk::CommandPoolCreateInfo{
+                       .flags = vk::CommandPoolCreateFlagBits::eTransient,
+                       .queueFamilyIndex = etna::get_context().getQueueFamilyIdx(),
+                     }));
+                 return pools;
+               }}
+{
+}
+
+vk::CommandBuffer SecondaryCmdRecorder::ThreadCmdPool::acquire()
+{
+  if (used == buffers.size())
+  {
+    auto device = etna::get_context().getDevice();
+    auto newBuffers = etna::unwrap_vk_result(
+      device.allocateCommandBuffersUnique(vk::CommandBufferAllocateInfo{
+        .commandPool = pool.get(),
+        .level = vk::CommandBufferLevel::eSecondary,
+        .commandBufferCount = 1,
+      }));
+    buffers.push_back(std::move(newBuffers.front()));
+  }
+  return buffers[used++].get();
+}
+
+void SecondaryCmdRecorder::beginFrame()
+{
+  ZoneScoped;
+
+  auto device = etna::get_context().getDevice();
+  for (auto& pool : framePools.get())
+  {
+    // Buffers go back to the initial state and get reused, no need to free them
+    ETNA_CHECK_VK_RESULT(device.resetCommandPool(pool.pool.get()));
+    pool.used = 0;
+  }
+}
+
+std::vector<vk::CommandBuffer> SecondaryCmdRecorder::record(
+  std::span<const RenderingInfo> tasks, RecordFunc func)
+{
+  ZoneScoped;
+
+  std::vector<vk::CommandBuffer> result(tasks.size());
+  auto& pools = framePools.get();
+
+  const auto job = [&](std::size_t task, std::size_t thread) {
+    ZoneScopedN("recordSecondary");
+
+    const auto& info = tasks[task];
+    auto cmdBuf = pools[thread].acquire();
+
+    const vk::CommandBufferInheritanceRenderingInfo renderingInfo{
+      .colorAttachmentCount = static_cast<std::uint32_t>(info.colorFormats.size()),
+      .pColorAttachmentFormats = info.colorFormats.data(),
+      .depthAttachmentFormat = info.depthFormat,
+      .rasterizationSamples = vk::SampleCountFlagBits::e1,
+    };
+    const vk::CommandBufferInheritanceInfo inheritance{.pNext = &renderingInfo};
+
+    ETNA_CHECK_VK_RESULT(cmdBuf.begin(vk::CommandBufferBeginInfo{
+      .flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit |
+        vk::CommandBufferUsageFlagBits::eRenderPassContinue,
+      .pInheritanceInfo = &inheritance,
+    }));
+
+    cmdBuf.setViewport(
+      0,
+      {vk::Viewport{
+        .x = static_cast<float>(info.area.offset.x),
+        .y = static_cast<float>(info.area.offset.y),
+        .width = static_cast<float>(info.area.extent.width),
+        .height = static_cast<float>(info.area.extent.height),
+        .minDepth = 0.0f,
+        .maxDepth = 1.0f,
+      }});
+    cmdBuf.setScissor(0, {info.area});
+
+    func(task, cmdBuf);
+
+    ETNA_CHECK_VK_RESULT(cmdBuf.end());
+
+    result[task] = cmdBuf;
+  };
+
+  if (parallel)
+    workers.parallelFor(tasks.size(), job);
+  else
+    for (std::size_t i = 0; i < tasks.size(); ++i)
+      job(i, 0);
+
+  return result;
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <span>
+#include <vector>
+
+#include <etna/Vulkan.hpp>
+#include <etna/GpuSharedResource.hpp>
+#include <function2/function2.hpp>
+
+#include "threading/WorkerPool.hpp"
+
+
+/**
+ * Records secondary command buffers for dynamic rendering on a WorkerPool.
+ * Every thread of the pool gets its own command pool for every frame in flight,
+ * so recording requires no synchronization at all, and a pool is only reset once
+ * the GPU is guaranteed to be done with the frame that used it.
+ */
+class SecondaryCmdRecorder
+{
+public:
+  // Describes the dynamic rendering scope that a secondary buffer will be executed in
+  struct RenderingInfo
+  {
+    std::span<const vk::Format> colorFormats = {};
+    vk::Format depthFormat = vk::Format::eUndefined;
+    // Viewport and scissor are not inherited from the primary buffer, so we set them here
+    vk::Rect2D area = {};
+  };
+
+  using RecordFunc = fu2::function_view<void(std::size_t task, vk::CommandBuffer cmd_buf) const>;
+
+  explicit SecondaryCmdRecorder(WorkerPool& worker_pool);
+
+  SecondaryCmdRecorder(const SecondaryCmdRecorder&) = delete;
+  SecondaryCmdRecorder& operator=(const SecondaryCmdRecorder&) = delete;
+
+  // Resets all command pools of the current frame in flight.
+  // Must be called once per frame before any calls to record.
+  void beginFrame();
+
+  // Records tasks.size() secondary buffers in parallel, the i-th one is begun
+  // according to tasks[i] and then passed to func. Returns buffers in task order,
+  // which stay valid until the next beginFrame for the same frame in flight.
+  std::vector<vk::CommandBuffer> record(std::span<const RenderingInfo> tasks, RecordFunc func);
+
+  // Useful for measuring how much we gain from threading
+  void setParallel(bool value) { parallel = value; }
+  bool isParallel() const { return parallel; }
+
+private:
+  struct ThreadCmdPool
+  {
+    vk::UniqueCommandPool pool;
+    std::vector<vk::UniqueCommandBuffer> buffers;
+    std::size_t used = 0;
+
+    vk::CommandBuffer acquire();
+  };
+
+  WorkerPool& workers;
+  etna::GpuSharedResource<std::vector<ThreadCmdPool>> framePools;
+  bool parallel = true;
+};
@@ -0,0 +1,321 @@
+#include "ShaderHotReloader.hpp"
+
+#include <cstdlib>
+#include <fstream>
+#include <optional>
+#include <span>
+#include <sstream>
+#include <string_view>
+
+#include <etna/Assert.hpp>
+#include <tracy/Tracy.hpp>
+
+#ifdef GRAPHICS_COURSE_HAS_SHADERC
+#include <shaderc/shaderc.hpp>
+#endif
+
+
+static std::vector<std::string> split_list(std::string_view list)
+{
+  std::vector<std::string> result;
+  while (!list.empty())
+  {
+    const auto separator = list.find('|');
+    if (separator != 0)
+      result.emplace_back(list.substr(0, separator));
+    if (separator == std::string_view::npos)
+      break;
+    list.remove_prefix(separator + 1);
+  }
+  return result;
+}
+
+#ifdef GRAPHICS_COURSE_HAS_SHADERC
+
+static std::optional<std::string> read_text_file(const std::filesystem::path& path)
+{
+  std::ifstream file{path};
+  if (!file.is_open())
+    return std::nullopt;
+  std::stringstream result;
+  result << file.rdbuf();
+  return result.str();
+}
+
+// Writes through a temporary file, so that etna never sees a half-written binary
+static bool write_binary_file(
+  const std::filesystem::path& path, std::span<const std::uint32_t> data)
+{
+  auto tmpPath = path;
+  tmpPath += ".tmp";
+  {
+    std::ofstream file{tmpPath, std::ios::binary | std::ios::trunc};
+    if (!file.is_open())
+      return false;
+    file.write(
+      reinterpret_cast<const char*>(data.data()),
+      static_cast<std::streamsize>(data.size_bytes()));
+  }
+  std::error_code ec;
+  std::filesystem::rename(tmpPath, path, ec);
+  return !ec;
+}
+
+namespace
+{
+
+class Includer : public shaderc::CompileOptions::IncluderInterface
+{
+public:
+  explicit Includer(std::vector<std::filesystem::path> include_dirs)
+    : includeDirs{std::move(include_dirs)}
+  {
+  }
+
+  shaderc_include_result* GetInclude(
+    const char* requested_source,
+    shaderc_include_type type,
+    const char* requesting_source,
+    size_t /*include_depth*/) override
+  {
+    auto result = std::make_unique<Result>();
+
+    std::vector<std::filesystem::path> candidates;
+    if (type == shaderc_include_type_relative)
+      candidates.push_back(std::filesystem::path{requesting_source}.parent_path());
+    candidates.insert(candidates.end(), includeDirs.begin(), includeDirs.end());
+
+    for (const auto& dir : candidates)
+    {
+      const auto path = dir / requested_source;
+      if (auto content = read_text_file(path))
+      {
+        result->name = path.string();
+        result->content = std::move(*content);
+        break;
+      }
+    }
+
+    // An empty name is how shaderc expects us to report a failure
+    if (result->name.empty())
+      result->content = std::string{"Unable to find "} + requested_source;
+
+    result->result = shaderc_include_result{
+      .source_name = result->name.data(),
+      .source_name_length = result->name.size(),
+      .content = result->content.data(),
+      .content_length = result->content.size(),
+      .user_data = result.get(),
+    };
+    return &result.release()->result;
+  }
+
+  void ReleaseInclude(shaderc_include_result* data) override
+  {
+    delete static_cast<Result*>(data->user_data);
+  }
+
+private:
+  struct Result
+  {
+    shaderc_include_result result;
+    std::string name;
+    std::string content;
+  };
+
+  std::vector<std::filesystem::path> includeDirs;
+};
+
+} // namespace
+
+static std::optional<shaderc_shader_kind> get_shader_kind(const std::filesystem::path& path)
+{
+  const auto ext = path.extension();
+  if (ext == ".vert")
+    return shaderc_vertex_shader;
+  if (ext == ".frag")
+    return shaderc_fragment_shader;
+  if (ext == ".comp")
+    return shaderc_compute_shader;
+  if (ext == ".geom")
+    return shaderc_geometry_shader;
+  if (ext == ".tesc")
+    return shaderc_tess_control_shader;
+  if (ext == ".tese")
+    return shaderc_tess_evaluation_shader;
+  return std::nullopt;
+}
+
+#endif
+
+ShaderHotReloader::ShaderHotReloader(CreateInfo info)
+  : pollInterval{info.pollInterval}
+{
+  for (const auto& set : info.shaderSets)
+  {
+    std::vector<std::filesystem::path> includeDirs;
+    for (auto& dir : split_list(set.includeDirs))
+      includeDirs.emplace_back(std::move(dir));
+
+    for (auto& source : split_list(set.sources))
+    {
+      Shader shader{
+        .source = std::move(source),
+        .binary = {},
+        .includeDirs = includeDirs,
+      };
+      shader.binary = set.spirvDir / shader.source.filename();
+      shader.binary += ".spv";
+      shaders.push_back(std::move(shader));
+    }
+  }
+
+  lastWriteTimes.reserve(shaders.size());
+  for (const auto& shader : shaders)
+    lastWriteTimes.push_back(getNewestWriteTime(shader));
+
+  watcher = std::thread([this]() { watchLoop(); });
+}
+
+ShaderHotReloader::~ShaderHotReloader()
+{
+  {
+    std::lock_guard lock{mutex};
+    stop = true;
+  }
+  wakeUp.notify_one();
+  watcher.join();
+}
+
+void ShaderHotReloader::requestRebuild()
+{
+  {
+    std::lock_guard lock{mutex};
+    rebuildRequested = true;
+  }
+  wakeUp.notify_one();
+}
+
+void ShaderHotReloader::watchLoop()
+{
+  tracy::SetThreadName("Shader watcher");
+
+  while (true)
+  {
+    bool rebuildAll = false;
+    {
+      std::unique_lock lock{mutex};
+      wakeUp.wait_for(lock, pollInterval, [this]() { return stop || rebuildRequested; });
+      if (stop)
+        return;
+      rebuildAll = std::exchange(rebuildRequested, false);
+    }
+
+    bool anyCompiled = false;
+    bool anyFailed = false;
+    for (std::size_t i = 0; i < shaders.size(); ++i)
+    {
+      // Includes are not tracked per shader, so any change in the shader's own
+      // directory or in one of its include directories triggers recompilation.
+      const auto writeTime = getNewestWriteTime(shaders[i]);
+      if (!rebuildAll && writeTime == lastWriteTimes[i])
+        continue;
+      lastWriteTimes[i] = writeTime;
+
+      if (compile(shaders[i]))
+        anyCompiled = true;
+      else
+        anyFailed = true;
+    }
+
+    // A broken shader would fail to reload anyway, so we wait until the user fixes it
+    if (anyCompiled && !anyFailed)
+      recompiled = true;
+  }
+}
+
+std::filesystem::file_time_type ShaderHotReloader::getNewestWriteTime(const Shader& shader) const
+{
+  std::error_code ec;
+  auto newest = std::filesystem::last_write_time(shader.source, ec);
+
+  const auto checkDir = [&newest](const std::filesystem::path& dir) {
+    std::error_code dirEc;
+    for (const auto& entry : std::filesystem::directory_iterator{dir, dirEc})
+    {
+      std::error_code fileEc;
+      if (!entry.is_regular_file(fileEc))
+        continue;
+      const auto time = entry.last_write_time(fileEc);
+      if (!fileEc && time > newest)
+        newest = time;
+    }
+  };
+
+  checkDir(shader.source.parent_path());
+  for (const auto& dir : shader.includeDirs)
+    checkDir(dir);
+
+  return newest;
+}
+
+bool ShaderHotReloader::compile(const Shader& shader) const
+{
+  ZoneScoped;
+
+#ifdef GRAPHICS_COURSE_HAS_SHADERC
+  const auto source = read_text_file(shader.source);
+  const auto kind = get_shader_kind(shader.source);
+  if (!source.has_value() || !kind.has_value())
+  {
+    spdlog::error("Unable to compile {}", shader.source.string());
+    return false;
+  }
+
+  shaderc::CompileOptions options;
+  options.SetTargetEnvironment(shaderc_target_env_vulkan, shaderc_env_version_vulkan_1_3);
+  options.SetIncluder(std::make_unique<Includer>(shader.includeDirs));
+#ifndef NDEBUG
+  options.SetGenerateDebugInfo();
+#endif
+
+  shaderc::Compiler compiler;
+  const auto result =
+    compiler.CompileGlslToSpv(*source, *kind, shader.source.string().c_str(), options);
+  if (result.GetCompilationStatus() != shaderc_compilation_status_success)
+  {
+    spdlog::error("Failed to compile {}:\n{}", shader.source.string(), result.GetErrorMessage());
+    return false;
+  }
+
+  const std::vector<std::uint32_t> spirv(result.cbegin(), result.cend());
+  if (!write_binary_file(shader.binary, spirv))
+  {
+    spdlog::error("Unable to write {}", shader.binary.string());
+    return false;
+  }
+#else
+  // No shaderc in this Vulkan SDK, run the same compiler that the build uses
+  std::string command = "\"" GLSLANG_VALIDATOR "\" -V --target-env vulkan1.3";
+  for (const auto& dir : shader.includeDirs)
+    command += " \"-I" + dir.string() + "\"";
+#ifndef NDEBUG
+  command += " -g";
+#endif
+  command += " \"" + shader.source.string() + "\" -o \"" + shader.binary.string() + "\"";
+
+  if (std::system(command.c_str()) != 0)
+  {
+    spdlog::error("Failed to compile {}", shader.source.string());
+    return false;
+  }
+#endif
+
+  spdlog::info("Recompiled {}", shader.source.filename().string());
+  return true;
+}
+
+ShaderHotReloader::ShaderSet get_render_utils_shader_set()
+{
+  return SHADER_SET(RENDER_UTILS);
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+/**
+ * Watches GLSL sources of one or more targets and recompiles them to SPIR-V on a
+ * background thread whenever they change, so that editing a shader never stalls
+ * the frame. Compilation happens in-process through shaderc when the Vulkan SDK
+ * provides it, and falls back to running glslangValidator otherwise.
+ * The application polls consumeRecompiled() at a frame boundary and rebuilds its
+ * pipelines once new binaries are in place, see ReloadableGraphicsPipeline.
+ */
+class ShaderHotReloader
+{
+public:
+  // Shaders of a single target, see target_add_shaders and SHADER_SET
+  struct ShaderSet
+  {
+    // '|'-separated absolute paths
+    std::string sources;
+    std::string includeDirs;
+    // Where the SPIR-V binaries of this target are, named <source file name>.spv
+    std::filesystem::path spirvDir;
+  };
+
+  struct CreateInfo
+  {
+    std::vector<ShaderSet> shaderSets;
+    std::chrono::milliseconds pollInterval{250};
+  };
+
+  explicit ShaderHotReloader(CreateInfo info);
+  ~ShaderHotReloader();
+
+  ShaderHotReloader(const ShaderHotReloader&) = delete;
+  ShaderHotReloader& operator=(const ShaderHotReloader&) = delete;
+
+  // Recompiles all shaders regardless of whether they changed
+  void requestRebuild();
+
+  // Returns true once after every successful batch of recompilations
+  bool consumeRecompiled() { return recompiled.exchange(false); }
+
+private:
+  struct Shader
+  {
+    std::filesystem::path source;
+    std::filesystem::path binary;
+    std::vector<std::filesystem::path> includeDirs;
+  };
+
+  void watchLoop();
+  // Returns the newest modification time among all watched files of a shader
+  std::filesystem::file_time_type getNewestWriteTime(const Shader& shader) const;
+  bool compile(const Shader& shader) const;
+
+private:
+  std::vector<Shader> shaders;
+  std::vector<std::filesystem::file_time_type> lastWriteTimes;
+  std::chrono::milliseconds pollInterval;
+
+  std::atomic<bool> recompiled{false};
+
+  std::mutex mutex;
+  std::condition_variable wakeUp;
+  bool stop = false;
+  bool rebuildRequested = false;
+
+  std::thread watcher;
+};
+
+// Shaders of the render_utils library itself
+ShaderHotReloader::ShaderSet get_render_utils_shader_set();
+
+// Collects the shader set of the current target from definitions made by target_add_shaders
+#define SHADER_SET(TARGET)                                                                         \
+  ShaderHotReloader::ShaderSet{                                                                    \
+    TARGET##_SHADER_SOURCES, TARGET##_SHADER_INCLUDE_DIRS, TARGET##_SHADERS_ROOT}
@@ -0,0 +1,850 @@
+#include "TextureLoader.hpp"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
+#include <cstring>
+#include <iterator>
+
+#include <etna/Etna.hpp>
+#include <etna/GlobalContext.hpp>
+#include <etna/OneShotCmdMgr.hpp>
+#include <stb_image.h>
+#include <tracy/Tracy.hpp>
+
+#include "render_utils/HostReadback.hpp"
+#include "shaders/MipFeedback.h"
+
+
+// Textures that weren't sampled for this long lose their streamed in mips first
+static constexpr std::uint64_t STALE_FRAMES = 120;
+
+// Decoding from disk is slow, so only a few textures get finer mips at a time
+static constexpr std::size_t MAX_STREAM_INS = 4;
+
+static vk::Format texture_format(bool srgb)
+{
+  return srgb ? vk::Format::eR8G8B8A8Srgb : vk::Format::eR8G8B8A8Unorm;
+}
+
+static std::uint32_t mip_count(glm::uvec2 extent)
+{
+  return static_cast<std::uint32_t>(std::bit_width(std::max(extent.x, extent.y)));
+}
+
+static glm::uvec2 mip_extent(glm::uvec2 extent, std::uint32_t level)
+{
+  return glm::max(extent >> glm::uvec2{level}, glm::uvec2{1});
+}
+
+static vk::ImageSubresourceLayers mip_layers(std::uint32_t level)
+{
+  return vk::ImageSubresourceLayers{
+    .aspectMask = vk::ImageAspectFlagBits::eColor,
+    .mipLevel = level,
+    .baseArrayLayer = 0,
+    .layerCount = 1,
+  };
+}
+
+static vk::Offset3D mip_corner(glm::uvec2 extent, std::uint32_t level)
+{
+  const auto corner = mip_extent(extent, level);
+  return vk::Offset3D{static_cast<std::int32_t>(corner.x), static_cast<std::int32_t>(corner.y), 1};
+}
+
+static float srgb_to_linear(float value)
+{
+  return value <= 0.04045f ? value / 12.92f : std::pow((value + 0.055f) / 1.055f, 2.4f);
+}
+
+static float linear_to_srgb(float value)
+{
+  return value <= 0.0031308f ? value * 12.92f : 1.055f * std::pow(value, 1.0f / 2.4f) - 0.055f;
+}
+
+// Halves an RGBA8 image with a box filter in place. Every texel of the result only
+// reads texels that are at or after its own position, which have not been overwritten yet.
+static glm::uvec2 downsample(std::uint8_t* pixels, glm::uvec2 extent, bool srgb)
+{
+  static const auto toLinear = []() {
+    std::array<float, 256> result;
+    for (std::size_t i = 0; i < result.size(); ++i)
+      result[i] = srgb_to_linear(static_cast<float>(i) / 255.0f);
+    return result;
+  }();
+
+  const glm::uvec2 half = mip_extent(extent, 1);
+  for (std::uint32_t y = 0; y < half.y; ++y)
+    for (std::uint32_t x = 0; x < half.x; ++x)
+    {
+      // Odd sizes lose their last row or column, as blits do
+      const std::array sources{
+        std::min(2 * y, extent.y - 1) * extent.x + std::min(2 * x, extent.x - 1),
+        std::min(2 * y, extent.y - 1) * extent.x + std::min(2 * x + 1, extent.x - 1),
+        std::min(2 * y + 1, extent.y - 1) * extent.x + std::min(2 * x, extent.x - 1),
+        std::min(2 * y + 1, extent.y - 1) * extent.x + std::min(2 * x + 1, extent.x - 1),
+      };
+
+      std::array<std::uint8_t, 4> texel;
+      for (std::uint32_t c = 0; c < 4; ++c)
+      {
+        // Alpha is always linear
+        const bool linearize = srgb && c < 3;
+        float sum = 0;
+        for (const auto source : sources)
+        {
+          const std::uint8_t value = pixels[4 * source + c];
+          sum += linearize ? toLinear[value] : static_cast<float>(value) / 255.0f;
+        }
+        const float average = linearize ? linear_to_srgb(sum / 4.0f) : sum / 4.0f;
+        texel[c] = static_cast<std::uint8_t>(std::clamp(average, 0.0f, 1.0f) * 255.0f + 0.5f);
+      }
+      std::memcpy(pixels + 4 * (y * half.x + x), texel.data(), texel.size());
+    }
+
+  return half;
+}
+
+void TextureLoader::PixelsDeleter::operator()(std::uint8_t* pixels) const
+{
+  stbi_image_free(pixels);
+}
+
+TextureLoader::TextureLoader(CreateInfo info)
+  : decoders{info.decodeThreads}
+  , staging{FrameRingAllocator::CreateInfo{
+      .sizePerFrame = info.stagingPerFrame,
+      .name = "texture_staging",
+    }}
+  , finished{etna::get_context().getMainWorkCount(), [](std::size_t) {
+               return std::vector<Handle>{};
+             }}
+  , retired{etna::get_context().getMainWorkCount(), [](std::size_t) {
+              return std::vector<etna::Image>{};
+            }}
+  , streamingStartExtent{info.streamingStartExtent}
+  , streamingBudget{info.streamingBudget}
+  , feedbackSlots{info.feedbackSlots}
+  , feedbackFrames{etna::get_context().getMainWorkCount(), [&info](std::size_t) {
+                     FeedbackFrame frame;
+                     if (info.feedbackSlots == 0)
+                       return frame;
+                     frame.readback = create_readback_buffer(
+                       info.feedbackSlots * sizeof(std::uint32_t), "mip_feedback_readback");
+                     // Stays mapped for the whole lifetime of the loader
+                     frame.readback.map();
+                     return frame;
+                   }}
+{
+  auto& ctx = etna::get_context();
+
+  // Both formats support linear filtering pretty much everywhere, but it's not mandatory
+  for (bool srgb : {false, true})
+  {
+    const auto props = ctx.getPhysicalDevice().getFormatProperties(texture_format(srgb));
+    linearBlits = linearBlits &&
+      (props.optimalTilingFeatures & vk::FormatFeatureFlagBits::eSampledImageFilterLinear);
+  }
+
+  if (info.feedbackSlots != 0)
+    feedback = ctx.createBuffer(etna::Buffer::CreateInfo{
+      .size = info.feedbackSlots * sizeof(std::uint32_t),
+      .bufferUsage = vk::BufferUsageFlagBits::eStorageBuffer |
+        vk::BufferUsageFlagBits::eTransferSrc | vk::BufferUsageFlagBits::eTransferDst,
+      .memoryUsage = VMA_MEMORY_USAGE_GPU_ONLY,
+      .name = "mip_feedback",
+    });
+
+  placeholder = ctx.createImage(etna::Image::CreateInfo{
+    .extent = vk::Extent3D{1, 1, 1},
+    .name = "texture_placeholder",
+    .format = texture_format(false),
+    .imageUsage = vk::ImageUsageFlagBits::eSampled | vk::ImageUsageFlagBits::eTransferDst,
+  });
+
+  // A one-off at load time, so that the placeholder is usable from the very first frame
+  auto cmdMgr = ctx.createOneShotCmdMgr();
+  auto cmdBuf = cmdMgr->start();
+  ETNA_CHECK_VK_RESULT(cmdBuf.begin(vk::CommandBufferBeginInfo{}));
+  {
+    etna::set_state(
+      cmdBuf,
+      placeholder.get(),
+      vk::PipelineStageFlagBits2::eTransfer,
+      vk::AccessFlagBits2::eTransferWrite,
+      vk::ImageLayout::eTransferDstOptimal,
+      vk::ImageAspectFlagBits::eColor);
+    etna::flush_barriers(cmdBuf);
+
+    const vk::ImageSubresourceRange range{
+      .aspectMask = vk::ImageAspectFlagBits::eColor,
+      .baseMipLevel = 0,
+      .levelCount = 1,
+      .baseArrayLayer = 0,
+      .layerCount = 1,
+    };
+    cmdBuf.clearColorImage(
+      placeholder.get(),
+      vk::ImageLayout::eTransferDstOptimal,
+      vk::ClearColorValue{std::array{1.0f, 1.0f, 1.0f, 1.0f}},
+      {range});
+
+    etna::set_state(
+      cmdBuf,
+      placeholder.get(),
+      vk::PipelineStageFlagBits2::eFragmentShader | vk::PipelineStageFlagBits2::eComputeShader,
+      vk::AccessFlagBits2::eShaderSampledRead,
+      vk::ImageLayout::eShaderReadOnlyOptimal,
+      vk::ImageAspectFlagBits::eColor);
+    etna::flush_barriers(cmdBuf);
+  }
+  ETNA_CHECK_VK_RESULT(cmdBuf.end());
+  cmdMgr->submitAndWait(std::move(cmdBuf));
+
+  decodeThread = std::thread{[this]() { decodeLoop(); }};
+}
+
+TextureLoader::~TextureLoader()
+{
+  {
+    std::unique_lock lock{mutex};
+    stopping = true;
+  }
+  wakeUp.notify_one();
+  // Waits for the batch being decoded right now, the rest is dropped
+  decodeThread.join();
+}
+
+TextureLoader::Handle TextureLoader::load(const std::filesystem::path& path, bool srgb)
+{
+  if (auto it = handles.find({path, srgb}); it != handles.end())
+    return it->second;
+
+  const auto handle = static_cast<Handle>(textures.size());
+  textures.push_back(Texture{.path = path, .srgb = srgb});
+  handles.emplace(std::pair{path, srgb}, handle);
+  ++pendingCount;
+
+  enqueue(handle, 0, streamingStartExtent);
+
+  return handle;
+}
+
+void TextureLoader::enqueue(Handle handle, std::uint32_t mip, std::uint32_t max_extent)
+{
+  const auto& texture = textures[static_cast<std::size_t>(handle)];
+  {
+    std::unique_lock lock{mutex};
+    requests.push_back(Request{
+      .handle = handle,
+      .path = texture.path,
+      .srgb = texture.srgb,
+      .mip = mip,
+      .maxExtent = max_extent,
+    });
+  }
+  wakeUp.notify_one();
+}
+
+void TextureLoader::decodeLoop()
+{
+  tracy::SetThreadName("Texture decoder");
+
+  for (;;)
+  {
+    std::vector<Request> batch;
+    {
+      std::unique_lock lock{mutex};
+      wakeUp.wait(lock, [this]() { return stopping || !requests.empty(); });
+      if (stopping)
+        return;
+      batch.swap(requests);
+    }
+
+    std::vector<Decoded> results(batch.size());
+    decoders.parallelFor(batch.size(), [&batch, &results](std::size_t task, std::size_t) {
+      results[task] = decode(batch[task]);
+    });
+
+    std::unique_lock lock{mutex};
+    std::ranges::move(results, std::back_inserter(decoded));
+  }
+}
+
+TextureLoader::Decoded TextureLoader::decode(const Request& request)
+{
+  ZoneScopedN("decodeTexture");
+
+  int width = 0;
+  int height = 0;
+  int channels = 0;
+  std::uint8_t* pixels =
+    stbi_load(request.path.string().c_str(), &width, &height, &channels, STBI_rgb_alpha);
+
+  Decoded result{
+    .handle = request.handle,
+    .pixels = std::unique_ptr<std::uint8_t, PixelsDeleter>{pixels},
+  };
+  if (pixels == nullptr)
+  {
+    spdlog::error("Unable to load {}: {}", request.path.string(), stbi_failure_reason());
+    return result;
+  }
+
+  result.fullExtent = {static_cast<std::uint32_t>(width), static_cast<std::uint32_t>(height)};
+  result.extent = result.fullExtent;
+
+  // Streamed textures skip their finest mips, which the GPU never gets to see
+  const std::uint32_t lastMip = mip_count(result.fullExtent) - 1;
+  const auto tooLarge = [&request](glm::uvec2 extent) {
+    return request.maxExtent != 0 && std::max(extent.x, extent.y) > request.maxExtent;
+  };
+  while (result.mip < lastMip && (result.mip < request.mip || tooLarge(result.extent)))
+  {
+    result.extent = downsample(pixels, result.extent, request.srgb);
+    ++result.mip;
+  }
+
+  return result;
+}
+
+void TextureLoader::update(vk::CommandBuffer cmd_buf)
+{
+  ZoneScoped;
+
+  ++frame;
+
+  // The fence of this frame slot was waited on, so other frames in flight were submitted
+  // after the ones that could still sample these images.
+  retired.get().clear();
+
+  // Uploads and evictions recorded into this frame slot are complete
+  if (!finished.get().empty())
+    ++imageVersion;
+  for (const Handle handle : finished.get())
+  {
+    auto& texture = textures[static_cast<std::size_t>(handle)];
+    if (texture.state != State::Ready)
+      --pendingCount;
+    texture.state = State::Ready;
+
+    if (texture.image.get())
+      retired.get().push_back(std::move(texture.image));
+    texture.image = std::move(texture.nextImage);
+    texture.baseMip = texture.nextBaseMip;
+    texture.changing = false;
+  }
+  finished.get().clear();
+
+  staging.beginFrame();
+
+  readFeedback();
+  processUploads(cmd_buf);
+  if (isStreaming())
+    stream(cmd_buf);
+}
+
+void TextureLoader::processUploads(vk::CommandBuffer cmd_buf)
+{
+  {
+    std::unique_lock lock{mutex};
+    for (auto& image : decoded)
+      uploads.push_back(Upload{.decoded = std::move(image)});
+    decoded.clear();
+  }
+
+  const auto maxExtent =
+    etna::get_context().getPhysicalDevice().getProperties().limits.maxImageDimension2D;
+
+  while (!uploads.empty())
+  {
+    auto& upload = uploads.front();
+    const auto& image = upload.decoded;
+    auto& texture = textures[static_cast<std::size_t>(image.handle)];
+    const vk::DeviceSize rowPitch = image.extent.x * 4;
+
+    if (upload.rowsDone == 0)
+    {
+      if (image.pixels == nullptr)
+      {
+        fail(image.handle);
+        uploads.pop_front();
+        continue;
+      }
+      if (image.extent.x > maxExtent || image.extent.y > maxExtent ||
+        rowPitch > staging.getSizePerFrame())
+      {
+        spdlog::error(
+          "Texture {} is too large, {}x{}", texture.path.string(), image.extent.x, image.extent.y);
+        fail(image.handle);
+        uploads.pop_front();
+        continue;
+      }
+    }
+
+    // Staging allocations are 16 byte aligned
+    const vk::DeviceSize used = (staging.getUsedSize() + 15) / 16 * 16;
+    const vk::DeviceSize freeRows =
+      used < staging.getSizePerFrame() ? (staging.getSizePerFrame() - used) / rowPitch : 0;
+    const auto rows = static_cast<std::uint32_t>(
+      std::min<vk::DeviceSize>(image.extent.y - upload.rowsDone, freeRows));
+    if (rows == 0)
+      break;
+
+    if (upload.rowsDone == 0)
+      startUpload(cmd_buf, upload);
+
+    const auto allocation = staging.allocateStaging(rows * rowPitch);
+    std::memcpy(allocation.data, image.pixels.get() + upload.rowsDone * rowPitch, allocation.size);
+
+    cmd_buf.copyBufferToImage(
+      allocation.buffer,
+      texture.nextImage.get(),
+      vk::ImageLayout::eTransferDstOptimal,
+      {vk::BufferImageCopy{
+        .bufferOffset = allocation.offset,
+        .bufferRowLength = 0,
+        .bufferImageHeight = 0,
+        .imageSubresource = mip_layers(0),
+        .imageOffset = {0, static_cast<std::int32_t>(upload.rowsDone), 0},
+        .imageExtent = {image.extent.x, rows, 1},
+      }});
+
+    upload.rowsDone += rows;
+    if (upload.rowsDone < image.extent.y)
+      break;
+
+    generateMips(cmd_buf, texture.nextImage, image.extent);
+    finished.get().push_back(image.handle);
+    uploads.pop_front();
+  }
+}
+
+void TextureLoader::startUpload(vk::CommandBuffer cmd_buf, Upload& upload)
+{
+  auto& texture = textures[static_cast<std::size_t>(upload.decoded.handle)];
+
+  if (texture.state == State::Decoding)
+  {
+    texture.state = State::Uploading;
+    texture.fullExtent = upload.decoded.fullExtent;
+    texture.fullMips = mip_count(texture.fullExtent);
+    texture.wantedMip = upload.decoded.mip;
+    texture.lastUsed = frame;
+    residentSize += imageSize(texture, upload.decoded.mip);
+  }
+
+  texture.nextBaseMip = upload.decoded.mip;
+  texture.nextImage = createImage(texture, texture.nextBaseMip);
+
+  etna::set_state(
+    cmd_buf,
+    texture.nextImage.get(),
+    vk::PipelineStageFlagBits2::eTransfer,
+    vk::AccessFlagBits2::eTransferWrite,
+    vk::ImageLayout::eTransferDstOptimal,
+    vk::ImageAspectFlagBits::eColor);
+  etna::flush_barriers(cmd_buf);
+}
+
+void TextureLoader::generateMips(
+  vk::CommandBuffer cmd_buf, const etna::Image& image, glm::uvec2 extent) const
+{
+  ZoneScoped;
+
+  const std::uint32_t levels = mip_count(extent);
+
+  const auto mipBarrier = [&](std::uint32_t base_level,
+                              std::uint32_t level_count,
+                              vk::AccessFlags2 src_access,
+                              vk::ImageLayout old_layout,
+                              vk::AccessFlags2 dst_access,
+                              vk::ImageLayout new_layout) {
+    const vk::ImageMemoryBarrier2 barrier{
+      .srcStageMask = vk::PipelineStageFlagBits2::eTransfer,
+      .srcAccessMask = src_access,
+      .dstStageMask = vk::PipelineStageFlagBits2::eTransfer,
+      .dstAccessMask = dst_access,
+      .oldLayout = old_layout,
+      .newLayout = new_layout,
+      .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+      .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+      .image = image.get(),
+      .subresourceRange =
+        {
+          .aspectMask = vk::ImageAspectFlagBits::eColor,
+          .baseMipLevel = base_level,
+          .levelCount = level_count,
+          .baseArrayLayer = 0,
+          .layerCount = 1,
+        },
+    };
+    cmd_buf.pipelineBarrier2(vk::DependencyInfo{
+      .imageMemoryBarrierCount = 1,
+      .pImageMemoryBarriers = &barrier,
+    });
+  };
+
+  // Every level is downsampled from the previous one, which becomes a blit source for that
+  for (std::uint32_t level = 1; level < levels; ++level)
+  {
+    mipBarrier(
+      level - 1,
+      1,
+      vk::AccessFlagBits2::eTransferWrite,
+      vk::ImageLayout::eTransferDstOptimal,
+      vk::AccessFlagBits2::eTransferRead,
+      vk::ImageLayout::eTransferSrcOptimal);
+
+    cmd_buf.blitImage(
+      image.get(),
+      vk::ImageLayout::eTransferSrcOptimal,
+      image.get(),
+      vk::ImageLayout::eTransferDstOptimal,
+      {vk::ImageBlit{
+        .srcSubresource = mip_layers(level - 1),
+        .srcOffsets = std::array{vk::Offset3D{0, 0, 0}, mip_corner(extent, level - 1)},
+        .dstSubresource = mip_layers(level),
+        .dstOffsets = std::array{vk::Offset3D{0, 0, 0}, mip_corner(extent, level)},
+      }},
+      linearBlits ? vk::Filter::eLinear : vk::Filter::eNearest);
+  }
+
+  // etna tracks the layout of the whole image, which is still transfer dst as far as it knows
+  if (levels > 1)
+    mipBarrier(
+      0,
+      levels - 1,
+      vk::AccessFlagBits2::eNone,
+      vk::ImageLayout::eTransferSrcOptimal,
+      vk::AccessFlagBits2::eTransferWrite,
+      vk::ImageLayout::eTransferDstOptimal);
+
+  etna::set_state(
+    cmd_buf,
+    image.get(),
+    vk::PipelineStageFlagBits2::eFragmentShader | vk::PipelineStageFlagBits2::eComputeShader,
+    vk::AccessFlagBits2::eShaderSampledRead,
+    vk::ImageLayout::eShaderReadOnlyOptimal,
+    vk::ImageAspectFlagBits::eColor);
+  etna::flush_barriers(cmd_buf);
+}
+
+void TextureLoader::fail(Handle handle)
+{
+  auto& texture = textures[static_cast<std::size_t>(handle)];
+
+  // A texture that is already shown keeps the mips it has and stops asking for more
+  if (texture.state == State::Ready)
+  {
+    residentSize -= imageSize(texture, texture.nextBaseMip);
+    residentSize += imageSize(texture, texture.baseMip);
+    texture.changing = false;
+    texture.streamable = false;
+    texture.wantedMip = texture.baseMip;
+    return;
+  }
+
+  texture.state = State::Failed;
+  --pendingCount;
+}
+
+etna::BufferBinding TextureLoader::beginFeedback(
+  vk::CommandBuffer cmd_buf, std::span<const Handle> bound)
+{
+  ETNA_VERIFYF(
+    bound.size() <= feedbackSlots,
+    "Mip feedback for {} textures was requested, but there are only {} slots",
+    bound.size(),
+    feedbackSlots);
+
+  // Mips are relative to the images shaders are going to sample
+  auto& current = feedbackFrames.get();
+  current.handles.assign(bound.begin(), bound.end());
+  current.baseMips.clear();
+  for (const Handle handle : bound)
+    current.baseMips.push_back(
+      isReady(handle) ? textures[static_cast<std::size_t>(handle)].baseMip : MIP_FEEDBACK_NONE);
+
+  // The previous frame might still be writing and copying the feedback
+  {
+    const vk::MemoryBarrier2 barrier{
+      .srcStageMask =
+        vk::PipelineStageFlagBits2::eFragmentShader | vk::PipelineStageFlagBits2::eTransfer,
+      .srcAccessMask = vk::AccessFlagBits2::eShaderStorageWrite,
+      .dstStageMask = vk::PipelineStageFlagBits2::eTransfer,
+      .dstAccessMask = vk::AccessFlagBits2::eTransferWrite,
+    };
+    cmd_buf.pipelineBarrier2(vk::DependencyInfo{
+      .memoryBarrierCount = 1,
+      .pMemoryBarriers = &barrier,
+    });
+  }
+
+  cmd_buf.fillBuffer(feedback.get(), 0, VK_WHOLE_SIZE, MIP_FEEDBACK_NONE);
+
+  {
+    const vk::MemoryBarrier2 barrier{
+      .srcStageMask = vk::PipelineStageFlagBits2::eTransfer,
+      .srcAccessMask = vk::AccessFlagBits2::eTransferWrite,
+      .dstStageMask = vk::PipelineStageFlagBits2::eFragmentShader,
+      .dstAccessMask =
+        vk::AccessFlagBits2::eShaderStorageRead | vk::AccessFlagBits2::eShaderStorageWrite,
+    };
+    cmd_buf.pipelineBarrier2(vk::DependencyInfo{
+      .memoryBarrierCount = 1,
+      .pMemoryBarriers = &barrier,
+    });
+  }
+
+  return feedback.genBinding();
+}
+
+void TextureLoader::endFeedback(vk::CommandBuffer cmd_buf)
+{
+  auto& current = feedbackFrames.get();
+  if (current.handles.empty())
+    return;
+
+  {
+    const vk::MemoryBarrier2 barrier{
+      .srcStageMask = vk::PipelineStageFlagBits2::eFragmentShader,
+      .srcAccessMask = vk::AccessFlagBits2::eShaderStorageWrite,
+      .dstStageMask = vk::PipelineStageFlagBits2::eTransfer,
+      .dstAccessMask = vk::AccessFlagBits2::eTransferRead,
+    };
+    cmd_buf.pipelineBarrier2(vk::DependencyInfo{
+      .memoryBarrierCount = 1,
+      .pMemoryBarriers = &barrier,
+    });
+  }
+
+  cmd_buf.copyBuffer(
+    feedback.get(),
+    current.readback.get(),
+    {vk::BufferCopy{
+      .srcOffset = 0,
+      .dstOffset = 0,
+      .size = current.handles.size() * sizeof(std::uint32_t),
+    }});
+
+  make_writes_host_visible(cmd_buf);
+}
+
+void TextureLoader::readFeedback()
+{
+  auto& previous = feedbackFrames.get();
+  if (previous.handles.empty())
+    return;
+
+  const auto* values = reinterpret_cast<const std::uint32_t*>(previous.readback.data());
+  for (std::size_t i = 0; i < previous.handles.size(); ++i)
+  {
+    if (values[i] == MIP_FEEDBACK_NONE || previous.baseMips[i] == MIP_FEEDBACK_NONE)
+      continue;
+
+    auto& texture = textures[static_cast<std::size_t>(previous.handles[i])];
+    const auto mip = static_cast<std::int32_t>(values[i]) - MIP_FEEDBACK_BIAS +
+      static_cast<std::int32_t>(previous.baseMips[i]);
+    texture.wantedMip = static_cast<std::uint32_t>(
+      std::clamp(mip, 0, static_cast<std::int32_t>(texture.fullMips) - 1));
+    texture.lastUsed = frame;
+  }
+
+  previous.handles.clear();
+}
+
+void TextureLoader::stream(vk::CommandBuffer cmd_buf)
+{
+  ZoneScoped;
+
+  std::size_t streamingIn = 0;
+  std::vector<Handle> wanted;
+  for (std::size_t i = 0; i < textures.size(); ++i)
+  {
+    const auto& texture = textures[i];
+    if (texture.state != State::Ready)
+      continue;
+    if (texture.changing && texture.nextBaseMip < texture.baseMip)
+      ++streamingIn;
+    else if (!texture.changing && texture.streamable && texture.wantedMip < texture.baseMip)
+      wanted.push_back(static_cast<Handle>(i));
+  }
+
+  // The most recently used textures are the most likely to be on screen right now
+  std::ranges::sort(wanted, [this](Handle a, Handle b) {
+    return textures[static_cast<std::size_t>(a)].lastUsed >
+      textures[static_cast<std::size_t>(b)].lastUsed;
+  });
+
+  for (const Handle handle : wanted)
+  {
+    if (streamingIn >= MAX_STREAM_INS)
+      break;
+
+    auto& texture = textures[static_cast<std::size_t>(handle)];
+    const vk::DeviceSize extra =
+      imageSize(texture, texture.wantedMip) - imageSize(texture, texture.baseMip);
+    if (!makeRoom(cmd_buf, extra, handle))
+      break;
+
+    residentSize += extra;
+    texture.nextBaseMip = texture.wantedMip;
+    texture.changing = true;
+    enqueue(handle, texture.wantedMip, 0);
+    ++streamingIn;
+    ++streamInCount;
+  }
+
+  // The budget might have been lowered
+  makeRoom(cmd_buf, 0, Handle::Invalid);
+}
+
+bool TextureLoader::makeRoom(vk::CommandBuffer cmd_buf, vk::DeviceSize extra, Handle keep)
+{
+  while (residentSize + extra > streamingBudget)
+  {
+    // Mips that are not wanted anymore go first, then the least recently used ones
+    Handle victim = Handle::Invalid;
+    for (std::size_t i = 0; i < textures.size(); ++i)
+    {
+      const auto& texture = textures[i];
+      const bool evictable = texture.state == State::Ready && !texture.changing &&
+        static_cast<Handle>(i) != keep && texture.baseMip < startMip(texture) &&
+        (texture.wantedMip > texture.baseMip || frame - texture.lastUsed > STALE_FRAMES);
+      if (!evictable)
+        continue;
+
+      if (victim == Handle::Invalid ||
+        texture.lastUsed < textures[static_cast<std::size_t>(victim)].lastUsed)
+        victim = static_cast<Handle>(i);
+    }
+
+    if (victim == Handle::Invalid)
+      return false;
+
+    // Stale textures drop everything that was streamed in at once
+    const auto& texture = textures[static_cast<std::size_t>(victim)];
+    const std::uint32_t baseMip = frame - texture.lastUsed > STALE_FRAMES
+      ? startMip(texture)
+      : std::max(texture.baseMip + 1, std::min(texture.wantedMip, startMip(texture)));
+    evict(cmd_buf, victim, baseMip);
+  }
+
+  return true;
+}
+
+void TextureLoader::evict(vk::CommandBuffer cmd_buf, Handle handle, std::uint32_t base_mip)
+{
+  ZoneScoped;
+
+  auto& texture = textures[static_cast<std::size_t>(handle)];
+
+  residentSize -= imageSize(texture, texture.baseMip);
+  residentSize += imageSize(texture, base_mip);
+  texture.nextBaseMip = base_mip;
+  texture.nextImage = createImage(texture, base_mip);
+  texture.changing = true;
+  ++evictionCount;
+
+  etna::set_state(
+    cmd_buf,
+    texture.image.get(),
+    vk::PipelineStageFlagBits2::eTransfer,
+    vk::AccessFlagBits2::eTransferRead,
+    vk::ImageLayout::eTransferSrcOptimal,
+    vk::ImageAspectFlagBits::eColor);
+  etna::set_state(
+    cmd_buf,
+    texture.nextImage.get(),
+    vk::PipelineStageFlagBits2::eTransfer,
+    vk::AccessFlagBits2::eTransferWrite,
+    vk::ImageLayout::eTransferDstOptimal,
+    vk::ImageAspectFlagBits::eColor);
+  etna::flush_barriers(cmd_buf);
+
+  // The mips stay as they are, no need to decode anything
+  std::vector<vk::ImageCopy> regions;
+  for (std::uint32_t level = base_mip; level < texture.fullMips; ++level)
+  {
+    const auto extent = mip_extent(texture.fullExtent, level);
+    regions.push_back(vk::ImageCopy{
+      .srcSubresource = mip_layers(level - texture.baseMip),
+      .srcOffset = {},
+      .dstSubresource = mip_layers(level - base_mip),
+      .dstOffset = {},
+      .extent = {extent.x, extent.y, 1},
+    });
+  }
+  cmd_buf.copyImage(
+    texture.image.get(),
+    vk::ImageLayout::eTransferSrcOptimal,
+    texture.nextImage.get(),
+    vk::ImageLayout::eTransferDstOptimal,
+    regions);
+
+  // The old image is still sampled until the new one is swapped in
+  for (const auto image : {texture.image.get(), texture.nextImage.get()})
+    etna::set_state(
+      cmd_buf,
+      image,
+      vk::PipelineStageFlagBits2::eFragmentShader | vk::PipelineStageFlagBits2::eComputeShader,
+      vk::AccessFlagBits2::eShaderSampledRead,
+      vk::ImageLayout::eShaderReadOnlyOptimal,
+      vk::ImageAspectFlagBits::eColor);
+  etna::flush_barriers(cmd_buf);
+
+  finished.get().push_back(handle);
+}
+
+std::uint32_t TextureLoader::startMip(const Texture& texture) const
+{
+  std::uint32_t mip = 0;
+  while (mip + 1 < texture.fullMips &&
+         std::max(texture.fullExtent.x, texture.fullExtent.y) >> mip > streamingStartExtent)
+    ++mip;
+  return mip;
+}
+
+etna::Image TextureLoader::createImage(const Texture& texture, std::uint32_t base_mip) const
+{
+  const auto extent = mip_extent(texture.fullExtent, base_mip);
+  return etna::get_context().createImage(etna::Image::CreateInfo{
+    .extent = vk::Extent3D{extent.x, extent.y, 1},
+    .name = texture.path.filename().string(),
+    .format = texture_format(texture.srgb),
+    .imageUsage = vk::ImageUsageFlagBits::eSampled | vk::ImageUsageFlagBits::eTransferSrc |
+      vk::ImageUsageFlagBits::eTransferDst,
+    .mipLevels = texture.fullMips - base_mip,
+  });
+}
+
+vk::DeviceSize TextureLoader::imageSize(const Texture& texture, std::uint32_t base_mip) const
+{
+  vk::DeviceSize result = 0;
+  for (std::uint32_t level = base_mip; level < texture.fullMips; ++level)
+  {
+    const auto extent = mip_extent(texture.fullExtent, level);
+    result += vk::DeviceSize{extent.x} * extent.y * 4;
+  }
+  return result;
+}
+
+bool TextureLoader::isReady(Handle handle) const
+{
+  return handle != Handle::Invalid &&
+    textures[static_cast<std::size_t>(handle)].state == State::Ready;
+}
+
+bool TextureLoader::hasFailed(Handle handle) const
+{
+  return handle == Handle::Invalid ||
+    textures[static_cast<std::size_t>(handle)].state == State::Failed;
+}
+
+const etna::Image& TextureLoader::get(Handle handle) const
+{
+  return isReady(handle) ? textures[static_cast<std::size_t>(handle)].image : placeholder;
+}
@@ -0,0 +1,241 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <etna/Vulkan.hpp>
+#include <etna/Buffer.hpp>
+#include <etna/Image.hpp>
+#include <etna/GpuSharedResource.hpp>
+
+#include "threading/WorkerPool.hpp"
+#include "render_utils/FrameRingAllocator.hpp"
+
+
+/**
+ * Loads RGBA8 textures (PNG, JPEG, BMP, TGA, ...) without ever stalling the frame.
+ * Files are decoded on a pool of worker threads in the background, decoded pixels
+ * are copied to the GPU through a staging ring with a fixed budget per frame (large
+ * images take several frames), and the mip chain is generated on the GPU with blits.
+ * A handle becomes ready once the frame that finished its upload has been waited on,
+ * until then get returns a 1x1 white placeholder, so callers never need to special-case
+ * textures that are still loading.
+ *
+ * With streaming enabled, textures start out small and only get finer mips once shaders
+ * report sampling them through the mip feedback buffer (see mip_feedback.glsl). Finer mips
+ * are decoded from disk again, while textures that were not used for the longest time lose
+ * their finest mips whenever the budget is exceeded. The image of a texture only ever holds
+ * resident mips, its base level being the finest one, so samplers can't reach missing data.
+ */
+class TextureLoader
+{
+public:
+  struct CreateInfo
+  {
+    // Pixel data uploaded per frame, rows of an image that don't fit wait for the next frame
+    vk::DeviceSize stagingPerFrame = 16 << 20;
+    // 0 means "one thread per hardware core"
+    std::size_t decodeThreads = 0;
+    // Textures are first loaded at most this large, 0 disables streaming altogether
+    std::uint32_t streamingStartExtent = 0;
+    // Streaming evicts mips once the textures take more memory than this
+    vk::DeviceSize streamingBudget = 256 << 20;
+    // Length of the mip feedback buffer, i.e. how many textures a frame can bind
+    std::uint32_t feedbackSlots = 0;
+  };
+
+  enum class Handle : std::uint32_t
+  {
+    Invalid = ~std::uint32_t{0},
+  };
+
+  explicit TextureLoader(CreateInfo info);
+  ~TextureLoader();
+
+  TextureLoader(const TextureLoader&) = delete;
+  TextureLoader& operator=(const TextureLoader&) = delete;
+
+  // Returns right away, loading the same file twice gives the same handle.
+  // Color textures are sRGB, data textures (normals, roughness, ...) should pass false.
+  Handle load(const std::filesystem::path& path, bool srgb = true);
+
+  // Records uploads and mip generation of decoded images, as well as streaming mips in and out.
+  // Must be called once per frame after the frame's fence was waited on, before any texture of
+  // this frame is used.
+  void update(vk::CommandBuffer cmd_buf);
+
+  // Resets the feedback buffer of this frame, element i of it is meant for the texture bound
+  // as bound[i]. Has to be called after update, and must be followed by endFeedback after
+  // the last draw that writes feedback.
+  etna::BufferBinding beginFeedback(vk::CommandBuffer cmd_buf, std::span<const Handle> bound);
+  // Copies the feedback for the CPU, which reads it once the frame is done
+  void endFeedback(vk::CommandBuffer cmd_buf);
+
+  bool isReady(Handle handle) const;
+  bool hasFailed(Handle handle) const;
+
+  // In the shader read only layout, the placeholder if the texture is not ready (yet)
+  const etna::Image& get(Handle handle) const;
+  const etna::Image& getPlaceholder() const { return placeholder; }
+  // Changes whenever get might return a different image for some handle, the old one is
+  // destroyed a couple of frames later. Descriptor sets that are kept around need it.
+  std::uint64_t getImageVersion() const { return imageVersion; }
+
+  // Textures that are neither ready nor failed
+  std::size_t getPendingCount() const { return pendingCount; }
+
+  bool isStreaming() const { return streamingStartExtent != 0; }
+  void setStreamingBudget(vk::DeviceSize budget) { streamingBudget = budget; }
+  vk::DeviceSize getStreamingBudget() const { return streamingBudget; }
+  // Memory that texture images take once mips that are being streamed in or out are done,
+  // the old and the new image of a texture both exist for a couple of frames in between.
+  vk::DeviceSize getResidentSize() const { return residentSize; }
+  // Mips streamed in and out so far
+  std::uint64_t getStreamInCount() const { return streamInCount; }
+  std::uint64_t getEvictionCount() const { return evictionCount; }
+
+private:
+  enum class State
+  {
+    Decoding,
+    Uploading,
+    Ready,
+    Failed,
+  };
+
+  struct Texture
+  {
+    std::filesystem::path path;
+    bool srgb;
+    State state = State::Decoding;
+
+    // Only holds mips from baseMip onwards, all of them once streaming is off
+    etna::Image image;
+    std::uint32_t baseMip = 0;
+    // Known after the first decode
+    glm::uvec2 fullExtent{0, 0};
+    std::uint32_t fullMips = 0;
+
+    // Replaces image once the frame that filled it is done
+    etna::Image nextImage;
+    std::uint32_t nextBaseMip = 0;
+    // From a request to load finer mips until nextImage is swapped in
+    bool changing = false;
+    // Cleared once loading finer mips failed, they would fail again every frame
+    bool streamable = true;
+
+    // Streaming feedback: the finest mip sampled during the last reported frame,
+    // and the frame that happened in
+    std::uint32_t wantedMip = 0;
+    std::uint64_t lastUsed = 0;
+  };
+
+  struct PixelsDeleter
+  {
+    void operator()(std::uint8_t* pixels) const;
+  };
+
+  struct Request
+  {
+    Handle handle;
+    std::filesystem::path path;
+    bool srgb;
+    // Finest mip to decode, made coarser until it fits into maxExtent, if that is not 0
+    std::uint32_t mip;
+    std::uint32_t maxExtent;
+  };
+
+  struct Decoded
+  {
+    Handle handle = Handle::Invalid;
+    glm::uvec2 fullExtent{0, 0};
+    std::uint32_t mip = 0;
+    // Extent of that mip
+    glm::uvec2 extent{0, 0};
+    // Tightly packed RGBA8 rows, null when decoding failed
+    std::unique_ptr<std::uint8_t, PixelsDeleter> pixels;
+  };
+
+  struct Upload
+  {
+    Decoded decoded;
+    std::uint32_t rowsDone = 0;
+  };
+
+  struct FeedbackFrame
+  {
+    etna::Buffer readback;
+    // What was bound when the feedback was written
+    std::vector<Handle> handles;
+    std::vector<std::uint32_t> baseMips;
+  };
+
+  void decodeLoop();
+  static Decoded decode(const Request& request);
+  void enqueue(Handle handle, std::uint32_t mip, std::uint32_t max_extent);
+
+  void processUploads(vk::CommandBuffer cmd_buf);
+  void startUpload(vk::CommandBuffer cmd_buf, Upload& upload);
+  void generateMips(vk::CommandBuffer cmd_buf, const etna::Image& image, glm::uvec2 extent) const;
+  void fail(Handle handle);
+
+  void readFeedback();
+  void stream(vk::CommandBuffer cmd_buf);
+  // Moves the coarser mips of a texture into a new smaller image
+  void evict(vk::CommandBuffer cmd_buf, Handle handle, std::uint32_t base_mip);
+  // Evicts mips of the least recently used textures until `extra` more bytes fit into the budget
+  bool makeRoom(vk::CommandBuffer cmd_buf, vk::DeviceSize extra, Handle keep);
+  // The coarsest base mip streaming keeps, the one textures are first loaded with
+  std::uint32_t startMip(const Texture& texture) const;
+  etna::Image createImage(const Texture& texture, std::uint32_t base_mip) const;
+  vk::DeviceSize imageSize(const Texture& texture, std::uint32_t base_mip) const;
+
+private:
+  std::vector<Texture> textures;
+  std::map<std::pair<std::filesystem::path, bool>, Handle> handles;
+  std::size_t pendingCount = 0;
+
+  etna::Image placeholder;
+  bool linearBlits = true;
+
+  // Only touched by the decoding thread
+  WorkerPool decoders;
+  std::thread decodeThread;
+
+  std::mutex mutex;
+  std::condition_variable wakeUp;
+  // Everything below is protected by the mutex
+  bool stopping = false;
+  std::vector<Request> requests;
+  std::vector<Decoded> decoded;
+
+  // Render thread only from here on
+  std::deque<Upload> uploads;
+  FrameRingAllocator staging;
+  // Textures whose new image was finished by the command buffer of a frame in flight
+  etna::GpuSharedResource<std::vector<Handle>> finished;
+  // Images replaced during a frame, other frames in flight might still sample them
+  etna::GpuSharedResource<std::vector<etna::Image>> retired;
+
+  std::uint32_t streamingStartExtent;
+  vk::DeviceSize streamingBudget;
+  vk::DeviceSize residentSize = 0;
+  std::uint64_t frame = 0;
+  std::uint64_t imageVersion = 0;
+  std::uint64_t streamInCount = 0;
+  std::uint64_t evictionCount = 0;
+
+  std::uint32_t feedbackSlots;
+  etna::Buffer feedback;
+  etna::GpuSharedResource<FeedbackFrame> feedbackFrames;
+};
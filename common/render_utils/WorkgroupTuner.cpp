@@ -0,0 +1,195 @@
+#include "WorkgroupTuner.hpp"
+
+#include <algorithm>
+#include <array>
+#include <fstream>
+#include <limits>
+
+#include <etna/Etna.hpp>
+#include <etna/GlobalContext.hpp>
+#include <tracy/Tracy.hpp>
+
+
+// The first run only warms up caches and clocks, the median of the rest is what counts
+static constexpr std::uint32_t TUNING_RUNS = 6;
+
+static std::string current_device_id()
+{
+  const auto props = etna::get_context().getPhysicalDevice().getProperties();
+  return fmt::format("{:x}:{:x}:{:x}", props.vendorID, props.deviceID, props.driverVersion);
+}
+
+// Orders dispatches of consecutive runs, so that they can't overlap and skew the timings
+static void serialize_dispatches(vk::CommandBuffer cmd_buf)
+{
+  const vk::MemoryBarrier2 barrier{
+    .srcStageMask = vk::PipelineStageFlagBits2::eComputeShader,
+    .srcAccessMask = vk::AccessFlagBits2::eShaderWrite,
+    .dstStageMask = vk::PipelineStageFlagBits2::eComputeShader,
+    .dstAccessMask = vk::AccessFlagBits2::eShaderRead | vk::AccessFlagBits2::eShaderWrite,
+  };
+  cmd_buf.pipelineBarrier2(vk::DependencyInfo{
+    .memoryBarrierCount = 1,
+    .pMemoryBarriers = &barrier,
+  });
+}
+
+WorkgroupTuner::WorkgroupTuner(std::filesystem::path cache_path)
+  : path{std::move(cache_path)}
+  , deviceId{current_device_id()}
+{
+  auto& ctx = etna::get_context();
+
+  const auto limits = ctx.getPhysicalDevice().getProperties().limits;
+  const auto families = ctx.getPhysicalDevice().getQueueFamilyProperties();
+  supported =
+    families[ctx.getQueueFamilyIdx()].timestampValidBits != 0 && limits.timestampPeriod > 0;
+  nsPerTick = limits.timestampPeriod;
+
+  cmdMgr = ctx.createOneShotCmdMgr();
+  queries = etna::unwrap_vk_result(ctx.getDevice().createQueryPoolUnique(vk::QueryPoolCreateInfo{
+    .queryType = vk::QueryType::eTimestamp,
+    .queryCount = 2 * TUNING_RUNS,
+  }));
+
+  // The first line names the device the sizes were picked on, one kernel per line after it
+  std::ifstream file{path};
+  std::string fileDevice;
+  if (!(file >> fileDevice))
+    return;
+  if (fileDevice != deviceId)
+  {
+    spdlog::info("Workgroup sizes in {} are for a different device, retuning", path.string());
+    dirty = true;
+    return;
+  }
+
+  std::string name;
+  glm::uvec2 size;
+  while (file >> name >> size.x >> size.y)
+    sizes[name] = size;
+}
+
+WorkgroupTuner::~WorkgroupTuner()
+{
+  if (dirty)
+    save();
+}
+
+std::optional<glm::uvec2> WorkgroupTuner::find(const std::string& name) const
+{
+  if (auto it = sizes.find(name); it != sizes.end())
+    return it->second;
+  return std::nullopt;
+}
+
+glm::uvec2 WorkgroupTuner::tune(const Kernel& kernel)
+{
+  ZoneScoped;
+
+  ETNA_VERIFYF(!kernel.candidates.empty(), "No workgroup sizes to pick from for {}", kernel.name);
+
+  // A cached size might not be among the candidates anymore, which is fine
+  if (auto cached = find(kernel.name); cached.has_value() && fits(*cached))
+    return *cached;
+
+  // Also what we go with when we can't measure anything
+  std::optional<glm::uvec2> largest;
+  for (const auto size : kernel.candidates)
+    if (fits(size) && (!largest.has_value() || size.x * size.y > largest->x * largest->y))
+      largest = size;
+  ETNA_VERIFYF(
+    largest.has_value(),
+    "None of the workgroup sizes of {} fit into the device limits",
+    kernel.name);
+
+  if (!supported)
+    return *largest;
+
+  glm::uvec2 best = *largest;
+  float bestMs = std::numeric_limits<float>::max();
+  for (const auto size : kernel.candidates)
+  {
+    if (!fits(size))
+      continue;
+
+    const float ms = measure(kernel, size);
+    spdlog::info("{}: {}x{} takes {:.3f} ms", kernel.name, size.x, size.y, ms);
+    if (ms < bestMs)
+    {
+      best = size;
+      bestMs = ms;
+    }
+  }
+
+  spdlog::info("{}: picked {}x{}", kernel.name, best.x, best.y);
+  sizes[kernel.name] = best;
+  dirty = true;
+  return best;
+}
+
+bool WorkgroupTuner::fits(glm::uvec2 size) const
+{
+  const auto limits = etna::get_context().getPhysicalDevice().getProperties().limits;
+  return size.x > 0 && size.y > 0 && size.x <= limits.maxComputeWorkGroupSize[0] &&
+    size.y <= limits.maxComputeWorkGroupSize[1] &&
+    size.x * size.y <= limits.maxComputeWorkGroupInvocations;
+}
+
+float WorkgroupTuner::measure(const Kernel& kernel, glm::uvec2 size)
+{
+  const vk::Pipeline pipeline = kernel.variants->getBlocking(kernel.constants(size));
+
+  // Earlier candidates are done, so their descriptor sets may be recycled
+  etna::begin_frame();
+
+  auto cmdBuf = cmdMgr->start();
+  ETNA_CHECK_VK_RESULT(cmdBuf.begin(vk::CommandBufferBeginInfo{}));
+
+  cmdBuf.resetQueryPool(queries.get(), 0, 2 * TUNING_RUNS);
+  for (std::uint32_t run = 0; run < TUNING_RUNS; ++run)
+  {
+    cmdBuf.writeTimestamp2(vk::PipelineStageFlagBits2::eAllCommands, queries.get(), 2 * run);
+    kernel.record(cmdBuf, pipeline, size);
+    cmdBuf.writeTimestamp2(vk::PipelineStageFlagBits2::eAllCommands, queries.get(), 2 * run + 1);
+    serialize_dispatches(cmdBuf);
+  }
+
+  ETNA_CHECK_VK_RESULT(cmdBuf.end());
+  cmdMgr->submitAndWait(std::move(cmdBuf));
+  etna::end_frame();
+
+  std::array<std::uint64_t, 2 * TUNING_RUNS> ticks{};
+  ETNA_CHECK_VK_RESULT(etna::get_context().getDevice().getQueryPoolResults(
+    queries.get(),
+    0,
+    2 * TUNING_RUNS,
+    sizeof(ticks),
+    ticks.data(),
+    sizeof(std::uint64_t),
+    vk::QueryResultFlagBits::e64 | vk::QueryResultFlagBits::eWait));
+
+  std::array<float, TUNING_RUNS - 1> times;
+  for (std::uint32_t run = 1; run < TUNING_RUNS; ++run)
+    times[run - 1] = static_cast<float>(ticks[2 * run + 1] - ticks[2 * run]) * nsPerTick * 1e-6f;
+
+  std::ranges::nth_element(times, times.begin() + times.size() / 2);
+  return times[times.size() / 2];
+}
+
+void WorkgroupTuner::save() const
+{
+  if (path.has_parent_path())
+    std::filesystem::create_directories(path.parent_path());
+
+  std::ofstream file{path, std::ios::trunc};
+  if (!file.is_open())
+  {
+    spdlog::warn("Unable to save workgroup sizes to {}", path.string());
+    return;
+  }
+
+  file << deviceId << '\n';
+  for (const auto& [name, size] : sizes)
+    file << name << ' ' << size.x << ' ' << size.y << '\n';
+}
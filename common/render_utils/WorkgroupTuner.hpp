@@ -0,0 +1,74 @@
+#pragma once
+
+#include <filesystem>
+#include <functional>
+#include <map>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <etna/Vulkan.hpp>
+#include <etna/OneShotCmdMgr.hpp>
+
+#include "render_utils/ComputeVariantCache.hpp"
+
+
+/**
+ * Picks workgroup sizes of compute kernels for the device at hand. Every candidate
+ * size is compiled as a ComputeVariantCache variant (the kernel has to declare its
+ * size with local_size_x_id/local_size_y_id), timed with GPU timestamps, and the
+ * fastest one is remembered in a cache file next to the identity of the device and
+ * driver. Kernels look their size up in the cache when creating pipelines, and only
+ * get tuned again on another device or after a driver update.
+ *
+ * NOTE: tuning submits and waits for work on etna's queue, do it at load time.
+ */
+class WorkgroupTuner
+{
+public:
+  struct Kernel
+  {
+    // Identifies the kernel in the cache file, must not contain whitespace
+    std::string name;
+    ComputeVariantCache* variants;
+    // Specialization constants for a given workgroup size
+    std::function<ComputeVariantCache::Constants(glm::uvec2)> constants;
+    // Sizes that don't fit into the device limits are skipped
+    std::vector<glm::uvec2> candidates;
+    // Must dispatch the same workload with the given variant whatever the workgroup size is
+    std::function<void(vk::CommandBuffer, vk::Pipeline, glm::uvec2)> record;
+  };
+
+  explicit WorkgroupTuner(std::filesystem::path cache_path);
+  ~WorkgroupTuner();
+
+  WorkgroupTuner(const WorkgroupTuner&) = delete;
+  WorkgroupTuner& operator=(const WorkgroupTuner&) = delete;
+
+  // The cached size, or the fastest candidate, which gets cached. Without timestamp
+  // support, the largest candidate that fits is returned and nothing is cached.
+  // Fails if none of the candidates fit into the device limits.
+  glm::uvec2 tune(const Kernel& kernel);
+
+  std::optional<glm::uvec2> find(const std::string& name) const;
+
+  void save() const;
+
+private:
+  bool fits(glm::uvec2 size) const;
+  float measure(const Kernel& kernel, glm::uvec2 size);
+
+private:
+  std::filesystem::path path;
+  std::string deviceId;
+  bool supported = false;
+  float nsPerTick = 1;
+
+  std::unique_ptr<etna::OneShotCmdMgr> cmdMgr;
+  vk::UniqueQueryPool queries;
+
+  std::map<std::string, glm::uvec2> sizes;
+  bool dirty = false;
+};
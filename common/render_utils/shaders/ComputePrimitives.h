@@ -0,0 +1,31 @@
+#ifndef COMPUTE_PRIMITIVES_H_INCLUDED
+#define COMPUTE_PRIMITIVES_H_INCLUDED
+
+#include "cpp_glsl_compat.h"
+
+
+#define PRIMITIVES_GROUP_SIZE 256
+#define PRIMITIVES_ITEMS_PER_THREAD 4
+// Elements processed by a single workgroup of every primitive
+#define PRIMITIVES_BLOCK_SIZE (PRIMITIVES_GROUP_SIZE * PRIMITIVES_ITEMS_PER_THREAD)
+
+// Radix sort goes through keys in digits of this many bits
+#define PRIMITIVES_RADIX_BITS 4
+#define PRIMITIVES_RADIX_SIZE (1 << PRIMITIVES_RADIX_BITS)
+
+// The minimum guaranteed by the spec, larger dispatches wrap into the y dimension
+#define PRIMITIVES_MAX_GROUPS_X 65535
+
+struct PrimitivesParams
+{
+  shader_uint count;
+  // Workgroups that have data, the rest of a wrapped 2D dispatch exits right away
+  shader_uint groupCount;
+  // Radix sort only: the lowest bit of the current digit
+  shader_uint shift;
+  // Radix sort only: whether values are moved together with keys
+  shader_bool hasValues;
+};
+
+
+#endif // COMPUTE_PRIMITIVES_H_INCLUDED
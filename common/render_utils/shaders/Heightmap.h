@@ -0,0 +1,33 @@
+#ifndef HEIGHTMAP_H_INCLUDED
+#define HEIGHTMAP_H_INCLUDED
+
+#include "cpp_glsl_compat.h"
+
+
+#define HEIGHTMAP_GROUP_SIZE 16
+
+// Multi-octave Perlin noise is computed in fixed point with this many fraction bits,
+// so that the CPU and the GPU come up with exactly the same heights: integer math is
+// exact everywhere, and the final sum is converted to a float without any rounding.
+#define HEIGHTMAP_FRACTION_BITS 12
+#define HEIGHTMAP_ONE (1 << HEIGHTMAP_FRACTION_BITS)
+// A single octave is in [-2, 2] in fixed point, the sum of all of them has to fit
+// into the 24 bits of a float mantissa
+#define HEIGHTMAP_MAX_OCTAVES 10
+
+struct HeightmapParams
+{
+  // Texel of the whole map the region starts at, heights only depend on absolute texels
+  shader_uvec2 origin;
+  shader_uvec2 extent;
+  shader_uint seed;
+  shader_uint octaves;
+  // The lattice cell of the first octave is 2^baseCellBits texels large, every next octave
+  // halves it. At most HEIGHTMAP_FRACTION_BITS.
+  shader_uint baseCellBits;
+  // Maps the fixed point sum to (-1, 1), a power of two
+  shader_float scale;
+};
+
+
+#endif // HEIGHTMAP_H_INCLUDED
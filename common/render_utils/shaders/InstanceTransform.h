@@ -0,0 +1,22 @@
+#ifndef INSTANCE_TRANSFORM_H_INCLUDED
+#define INSTANCE_TRANSFORM_H_INCLUDED
+
+#include "cpp_glsl_compat.h"
+
+
+// Everything a vertex shader needs to know about where an instance is located.
+// This is computed on the CPU once whenever the instance's transform changes,
+// so that shaders never have to invert matrices per vertex.
+// NOTE: matrices are stored as rows, as the last row of an affine
+// 4x4 matrix is always (0, 0, 0, 1) and there is no point in storing it.
+struct InstanceTransform
+{
+  // Rows of the 3x4 affine model matrix
+  shader_vec4 modelRows[3];
+  // Rows of the inverse transpose of the upper-left 3x3 block of
+  // the model matrix, i.e. the normal matrix. W is unused.
+  shader_vec4 normalRows[3];
+};
+
+
+#endif // INSTANCE_TRANSFORM_H_INCLUDED
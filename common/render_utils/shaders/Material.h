@@ -0,0 +1,26 @@
+#ifndef MATERIAL_H_INCLUDED
+#define MATERIAL_H_INCLUDED
+
+#include "cpp_glsl_compat.h"
+
+
+// Size of the texture array that every material indexes into
+#define MAX_MATERIAL_TEXTURES 128
+// Slot 0 of the texture array always holds a 1x1 white texture,
+// so materials without a texture need no special casing in shaders
+#define MATERIAL_NO_TEXTURE 0
+
+// A single entry of the material table. Draws don't bind anything per material,
+// shaders look the material up by an index that comes with the vertices.
+struct Material
+{
+  shader_vec4 baseColorFactor;
+  // Slot in the texture array, multiplied by the factor
+  shader_uint baseColorTexture;
+  shader_float metallicFactor;
+  shader_float roughnessFactor;
+  shader_uint padding;
+};
+
+
+#endif // MATERIAL_H_INCLUDED
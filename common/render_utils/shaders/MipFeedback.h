@@ -0,0 +1,15 @@
+#ifndef MIP_FEEDBACK_H_INCLUDED
+#define MIP_FEEDBACK_H_INCLUDED
+
+#include "cpp_glsl_compat.h"
+
+
+// Written by shaders into the mip feedback buffer of TextureLoader, one element per bound texture.
+// An element holds the finest mip level sampled during the frame, relative to the base level of
+// the image that was bound, plus MIP_FEEDBACK_BIAS, so that wanting finer levels than the image
+// has is representable too.
+#define MIP_FEEDBACK_NONE 0xFFFFFFFFu
+#define MIP_FEEDBACK_BIAS 16
+
+
+#endif // MIP_FEEDBACK_H_INCLUDED
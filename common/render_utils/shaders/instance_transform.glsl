@@ -0,0 +1,25 @@
+#ifndef INSTANCE_TRANSFORM_GLSL_INCLUDED
+#define INSTANCE_TRANSFORM_GLSL_INCLUDED
+
+#include "InstanceTransform.h"
+
+
+// NOTE: multiplying a row vector by a matrix built from our rows as columns
+// is the same as multiplying the original matrix by a column vector.
+
+vec3 transform_point(InstanceTransform tm, vec3 point)
+{
+  return vec4(point, 1.0f) * mat3x4(tm.modelRows[0], tm.modelRows[1], tm.modelRows[2]);
+}
+
+vec3 transform_direction(InstanceTransform tm, vec3 dir)
+{
+  return vec4(dir, 0.0f) * mat3x4(tm.modelRows[0], tm.modelRows[1], tm.modelRows[2]);
+}
+
+vec3 transform_normal(InstanceTransform tm, vec3 normal)
+{
+  return normal * mat3(tm.normalRows[0].xyz, tm.normalRows[1].xyz, tm.normalRows[2].xyz);
+}
+
+#endif // INSTANCE_TRANSFORM_GLSL_INCLUDED
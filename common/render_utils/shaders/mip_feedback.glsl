@@ -0,0 +1,24 @@
+#ifndef MIP_FEEDBACK_GLSL_INCLUDED
+#define MIP_FEEDBACK_GLSL_INCLUDED
+
+#include "MipFeedback.h"
+
+
+// A single pixel of every 8x8 block is plenty to find out which levels are in use,
+// and keeps the number of atomics per frame low.
+bool is_mip_feedback_pixel(vec2 frag_coord)
+{
+  return all(equal(uvec2(frag_coord) & 7u, uvec2(0u)));
+}
+
+// The value to atomicMin into the feedback buffer. Only works in fragment shaders,
+// as the level comes from implicit derivatives, and must be called in uniform
+// control flow for the same reason, i.e. outside of is_mip_feedback_pixel checks.
+uint mip_feedback_value(sampler2D tex, vec2 uv)
+{
+  const float level = floor(textureQueryLod(tex, uv).y) + MIP_FEEDBACK_BIAS;
+  return uint(clamp(level, 0.0, 2.0 * MIP_FEEDBACK_BIAS));
+}
+
+
+#endif // MIP_FEEDBACK_GLSL_INCLUDED
@@ -0,0 +1,124 @@
+#ifndef PRIMITIVES_GLSL_INCLUDED
+#define PRIMITIVES_GLSL_INCLUDED
+
+#include "ComputePrimitives.h"
+
+// Shaders that define PRIMITIVES_SUBGROUPS must enable subgroup arithmetic themselves,
+// the shared memory fallback is used otherwise.
+
+layout(local_size_x = PRIMITIVES_GROUP_SIZE) in;
+
+layout(push_constant) uniform PushConstants
+{
+  PrimitivesParams params;
+};
+
+shared uint scanScratch[PRIMITIVES_GROUP_SIZE];
+shared uvec4 scanScratch4[PRIMITIVES_GROUP_SIZE];
+
+
+// Index of the workgroup within a dispatch that might have been wrapped into 2D
+uint group_index()
+{
+  return gl_WorkGroupID.y * gl_NumWorkGroups.x + gl_WorkGroupID.x;
+}
+
+// Sum of values of all invocations before this one in the workgroup.
+// NOTE: must be called from uniform control flow.
+#ifdef PRIMITIVES_SUBGROUPS
+
+uint block_exclusive_scan(uint value, out uint total)
+{
+  uint inclusive = subgroupInclusiveAdd(value);
+  if (gl_SubgroupInvocationID == gl_SubgroupSize - 1)
+    scanScratch[gl_SubgroupID] = inclusive;
+  barrier();
+
+  // There are only a few subgroups, so every invocation simply walks all of their totals
+  uint offset = 0;
+  total = 0;
+  for (uint i = 0; i < gl_NumSubgroups; ++i)
+  {
+    uint subgroupTotal = scanScratch[i];
+    offset += i < gl_SubgroupID ? subgroupTotal : 0;
+    total += subgroupTotal;
+  }
+  barrier();
+
+  return offset + inclusive - value;
+}
+
+uvec4 block_exclusive_scan(uvec4 value, out uvec4 total)
+{
+  uvec4 inclusive = subgroupInclusiveAdd(value);
+  if (gl_SubgroupInvocationID == gl_SubgroupSize - 1)
+    scanScratch4[gl_SubgroupID] = inclusive;
+  barrier();
+
+  uvec4 offset = uvec4(0);
+  total = uvec4(0);
+  for (uint i = 0; i < gl_NumSubgroups; ++i)
+  {
+    uvec4 subgroupTotal = scanScratch4[i];
+    offset += i < gl_SubgroupID ? subgroupTotal : uvec4(0);
+    total += subgroupTotal;
+  }
+  barrier();
+
+  return offset + inclusive - value;
+}
+
+#else
+
+uint block_exclusive_scan(uint value, out uint total)
+{
+  uint index = gl_LocalInvocationIndex;
+  scanScratch[index] = value;
+  barrier();
+
+  for (uint stride = 1; stride < PRIMITIVES_GROUP_SIZE; stride *= 2)
+  {
+    uint other = index >= stride ? scanScratch[index - stride] : 0;
+    barrier();
+    scanScratch[index] += other;
+    barrier();
+  }
+
+  uint inclusive = scanScratch[index];
+  total = scanScratch[PRIMITIVES_GROUP_SIZE - 1];
+  barrier();
+
+  return inclusive - value;
+}
+
+uvec4 block_exclusive_scan(uvec4 value, out uvec4 total)
+{
+  uint index = gl_LocalInvocationIndex;
+  scanScratch4[index] = value;
+  barrier();
+
+  for (uint stride = 1; stride < PRIMITIVES_GROUP_SIZE; stride *= 2)
+  {
+    uvec4 other = index >= stride ? scanScratch4[index - stride] : uvec4(0);
+    barrier();
+    scanScratch4[index] += other;
+    barrier();
+  }
+
+  uvec4 inclusive = scanScratch4[index];
+  total = scanScratch4[PRIMITIVES_GROUP_SIZE - 1];
+  barrier();
+
+  return inclusive - value;
+}
+
+#endif
+
+uint block_sum(uint value)
+{
+  uint total;
+  block_exclusive_scan(value, total);
+  return total;
+}
+
+#endif // PRIMITIVES_GLSL_INCLUDED
@@ -0,0 +1,93 @@
+#include "primitives.glsl"
+
+layout(std430, binding = 0) readonly buffer KeysIn
+{
+  uint keysIn[];
+};
+
+layout(std430, binding = 1) readonly buffer ValuesIn
+{
+  uint valuesIn[];
+};
+
+layout(std430, binding = 2) writeonly buffer KeysOut
+{
+  uint keysOut[];
+};
+
+layout(std430, binding = 3) writeonly buffer ValuesOut
+{
+  uint valuesOut[];
+};
+
+// Exclusive scan of primitives_radix_count.comp's output
+layout(std430, binding = 4) readonly buffer DigitOffsets
+{
+  uint digitOffsets[];
+};
+
+// Per-digit counters are packed two per component, as a block has fewer than 65536 elements
+struct DigitCounters
+{
+  uvec4 low;
+  uvec4 high;
+};
+
+
+uint get_counter(DigitCounters counters, uint digit)
+{
+  uvec4 pairs = digit < 8 ? counters.low : counters.high;
+  return (pairs[(digit / 2) % 4] >> (16 * (digit % 2))) & 0xFFFF;
+}
+
+void increment_counter(inout DigitCounters counters, uint digit)
+{
+  uvec4 increment = uvec4(0);
+  increment[(digit / 2) % 4] = 1u << (16 * (digit % 2));
+  if (digit < 8)
+    counters.low += increment;
+  else
+    counters.high += increment;
+}
+
+void main()
+{
+  uint group = group_index();
+  if (group >= params.groupCount)
+    return;
+
+  // Consecutive elements per invocation, ranks follow the input order and the sort is stable
+  uint first =
+    group * PRIMITIVES_BLOCK_SIZE + gl_LocalInvocationIndex * PRIMITIVES_ITEMS_PER_THREAD;
+
+  uint keys[PRIMITIVES_ITEMS_PER_THREAD];
+  uint ranks[PRIMITIVES_ITEMS_PER_THREAD];
+  DigitCounters counters = DigitCounters(uvec4(0), uvec4(0));
+  for (uint k = 0; k < PRIMITIVES_ITEMS_PER_THREAD; ++k)
+  {
+    if (first + k >= params.count)
+      continue;
+    keys[k] = keysIn[first + k];
+    uint digit = (keys[k] >> params.shift) & (PRIMITIVES_RADIX_SIZE - 1);
+    ranks[k] = get_counter(counters, digit);
+    increment_counter(counters, digit);
+  }
+
+  // Elements of the same digit in earlier invocations of the block
+  DigitCounters before;
+  uvec4 unused;
+  before.low = block_exclusive_scan(counters.low, unused);
+  before.high = block_exclusive_scan(counters.high, unused);
+
+  for (uint k = 0; k < PRIMITIVES_ITEMS_PER_THREAD; ++k)
+  {
+    if (first + k >= params.count)
+      continue;
+    uint digit = (keys[k] >> params.shift) & (PRIMITIVES_RADIX_SIZE - 1);
+    uint destination = digitOffsets[digit * params.groupCount + group] +
+      get_counter(before, digit) + ranks[k];
+    keysOut[destination] = keys[k];
+    if (params.hasValues)
+      valuesOut[destination] = valuesIn[first + k];
+  }
+}
@@ -0,0 +1,33 @@
+#include "primitives.glsl"
+
+layout(std430, binding = 0) readonly buffer Input
+{
+  uint inputData[];
+};
+
+// One partial sum per workgroup
+layout(std430, binding = 1) writeonly buffer Output
+{
+  uint outputData[];
+};
+
+
+void main()
+{
+  uint group = group_index();
+  if (group >= params.groupCount)
+    return;
+
+  // Strided, so that neighbouring invocations read neighbouring elements
+  uint sum = 0;
+  for (uint k = 0; k < PRIMITIVES_ITEMS_PER_THREAD; ++k)
+  {
+    uint i = group * PRIMITIVES_BLOCK_SIZE + k * PRIMITIVES_GROUP_SIZE + gl_LocalInvocationIndex;
+    if (i < params.count)
+      sum += inputData[i];
+  }
+
+  uint total = block_sum(sum);
+  if (gl_LocalInvocationIndex == 0)
+    outputData[group] = total;
+}
@@ -0,0 +1,50 @@
+#include "primitives.glsl"
+
+layout(std430, binding = 0) readonly buffer Input
+{
+  uint inputData[];
+};
+
+// Scanned within each block, primitives_scan_add.comp adds offsets of blocks afterwards
+layout(std430, binding = 1) writeonly buffer Output
+{
+  uint outputData[];
+};
+
+layout(std430, binding = 2) writeonly buffer BlockSums
+{
+  uint blockSums[];
+};
+
+
+void main()
+{
+  uint group = group_index();
+  if (group >= params.groupCount)
+    return;
+
+  // Every invocation owns consecutive elements, as their order matters here
+  uint first =
+    group * PRIMITIVES_BLOCK_SIZE + gl_LocalInvocationIndex * PRIMITIVES_ITEMS_PER_THREAD;
+
+  uint items[PRIMITIVES_ITEMS_PER_THREAD];
+  uint sum = 0;
+  for (uint k = 0; k < PRIMITIVES_ITEMS_PER_THREAD; ++k)
+  {
+    items[k] = first + k < params.count ? inputData[first + k] : 0;
+    sum += items[k];
+  }
+
+  uint total;
+  uint prefix = block_exclusive_scan(sum, total);
+
+  for (uint k = 0; k < PRIMITIVES_ITEMS_PER_THREAD; ++k)
+  {
+    if (first + k < params.count)
+      outputData[first + k] = prefix;
+    prefix += items[k];
+  }
+
+  if (gl_LocalInvocationIndex == 0)
+    blockSums[group] = total;
+}
@@ -0,0 +1,82 @@
+#include "CameraPath.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
+#include <etna/Assert.hpp>
+
+
+CameraPath CameraPath::load(const std::filesystem::path& path)
+{
+  std::ifstream file{path};
+  ETNA_VERIFYF(file.is_open(), "Unable to open camera path {}!", path.string());
+
+  std::vector<Keyframe> keyframes;
+  std::string line;
+  for (std::size_t lineIdx = 1; std::getline(file, line); ++lineIdx)
+  {
+    std::istringstream stream{line};
+
+    std::string first;
+    if (!(stream >> first) || first.front() == '#')
+      continue;
+
+    float time = 0;
+    glm::vec3 from;
+    glm::vec3 to;
+    stream.str(line);
+    stream.clear();
+    ETNA_VERIFYF(
+      stream >> time >> from.x >> from.y >> from.z >> to.x >> to.y >> to.z,
+      "Malformed keyframe at {}:{}!",
+      path.string(),
+      lineIdx);
+
+    Keyframe keyframe{.time = time, .camera = {}};
+    keyframe.camera.lookAt(from, to, {0, 1, 0});
+
+    float fov;
+    if (stream >> fov)
+      keyframe.camera.fov = fov;
+
+    keyframes.push_back(keyframe);
+  }
+
+  return CameraPath{std::move(keyframes)};
+}
+
+CameraPath::CameraPath(std::vector<Keyframe> a_keyframes)
+  : keyframes{std::move(a_keyframes)}
+{
+  ETNA_VERIFYF(!keyframes.empty(), "Camera path must have at least one keyframe!");
+  ETNA_VERIFYF(
+    std::is_sorted(
+      keyframes.begin(),
+      keyframes.end(),
+      [](const Keyframe& a, const Keyframe& b) { return a.time < b.time; }),
+    "Camera path keyframes must be sorted by time!");
+}
+
+Camera CameraPath::sample(float time) const
+{
+  if (time <= keyframes.front().time)
+    return keyframes.front().camera;
+  if (time >= keyframes.back().time)
+    return keyframes.back().camera;
+
+  const auto next = std::upper_bound(
+    keyframes.begin(), keyframes.end(), time, [](float t, const Keyframe& keyframe) {
+      return t < keyframe.time;
+    });
+  const auto& to = *next;
+  const auto& from = *(next - 1);
+
+  const float t = (time - from.time) / std::max(to.time - from.time, 1e-6f);
+
+  Camera result = from.camera;
+  result.position = glm::mix(from.camera.position, to.camera.position, t);
+  result.rotation = glm::slerp(from.camera.rotation, to.camera.rotation, t);
+  result.fov = glm::mix(from.camera.fov, to.camera.fov, t);
+  return result;
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <filesystem>
+#include <vector>
+
+#include "scene/Camera.hpp"
+
+
+/**
+ * Scripted camera movement for reproducible benchmarks. Keyframes are read from a
+ * text file, one per line: `time px py pz tx ty tz [fov]`, where t is the point the
+ * camera looks at. Empty lines and lines starting with # are ignored.
+ * Positions and fov are interpolated linearly, rotations are slerped.
+ */
+class CameraPath
+{
+public:
+  struct Keyframe
+  {
+    float time;
+    Camera camera;
+  };
+
+  static CameraPath load(const std::filesystem::path& path);
+
+  explicit CameraPath(std::vector<Keyframe> keyframes);
+
+  // Times outside of the path are clamped to its ends
+  Camera sample(float time) const;
+
+  float duration() const { return keyframes.back().time; }
+
+private:
+  std::vector<Keyframe> keyframes;
+};
@@ -0,0 +1,55 @@
+#include "CameraPathBenchmark.hpp"
+
+#include <chrono>
+
+#include <spdlog/spdlog.h>
+#include <tracy/Tracy.hpp>
+
+#include "render_utils/BenchmarkRecorder.hpp"
+#include "scene/CameraPath.hpp"
+
+
+CameraPathBenchmark::CameraPathBenchmark(CreateInfo create_info)
+  : info{std::move(create_info)}
+{
+}
+
+void CameraPathBenchmark::run(
+  const GpuTimestampProfiler& gpu_profiler, const DrawFrame& draw_frame) const
+{
+  const auto path = CameraPath::load(info.cameraPath);
+  const auto pathFrames = static_cast<std::uint32_t>(path.duration() / info.frameTime) + 1;
+  const std::uint32_t frameCount = info.warmupFrames + pathFrames;
+
+  spdlog::info("Benchmarking {} frames after {} warm-up frames", pathFrames, info.warmupFrames);
+
+  BenchmarkRecorder recorder;
+  std::uint64_t gpuResultsVersion = gpu_profiler.getResultsVersion();
+
+  auto lastFrameEnd = std::chrono::steady_clock::now();
+  for (std::uint32_t frame = 0; frame < frameCount; ++frame)
+  {
+    const bool warmup = frame < info.warmupFrames;
+    const float time =
+      warmup ? 0.0f : static_cast<float>(frame - info.warmupFrames) * info.frameTime;
+    if (!draw_frame(path.sample(time), time))
+      break;
+
+    const auto frameEnd = std::chrono::steady_clock::now();
+    // NOTE: GPU results lag behind by the number of frames in flight, so the
+    // first few of them after the warm-up actually belong to warm-up frames.
+    if (!warmup)
+    {
+      recorder.addCpuFrame(
+        std::chrono::duration<float, std::milli>(frameEnd - lastFrameEnd).count());
+      if (gpu_profiler.getResultsVersion() != gpuResultsVersion)
+        recorder.addGpuFrame(gpu_profiler.getResults());
+    }
+    gpuResultsVersion = gpu_profiler.getResultsVersion();
+    lastFrameEnd = frameEnd;
+
+    FrameMark;
+  }
+
+  recorder.write(info.output);
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+
+#include "render_utils/GpuTimestampProfiler.hpp"
+#include "scene/Camera.hpp"
+
+
+/**
+ * Replays a camera path frame by frame with a fixed time step and writes CPU frame time
+ * and per-zone GPU time statistics, see BenchmarkRecorder. Warm-up frames stand still at
+ * the beginning of the path and are not recorded. Drawing is up to the caller, so the same
+ * benchmark runs both with a window and headless.
+ */
+class CameraPathBenchmark
+{
+public:
+  struct CreateInfo
+  {
+    std::filesystem::path cameraPath;
+    std::uint32_t warmupFrames = 60;
+    // CSV or JSON, depending on the extension
+    std::filesystem::path output = "benchmark.csv";
+    float frameTime = 1.0f / 60.0f;
+  };
+
+  // Draws a single frame as seen by `camera` at `time`, returns false to stop early,
+  // e.g. when the window was closed
+  using DrawFrame = std::function<bool(const Camera& camera, float time)>;
+
+  explicit CameraPathBenchmark(CreateInfo info);
+
+  void run(const GpuTimestampProfiler& gpu_profiler, const DrawFrame& draw_frame) const;
+
+private:
+  CreateInfo info;
+};
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <array>
+#include <limits>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_access.hpp>
+
+
+// Axis-aligned bounding box. Default-constructed boxes are empty.
+struct BoundingBox
+{
+  glm::vec3 min{std::numeric_limits<float>::max()};
+  glm::vec3 max{std::numeric_limits<float>::lowest()};
+
+  bool isEmpty() const { return min.x > max.x || min.y > max.y || min.z > max.z; }
+
+  void extend(glm::vec3 point)
+  {
+    min = glm::min(min, point);
+    max = glm::max(max, point);
+  }
+
+  void extend(const BoundingBox& other)
+  {
+    min = glm::min(min, other.min);
+    max = glm::max(max, other.max);
+  }
+
+  // Returns a box containing this one after being transformed by an affine matrix
+  BoundingBox transformed(const glm::mat4x4& tm) const
+  {
+    if (isEmpty())
+      return *this;
+
+    const glm::vec3 center = glm::vec3(tm * glm::vec4((min + max) * 0.5f, 1.0f));
+    const glm::vec3 extent = (max - min) * 0.5f;
+
+    // Projecting the extents onto the new axes is
+    // cheaper than transforming all 8 corners of the box.
+    const glm::mat3x3 absTm{
+      glm::abs(glm::vec3(tm[0])), glm::abs(glm::vec3(tm[1])), glm::abs(glm::vec3(tm[2]))};
+    const glm::vec3 newExtent = absTm * extent;
+
+    return BoundingBox{.min = center - newExtent, .max = center + newExtent};
+  }
+};
+
+struct Frustum
+{
+  // Plane equations (normal, offset), normals point inside of the frustum.
+  // NOTE: the planes are not normalized, as we only ever care about signs.
+  std::array<glm::vec4, 6> planes;
+
+  // Extracts the planes from a projection-view matrix with
+  // vulkan-style clip space, i.e. 0 <= z <= w.
+  static Frustum fromMatrix(const glm::mat4x4& proj_view)
+  {
+    const glm::vec4 x = glm::row(proj_view, 0);
+    const glm::vec4 y = glm::row(proj_view, 1);
+    const glm::vec4 z = glm::row(proj_view, 2);
+    const glm::vec4 w = glm::row(proj_view, 3);
+
+    return Frustum{.planes = {w + x, w - x, w + y, w - y, z, w - z}};
+  }
+
+  // Conservative test, might return true for boxes that are slightly outside
+  bool intersects(const BoundingBox& box) const
+  {
+    if (box.isEmpty())
+      return false;
+
+    const glm::vec3 center = (box.min + box.max) * 0.5f;
+    const glm::vec3 extent = (box.max - box.min) * 0.5f;
+
+    for (const auto& plane : planes)
+    {
+      const glm::vec3 normal{plane};
+      // Distance from the center to the plane plus the "radius" of the box along the normal
+      if (glm::dot(normal, center) + plane.w + glm::dot(glm::abs(normal), extent) < 0)
+        return false;
+    }
+
+    return true;
+  }
+};
@@ -1,19 +1,40 @@
 #include "SceneManager.hpp"
 
 #include <stack>
+#include <algorithm>
+#include <cstring>
+#include <map>
 
 #include <spdlog/spdlog.h>
 #include <fmt/std.h>
 #include <glm/ext/matrix_transform.hpp>
 #include <glm/gtc/quaternion.hpp>
+#include <glm/gtc/matrix_access.hpp>
+#include <glm/gtc/matrix_inverse.hpp>
 #include <etna/GlobalContext.hpp>
 #include <etna/OneShotCmdMgr.hpp>
 
 
+// Images are loaded by the renderer on its own schedule, tinygltf only has to keep their URIs
+static bool skip_image_decoding(
+  tinygltf::Image*,
+  const int,
+  std::string*,
+  std::string*,
+  int,
+  int,
+  const unsigned char*,
+  int,
+  void*)
+{
+  return true;
+}
+
 SceneManager::SceneManager()
   : oneShotCommands{etna::get_context().createOneShotCmdMgr()}
   , transferHelper{etna::BlockingTransferHelper::CreateInfo{.stagingSize = 4096 * 4096 * 4}}
 {
+  loader.SetImageLoader(skip_image_decoding, nullptr);
 }
 
 std::optional<tinygltf::Model> SceneManager::loadModel(std::filesystem::path path)
@@ -48,7 +69,9 @@ std::optional<tinygltf::Model> SceneManager::loadModel(std::filesystem::path pat
 
   if (
     !model.extensions.empty() || !model.extensionsRequired.empty() || !model.extensionsUsed.empty())
-    spdlog::warn("glTF: No glTF extensions are currently implemented!");
+    spdlog::warn(
+      "glTF: No glTF extensions are currently implemented, "
+      "except for the diffuse part of KHR_materials_pbrSpecularGlossiness!");
 
   return model;
 }
@@ -133,6 +156,21 @@ SceneManager::ProcessedInstances SceneManager::processInstances(const tinygltf::
   return result;
 }
 
+static InstanceTransform make_instance_transform(const glm::mat4x4& model)
+{
+  // Inverting a matrix is quite expensive, so we do it once here instead of
+  // doing it for every vertex in the vertex shader.
+  const glm::mat3x3 normalMatrix = glm::inverseTranspose(glm::mat3x3(model));
+
+  InstanceTransform result;
+  for (int i = 0; i < 3; ++i)
+  {
+    result.modelRows[i] = glm::row(model, i);
+    result.normalRows[i] = glm::vec4(glm::row(normalMatrix, i), 0);
+  }
+  return result;
+}
+
 static std::uint32_t encode_normal(glm::vec3 normal)
 {
   const std::int32_t x = static_cast<std::int32_t>(normal.x * 32767.0f);
@@ -234,10 +272,15 @@ SceneManager::ProcessedMeshes SceneManager::processMeshes(const tinygltf::Model&
         hasTexcoord ? &model.bufferViews[accessors[4]->bufferView] : nullptr,
       };
 
+      // The default material goes after all materials of the model
+      const auto material = static_cast<std::uint32_t>(
+        prim.material >= 0 ? static_cast<std::size_t>(prim.material) : model.materials.size());
+
       result.relems.push_back(RenderElement{
         .vertexOffset = static_cast<std::uint32_t>(result.vertices.size()),
         .indexOffset = static_cast<std::uint32_t>(result.indices.size()),
         .indexCount = static_cast<std::uint32_t>(accessors[0]->count),
+        .material = material,
       });
 
       const std::size_t vertexCount = accessors[1]->count;
@@ -309,9 +352,11 @@ SceneManager::ProcessedMeshes SceneManager::processMeshes(const tinygltf::Model&
           std::memcpy(&texcoord, ptrs[4], sizeof(texcoord));
 
 
+        result.meshes.back().bounds.extend(pos);
+
         vtx.positionAndNormal = glm::vec4(pos, std::bit_cast<float>(encode_normal(normal)));
-        vtx.texCoordAndTangentAndPadding =
-          glm::vec4(texcoord, std::bit_cast<float>(encode_normal(tangent)), 0);
+        vtx.texCoordAndTangentAndPadding = glm::vec4(
+          texcoord, std::bit_cast<float>(encode_normal(tangent)), std::bit_cast<float>(material));
 
         ptrs[1] += strides[1];
         if (hasNormals)
@@ -350,8 +395,91 @@ SceneManager::ProcessedMeshes SceneManager::processMeshes(const tinygltf::Model&
   return result;
 }
 
+SceneManager::ProcessedMaterials SceneManager::processMaterials(
+  const tinygltf::Model& model, const std::filesystem::path& base_dir) const
+{
+  ProcessedMaterials result;
+  result.materials.reserve(model.materials.size() + 1);
+
+  // Materials often share images, so every image gets a single slot per color space
+  std::map<std::pair<int, bool>, std::uint32_t> slots;
+  const auto textureSlot = [&](int texture_idx, bool srgb) -> std::uint32_t {
+    if (texture_idx < 0 || static_cast<std::size_t>(texture_idx) >= model.textures.size())
+      return MATERIAL_NO_TEXTURE;
+
+    const int source = model.textures[texture_idx].source;
+    if (source < 0)
+      return MATERIAL_NO_TEXTURE;
+
+    if (auto it = slots.find({source, srgb}); it != slots.end())
+      return it->second;
+
+    const auto& image = model.images[source];
+    std::uint32_t slot = MATERIAL_NO_TEXTURE;
+    if (image.uri.empty() || image.uri.starts_with("data:"))
+      spdlog::warn("glTF: Image {} is embedded into the model, this is not supported!", source);
+    else if (result.textures.size() + 1 >= MAX_MATERIAL_TEXTURES)
+      spdlog::warn("glTF: Too many textures, '{}' is left out!", image.uri);
+    else
+    {
+      result.textures.push_back(MaterialTexture{.path = base_dir / image.uri, .srgb = srgb});
+      slot = static_cast<std::uint32_t>(result.textures.size());
+    }
+
+    slots.emplace(std::pair{source, srgb}, slot);
+    return slot;
+  };
+
+  for (const auto& material : model.materials)
+  {
+    const auto& pbr = material.pbrMetallicRoughness;
+
+    Material entry{
+      .baseColorFactor = {},
+      .baseColorTexture = textureSlot(pbr.baseColorTexture.index, true),
+      .metallicFactor = static_cast<float>(pbr.metallicFactor),
+      .roughnessFactor = static_cast<float>(pbr.roughnessFactor),
+      .padding = 0,
+    };
+    for (glm::length_t i = 0; i < 4; ++i)
+      entry.baseColorFactor[i] = static_cast<float>(pbr.baseColorFactor[i]);
+
+    // Older assets use the specular-glossiness workflow, its diffuse is close enough to base color
+    const auto specGloss = material.extensions.find("KHR_materials_pbrSpecularGlossiness");
+    if (specGloss != material.extensions.end())
+    {
+      const auto& ext = specGloss->second;
+      if (ext.Has("diffuseFactor"))
+      {
+        const auto& factor = ext.Get("diffuseFactor");
+        for (glm::length_t i = 0; i < 4 && static_cast<std::size_t>(i) < factor.ArrayLen(); ++i)
+          entry.baseColorFactor[i] = static_cast<float>(factor.Get(i).GetNumberAsDouble());
+      }
+      if (ext.Has("diffuseTexture"))
+        entry.baseColorTexture =
+          textureSlot(ext.Get("diffuseTexture").Get("index").GetNumberAsInt(), true);
+    }
+
+    result.materials.push_back(entry);
+  }
+
+  // Used by primitives without a material
+  result.materials.push_back(Material{
+    .baseColorFactor = glm::vec4{1},
+    .baseColorTexture = MATERIAL_NO_TEXTURE,
+    .metallicFactor = 0,
+    .roughnessFactor = 1,
+    .padding = 0,
+  });
+
+  return result;
+}
+
 void SceneManager::uploadData(
-  std::span<const Vertex> vertices, std::span<const std::uint32_t> indices)
+  std::span<const Vertex> vertices,
+  std::span<const std::uint32_t> indices,
+  std::span<const InstanceTransform> transforms,
+  std::span<const Material> materials)
 {
   unifiedVbuf = etna::get_context().createBuffer(etna::Buffer::CreateInfo{
     .size = vertices.size_bytes(),
@@ -367,8 +495,25 @@ void SceneManager::uploadData(
     .name = "unifiedIbuf",
   });
 
+  instanceTransformsBuf = etna::get_context().createBuffer(etna::Buffer::CreateInfo{
+    .size = transforms.size_bytes(),
+    .bufferUsage = vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eStorageBuffer,
+    .memoryUsage = VMA_MEMORY_USAGE_GPU_ONLY,
+    .name = "instanceTransforms",
+  });
+
+  materialsBuf = etna::get_context().createBuffer(etna::Buffer::CreateInfo{
+    .size = materials.size_bytes(),
+    .bufferUsage = vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eStorageBuffer,
+    .memoryUsage = VMA_MEMORY_USAGE_GPU_ONLY,
+    .name = "materials",
+  });
+
   transferHelper.uploadBuffer<Vertex>(*oneShotCommands, unifiedVbuf, 0, vertices);
   transferHelper.uploadBuffer<std::uint32_t>(*oneShotCommands, unifiedIbuf, 0, indices);
+  transferHelper.uploadBuffer<InstanceTransform>(
+    *oneShotCommands, instanceTransformsBuf, 0, transforms);
+  transferHelper.uploadBuffer<Material>(*oneShotCommands, materialsBuf, 0, materials);
 }
 
 void SceneManager::selectScene(std::filesystem::path path)
@@ -393,7 +538,105 @@ void SceneManager::selectScene(std::filesystem::path path)
   renderElements = std::move(relems);
   meshes = std::move(meshs);
 
-  uploadData(verts, inds);
+  auto [mats, textures] = processMaterials(model, path.parent_path());
+  materials = std::move(mats);
+  materialTextures = std::move(textures);
+
+  instanceTransforms.clear();
+  instanceTransforms.reserve(instanceMatrices.size());
+  instanceBounds.clear();
+  instanceBounds.reserve(instanceMatrices.size());
+  for (std::size_t i = 0; i < instanceMatrices.size(); ++i)
+  {
+    instanceTransforms.push_back(make_instance_transform(instanceMatrices[i]));
+    instanceBounds.push_back(meshes[instanceMeshes[i]].bounds.transformed(instanceMatrices[i]));
+  }
+
+  instanceDynamic.assign(instanceMatrices.size(), false);
+  dynamicInstanceCount = 0;
+  dirtyInstances.clear();
+  ++staticGeometryVersion;
+
+  uploadData(verts, inds, instanceTransforms, materials);
+}
+
+void SceneManager::setInstanceMatrix(std::size_t instance_idx, const glm::mat4x4& matrix)
+{
+  instanceMatrices[instance_idx] = matrix;
+  instanceTransforms[instance_idx] = make_instance_transform(matrix);
+  instanceBounds[instance_idx] =
+    meshes[instanceMeshes[instance_idx]].bounds.transformed(matrix);
+
+  if (!instanceDynamic[instance_idx])
+  {
+    // The instance leaves the static set, so static caches become invalid
+    instanceDynamic[instance_idx] = true;
+    ++dynamicInstanceCount;
+    ++staticGeometryVersion;
+  }
+
+  dirtyInstances.push_back(static_cast<std::uint32_t>(instance_idx));
+}
+
+void SceneManager::flushInstanceUpdates(vk::CommandBuffer cmd_buf, FrameRingAllocator& ring)
+{
+  if (dirtyInstances.empty())
+    return;
+
+  std::sort(dirtyInstances.begin(), dirtyInstances.end());
+  dirtyInstances.erase(
+    std::unique(dirtyInstances.begin(), dirtyInstances.end()), dirtyInstances.end());
+
+  // Transforms are staged in this frame's part of the ring, so
+  // we never touch memory that previous frames might still be reading.
+  auto staging = ring.allocateStaging(dirtyInstances.size() * sizeof(InstanceTransform));
+
+  std::vector<vk::BufferCopy> regions;
+  regions.reserve(dirtyInstances.size());
+  for (std::size_t i = 0; i < dirtyInstances.size(); ++i)
+  {
+    const auto idx = dirtyInstances[i];
+    std::memcpy(
+      staging.data + i * sizeof(InstanceTransform),
+      &instanceTransforms[idx],
+      sizeof(InstanceTransform));
+    regions.push_back(vk::BufferCopy{
+      .srcOffset = staging.offset + i * sizeof(InstanceTransform),
+      .dstOffset = idx * sizeof(InstanceTransform),
+      .size = sizeof(InstanceTransform),
+    });
+  }
+
+  // Previous frames might still be reading the transforms
+  {
+    vk::MemoryBarrier2 barrier{
+      .srcStageMask = vk::PipelineStageFlagBits2::eVertexShader,
+      .srcAccessMask = vk::AccessFlagBits2::eShaderStorageRead,
+      .dstStageMask = vk::PipelineStageFlagBits2::eTransfer,
+      .dstAccessMask = vk::AccessFlagBits2::eTransferWrite,
+    };
+    cmd_buf.pipelineBarrier2(vk::DependencyInfo{
+      .memoryBarrierCount = 1,
+      .pMemoryBarriers = &barrier,
+    });
+  }
+
+  cmd_buf.copyBuffer(staging.buffer, instanceTransformsBuf.get(), regions);
+
+  {
+    vk::MemoryBarrier2 barrier{
+      .srcStageMask = vk::PipelineStageFlagBits2::eTransfer,
+      .srcAccessMask = vk::AccessFlagBits2::eTransferWrite,
+      .dstStageMask = vk::PipelineStageFlagBits2::eVertexShader,
+      .dstAccessMask = vk::AccessFlagBits2::eShaderStorageRead,
+    };
+    cmd_buf.pipelineBarrier2(vk::DependencyInfo{
+      .memoryBarrierCount = 1,
+      .pMemoryBarriers = &barrier,
+    });
+  }
+
+  dirtyInstances.clear();
 }
 
 etna::VertexByteStreamFormatDescription SceneManager::getVertexFormatDescription()
@@ -8,6 +8,11 @@
 #include <etna/BlockingTransferHelper.hpp>
 #include <etna/VertexInput.hpp>
 
+#include "InstanceTransform.h"
+#include "Material.h"
+#include "render_utils/FrameRingAllocator.hpp"
+#include "scene/Frustum.hpp"
+
 
 // A single render element (relem) corresponds to a single draw call
 // of a certain pipeline with specific bindings (including material data)
@@ -16,8 +21,17 @@ struct RenderElement
   std::uint32_t vertexOffset;
   std::uint32_t indexOffset;
   std::uint32_t indexCount;
-  // Not implemented!
-  // Material* material;
+  // Index into the material table, shaders get it from the vertices
+  std::uint32_t material;
+};
+
+// A texture referenced by materials. Texture i of the scene goes
+// to slot i + 1 of the texture array, see MATERIAL_NO_TEXTURE.
+struct MaterialTexture
+{
+  std::filesystem::path path;
+  // Color textures are sRGB, data textures are linear
+  bool srgb;
 };
 
 // A mesh is a collection of relems. A scene may have the same mesh
@@ -27,6 +41,8 @@ struct Mesh
 {
   std::uint32_t firstRelem;
   std::uint32_t relemCount;
+  // In the mesh's local space
+  BoundingBox bounds;
 };
 
 class SceneManager
@@ -41,12 +57,43 @@ public:
   std::span<const glm::mat4x4> getInstanceMatrices() { return instanceMatrices; }
   std::span<const std::uint32_t> getInstanceMeshes() { return instanceMeshes; }
 
+  // Precomputed per-instance transforms, both on the CPU and in a GPU storage buffer.
+  // Index this buffer with the instance index in shaders.
+  std::span<const InstanceTransform> getInstanceTransforms() { return instanceTransforms; }
+  const etna::Buffer& getInstanceTransformBuffer() { return instanceTransformsBuf; }
+
+  // World space bounds of every instance, recomputed when instances move
+  std::span<const BoundingBox> getInstanceBounds() { return instanceBounds; }
+
+  // Moves an instance. Instances that were moved at least once are considered
+  // dynamic, all other ones are static and can be cached by the renderer.
+  // NOTE: the GPU copy of the transform is only updated by flushInstanceUpdates.
+  void setInstanceMatrix(std::size_t instance_idx, const glm::mat4x4& matrix);
+  bool isInstanceDynamic(std::size_t instance_idx) const { return instanceDynamic[instance_idx]; }
+  bool hasDynamicInstances() const { return dynamicInstanceCount > 0; }
+
+  // Changes every time the set of static instances changes, e.g. when
+  // a new scene is loaded. Caches of static geometry should compare against it.
+  std::uint64_t getStaticGeometryVersion() const { return staticGeometryVersion; }
+
+  // Records copies of transforms changed since the last call into the GPU buffer,
+  // the data is staged through the ring. Must be called outside of a render pass
+  // before any draws that use the transforms.
+  void flushInstanceUpdates(vk::CommandBuffer cmd_buf, FrameRingAllocator& ring);
+
   // Every mesh is a collection of relems
   std::span<const Mesh> getMeshes() { return meshes; }
 
   // Every relem is a single draw call
   std::span<const RenderElement> getRenderElements() { return renderElements; }
 
+  // Materials of the scene, the last one is the default for primitives without a material
+  std::span<const Material> getMaterials() { return materials; }
+  const etna::Buffer& getMaterialBuffer() { return materialsBuf; }
+
+  // Textures are only referenced by path, loading them is up to the renderer
+  std::span<const MaterialTexture> getMaterialTextures() { return materialTextures; }
+
   vk::Buffer getVertexBuffer() { return unifiedVbuf.get(); }
   vk::Buffer getIndexBuffer() { return unifiedIbuf.get(); }
 
@@ -67,7 +114,7 @@ private:
   {
     // First 3 floats are position, 4th float is a packed normal
     glm::vec4 positionAndNormal;
-    // First 2 floats are tex coords, 3rd is a packed tangent, 4th is padding
+    // First 2 floats are tex coords, 3rd is a packed tangent, 4th is the material index
     glm::vec4 texCoordAndTangentAndPadding;
   };
 
@@ -81,7 +128,20 @@ private:
     std::vector<Mesh> meshes;
   };
   ProcessedMeshes processMeshes(const tinygltf::Model& model) const;
-  void uploadData(std::span<const Vertex> vertices, std::span<const std::uint32_t>);
+
+  struct ProcessedMaterials
+  {
+    std::vector<Material> materials;
+    std::vector<MaterialTexture> textures;
+  };
+  ProcessedMaterials processMaterials(
+    const tinygltf::Model& model, const std::filesystem::path& base_dir) const;
+
+  void uploadData(
+    std::span<const Vertex> vertices,
+    std::span<const std::uint32_t> indices,
+    std::span<const InstanceTransform> transforms,
+    std::span<const Material> materials);
 
 private:
   tinygltf::TinyGLTF loader;
@@ -90,9 +150,19 @@ private:
 
   std::vector<RenderElement> renderElements;
   std::vector<Mesh> meshes;
+  std::vector<Material> materials;
+  std::vector<MaterialTexture> materialTextures;
   std::vector<glm::mat4x4> instanceMatrices;
   std::vector<std::uint32_t> instanceMeshes;
+  std::vector<InstanceTransform> instanceTransforms;
+  std::vector<BoundingBox> instanceBounds;
+  std::vector<bool> instanceDynamic;
+  std::size_t dynamicInstanceCount = 0;
+  std::vector<std::uint32_t> dirtyInstances;
+  std::uint64_t staticGeometryVersion = 0;
 
   etna::Buffer unifiedVbuf;
   etna::Buffer unifiedIbuf;
+  etna::Buffer instanceTransformsBuf;
+  etna::Buffer materialsBuf;
 };
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+
+/**
+ * Lock-free single producer, single consumer triple buffer. The producer always
+ * has a buffer to write into and never waits, the consumer always gets the most
+ * recently published value and never waits either. Values published in between
+ * two reads are silently dropped, which is exactly what we want for passing
+ * "latest state of the world" from one thread to another.
+ */
+template <class T>
+class TripleBuffer
+{
+public:
+  TripleBuffer() = default;
+
+  // Initializes all three buffers, e.g. so that the consumer has something to read right away
+  explicit TripleBuffer(const T& initial)
+    : buffers{initial, initial, initial}
+  {
+  }
+
+  TripleBuffer(const TripleBuffer&) = delete;
+  TripleBuffer& operator=(const TripleBuffer&) = delete;
+
+  // Producer side. The buffer is owned by the producer until publish is called.
+  T& writeBuffer() { return buffers[writeIndex]; }
+
+  void publish()
+  {
+    const std::uint8_t previous =
+      middle.exchange(static_cast<std::uint8_t>(writeIndex | FRESH_BIT), std::memory_order_acq_rel);
+    writeIndex = static_cast<std::uint8_t>(previous & INDEX_MASK);
+  }
+
+  // Consumer side. Returns true if something new was published since the last call,
+  // otherwise the read buffer stays the same.
+  bool acquireLatest()
+  {
+    if ((middle.load(std::memory_order_relaxed) & FRESH_BIT) == 0)
+      return false;
+
+    const std::uint8_t previous = middle.exchange(readIndex, std::memory_order_acq_rel);
+    readIndex = static_cast<std::uint8_t>(previous & INDEX_MASK);
+    return true;
+  }
+
+  const T& readBuffer() const { return buffers[readIndex]; }
+
+private:
+  static constexpr std::uint8_t INDEX_MASK = 0b011;
+  // Set when the middle buffer contains a value that the consumer hasn't seen yet
+  static constexpr std::uint8_t FRESH_BIT = 0b100;
+
+  std::array<T, 3> buffers{};
+
+  // Owned by the producer
+  std::uint8_t writeIndex = 0;
+  // The only index touched by both threads
+  std::atomic<std::uint8_t> middle{1};
+  // Owned by the consumer
+  std::uint8_t readIndex = 2;
+};
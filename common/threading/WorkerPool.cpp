@@ -0,0 +1,94 @@
+#include "WorkerPool.hpp"
+
+#include <algorithm>
+
+#include <tracy/Tracy.hpp>
+
+
+WorkerPool::WorkerPool(std::size_t thread_count)
+{
+  if (thread_count == 0)
+    thread_count = std::max(std::thread::hardware_concurrency(), 1u);
+
+  workers.reserve(thread_count - 1);
+  for (std::size_t i = 1; i < thread_count; ++i)
+    workers.emplace_back([this, i]() { workerLoop(i); });
+}
+
+WorkerPool::~WorkerPool()
+{
+  {
+    std::lock_guard lock{mutex};
+    stopping = true;
+  }
+  wakeUp.notify_all();
+
+  for (auto& worker : workers)
+    worker.join();
+}
+
+void WorkerPool::parallelFor(std::size_t task_count, Job job)
+{
+  ZoneScoped;
+
+  if (task_count == 0)
+    return;
+
+  // Not worth waking anyone up
+  if (task_count == 1 || workers.empty())
+  {
+    for (std::size_t i = 0; i < task_count; ++i)
+      job(i, 0);
+    return;
+  }
+
+  {
+    std::lock_guard lock{mutex};
+    currentJob = &job;
+    taskCount = task_count;
+    nextTask.store(0, std::memory_order_relaxed);
+    busyWorkers = workers.size();
+    ++generation;
+  }
+  wakeUp.notify_all();
+
+  runTasks(0);
+
+  std::unique_lock lock{mutex};
+  allDone.wait(lock, [this]() { return busyWorkers == 0; });
+  currentJob = nullptr;
+}
+
+void WorkerPool::workerLoop(std::size_t thread_index)
+{
+  std::uint64_t seenGeneration = 0;
+
+  while (true)
+  {
+    {
+      std::unique_lock lock{mutex};
+      wakeUp.wait(lock, [&]() { return stopping || generation != seenGeneration; });
+      if (stopping)
+        return;
+      seenGeneration = generation;
+    }
+
+    runTasks(thread_index);
+
+    bool last = false;
+    {
+      std::lock_guard lock{mutex};
+      last = --busyWorkers == 0;
+    }
+    if (last)
+      allDone.notify_one();
+  }
+}
+
+void WorkerPool::runTasks(std::size_t thread_index)
+{
+  // Tasks are handed out one by one, so threads that got cheap tasks pick up more of them
+  for (std::size_t task = nextTask.fetch_add(1, std::memory_order_relaxed); task < taskCount;
+       task = nextTask.fetch_add(1, std::memory_order_relaxed))
+    (*currentJob)(task, thread_index);
+}
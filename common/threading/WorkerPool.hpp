@@ -0,0 +1,61 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <function2/function2.hpp>
+
+
+/**
+ * A fixed set of threads for fork-join style parallelism. The thread that calls
+ * parallelFor participates in the work too, so it always gets thread index 0,
+ * while worker threads get indices 1..threadCount()-1. Indices are stable, which
+ * allows keeping per-thread resources (e.g. command pools) in a plain array.
+ */
+class WorkerPool
+{
+public:
+  // 0 means "one thread per hardware core"
+  explicit WorkerPool(std::size_t thread_count = 0);
+  ~WorkerPool();
+
+  WorkerPool(const WorkerPool&) = delete;
+  WorkerPool& operator=(const WorkerPool&) = delete;
+
+  WorkerPool(WorkerPool&&) = delete;
+  WorkerPool& operator=(WorkerPool&&) = delete;
+
+  // Including the calling thread
+  std::size_t threadCount() const { return workers.size() + 1; }
+
+  using Job = fu2::function_view<void(std::size_t task_index, std::size_t thread_index) const>;
+
+  // Runs job for every task index in [0, task_count) and blocks until all of them are done.
+  // NOTE: must not be called concurrently or from inside of a job.
+  void parallelFor(std::size_t task_count, Job job);
+
+private:
+  void workerLoop(std::size_t thread_index);
+  void runTasks(std::size_t thread_index);
+
+private:
+  std::vector<std::thread> workers;
+
+  std::mutex mutex;
+  std::condition_variable wakeUp;
+  std::condition_variable allDone;
+
+  // Everything below is protected by the mutex, except for the atomics
+  std::uint64_t generation = 0;
+  bool stopping = false;
+  std::size_t busyWorkers = 0;
+
+  // Points to parallelFor's argument, only valid while it runs
+  const Job* currentJob = nullptr;
+  std::size_t taskCount = 0;
+  std::atomic<std::size_t> nextTask{0};
+};
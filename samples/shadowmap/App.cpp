@@ -1,18 +1,57 @@
 #include "App.hpp"
 
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+#include <thread>
+
 #include <tracy/Tracy.hpp>
 
 #include "gui/ImGuiRenderer.hpp"
+#include "scene/CameraPathBenchmark.hpp"
+
+
+// In threaded mode there's no point in simulating much faster than we can possibly render
+static constexpr auto SIMULATION_TICK = std::chrono::microseconds{1'000'000 / 240};
 
+static constexpr float FIXED_FRAME_TIME = 1.0f / 60.0f;
+
+static std::uint64_t pack_resolution(glm::uvec2 res)
+{
+  return (static_cast<std::uint64_t>(res.x) << 32) | res.y;
+}
 
-App::App()
+static glm::uvec2 unpack_resolution(std::uint64_t packed)
 {
-  glm::uvec2 initialRes = {1280, 720};
-  mainWindow = windowing.createWindow(OsWindow::CreateInfo{
+  return {static_cast<std::uint32_t>(packed >> 32), static_cast<std::uint32_t>(packed)};
+}
+
+App::App(Options app_options)
+  : options{std::move(app_options)}
+{
+  if (options.headless)
+    initHeadless();
+  else
+    initWindowed();
+
+  initScene();
+}
+
+void App::initWindowed()
+{
+  windowing = std::make_unique<OsWindowingManager>();
+
+  const glm::uvec2 initialRes = options.resolution;
+  windowResolution = pack_resolution(initialRes);
+  mainWindow = windowing->createWindow(OsWindow::CreateInfo{
     .resolution = initialRes,
     .resizeable = true,
     .refreshCb =
       [this]() {
+        // The render thread keeps drawing on its own while the window is being resized
+        if (options.threaded)
+          return;
+
         // NOTE: this is only called when the window is being resized.
         drawFrame();
         FrameMark;
@@ -22,24 +61,53 @@ App::App()
         if (res.x == 0 || res.y == 0)
           return;
 
+        if (options.threaded)
+        {
+          windowResolution = pack_resolution(res);
+          resizeRequested = true;
+          return;
+        }
+
         renderer->recreateSwapchain(res);
       },
   });
 
   renderer.reset(new Renderer(initialRes));
 
-  auto instExts = windowing.getRequiredVulkanInstanceExtensions();
+  auto instExts = windowing->getRequiredVulkanInstanceExtensions();
   renderer->initVulkan(instExts);
+  if (!options.pipelineCachePath.empty())
+    renderer->initPipelineCache(options.pipelineCachePath);
 
   auto surface = mainWindow->createVkSurface(etna::get_context().getInstance());
 
+  // NOTE: in threaded mode, the resolution is queried from the render thread,
+  // while the window is only updated on the main thread.
+  // Frame times of a benchmark capped by the display refresh rate would be meaningless
+  const bool vsync = options.benchmarkPath.empty();
   renderer->initFrameDelivery(
-    std::move(surface), [window = mainWindow.get()]() { return window->getResolution(); });
+    std::move(surface),
+    [this]() {
+      return options.threaded ? unpack_resolution(windowResolution) : mainWindow->getResolution();
+    },
+    vsync);
 
   // TODO: this is bad design, this initialization is dependent on the current ImGui context, but we
   // pass it implicitly here instead of explicitly. Beware if trying to do something tricky.
   ImGuiRenderer::enableImGuiForWindow(mainWindow->native());
+}
+
+void App::initHeadless()
+{
+  renderer.reset(new Renderer(options.resolution));
+  renderer->initVulkan({}, true);
+  if (!options.pipelineCachePath.empty())
+    renderer->initPipelineCache(options.pipelineCachePath);
+  renderer->initHeadlessFrameDelivery();
+}
 
+void App::initScene()
+{
   shadowCam.lookAt({-8, 10, 8}, {0, 0, 0}, {0, 1, 0});
   mainCam.lookAt({0, 10, 10}, {0, 0, 0}, {0, 1, 0});
 
@@ -48,23 +116,167 @@ App::App()
 
 void App::run()
 {
-  double lastTime = windowing.getTime();
+  if (!options.benchmarkPath.empty())
+    runBenchmark();
+  else if (options.headless)
+    runHeadless();
+  else if (options.threaded)
+    runThreaded();
+  else
+    runSingleThreaded();
+}
+
+void App::runSingleThreaded()
+{
+  double lastTime = windowing->getTime();
   while (!mainWindow->isBeingClosed())
   {
-    const double currTime = windowing.getTime();
+    const double currTime = windowing->getTime();
     const float diffTime = static_cast<float>(currTime - lastTime);
     lastTime = currTime;
 
-    windowing.poll();
+    windowing->poll();
+    lastPollTime = std::chrono::steady_clock::now();
 
     processInput(diffTime);
 
+    simFrameTimeMs = std::chrono::duration<float, std::milli>(
+                       std::chrono::steady_clock::now() - lastPollTime)
+                       .count();
+
     drawFrame();
 
     FrameMark;
   }
 }
 
+void App::runThreaded()
+{
+  // The render thread must have something to draw right away
+  ImGuiRenderer::nextPlatformFrame();
+  lastPollTime = std::chrono::steady_clock::now();
+  packets.writeBuffer() = makePacket();
+  packets.publish();
+
+  std::atomic<bool> stop{false};
+  std::thread renderThread([this, &stop]() { renderThreadLoop(stop); });
+
+  double lastTime = windowing->getTime();
+  while (!mainWindow->isBeingClosed())
+  {
+    const auto tickStart = std::chrono::steady_clock::now();
+
+    const double currTime = windowing->getTime();
+    const float diffTime = static_cast<float>(currTime - lastTime);
+    lastTime = currTime;
+
+    {
+      std::lock_guard lock{guiMutex};
+      windowing->poll();
+      // GLFW may only be used from the main thread, so this half of the ImGui frame is
+      // done here. Input reaches ImGui as events queued into its IO, and the render
+      // thread consumes them when it starts its next GUI frame.
+      ImGuiRenderer::nextPlatformFrame();
+    }
+    lastPollTime = std::chrono::steady_clock::now();
+
+    processInput(diffTime);
+
+    packets.writeBuffer() = makePacket();
+    packets.publish();
+
+    simFrameTimeMs =
+      std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - tickStart)
+        .count();
+
+    FrameMarkNamed("Simulation");
+
+    std::this_thread::sleep_until(tickStart + SIMULATION_TICK);
+  }
+
+  stop = true;
+  renderThread.join();
+}
+
+void App::renderThreadLoop(const std::atomic<bool>& stop)
+{
+  tracy::SetThreadName("Render");
+
+  std::vector<Keyboard> debugInput;
+  while (!stop)
+  {
+    // If nothing new was published, we simply draw the same packet once again
+    packets.acquireLatest();
+
+    {
+      std::lock_guard lock{debugInputMutex};
+      std::swap(debugInput, pendingDebugInput);
+    }
+    for (const auto& kb : debugInput)
+      renderer->debugInput(kb);
+    debugInput.clear();
+
+    if (resizeRequested.exchange(false))
+      renderer->recreateSwapchain(unpack_resolution(windowResolution));
+
+    renderer->update(packets.readBuffer());
+    {
+      std::lock_guard lock{guiMutex};
+      renderer->drawGui();
+    }
+    renderer->drawFrame();
+
+    FrameMark;
+  }
+}
+
+void App::runHeadless()
+{
+  for (std::uint32_t frame = 0; frame < options.frameCount; ++frame)
+  {
+    fixedTime = static_cast<float>(frame) * FIXED_FRAME_TIME;
+    lastPollTime = std::chrono::steady_clock::now();
+
+    const auto& dumps = options.dumpFrames;
+    if (std::find(dumps.begin(), dumps.end(), frame) != dumps.end())
+    {
+      std::ostringstream name;
+      name << "frame_" << std::setw(5) << std::setfill('0') << frame << ".png";
+      renderer->requestFrameDump(options.outputDir / name.str());
+    }
+
+    renderer->update(makePacket());
+    renderer->drawFrame();
+
+    FrameMark;
+  }
+}
+
+void App::runBenchmark()
+{
+  const CameraPathBenchmark benchmark{CameraPathBenchmark::CreateInfo{
+    .cameraPath = options.benchmarkPath,
+    .warmupFrames = options.warmupFrames,
+    .output = options.benchmarkOutput,
+    .frameTime = FIXED_FRAME_TIME,
+  }};
+
+  benchmark.run(renderer->getGpuProfiler(), [this](const Camera& camera, float time) {
+    if (mainWindow != nullptr)
+    {
+      windowing->poll();
+      if (mainWindow->isBeingClosed())
+        return false;
+    }
+    lastPollTime = std::chrono::steady_clock::now();
+
+    fixedTime = time;
+    mainCam = camera;
+    drawFrame();
+    return true;
+  });
+}
+
 void App::processInput(float dt)
 {
   ZoneScoped;
@@ -89,18 +301,43 @@ void App::processInput(float dt)
   if (mainWindow->captureMouse)
     rotateCam(camToControl, mainWindow->mouse, dt);
 
-  renderer->debugInput(mainWindow->keyboard);
+  if (!options.threaded)
+  {
+    renderer->debugInput(mainWindow->keyboard);
+    return;
+  }
+
+  const auto& keys = mainWindow->keyboard.keys;
+  const bool anyKeyEvents = std::any_of(keys.begin(), keys.end(), [](ButtonState state) {
+    return state == ButtonState::Rising || state == ButtonState::Falling;
+  });
+  if (anyKeyEvents)
+  {
+    std::lock_guard lock{debugInputMutex};
+    pendingDebugInput.push_back(mainWindow->keyboard);
+  }
+}
+
+FramePacket App::makePacket()
+{
+  return FramePacket{
+    .mainCam = mainCam,
+    .shadowCam = shadowCam,
+    .currentTime = fixedTime.has_value() ? *fixedTime : static_cast<float>(windowing->getTime()),
+    .inputTime = lastPollTime,
+    .simFrameTimeMs = simFrameTimeMs,
+  };
 }
 
 void App::drawFrame()
 {
   ZoneScoped;
 
-  renderer->update(FramePacket{
-    .mainCam = mainCam,
-    .shadowCam = shadowCam,
-    .currentTime = static_cast<float>(windowing.getTime()),
-  });
+  renderer->update(makePacket());
+  // Benchmarks might run without a window, and so without ImGui
+  if (mainWindow != nullptr)
+    ImGuiRenderer::nextPlatformFrame();
+  renderer->drawGui();
   renderer->drawFrame();
 }
 
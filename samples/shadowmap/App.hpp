@@ -1,7 +1,14 @@
 #pragma once
 
+#include <atomic>
+#include <filesystem>
+#include <mutex>
+#include <optional>
+#include <vector>
+
 #include "wsi/OsWindowingManager.hpp"
 #include "scene/Camera.hpp"
+#include "threading/TripleBuffer.hpp"
 
 #include "Renderer.hpp"
 
@@ -13,19 +20,54 @@
 class App
 {
 public:
-  App();
+  struct Options
+  {
+    // Simulate on the main thread and render on a separate one
+    bool threaded = false;
+
+    // Scene and GUI pipelines are stored here between runs, empty to disable
+    std::filesystem::path pipelineCachePath = "shadowmap_pipeline_cache.bin";
+
+    // Render a fixed amount of frames into an offscreen image without creating a window
+    bool headless = false;
+    std::uint32_t frameCount = 100;
+    glm::uvec2 resolution = {1280, 720};
+    // Headless mode only, these frames are written to outputDir as PNGs
+    std::vector<std::uint32_t> dumpFrames;
+    std::filesystem::path outputDir = "frames";
+
+    // Replays a camera path and writes frame time statistics, with or without a window
+    std::filesystem::path benchmarkPath;
+    std::uint32_t warmupFrames = 60;
+    // CSV or JSON, depending on the extension
+    std::filesystem::path benchmarkOutput = "benchmark.csv";
+  };
+
+  explicit App(Options options);
 
   void run();
 
 private:
+  void initWindowed();
+  void initHeadless();
+  void initScene();
+
+  void runSingleThreaded();
+  void runThreaded();
+  void renderThreadLoop(const std::atomic<bool>& stop);
+  void runHeadless();
+  void runBenchmark();
+
   void processInput(float dt);
+  FramePacket makePacket();
   void drawFrame();
 
   void moveCam(Camera& cam, const Keyboard& kb, float dt);
   void rotateCam(Camera& cam, const Mouse& ms, float dt);
 
 private:
-  OsWindowingManager windowing;
+  // Neither of these exist in headless mode
+  std::unique_ptr<OsWindowingManager> windowing;
   std::unique_ptr<OsWindow> mainWindow;
 
   float camMoveSpeed = 1;
@@ -37,4 +79,30 @@ private:
   bool controlShadowCam = false;
 
   std::unique_ptr<Renderer> renderer;
+
+  Options options;
+
+  std::chrono::steady_clock::time_point lastPollTime = {};
+  float simFrameTimeMs = 0;
+
+  // Headless and benchmark runs advance time by a fixed step every frame to be reproducible
+  std::optional<float> fixedTime;
+
+  // Everything below is only used in threaded mode
+
+  TripleBuffer<FramePacket> packets;
+
+  // Debug input is handled by the renderer, but key presses are events that
+  // must not get lost when packets are dropped, so they are queued separately.
+  std::mutex debugInputMutex;
+  std::vector<Keyboard> pendingDebugInput;
+
+  // NOTE: ImGui's GLFW backend runs on the main thread, both its callbacks while polling
+  // and its half of NewFrame, while the render thread builds and renders the GUI.
+  // Both of them use the same ImGui context, so they are serialized with this mutex.
+  std::mutex guiMutex;
+
+  // Resizes are detected on the main thread but have to be handled on the render thread
+  std::atomic<bool> resizeRequested{false};
+  std::atomic<std::uint64_t> windowResolution{0};
 };
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <chrono>
+
 #include <scene/Camera.hpp>
 
 
@@ -12,4 +14,9 @@ struct FramePacket
   Camera mainCam;
   Camera shadowCam;
   float currentTime = 0;
+
+  // When the input that this packet reflects was polled, used for measuring latency
+  std::chrono::steady_clock::time_point inputTime = {};
+  // How long the producer of this packet took to simulate its last frame
+  float simFrameTimeMs = 0;
 };
@@ -1,5 +1,8 @@
 #include "Renderer.hpp"
 
+#include <algorithm>
+#include <utility>
+
 #include <etna/GlobalContext.hpp>
 #include <etna/Etna.hpp>
 #include <etna/RenderTargetStates.hpp>
@@ -15,7 +18,7 @@ Renderer::Renderer(glm::uvec2 res)
 {
 }
 
-void Renderer::initVulkan(std::span<const char*> instance_extensions)
+void Renderer::initVulkan(std::span<const char*> instance_extensions, bool headless_mode)
 {
   std::vector<const char*> instanceExtensions;
 
@@ -24,14 +27,23 @@ void Renderer::initVulkan(std::span<const char*> instance_extensions)
 
   std::vector<const char*> deviceExtensions;
 
-  deviceExtensions.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+  // Software rasterizers on CI machines might not even support presenting
+  if (!headless_mode)
+    deviceExtensions.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
 
   etna::initialize(etna::InitParams{
     .applicationName = "ShadowmapSample",
     .applicationVersion = VK_MAKE_VERSION(0, 1, 0),
     .instanceExtensions = instanceExtensions,
     .deviceExtensions = deviceExtensions,
-    .features = vk::PhysicalDeviceFeatures2{.features = {}},
+    // Materials index into an array of textures and report the mips they sample
+    .features = vk::PhysicalDeviceFeatures2{
+      .features =
+        {
+          .fragmentStoresAndAtomics = VK_TRUE,
+          .shaderSampledImageArrayDynamicIndexing = VK_TRUE,
+        },
+    },
     // Replace with an index if etna detects your preferred GPU incorrectly
     .physicalDeviceIndexOverride = {},
     // How much frames we buffer on the GPU without waiting for their completion on the CPU
@@ -39,11 +51,18 @@ void Renderer::initVulkan(std::span<const char*> instance_extensions)
   });
 }
 
-void Renderer::initFrameDelivery(vk::UniqueSurfaceKHR a_surface, ResolutionProvider res_provider)
+void Renderer::initPipelineCache(std::filesystem::path path)
+{
+  pipelineCache = std::make_unique<PersistentPipelineCache>(std::move(path));
+}
+
+void Renderer::initFrameDelivery(
+  vk::UniqueSurfaceKHR a_surface, ResolutionProvider res_provider, bool vsync)
 {
   auto& ctx = etna::get_context();
 
   resolutionProvider = std::move(res_provider);
+  useVsync = vsync;
   commandManager = ctx.createPerFrameCmdMgr();
 
   window = ctx.createWindow(etna::Window::CreateInfo{
@@ -52,36 +71,80 @@ void Renderer::initFrameDelivery(vk::UniqueSurfaceKHR a_surface, ResolutionProvi
 
   auto [w, h] = window->recreateSwapchain(etna::Window::DesiredProperties{
     .resolution = {resolution.x, resolution.y},
-    .vsync = true,
+    .vsync = useVsync,
   });
   resolution = {w, h};
 
+  initWorldRenderer(window->getCurrentFormat());
+
+  guiRenderer = std::make_unique<ImGuiRenderer>(
+    window->getCurrentFormat(), pipelineCache ? pipelineCache->get() : vk::PipelineCache{});
+}
+
+void Renderer::initHeadlessFrameDelivery()
+{
+  headless = std::make_unique<HeadlessFrameDelivery>(HeadlessFrameDelivery::CreateInfo{
+    .resolution = resolution,
+  });
+
+  initWorldRenderer(headless->getFormat());
+}
+
+void Renderer::initWorldRenderer(vk::Format target_format)
+{
+  gpuProfiler = std::make_unique<GpuTimestampProfiler>();
+
   worldRenderer = std::make_unique<WorldRenderer>();
+  worldRenderer->setGpuProfiler(gpuProfiler.get());
+  worldRenderer->setPipelineCache(pipelineCache ? pipelineCache->get() : vk::PipelineCache{});
 
   worldRenderer->allocateResources(resolution);
   worldRenderer->loadShaders();
-  worldRenderer->setupPipelines(window->getCurrentFormat());
+  worldRenderer->setupPipelines(target_format);
+
+  // Nobody is going to edit shaders during a headless run.
+  // NOTE: only our own shaders are watched, pipelines of render_utils are built by etna,
+  // which can't rebuild them without draining the GPU.
+  if (headless == nullptr)
+    shaderReloader = std::make_unique<ShaderHotReloader>(ShaderHotReloader::CreateInfo{
+      .shaderSets = {SHADER_SET(SHADOWMAP)},
+    });
+}
 
-  guiRenderer = std::make_unique<ImGuiRenderer>(window->getCurrentFormat());
+void Renderer::reloadShadersIfNeeded()
+{
+  if (shaderReloader == nullptr || !shaderReloader->consumeRecompiled())
+    return;
+
+  // Compilation already happened in the background, pipelines are built in the background
+  // too and swapped in at a frame boundary, while frames in flight keep the old ones.
+  worldRenderer->rebuildPipelines();
+  spdlog::info("Shaders were recompiled, rebuilding pipelines");
 }
 
 void Renderer::recreateSwapchain(glm::uvec2 res)
 {
-  auto& ctx = etna::get_context();
+  ZoneScoped;
 
-  ETNA_CHECK_VK_RESULT(ctx.getDevice().waitIdle());
+  // Etna destroys the old swapchain images and views right away, while frames in flight
+  // might still render into them and wait to be presented. It exposes neither the frame
+  // fences nor the old swapchain, so we wait for everything submitted to its only queue.
+  // The frame graph's attachments don't need this, it retires them on its own.
+  ETNA_CHECK_VK_RESULT(etna::get_context().getQueue().waitIdle());
 
   auto [w, h] = window->recreateSwapchain(etna::Window::DesiredProperties{
     .resolution = {res.x, res.y},
-    .vsync = true,
+    .vsync = useVsync,
   });
   resolution = {w, h};
 
-  // Most resources depend on the current resolution, so we recreate them.
-  worldRenderer->allocateResources(resolution);
+  worldRenderer->resize(resolution);
 
-  // Format of the swapchain CAN change on android
-  worldRenderer->setupPipelines(window->getCurrentFormat());
+  // Format of the swapchain CAN change on android, the queue is already drained
+  // so etna can destroy the old pipelines right away.
+  const auto format = window->getCurrentFormat();
+  if (format != worldRenderer->getColorFormat())
+    worldRenderer->setupPipelines(format);
 }
 
 void Renderer::loadScene(std::filesystem::path path)
@@ -93,36 +156,65 @@ void Renderer::debugInput(const Keyboard& kb)
 {
   worldRenderer->debugInput(kb);
 
-  if (kb[KeyboardKey::kB] == ButtonState::Falling)
-  {
-    const int retval = std::system("cd " GRAPHICS_COURSE_ROOT "/build"
-                                   " && cmake --build . --target shadowmap_shaders");
-    if (retval != 0)
-      spdlog::warn("Shader recompilation returned a non-zero return code!");
-    else
-    {
-      ETNA_CHECK_VK_RESULT(etna::get_context().getDevice().waitIdle());
-      etna::reload_shaders();
-      spdlog::info("Successfully reloaded shaders!");
-    }
-  }
+  // Changes are picked up automatically, this is for when the watcher misses something
+  if (kb[KeyboardKey::kB] == ButtonState::Falling && shaderReloader != nullptr)
+    shaderReloader->requestRebuild();
+}
+
+// Smooths out noisy per-frame measurements for display
+static void accumulate_average(float& average, float value)
+{
+  constexpr float WEIGHT = 0.05f;
+  average = average == 0 ? value : average + (value - average) * WEIGHT;
 }
 
 void Renderer::update(const FramePacket& packet)
 {
   worldRenderer->update(packet);
+
+  timings.packetInputTime = packet.inputTime;
+  accumulate_average(timings.simFrameMs, packet.simFrameTimeMs);
+}
+
+void Renderer::drawGui()
+{
+  ZoneScoped;
+
+  // There's no ImGui context without a window
+  if (headless)
+    return;
+
+  // The GLFW half of the frame is up to the app, as it has to run on the main thread. That
+  // half measures time between its own calls, which in threaded mode are not our frames.
+  const auto now = std::chrono::steady_clock::now();
+  if (timings.lastGuiFrame != std::chrono::steady_clock::time_point{})
+    ImGui::GetIO().DeltaTime = std::max(
+      std::chrono::duration<float>(now - timings.lastGuiFrame).count(), 1e-6f);
+  timings.lastGuiFrame = now;
+
+  guiRenderer->nextRendererFrame();
+  ImGui::NewFrame();
+  worldRenderer->drawGui();
+
+  ImGui::Begin("Frame timings");
+  ImGui::Text("Simulation: %.3f ms/frame", timings.simFrameMs);
+  ImGui::Text("Rendering: %.3f ms/frame", timings.renderFrameMs);
+  ImGui::Text("Input latency: %.3f ms", timings.inputLatencyMs);
+  ImGui::End();
+
+  ImGui::Render();
 }
 
 void Renderer::drawFrame()
 {
   ZoneScoped;
 
+  reloadShadersIfNeeded();
+
+  if (headless)
   {
-    ZoneScopedN("drawGui");
-    guiRenderer->nextFrame();
-    ImGui::NewFrame();
-    worldRenderer->drawGui();
-    ImGui::Render();
+    drawFrameHeadless();
+    return;
   }
 
   auto currentCmdBuf = commandManager->acquireNext();
@@ -142,8 +234,10 @@ void Renderer::drawFrame()
     auto [image, view, availableSem] = *nextSwapchainImage;
 
     ETNA_CHECK_VK_RESULT(currentCmdBuf.begin(vk::CommandBufferBeginInfo{}));
+    gpuProfiler->beginFrame(currentCmdBuf);
     {
       ETNA_PROFILE_GPU(currentCmdBuf, renderFrame);
+      GpuTimestampProfiler::Scope frameZone{gpuProfiler.get(), currentCmdBuf, "frame"};
 
       worldRenderer->renderWorld(currentCmdBuf, image, view);
 
@@ -168,6 +262,12 @@ void Renderer::drawFrame()
     ETNA_CHECK_VK_RESULT(currentCmdBuf.end());
 
     auto renderingDone = commandManager->submit(std::move(currentCmdBuf), std::move(availableSem));
+    reportFirstFrame();
+
+    const auto submitTime = std::chrono::steady_clock::now();
+    accumulate_average(
+      timings.inputLatencyMs,
+      std::chrono::duration<float, std::milli>(submitTime - timings.packetInputTime).count());
 
     const bool presented = window->present(std::move(renderingDone), view);
 
@@ -177,6 +277,8 @@ void Renderer::drawFrame()
 
   etna::end_frame();
 
+  accumulateFrameTime();
+
   if (!nextSwapchainImage)
   {
     auto res = resolutionProvider();
@@ -187,6 +289,76 @@ void Renderer::drawFrame()
   }
 }
 
+void Renderer::drawFrameHeadless()
+{
+  auto currentCmdBuf = headless->acquireNext();
+
+  etna::begin_frame();
+
+  ETNA_CHECK_VK_RESULT(currentCmdBuf.begin(vk::CommandBufferBeginInfo{}));
+  gpuProfiler->beginFrame(currentCmdBuf);
+  {
+    ETNA_PROFILE_GPU(currentCmdBuf, renderFrame);
+    GpuTimestampProfiler::Scope frameZone{gpuProfiler.get(), currentCmdBuf, "frame"};
+
+    const auto& target = headless->getColorImage();
+    worldRenderer->renderWorld(currentCmdBuf, target.get(), target.getView({}));
+
+    if (pendingFrameDump.has_value())
+    {
+      headless->recordDump(currentCmdBuf, std::move(*pendingFrameDump));
+      pendingFrameDump.reset();
+    }
+
+    ETNA_READ_BACK_GPU_PROFILING(currentCmdBuf);
+  }
+  ETNA_CHECK_VK_RESULT(currentCmdBuf.end());
+
+  headless->submit(currentCmdBuf);
+  reportFirstFrame();
+
+  etna::end_frame();
+
+  accumulateFrameTime();
+}
+
+void Renderer::requestFrameDump(std::filesystem::path path)
+{
+  ETNA_VERIFYF(headless != nullptr, "Frame dumps are only supported in headless mode!");
+  pendingFrameDump = std::move(path);
+}
+
+void Renderer::reportFirstFrame()
+{
+  if (std::exchange(timings.firstFrameReported, true))
+    return;
+
+  const float ms = std::chrono::duration<float, std::milli>(
+                     std::chrono::steady_clock::now() - timings.startup)
+                     .count();
+  // NOTE: the cache covers scene and GUI pipelines,
+  // but not the debug quad, which etna builds without it.
+  if (pipelineCache == nullptr)
+    spdlog::info("Time to first frame: {:.1f} ms, pipeline cache disabled", ms);
+  else if (pipelineCache->wasLoaded())
+    spdlog::info(
+      "Time to first frame: {:.1f} ms, loaded {} bytes of pipeline cache",
+      ms,
+      pipelineCache->getLoadedSize());
+  else
+    spdlog::info("Time to first frame: {:.1f} ms, pipeline cache was empty", ms);
+}
+
+void Renderer::accumulateFrameTime()
+{
+  const auto frameEnd = std::chrono::steady_clock::now();
+  if (timings.lastFrameEnd != std::chrono::steady_clock::time_point{})
+    accumulate_average(
+      timings.renderFrameMs,
+      std::chrono::duration<float, std::milli>(frameEnd - timings.lastFrameEnd).count());
+  timings.lastFrameEnd = frameEnd;
+}
+
 Renderer::~Renderer()
 {
   ETNA_CHECK_VK_RESULT(etna::get_context().getDevice().waitIdle());
@@ -5,6 +5,10 @@
 #include <glm/glm.hpp>
 #include <function2/function2.hpp>
 
+#include "render_utils/GpuTimestampProfiler.hpp"
+#include "render_utils/HeadlessFrameDelivery.hpp"
+#include "render_utils/PersistentPipelineCache.hpp"
+#include "render_utils/ShaderHotReloader.hpp"
 #include "wsi/Keyboard.hpp"
 
 #include "FramePacket.hpp"
@@ -26,23 +30,67 @@ public:
   ~Renderer();
 
   // Initializing all of rendering is a tricky multi-step dance
-  void initVulkan(std::span<const char*> instance_extensions);
-  void initFrameDelivery(vk::UniqueSurfaceKHR surface, ResolutionProvider res_provider);
+  void initVulkan(std::span<const char*> instance_extensions, bool headless_mode = false);
+  // Optional, must be called right after initVulkan
+  void initPipelineCache(std::filesystem::path path);
+  void initFrameDelivery(
+    vk::UniqueSurfaceKHR surface, ResolutionProvider res_provider, bool vsync = true);
+  // Alternative to initFrameDelivery, frames are rendered into an offscreen image
+  // and there is no GUI. Requires initVulkan to be called with headless = true.
+  void initHeadlessFrameDelivery();
   void recreateSwapchain(glm::uvec2 res);
   void loadScene(std::filesystem::path path);
 
   void debugInput(const Keyboard& kb);
   void update(const FramePacket& packet);
+  // Must be called right before drawFrame, after ImGuiRenderer::nextPlatformFrame
+  void drawGui();
   void drawFrame();
 
+  // Headless mode only, the next frame is written to `path` as a PNG
+  void requestFrameDump(std::filesystem::path path);
+
+  // GPU time of the whole frame and of every frame graph pass
+  const GpuTimestampProfiler& getGpuProfiler() const { return *gpuProfiler; }
+
+
+private:
+  void initWorldRenderer(vk::Format target_format);
+  void drawFrameHeadless();
+  void accumulateFrameTime();
+  void reportFirstFrame();
+  void reloadShadersIfNeeded();
 
 private:
   ResolutionProvider resolutionProvider;
+  std::unique_ptr<PersistentPipelineCache> pipelineCache;
   std::unique_ptr<etna::Window> window;
   std::unique_ptr<etna::PerFrameCmdMgr> commandManager;
 
+  // Replaces both of the above in headless mode
+  std::unique_ptr<HeadlessFrameDelivery> headless;
+  std::optional<std::filesystem::path> pendingFrameDump;
+
   glm::uvec2 resolution;
+  bool useVsync = true;
   std::unique_ptr<ImGuiRenderer> guiRenderer;
 
   std::unique_ptr<WorldRenderer> worldRenderer;
+  std::unique_ptr<GpuTimestampProfiler> gpuProfiler;
+  std::unique_ptr<ShaderHotReloader> shaderReloader;
+
+  struct FrameTimings
+  {
+    // Exponential moving averages
+    float simFrameMs = 0;
+    float renderFrameMs = 0;
+    // From polling the input to submitting the frame that reflects it
+    float inputLatencyMs = 0;
+
+    std::chrono::steady_clock::time_point lastFrameEnd = {};
+    std::chrono::steady_clock::time_point startup = std::chrono::steady_clock::now();
+    bool firstFrameReported = false;
+    std::chrono::steady_clock::time_point packetInputTime = {};
+    std::chrono::steady_clock::time_point lastGuiFrame = {};
+  } timings;
 };
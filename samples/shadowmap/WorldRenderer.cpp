@@ -2,14 +2,55 @@
 
 #include <etna/GlobalContext.hpp>
 #include <etna/PipelineManager.hpp>
-#include <etna/RenderTargetStates.hpp>
 #include <etna/Profiling.hpp>
 #include <glm/ext.hpp>
 #include <imgui.h>
 
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <limits>
+
+
+static constexpr std::uint32_t SHADOW_MAP_SIZE = 2048;
+
+// Draw lists are split into chunks of at least this size for recording on different threads,
+// smaller chunks are not worth the overhead of a secondary command buffer.
+static constexpr std::size_t MIN_INSTANCES_PER_TASK = 32;
+
+// Uniforms and transforms of moved instances, per frame in flight
+static constexpr vk::DeviceSize FRAME_RING_SIZE = 1 << 20;
+
+// Material textures are first shown this large, finer mips are streamed in on demand
+static constexpr std::uint32_t TEXTURE_START_EXTENT = 128;
+static constexpr vk::DeviceSize TEXTURE_BUDGET = 128 << 20;
+
+static_assert(SHADOW_CASCADE_COUNT <= 4, "Cascade splits are passed to shaders as a vec4!");
+
+static void execute_secondaries(
+  vk::CommandBuffer cmd_buf, std::span<const vk::CommandBuffer> secondaries)
+{
+  // A pass might have nothing to draw, e.g. when everything was culled
+  if (!secondaries.empty())
+    cmd_buf.executeCommands(static_cast<std::uint32_t>(secondaries.size()), secondaries.data());
+}
 
 WorldRenderer::WorldRenderer()
   : sceneMgr{std::make_unique<SceneManager>()}
+  , textureLoader{std::make_unique<TextureLoader>(TextureLoader::CreateInfo{
+      .streamingStartExtent = TEXTURE_START_EXTENT,
+      .streamingBudget = TEXTURE_BUDGET,
+      .feedbackSlots = MAX_MATERIAL_TEXTURES,
+    })}
+  , workers{std::make_unique<WorkerPool>()}
+  , cmdRecorder{std::make_unique<SecondaryCmdRecorder>(*workers)}
+  , frameGraph{std::make_unique<FrameGraph>()}
+  , frameRing{std::make_unique<FrameRingAllocator>(FrameRingAllocator::CreateInfo{
+      .sizePerFrame = FRAME_RING_SIZE,
+      .fixedSizePerFrame = sizeof(UniformParams),
+      .name = "frame_ring",
+    })}
+  , descriptorCache{std::make_unique<DescriptorSetCache>(DescriptorSetCache::CreateInfo{})}
 {
 }
 
@@ -19,35 +60,55 @@ void WorldRenderer::allocateResources(glm::uvec2 swapchain_resolution)
 
   auto& ctx = etna::get_context();
 
-  mainViewDepth = ctx.createImage(etna::Image::CreateInfo{
-    .extent = vk::Extent3D{resolution.x, resolution.y, 1},
-    .name = "main_view_depth",
-    .format = vk::Format::eD32Sfloat,
-    .imageUsage = vk::ImageUsageFlagBits::eDepthStencilAttachment,
-  });
-
   shadowMap = ctx.createImage(etna::Image::CreateInfo{
-    .extent = vk::Extent3D{2048, 2048, 1},
+    .extent = vk::Extent3D{SHADOW_MAP_SIZE, SHADOW_MAP_SIZE, 1},
     .name = "shadow_map",
     .format = vk::Format::eD16Unorm,
-    .imageUsage =
-      vk::ImageUsageFlagBits::eDepthStencilAttachment | vk::ImageUsageFlagBits::eSampled,
+    .imageUsage = vk::ImageUsageFlagBits::eDepthStencilAttachment |
+      vk::ImageUsageFlagBits::eSampled | vk::ImageUsageFlagBits::eTransferDst,
+    .layers = SHADOW_CASCADE_COUNT,
   });
 
+  staticShadowMap = ctx.createImage(etna::Image::CreateInfo{
+    .extent = vk::Extent3D{SHADOW_MAP_SIZE, SHADOW_MAP_SIZE, 1},
+    .name = "static_shadow_map",
+    .format = vk::Format::eD16Unorm,
+    .imageUsage = vk::ImageUsageFlagBits::eDepthStencilAttachment |
+      vk::ImageUsageFlagBits::eSampled | vk::ImageUsageFlagBits::eTransferSrc,
+    .layers = SHADOW_CASCADE_COUNT,
+  });
+  for (auto& cascade : cascades)
+    cascade.staticCache.valid = false;
+
   defaultSampler = etna::Sampler(etna::Sampler::CreateInfo{.name = "default_sampler"});
-  constants = ctx.createBuffer(etna::Buffer::CreateInfo{
-    .size = sizeof(UniformParams),
-    .bufferUsage = vk::BufferUsageFlagBits::eUniformBuffer,
-    .memoryUsage = VMA_MEMORY_USAGE_CPU_ONLY,
-    .name = "constants",
+  materialSampler = etna::Sampler(etna::Sampler::CreateInfo{
+    .filter = vk::Filter::eLinear,
+    .addressMode = vk::SamplerAddressMode::eRepeat,
+    .name = "material_sampler",
   });
 
-  constants.map();
+  // Handles of the old images and samplers might be reused by the new ones
+  descriptorCache->invalidate();
+}
+
+void WorldRenderer::resize(glm::uvec2 swapchain_resolution)
+{
+  // Shadow maps do not depend on the resolution, while the main view's attachments
+  // are transient frame graph images that get reallocated with deferred deletion.
+  resolution = swapchain_resolution;
 }
 
 void WorldRenderer::loadScene(std::filesystem::path path)
 {
   sceneMgr->selectScene(path);
+  descriptorCache->invalidate();
+  animateInstance = false;
+  animatedInstance = 0;
+  animatedInstanceRest.reset();
+
+  materialTextures.clear();
+  for (const auto& texture : sceneMgr->getMaterialTextures())
+    materialTextures.push_back(textureLoader->load(texture.path, texture.srgb));
 }
 
 void WorldRenderer::loadShaders()
@@ -60,58 +121,54 @@ void WorldRenderer::loadShaders()
 
 void WorldRenderer::setupPipelines(vk::Format swapchain_format)
 {
+  colorFormat = swapchain_format;
+
   quadRenderer = std::make_unique<QuadRenderer>(QuadRenderer::CreateInfo{
     .format = swapchain_format,
     .rect = {{0, 0}, {512, 512}},
+    .descriptorCache = descriptorCache.get(),
   });
 
-  etna::VertexShaderInputDescription sceneVertexInputDesc{
-    .bindings = {etna::VertexShaderInputDescription::Binding{
-      .byteStreamDescription = sceneMgr->getVertexFormatDescription(),
-    }},
+  const vk::PipelineRasterizationStateCreateInfo rasterization{
+    .polygonMode = vk::PolygonMode::eFill,
+    .cullMode = vk::CullModeFlagBits::eBack,
+    .frontFace = vk::FrontFace::eCounterClockwise,
+    .lineWidth = 1.f,
   };
 
-
-  auto& pipelineManager = etna::get_context().getPipelineManager();
-
-  basicForwardPipeline = {};
-  basicForwardPipeline = pipelineManager.createGraphicsPipeline(
-    "simple_material",
-    etna::GraphicsPipeline::CreateInfo{
-      .vertexShaderInput = sceneVertexInputDesc,
-      .rasterizationConfig =
-        vk::PipelineRasterizationStateCreateInfo{
-          .polygonMode = vk::PolygonMode::eFill,
-          .cullMode = vk::CullModeFlagBits::eBack,
-          .frontFace = vk::FrontFace::eCounterClockwise,
-          .lineWidth = 1.f,
-        },
-      .fragmentShaderOutput =
-        {
-          .colorAttachmentFormats = {swapchain_format},
-          .depthAttachmentFormat = vk::Format::eD32Sfloat,
-        },
+  // Built by us rather than etna, so that hot reloading can rebuild them in the background
+  basicForwardPipeline.reset();
+  basicForwardPipeline =
+    std::make_unique<ReloadableGraphicsPipeline>(ReloadableGraphicsPipeline::CreateInfo{
+      .programName = "simple_material",
+      .spirvPaths =
+        {SHADOWMAP_SHADERS_ROOT "simple.vert.spv", SHADOWMAP_SHADERS_ROOT "simple_shadow.frag.spv"},
+      .vertexInput = sceneMgr->getVertexFormatDescription(),
+      .rasterizationConfig = rasterization,
+      .colorAttachmentFormats = {swapchain_format},
+      .depthAttachmentFormat = vk::Format::eD32Sfloat,
+      .pipelineCache = pipelineCache,
     });
 
-  shadowPipeline = {};
-  shadowPipeline = pipelineManager.createGraphicsPipeline(
-    "simple_shadow",
-    etna::GraphicsPipeline::CreateInfo{
-      .vertexShaderInput = sceneVertexInputDesc,
-      .rasterizationConfig =
-        vk::PipelineRasterizationStateCreateInfo{
-          .polygonMode = vk::PolygonMode::eFill,
-          .cullMode = vk::CullModeFlagBits::eBack,
-          .frontFace = vk::FrontFace::eCounterClockwise,
-          .lineWidth = 1.f,
-        },
-      .fragmentShaderOutput =
-        {
-          .depthAttachmentFormat = vk::Format::eD16Unorm,
-        },
+  shadowPipeline.reset();
+  shadowPipeline =
+    std::make_unique<ReloadableGraphicsPipeline>(ReloadableGraphicsPipeline::CreateInfo{
+      .programName = "simple_shadow",
+      .spirvPaths = {SHADOWMAP_SHADERS_ROOT "simple.vert.spv"},
+      .vertexInput = sceneMgr->getVertexFormatDescription(),
+      .rasterizationConfig = rasterization,
+      .colorAttachmentFormats = {},
+      .depthAttachmentFormat = vk::Format::eD16Unorm,
+      .pipelineCache = pipelineCache,
     });
 }
 
+void WorldRenderer::rebuildPipelines()
+{
+  basicForwardPipeline->rebuildAsync();
+  shadowPipeline->rebuildAsync();
+}
+
 void WorldRenderer::debugInput(const Keyboard& kb)
 {
   if (kb[KeyboardKey::kQ] == ButtonState::Falling)
@@ -125,42 +182,153 @@ void WorldRenderer::update(const FramePacket& packet)
 {
   ZoneScoped;
 
+  const float aspect = float(resolution.x) / float(resolution.y);
+
   // calc camera matrix
   {
-    const float aspect = float(resolution.x) / float(resolution.y);
     worldViewProj = packet.mainCam.projTm(aspect) * packet.mainCam.viewTm();
   }
 
-  // calc light matrix
+  // calc light matrices
   {
-    const auto mProj = lightProps.usePerspectiveM
-      ? glm::perspectiveLH_ZO(
-          -glm::radians(packet.shadowCam.fov), 1.0f, 1.0f, lightProps.lightTargetDist * 2.0f)
-      : glm::orthoLH_ZO(
-          +lightProps.radius,
-          -lightProps.radius,
-          +lightProps.radius,
-          -lightProps.radius,
-          0.0f,
-          lightProps.lightTargetDist);
-
-    lightMatrix = mProj * packet.shadowCam.viewTm();
+    if (lightProps.usePerspectiveM)
+    {
+      // A spot light doesn't need cascades, a single one covers everything
+      const auto mProj = glm::perspectiveLH_ZO(
+        -glm::radians(packet.shadowCam.fov), 1.0f, 1.0f, lightProps.lightTargetDist * 2.0f);
+
+      cascades[0].lightMatrix = mProj * packet.shadowCam.viewTm();
+      cascades[0].splitFar = std::numeric_limits<float>::max();
+      activeCascades = 1;
+    }
+    else
+    {
+      updateCascades(packet.mainCam, packet.shadowCam, aspect);
+      activeCascades = SHADOW_CASCADE_COUNT;
+    }
 
     lightPos = packet.shadowCam.position;
   }
 
-  // Upload everything to GPU-mapped memory
+  // move the animated instance, the transform reaches the GPU in renderWorld
+  if (animateInstance && !sceneMgr->getInstanceMatrices().empty())
   {
-    uniformParams.lightMatrix = lightMatrix;
+    const auto idx = static_cast<std::size_t>(animatedInstance);
+    if (!animatedInstanceRest.has_value())
+      animatedInstanceRest = sceneMgr->getInstanceMatrices()[idx];
+
+    const glm::vec3 offset{0, std::sin(packet.currentTime * 2.0f), 0};
+    sceneMgr->setInstanceMatrix(
+      idx, glm::translate(glm::mat4x4{1.0f}, offset) * *animatedInstanceRest);
+  }
+
+  // NOTE: the uniforms are uploaded in renderWorld, as only there it is
+  // safe to write into memory belonging to the current frame in flight
+  {
+    for (std::size_t i = 0; i < SHADOW_CASCADE_COUNT; ++i)
+    {
+      uniformParams.cascadeMatrices[i] = cascades[i].lightMatrix;
+      uniformParams.cascadeSplits[static_cast<glm::length_t>(i)] = cascades[i].splitFar;
+    }
+    uniformParams.viewZ = glm::row(packet.mainCam.viewTm(), 2);
     uniformParams.lightPos = lightPos;
     uniformParams.time = packet.currentTime;
+  }
+}
+
+void WorldRenderer::updateCascades(const Camera& main_cam, const Camera& light_cam, float aspect)
+{
+  // Cascades are looking in the direction of the light camera, but are centered
+  // around the main camera's frustum instead of the light camera's position.
+  const glm::mat4x4 lightRotation = glm::mat4_cast(glm::conjugate(light_cam.rotation));
 
-    std::memcpy(constants.data(), &uniformParams, sizeof(uniformParams));
+  const float nearPlane = main_cam.zNear;
+  const float farPlane = std::min(main_cam.zFar, lightProps.shadowDistance);
+  const float tanHalfFov = std::tan(glm::radians(main_cam.fov) * 0.5f);
+
+  float sliceNear = nearPlane;
+  for (std::size_t i = 0; i < SHADOW_CASCADE_COUNT; ++i)
+  {
+    // The "practical" split scheme: logarithmic splits give every cascade the same
+    // texel density relative to the screen, but degenerate when near plane is tiny,
+    // so they are blended with uniform splits.
+    const float part = static_cast<float>(i + 1) / static_cast<float>(SHADOW_CASCADE_COUNT);
+    const float logSplit = nearPlane * std::pow(farPlane / nearPlane, part);
+    const float uniformSplit = nearPlane + (farPlane - nearPlane) * part;
+    const float sliceFar = glm::mix(uniformSplit, logSplit, lightProps.splitLambda);
+
+    std::array<glm::vec3, 8> corners;
+    for (std::size_t j = 0; j < corners.size(); ++j)
+    {
+      const float depth = (j & 4) != 0 ? sliceFar : sliceNear;
+      const float halfHeight = tanHalfFov * depth;
+      const float halfWidth = halfHeight * aspect;
+      corners[j] = main_cam.position + main_cam.forward() * depth +
+        main_cam.right() * ((j & 1) != 0 ? halfWidth : -halfWidth) +
+        main_cam.up() * ((j & 2) != 0 ? halfHeight : -halfHeight);
+    }
+
+    // We fit a sphere and not a box, as the size of a sphere doesn't change when
+    // the camera rotates, hence the size of a texel stays the same too.
+    glm::vec3 center{0};
+    for (const auto& corner : corners)
+      center += corner;
+    center /= static_cast<float>(corners.size());
+
+    float radius = 0;
+    for (const auto& corner : corners)
+      radius = std::max(radius, glm::distance(center, corner));
+    // Floating point noise shouldn't be able to change the texel size
+    radius = std::ceil(radius * 16.0f) / 16.0f;
+
+    // Snapping the cascade to whole texels makes shadow edges stay still
+    // instead of crawling around when the camera moves.
+    const float texelSize = 2.0f * radius / static_cast<float>(SHADOW_MAP_SIZE);
+    glm::vec3 lightSpaceCenter = glm::vec3(lightRotation * glm::vec4(center, 1.0f));
+    lightSpaceCenter.x = std::floor(lightSpaceCenter.x / texelSize) * texelSize;
+    lightSpaceCenter.y = std::floor(lightSpaceCenter.y / texelSize) * texelSize;
+
+    const auto mProj = glm::orthoLH_ZO(
+      lightSpaceCenter.x - radius,
+      lightSpaceCenter.x + radius,
+      lightSpaceCenter.y - radius,
+      lightSpaceCenter.y + radius,
+      lightSpaceCenter.z - radius - lightProps.casterMargin,
+      lightSpaceCenter.z + radius);
+
+    cascades[i].lightMatrix = mProj * lightRotation;
+    cascades[i].splitFar = sliceFar;
+
+    sliceNear = sliceFar;
+  }
+}
+
+void WorldRenderer::cullInstances(
+  const glm::mat4x4& proj_view, InstanceKind kind, std::vector<std::uint32_t>& result)
+{
+  ZoneScoped;
+
+  result.clear();
+
+  const auto frustum = Frustum::fromMatrix(proj_view);
+  auto bounds = sceneMgr->getInstanceBounds();
+
+  for (std::size_t instIdx = 0; instIdx < bounds.size(); ++instIdx)
+  {
+    if (kind != InstanceKind::All &&
+        sceneMgr->isInstanceDynamic(instIdx) != (kind == InstanceKind::Dynamic))
+      continue;
+
+    if (frustum.intersects(bounds[instIdx]))
+      result.push_back(static_cast<std::uint32_t>(instIdx));
   }
 }
 
 void WorldRenderer::renderScene(
-  vk::CommandBuffer cmd_buf, const glm::mat4x4& glob_tm, vk::PipelineLayout pipeline_layout)
+  vk::CommandBuffer cmd_buf,
+  const glm::mat4x4& glob_tm,
+  vk::PipelineLayout pipeline_layout,
+  std::span<const std::uint32_t> instances)
 {
   if (!sceneMgr->getVertexBuffer())
     return;
@@ -168,85 +336,386 @@ void WorldRenderer::renderScene(
   cmd_buf.bindVertexBuffers(0, {sceneMgr->getVertexBuffer()}, {0});
   cmd_buf.bindIndexBuffer(sceneMgr->getIndexBuffer(), 0, vk::IndexType::eUint32);
 
-  pushConst2M.projView = glob_tm;
+  // NOTE: this is called from multiple threads at once, so no writing to members here
+  const PushConstants pushConst{.projView = glob_tm};
+
+  cmd_buf.pushConstants<PushConstants>(
+    pipeline_layout, vk::ShaderStageFlagBits::eVertex, 0, {pushConst});
 
   auto instanceMeshes = sceneMgr->getInstanceMeshes();
-  auto instanceMatrices = sceneMgr->getInstanceMatrices();
 
   auto meshes = sceneMgr->getMeshes();
   auto relems = sceneMgr->getRenderElements();
 
-  for (std::size_t instIdx = 0; instIdx < instanceMeshes.size(); ++instIdx)
+  for (auto instIdx : instances)
   {
-    pushConst2M.model = instanceMatrices[instIdx];
-
-    cmd_buf.pushConstants<PushConstants>(
-      pipeline_layout, vk::ShaderStageFlagBits::eVertex, 0, {pushConst2M});
-
     const auto meshIdx = instanceMeshes[instIdx];
 
     for (std::size_t j = 0; j < meshes[meshIdx].relemCount; ++j)
     {
       const auto relemIdx = meshes[meshIdx].firstRelem + j;
       const auto& relem = relems[relemIdx];
-      cmd_buf.drawIndexed(relem.indexCount, 1, relem.indexOffset, relem.vertexOffset, 0);
+      // The vertex shader fetches the instance's transform by gl_InstanceIndex,
+      // which starts at firstInstance.
+      cmd_buf.drawIndexed(relem.indexCount, 1, relem.indexOffset, relem.vertexOffset, instIdx);
     }
   }
 }
 
+WorldRenderer::PassTasks WorldRenderer::addDrawTasks(
+  const DrawTask& pass,
+  const SecondaryCmdRecorder::RenderingInfo& rendering_info,
+  std::span<const std::uint32_t> instances)
+{
+  const std::size_t chunkCount = std::clamp<std::size_t>(
+    (instances.size() + MIN_INSTANCES_PER_TASK - 1) / MIN_INSTANCES_PER_TASK,
+    1,
+    workers->threadCount());
+  const std::size_t chunkSize = (instances.size() + chunkCount - 1) / chunkCount;
+
+  const std::size_t firstTask = drawTasks.size();
+  for (std::size_t first = 0; first < instances.size(); first += chunkSize)
+  {
+    DrawTask task = pass;
+    task.instances = instances.subspan(first, std::min(chunkSize, instances.size() - first));
+    drawTasks.push_back(task);
+    drawTaskInfos.push_back(rendering_info);
+  }
+
+  return PassTasks{.first = firstTask, .count = drawTasks.size() - firstTask};
+}
+
+void WorldRenderer::recordDrawTask(vk::CommandBuffer cmd_buf, const DrawTask& task)
+{
+  cmd_buf.bindPipeline(vk::PipelineBindPoint::eGraphics, task.pipeline);
+  cmd_buf.bindDescriptorSets(
+    vk::PipelineBindPoint::eGraphics, task.pipelineLayout, 0, {task.descriptorSet}, {});
+
+  renderScene(cmd_buf, task.projView, task.pipelineLayout, task.instances);
+}
+
+void WorldRenderer::copyShadowMap(
+  vk::CommandBuffer cmd_buf,
+  const etna::Image& from,
+  const etna::Image& to,
+  std::uint32_t cascade_count)
+{
+  const vk::ImageSubresourceLayers depthLayers{
+    .aspectMask = vk::ImageAspectFlagBits::eDepth,
+    .mipLevel = 0,
+    .baseArrayLayer = 0,
+    .layerCount = cascade_count,
+  };
+
+  cmd_buf.copyImage(
+    from.get(),
+    vk::ImageLayout::eTransferSrcOptimal,
+    to.get(),
+    vk::ImageLayout::eTransferDstOptimal,
+    {vk::ImageCopy{
+      .srcSubresource = depthLayers,
+      .srcOffset = {},
+      .dstSubresource = depthLayers,
+      .dstOffset = {},
+      .extent = {SHADOW_MAP_SIZE, SHADOW_MAP_SIZE, 1},
+    }});
+}
+
 void WorldRenderer::renderWorld(
   vk::CommandBuffer cmd_buf, vk::Image target_image, vk::ImageView target_image_view)
 {
   ETNA_PROFILE_GPU(cmd_buf, renderWorld);
 
-  // draw scene to shadowmap
+  frameRing->beginFrame();
+  cmdRecorder->beginFrame();
+  descriptorCache->beginFrame();
 
+  if (basicForwardPipeline->update())
+    spdlog::info("Swapped in the rebuilt forward pipeline");
+  if (shadowPipeline->update())
   {
-    ETNA_PROFILE_GPU(cmd_buf, renderShadowMap);
+    spdlog::info("Swapped in the rebuilt shadow pipeline");
+    // Cached static shadows were rendered by the old shaders
+    for (auto& cascade : cascades)
+      cascade.staticCache.valid = false;
+  }
+  textureLoader->update(cmd_buf);
+
+  // Lives in the fixed part of the ring, so its offset is the same every time a frame
+  // slot comes around and the descriptor sets binding it don't change
+  const auto constants = frameRing->uploadFixed(uniformParams);
+  sceneMgr->flushInstanceUpdates(cmd_buf, *frameRing);
 
-    etna::RenderTargetState renderTargets(
-      cmd_buf,
-      {{0, 0}, {2048, 2048}},
-      {},
-      {.image = shadowMap.get(), .view = shadowMap.getView({})});
+  // figure out which cascades of the static shadow cache are outdated
 
-    cmd_buf.bindPipeline(vk::PipelineBindPoint::eGraphics, shadowPipeline.getVkPipeline());
-    renderScene(cmd_buf, lightMatrix, shadowPipeline.getVkPipelineLayout());
+  for (std::uint32_t i = 0; i < activeCascades; ++i)
+  {
+    auto& cascade = cascades[i];
+    cascade.staticOutdated = !cacheStaticShadows || !cascade.staticCache.valid ||
+      cascade.staticCache.lightMatrix != cascade.lightMatrix ||
+      cascade.staticCache.staticGeometryVersion != sceneMgr->getStaticGeometryVersion();
   }
 
-  // draw final scene to screen
+  // cull everything we are going to draw this frame
+
+  {
+    ZoneScopedN("cullAll");
+
+    // Static and dynamic instances for every cascade, plus the main view
+    const std::size_t cullTaskCount = 2 * activeCascades + 1;
+    workers->parallelFor(cullTaskCount, [this, cullTaskCount](std::size_t task, std::size_t) {
+      if (task == cullTaskCount - 1)
+      {
+        cullInstances(worldViewProj, InstanceKind::All, visibleInstances);
+        return;
+      }
+
+      auto& cascade = cascades[task / 2];
+      if (task % 2 == 0)
+      {
+        if (cascade.staticOutdated)
+          cullInstances(cascade.lightMatrix, InstanceKind::Static, cascade.staticDrawList);
+      }
+      else if (sceneMgr->hasDynamicInstances())
+        cullInstances(cascade.lightMatrix, InstanceKind::Dynamic, cascade.dynamicDrawList);
+      else
+        cascade.dynamicDrawList.clear();
+    });
+  }
+
+  bool anyDynamicVisible = false;
+  for (std::uint32_t i = 0; i < activeCascades; ++i)
+    anyDynamicVisible = anyDynamicVisible || !cascades[i].dynamicDrawList.empty();
+
+  // Dynamic objects are drawn on top of a copy of the static shadowmap
+  const etna::Image& currentShadowMap = anyDynamicVisible ? shadowMap : staticShadowMap;
+
+  // NOTE: descriptor sets can only be created on this thread, so we do it before recording
+  const std::array shadowBindings{
+    etna::Binding{2, sceneMgr->getInstanceTransformBuffer().genBinding()},
+  };
+  const vk::DescriptorSet shadowSet = descriptorCache->get(
+    etna::get_shader_program("simple_shadow").getDescriptorLayoutId(0), shadowBindings);
+
+  // Element i of the mip feedback is about slot i of the texture array
+  std::array<TextureLoader::Handle, MAX_MATERIAL_TEXTURES> boundTextures;
+  for (std::uint32_t slot = 0; slot < MAX_MATERIAL_TEXTURES; ++slot)
+    boundTextures[slot] = slot != MATERIAL_NO_TEXTURE && slot <= materialTextures.size()
+      ? materialTextures[slot - 1]
+      : TextureLoader::Handle::Invalid;
+  const auto mipFeedback = textureLoader->beginFeedback(cmd_buf, boundTextures);
+
+  // Every material is drawn with this set, there is nothing to rebind between draws
+  std::vector<etna::Binding> forwardBindings{
+    etna::Binding{0, frameRing->genBinding(constants)},
+    etna::Binding{
+      1,
+      currentShadowMap.genBinding(defaultSampler.get(), vk::ImageLayout::eShaderReadOnlyOptimal)},
+    etna::Binding{2, sceneMgr->getInstanceTransformBuffer().genBinding()},
+    etna::Binding{4, sceneMgr->getMaterialBuffer().genBinding()},
+    etna::Binding{5, mipFeedback},
+  };
+  forwardBindings.reserve(forwardBindings.size() + MAX_MATERIAL_TEXTURES);
+  for (std::uint32_t slot = 0; slot < MAX_MATERIAL_TEXTURES; ++slot)
+  {
+    // Slots without a texture still need a valid descriptor, get returns the placeholder then
+    const etna::Image& texture = textureLoader->get(boundTextures[slot]);
+    forwardBindings.emplace_back(
+      3,
+      texture.genBinding(materialSampler.get(), vk::ImageLayout::eShaderReadOnlyOptimal),
+      slot);
+  }
+
+  // Streaming replaces texture images, which is what the version is for
+  const vk::DescriptorSet forwardSet = descriptorCache->get(
+    etna::get_shader_program("simple_material").getDescriptorLayoutId(0),
+    forwardBindings,
+    textureLoader->getImageVersion());
+
+  // split all passes into tasks and record them on worker threads
+
+  drawTasks.clear();
+  drawTaskInfos.clear();
 
+  const vk::Rect2D shadowRect{{0, 0}, {SHADOW_MAP_SIZE, SHADOW_MAP_SIZE}};
+  const vk::Rect2D forwardRect{{0, 0}, {resolution.x, resolution.y}};
+
+  const SecondaryCmdRecorder::RenderingInfo shadowRendering{
+    .depthFormat = vk::Format::eD16Unorm,
+    .area = shadowRect,
+  };
+  const DrawTask shadowPass{
+    .pipeline = shadowPipeline->getVkPipeline(),
+    .pipelineLayout = shadowPipeline->getVkPipelineLayout(),
+    .descriptorSet = shadowSet,
+  };
+
+  for (std::uint32_t i = 0; i < activeCascades; ++i)
   {
-    ETNA_PROFILE_GPU(cmd_buf, renderForward);
-
-    auto simpleMaterialInfo = etna::get_shader_program("simple_material");
-
-    auto set = etna::create_descriptor_set(
-      simpleMaterialInfo.getDescriptorLayoutId(0),
-      cmd_buf,
-      {etna::Binding{0, constants.genBinding()},
-       etna::Binding{
-         1, shadowMap.genBinding(defaultSampler.get(), vk::ImageLayout::eShaderReadOnlyOptimal)}});
-
-    etna::RenderTargetState renderTargets(
-      cmd_buf,
-      {{0, 0}, {resolution.x, resolution.y}},
-      {{.image = target_image, .view = target_image_view}},
-      {.image = mainViewDepth.get(), .view = mainViewDepth.getView({})});
-
-    cmd_buf.bindPipeline(vk::PipelineBindPoint::eGraphics, basicForwardPipeline.getVkPipeline());
-    cmd_buf.bindDescriptorSets(
-      vk::PipelineBindPoint::eGraphics,
-      basicForwardPipeline.getVkPipelineLayout(),
-      0,
-      {set.getVkSet()},
-      {});
-
-    renderScene(cmd_buf, worldViewProj, basicForwardPipeline.getVkPipelineLayout());
+    auto& cascade = cascades[i];
+
+    DrawTask pass = shadowPass;
+    pass.projView = cascade.lightMatrix;
+
+    cascade.staticTasks = cascade.staticOutdated
+      ? addDrawTasks(pass, shadowRendering, cascade.staticDrawList)
+      : PassTasks{};
+    cascade.dynamicTasks = addDrawTasks(pass, shadowRendering, cascade.dynamicDrawList);
   }
 
+  const PassTasks forwardTasks = addDrawTasks(
+    DrawTask{
+      .pipeline = basicForwardPipeline->getVkPipeline(),
+      .pipelineLayout = basicForwardPipeline->getVkPipelineLayout(),
+      .descriptorSet = forwardSet,
+      .projView = worldViewProj,
+    },
+    SecondaryCmdRecorder::RenderingInfo{
+      .colorFormats = {&colorFormat, 1},
+      .depthFormat = vk::Format::eD32Sfloat,
+      .area = forwardRect,
+    },
+    visibleInstances);
+
+  std::vector<vk::CommandBuffer> secondaries;
+  {
+    const auto recordingStart = std::chrono::steady_clock::now();
+
+    secondaries = cmdRecorder->record(
+      drawTaskInfos, [this](std::size_t task, vk::CommandBuffer secondary) {
+        recordDrawTask(secondary, drawTasks[task]);
+      });
+
+    recordingTimeMs = std::chrono::duration<float, std::milli>(
+                        std::chrono::steady_clock::now() - recordingStart)
+                        .count();
+  }
+
+  const auto secondariesOf = [&secondaries](PassTasks pass) {
+    return std::span<const vk::CommandBuffer>{secondaries}.subspan(pass.first, pass.count);
+  };
+
+  // describe the frame
+
+  frameGraph->beginFrame();
+
+  const auto staticShadows = frameGraph->importImage(
+    "static_shadow_map", staticShadowMap, shadowRect.extent, vk::ImageAspectFlagBits::eDepth);
+  const auto dynamicShadows = frameGraph->importImage(
+    "shadow_map", shadowMap, shadowRect.extent, vk::ImageAspectFlagBits::eDepth);
+  const auto currentShadows = anyDynamicVisible ? dynamicShadows : staticShadows;
+  const auto backbuffer = frameGraph->importImage(
+    "backbuffer",
+    target_image,
+    target_image_view,
+    forwardRect.extent,
+    vk::ImageAspectFlagBits::eColor);
+
+  const auto mainViewDepth = frameGraph->createImage(FrameGraph::TransientImageInfo{
+    .extent = forwardRect.extent,
+    .name = "main_view_depth",
+    .format = vk::Format::eD32Sfloat,
+    .imageUsage = vk::ImageUsageFlagBits::eDepthStencilAttachment,
+  });
+
+  const vk::ClearValue depthClear{.depthStencil = {.depth = 1.0f, .stencil = 0}};
+
+  // draw static part of the scene to the cached shadowmap, but only cascades that are outdated
+
+  for (std::uint32_t i = 0; i < activeCascades; ++i)
+  {
+    auto& cascade = cascades[i];
+    if (!cascade.staticOutdated)
+      continue;
+
+    frameGraph->addPass(
+      "static_shadow",
+      [&](FrameGraph::PassBuilder& builder) {
+        builder.depthAttachment(
+          staticShadows,
+          {.clearValue = depthClear, .view = {.baseLayer = i, .layerCount = 1}});
+        builder.useSecondaryCommandBuffers();
+      },
+      [&secondariesOf, tasks = cascade.staticTasks](vk::CommandBuffer pass_cmd_buf) {
+        execute_secondaries(pass_cmd_buf, secondariesOf(tasks));
+      });
+
+    cascade.staticCache = StaticShadowCache{
+      .valid = true,
+      .lightMatrix = cascade.lightMatrix,
+      .staticGeometryVersion = sceneMgr->getStaticGeometryVersion(),
+    };
+    ++staticShadowUpdates;
+  }
+
+  // draw dynamic objects on top of a copy of the static shadowmap
+
+  if (anyDynamicVisible)
+  {
+    frameGraph->addPass(
+      "copy_static_shadows",
+      [&](FrameGraph::PassBuilder& builder) {
+        builder.read(staticShadows, FrameGraph::Access::TransferSrc);
+        builder.write(dynamicShadows, FrameGraph::Access::TransferDst);
+      },
+      [this](vk::CommandBuffer pass_cmd_buf) {
+        copyShadowMap(pass_cmd_buf, staticShadowMap, shadowMap, activeCascades);
+      });
+
+    for (std::uint32_t i = 0; i < activeCascades; ++i)
+    {
+      if (cascades[i].dynamicTasks.count == 0)
+        continue;
+
+      frameGraph->addPass(
+        "dynamic_shadow",
+        [&](FrameGraph::PassBuilder& builder) {
+          builder.depthAttachment(
+            dynamicShadows,
+            {.loadOp = vk::AttachmentLoadOp::eLoad, .view = {.baseLayer = i, .layerCount = 1}});
+          builder.useSecondaryCommandBuffers();
+        },
+        [&secondariesOf, tasks = cascades[i].dynamicTasks](vk::CommandBuffer pass_cmd_buf) {
+          execute_secondaries(pass_cmd_buf, secondariesOf(tasks));
+        });
+    }
+  }
+
+  // draw final scene to screen
+
+  frameGraph->addPass(
+    "forward",
+    [&](FrameGraph::PassBuilder& builder) {
+      builder.sample(currentShadows);
+      builder.colorAttachment(backbuffer);
+      builder.depthAttachment(mainViewDepth, {.clearValue = depthClear});
+      builder.useSecondaryCommandBuffers();
+    },
+    [&secondariesOf, forwardTasks](vk::CommandBuffer pass_cmd_buf) {
+      execute_secondaries(pass_cmd_buf, secondariesOf(forwardTasks));
+    });
+
   if (drawDebugFSQuad)
-    quadRenderer->render(cmd_buf, target_image, target_image_view, shadowMap, defaultSampler);
+    frameGraph->addPass(
+      "debug_quad",
+      [&](FrameGraph::PassBuilder& builder) {
+        builder.sample(currentShadows);
+        builder.write(backbuffer, FrameGraph::Access::ColorAttachment);
+      },
+      [&, this](vk::CommandBuffer pass_cmd_buf) {
+        quadRenderer->render(
+          pass_cmd_buf,
+          target_image,
+          target_image_view,
+          currentShadowMap,
+          defaultSampler,
+          {.baseLayer = std::min(static_cast<std::uint32_t>(debugCascade), activeCascades - 1),
+           .layerCount = 1});
+      });
+
+  frameGraph->execute(cmd_buf);
+
+  textureLoader->endFeedback(cmd_buf);
 }
 
 void WorldRenderer::drawGui()
@@ -262,6 +731,67 @@ void WorldRenderer::drawGui()
   ImGui::SliderFloat3("Light source position", pos, -10.f, 10.f);
   uniformParams.lightPos = {pos[0], pos[1], pos[2]};
 
+  ImGui::SliderFloat("Shadow distance", &lightProps.shadowDistance, 5.f, 200.f);
+  ImGui::SliderFloat("Cascade split lambda", &lightProps.splitLambda, 0.f, 1.f);
+  ImGui::SliderInt("Debug cascade", &debugCascade, 0, static_cast<int>(activeCascades) - 1);
+
+  ImGui::Checkbox("Cache static shadows", &cacheStaticShadows);
+
+  const int instanceCount = static_cast<int>(sceneMgr->getInstanceMatrices().size());
+  if (instanceCount > 0)
+  {
+    if (ImGui::Checkbox("Animate an instance", &animateInstance) && animateInstance)
+      staticShadowUpdatesAtAnimationStart = staticShadowUpdates;
+    const int previousInstance = animatedInstance;
+    if (ImGui::SliderInt("Animated instance", &animatedInstance, 0, instanceCount - 1) &&
+      animatedInstance != previousInstance && animatedInstanceRest.has_value())
+    {
+      // Put the previous instance back where it was before animating another one
+      sceneMgr->setInstanceMatrix(
+        static_cast<std::size_t>(previousInstance), *animatedInstanceRest);
+      animatedInstanceRest.reset();
+    }
+    if (animateInstance)
+      ImGui::Text(
+        "Static shadow map re-rendered %u times since the animation started",
+        staticShadowUpdates - staticShadowUpdatesAtAnimationStart);
+  }
+
+  bool parallelRecording = cmdRecorder->isParallel();
+  ImGui::Checkbox("Record commands on worker threads", &parallelRecording);
+  cmdRecorder->setParallel(parallelRecording);
+  ImGui::Text(
+    "Recorded %zu secondary buffers in %.3f ms using %zu threads",
+    drawTasks.size(),
+    recordingTimeMs,
+    parallelRecording ? workers->threadCount() : std::size_t{1});
+  ImGui::Text("Static shadow map re-rendered %u times", staticShadowUpdates);
+  ImGui::Text(
+    "Textures: %zu of %zu still loading",
+    textureLoader->getPendingCount(),
+    materialTextures.size());
+  int textureBudgetMib = static_cast<int>(textureLoader->getStreamingBudget() >> 20);
+  ImGui::SliderInt("Texture budget, MiB", &textureBudgetMib, 8, 1024);
+  textureLoader->setStreamingBudget(vk::DeviceSize(textureBudgetMib) << 20);
+  ImGui::Text(
+    "Texture memory: %.1f MiB, %llu mips streamed in, %llu evicted",
+    static_cast<double>(textureLoader->getResidentSize()) / (1024.0 * 1024.0),
+    static_cast<unsigned long long>(textureLoader->getStreamInCount()),
+    static_cast<unsigned long long>(textureLoader->getEvictionCount()));
+  ImGui::Text(
+    "Descriptors written this frame: %u, %zu sets cached",
+    descriptorCache->getWriteCount(),
+    descriptorCache->getSetCount());
+  ImGui::Text(
+    "Frame ring: %llu / %llu KiB used",
+    static_cast<unsigned long long>(frameRing->getUsedSize() / 1024),
+    static_cast<unsigned long long>(frameRing->getSizePerFrame() / 1024));
+  ImGui::Text(
+    "Transient memory: %.1f MiB (%.1f MiB without aliasing), %zu passes culled",
+    static_cast<double>(frameGraph->getTransientMemorySize()) / (1024.0 * 1024.0),
+    static_cast<double>(frameGraph->getTransientImagesSize()) / (1024.0 * 1024.0),
+    frameGraph->getCulledPassCount());
+
   ImGui::Text(
     "Application average %.3f ms/frame (%.1f FPS)",
     1000.0f / ImGui::GetIO().Framerate,
@@ -3,12 +3,20 @@
 #include <etna/Image.hpp>
 #include <etna/Sampler.hpp>
 #include <etna/Buffer.hpp>
-#include <etna/GraphicsPipeline.hpp>
 #include <glm/glm.hpp>
 
+#include <optional>
+
 #include "shaders/UniformParams.h"
 #include "scene/SceneManager.hpp"
 #include "render_utils/QuadRenderer.hpp"
+#include "render_utils/ReloadableGraphicsPipeline.hpp"
+#include "render_utils/FrameGraph.hpp"
+#include "render_utils/FrameRingAllocator.hpp"
+#include "render_utils/DescriptorSetCache.hpp"
+#include "render_utils/SecondaryCmdRecorder.hpp"
+#include "render_utils/TextureLoader.hpp"
+#include "threading/WorkerPool.hpp"
 #include "wsi/Keyboard.hpp"
 
 #include "FramePacket.hpp"
@@ -29,6 +37,19 @@ public:
   void allocateResources(glm::uvec2 swapchain_resolution);
   void setupPipelines(vk::Format swapchain_format);
 
+  // Cheap enough to be called on every resize event while frames are in flight
+  void resize(glm::uvec2 swapchain_resolution);
+  vk::Format getColorFormat() const { return colorFormat; }
+
+  // Passes of the frame graph are timed with it, may be null
+  void setGpuProfiler(GpuTimestampProfiler* profiler) { frameGraph->setProfiler(profiler); }
+  // Scene pipelines are built with it, must be set before setupPipelines
+  void setPipelineCache(vk::PipelineCache cache) { pipelineCache = cache; }
+
+  // Rebuilds scene pipelines from the SPIR-V on disk in the background,
+  // they are swapped in by one of the following renderWorld calls
+  void rebuildPipelines();
+
   void debugInput(const Keyboard& kb);
   void update(const FramePacket& packet);
   void drawGui();
@@ -36,47 +57,167 @@ public:
     vk::CommandBuffer cmd_buf, vk::Image target_image, vk::ImageView target_image_view);
 
 private:
+  enum class InstanceKind
+  {
+    All,
+    Static,
+    Dynamic,
+  };
+
+  // Fills `result` with instances of the specified kind that are visible through `proj_view`
+  void cullInstances(
+    const glm::mat4x4& proj_view, InstanceKind kind, std::vector<std::uint32_t>& result);
+
   void renderScene(
-    vk::CommandBuffer cmd_buf, const glm::mat4x4& glob_tm, vk::PipelineLayout pipeline_layout);
+    vk::CommandBuffer cmd_buf,
+    const glm::mat4x4& glob_tm,
+    vk::PipelineLayout pipeline_layout,
+    std::span<const std::uint32_t> instances);
+
+  // Fits every cascade to a slice of the main camera's frustum
+  void updateCascades(const Camera& main_cam, const Camera& light_cam, float aspect);
+
+  // A chunk of a pass that gets recorded into its own secondary command buffer
+  struct DrawTask
+  {
+    vk::Pipeline pipeline;
+    vk::PipelineLayout pipelineLayout;
+    vk::DescriptorSet descriptorSet;
+    glm::mat4x4 projView;
+    std::span<const std::uint32_t> instances;
+  };
+
+  // Range of drawTasks that belong to a single pass
+  struct PassTasks
+  {
+    std::size_t first = 0;
+    std::size_t count = 0;
+  };
+
+  // Splits instances into chunks and adds a copy of `pass` for each of them
+  PassTasks addDrawTasks(
+    const DrawTask& pass,
+    const SecondaryCmdRecorder::RenderingInfo& rendering_info,
+    std::span<const std::uint32_t> instances);
+
+  void recordDrawTask(vk::CommandBuffer cmd_buf, const DrawTask& task);
+
+  void copyShadowMap(
+    vk::CommandBuffer cmd_buf,
+    const etna::Image& from,
+    const etna::Image& to,
+    std::uint32_t cascade_count);
 
 
 private:
   std::unique_ptr<SceneManager> sceneMgr;
 
-  etna::Image mainViewDepth;
+  // Both shadow maps are arrays with a layer per cascade
   etna::Image shadowMap;
+  // Depth of static geometry only. A cascade is re-rendered only when either
+  // its matrix or the set of static instances changes, dynamic instances are
+  // drawn on top of a copy of it into shadowMap.
+  etna::Image staticShadowMap;
   etna::Sampler defaultSampler;
-  etna::Buffer constants;
 
+  // Textures of the scene's materials, slot i + 1 of the texture array holds texture i.
+  // Textures that are still loading are drawn with a placeholder.
+  std::unique_ptr<TextureLoader> textureLoader;
+  std::vector<TextureLoader::Handle> materialTextures;
+  etna::Sampler materialSampler;
+
+  // Model matrices are not pushed per-draw, they are
+  // read from SceneManager's instance transform buffer.
   struct PushConstants
   {
     glm::mat4x4 projView;
-    glm::mat4x4 model;
-  } pushConst2M;
+  };
+
+  struct StaticShadowCache
+  {
+    bool valid = false;
+    glm::mat4x4 lightMatrix;
+    std::uint64_t staticGeometryVersion = 0;
+  };
+
+  struct ShadowCascade
+  {
+    glm::mat4x4 lightMatrix;
+    // View space depth at which this cascade ends
+    float splitFar = 0;
+    StaticShadowCache staticCache;
+    bool staticOutdated = true;
+    // Culling results, kept around to avoid allocations
+    std::vector<std::uint32_t> staticDrawList;
+    std::vector<std::uint32_t> dynamicDrawList;
+    PassTasks staticTasks;
+    PassTasks dynamicTasks;
+  };
+
+  std::array<ShadowCascade, SHADOW_CASCADE_COUNT> cascades;
+  std::uint32_t activeCascades = SHADOW_CASCADE_COUNT;
+
+  bool cacheStaticShadows = true;
+  std::uint32_t staticShadowUpdates = 0;
+
+  // Bobs a single instance up and down. It becomes dynamic and goes through
+  // the dynamic shadow passes, while the static cascades should stay cached.
+  bool animateInstance = false;
+  int animatedInstance = 0;
+  std::optional<glm::mat4x4> animatedInstanceRest;
+  std::uint32_t staticShadowUpdatesAtAnimationStart = 0;
+
+  // Scratch space for culling results, kept around to avoid allocations
+  std::vector<std::uint32_t> visibleInstances;
+
+  // All passes are recorded into secondary command buffers on these threads
+  std::unique_ptr<WorkerPool> workers;
+  std::unique_ptr<SecondaryCmdRecorder> cmdRecorder;
+  std::vector<DrawTask> drawTasks;
+  std::vector<SecondaryCmdRecorder::RenderingInfo> drawTaskInfos;
+  float recordingTimeMs = 0;
+
+  // Main view depth is a transient image owned by the graph
+  std::unique_ptr<FrameGraph> frameGraph;
+
+  // All data the CPU sends to the GPU every frame goes through here
+  std::unique_ptr<FrameRingAllocator> frameRing;
+  // Sets of the passes, which bind the same resources frame after frame
+  std::unique_ptr<DescriptorSetCache> descriptorCache;
 
   glm::mat4x4 worldViewProj;
-  glm::mat4x4 lightMatrix;
   glm::vec3 lightPos;
 
   struct ShadowMapCam
   {
-    float radius = 10;
+    // Only used for the perspective light, which is rendered into a single cascade
     float lightTargetDist = 24;
     bool usePerspectiveM = false;
+    // Cascades cover the main camera's frustum only up to this distance
+    float shadowDistance = 40;
+    // 0 means uniform cascade splits, 1 means logarithmic ones
+    float splitLambda = 0.75f;
+    // How far behind a cascade's bounding sphere shadow casters can be
+    float casterMargin = 20;
   } lightProps;
 
   UniformParams uniformParams{
-    .lightMatrix = {},
+    .cascadeMatrices = {},
+    .cascadeSplits = {},
+    .viewZ = {},
     .lightPos = {},
     .time = {},
     .baseColor = {0.9f, 0.92f, 1.0f},
   };
 
-  etna::GraphicsPipeline basicForwardPipeline{};
-  etna::GraphicsPipeline shadowPipeline{};
+  vk::PipelineCache pipelineCache;
+  std::unique_ptr<ReloadableGraphicsPipeline> basicForwardPipeline;
+  std::unique_ptr<ReloadableGraphicsPipeline> shadowPipeline;
 
   std::unique_ptr<QuadRenderer> quadRenderer;
   bool drawDebugFSQuad = false;
+  int debugCascade = 0;
 
   glm::uvec2 resolution;
+  vk::Format colorFormat = vk::Format::eUndefined;
 };
@@ -1,10 +1,116 @@
+#include <charconv>
+#include <cstdio>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
 #include "App.hpp"
 
 
-int main()
+static void print_usage()
+{
+  std::printf(
+    "Usage: shadowmap [--threaded] [--no-pipeline-cache] [--headless] [--frames N]\n"
+    "                 [--resolution WxH] [--dump-frames I,J,...] [--output DIR]\n"
+    "                 [--benchmark CAMERA_PATH] [--warmup N] [--benchmark-output FILE]\n");
+}
+
+// The whole string has to be a number, std::stoul would take "12abc" and throw on "abc"
+static std::optional<std::uint32_t> parse_uint(std::string_view str)
+{
+  std::uint32_t value = 0;
+  const auto [end, error] = std::from_chars(str.data(), str.data() + str.size(), value);
+  if (error != std::errc{} || end != str.data() + str.size())
+    return std::nullopt;
+  return value;
+}
+
+static std::optional<std::uint32_t> parse_positive(std::string_view str)
+{
+  const auto value = parse_uint(str);
+  if (!value.has_value() || *value == 0)
+    return std::nullopt;
+  return value;
+}
+
+static std::optional<glm::uvec2> parse_resolution(std::string_view str)
+{
+  const auto separator = str.find('x');
+  if (separator == std::string_view::npos)
+    return std::nullopt;
+  const auto width = parse_positive(str.substr(0, separator));
+  const auto height = parse_positive(str.substr(separator + 1));
+  if (!width.has_value() || !height.has_value())
+    return std::nullopt;
+  return glm::uvec2{*width, *height};
+}
+
+static std::optional<std::vector<std::uint32_t>> parse_frame_list(std::string_view list)
+{
+  std::vector<std::uint32_t> result;
+  std::istringstream stream{std::string{list}};
+  for (std::string item; std::getline(stream, item, ',');)
+  {
+    const auto frame = parse_uint(item);
+    if (!frame.has_value())
+      return std::nullopt;
+    result.push_back(*frame);
+  }
+  return result;
+}
+
+int main(int argc, char** argv)
 {
+  App::Options options;
+  for (int i = 1; i < argc; ++i)
+  {
+    const std::string_view arg{argv[i]};
+    const bool hasValue = i + 1 < argc;
+
+    // Every option that takes a value sets this to false when the value is malformed
+    bool valid = true;
+    const auto assign = [&valid](auto& target, const auto& parsed) {
+      if (parsed.has_value())
+        target = *parsed;
+      else
+        valid = false;
+    };
+
+    if (arg == "--threaded")
+      options.threaded = true;
+    else if (arg == "--no-pipeline-cache")
+      options.pipelineCachePath.clear();
+    else if (arg == "--headless")
+      options.headless = true;
+    else if (arg == "--frames" && hasValue)
+      assign(options.frameCount, parse_positive(argv[++i]));
+    else if (arg == "--resolution" && hasValue)
+      assign(options.resolution, parse_resolution(argv[++i]));
+    else if (arg == "--dump-frames" && hasValue)
+      assign(options.dumpFrames, parse_frame_list(argv[++i]));
+    else if (arg == "--output" && hasValue)
+      options.outputDir = argv[++i];
+    else if (arg == "--benchmark" && hasValue)
+      options.benchmarkPath = argv[++i];
+    else if (arg == "--warmup" && hasValue)
+      assign(options.warmupFrames, parse_uint(argv[++i]));
+    else if (arg == "--benchmark-output" && hasValue)
+      options.benchmarkOutput = argv[++i];
+    else
+      valid = false;
+
+    if (!valid)
+    {
+      std::fprintf(stderr, "Invalid argument: %s\n", argv[i]);
+      print_usage();
+      return 1;
+    }
+  }
+
   {
-    App app;
+    App app{options};
     app.run();
   }
 
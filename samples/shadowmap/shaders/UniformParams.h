@@ -4,9 +4,16 @@
 #include "cpp_glsl_compat.h"
 
 
+// NOTE: can't be more than 4, as split distances are packed into a vec4
+#define SHADOW_CASCADE_COUNT 4
+
 struct UniformParams
 {
-  shader_mat4 lightMatrix;
+  shader_mat4 cascadeMatrices[SHADOW_CASCADE_COUNT];
+  // View space depth at which every cascade ends
+  shader_vec4 cascadeSplits;
+  // Third row of the main camera's view matrix, i.e. dot(viewZ, vec4(p, 1)) is the view depth of p
+  shader_vec4 viewZ;
   shader_vec3 lightPos;
   shader_float time;
   shader_vec3 baseColor;
@@ -3,6 +3,8 @@
 #extension GL_GOOGLE_include_directive : require
 
 #include "UniformParams.h"
+#include "Material.h"
+#include "mip_feedback.glsl"
 
 
 layout(location = 0) out vec4 out_fragColor;
@@ -13,6 +15,7 @@ layout(location = 0) in VS_OUT
   vec3 wNorm;
   vec3 wTangent;
   vec2 texCoord;
+  flat uint materialIdx;
 } surf;
 
 layout(binding = 0, set = 0) uniform AppData
@@ -20,11 +23,35 @@ layout(binding = 0, set = 0) uniform AppData
   UniformParams params;
 };
 
-layout(binding = 1) uniform sampler2D shadowMap;
+layout(binding = 1) uniform sampler2DArray shadowMap;
 
-void main()
+// Indexed with a value that is uniform within a draw, as a relem has a single material.
+// Merging relems with different materials into one draw would require nonuniformEXT.
+layout(binding = 3) uniform sampler2D materialTextures[MAX_MATERIAL_TEXTURES];
+
+layout(std430, binding = 4) readonly buffer Materials
+{
+  Material materials[];
+};
+
+// Finest mip sampled from every slot of the texture array, read back by TextureLoader
+layout(std430, binding = 5) buffer MipFeedback
+{
+  uint mipFeedback[];
+};
+
+float calc_shadow(vec3 wPos)
 {
-  const vec4 posLightClipSpace = params.lightMatrix*vec4(surf.wPos, 1.0f);
+  // Cascades are sorted by distance from the camera, pick the first one that covers us
+  const float viewDepth = dot(params.viewZ, vec4(wPos, 1.0f));
+  uint cascade = 0;
+  while (cascade + 1 < SHADOW_CASCADE_COUNT && viewDepth > params.cascadeSplits[cascade])
+    ++cascade;
+
+  if (viewDepth > params.cascadeSplits[cascade])
+    return 1.0f;
+
+  const vec4 posLightClipSpace = params.cascadeMatrices[cascade]*vec4(wPos, 1.0f);
 
   // for orto matrix, we don't need perspective division, you can remove it if you want; this is general case;
   const vec3 posLightSpaceNDC = posLightClipSpace.xyz/posLightClipSpace.w;
@@ -33,7 +60,22 @@ void main()
   const vec2 shadowTexCoord = posLightSpaceNDC.xy*0.5f + vec2(0.5f, 0.5f);
 
   const bool  outOfView = (shadowTexCoord.x < 0.0001f || shadowTexCoord.x > 0.9999f || shadowTexCoord.y < 0.0091f || shadowTexCoord.y > 0.9999f);
-  const float shadow    = ((posLightSpaceNDC.z < textureLod(shadowMap, shadowTexCoord, 0).x + 0.001f) || outOfView) ? 1.0f : 0.0f;
+  return ((posLightSpaceNDC.z < textureLod(shadowMap, vec3(shadowTexCoord, cascade), 0).x + 0.001f) || outOfView) ? 1.0f : 0.0f;
+}
+
+void main()
+{
+  const float shadow = calc_shadow(surf.wPos);
+
+  const Material material = materials[surf.materialIdx];
+  const vec4 albedo = material.baseColorFactor *
+    texture(materialTextures[material.baseColorTexture], surf.texCoord);
+
+  // Every fragment queries the LOD, derivatives are undefined inside of the branch
+  const uint feedbackMip =
+    mip_feedback_value(materialTextures[material.baseColorTexture], surf.texCoord);
+  if (is_mip_feedback_pixel(gl_FragCoord.xy))
+    atomicMin(mipFeedback[material.baseColorTexture], feedbackMip);
 
   const vec4 dark_violet = vec4(0.59f, 0.0f, 0.82f, 1.0f);
   const vec4 chartreuse  = vec4(0.5f, 1.0f, 0.0f, 1.0f);
@@ -45,5 +87,5 @@ void main()
   const vec4 lightColor = max(dot(surf.wNorm, lightDir), 0.0f) * lightColor1;
   const float ambient = 0.05;
   // Light formula is pretty arbitrary and most definitely wrong
-  out_fragColor = (lightColor * shadow + ambient) * vec4(params.baseColor, 1.0f);
+  out_fragColor = (lightColor * shadow + ambient) * vec4(params.baseColor, 1.0f) * albedo;
 }
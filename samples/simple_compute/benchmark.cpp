@@ -0,0 +1,272 @@
+#include "simple_compute.h"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <iterator>
+#include <limits>
+#include <numeric>
+#include <random>
+#include <span>
+#include <utility>
+
+#include <etna/Etna.hpp>
+
+
+// GPU timings are the best of this many runs, the CPU only runs once as it's way slower anyway
+static constexpr int GPU_RUNS = 3;
+
+template <class F>
+static float measure_cpu(F&& func)
+{
+  const auto start = std::chrono::steady_clock::now();
+  func();
+  return std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Returns whether the results matched, so that callers can count failures
+static bool report(
+  const char* primitive, std::uint32_t count, float cpu_ms, float gpu_ms, bool matches)
+{
+  // Millions of elements per second
+  const auto throughput = [count](float ms) { return static_cast<float>(count) / ms * 1e-3f; };
+
+  spdlog::info(
+    "{:>8} {:>10} | cpu {:10.3f} ms {:8.1f} M/s | gpu {:10.3f} ms {:8.1f} M/s | x{:<6.1f}{}",
+    primitive,
+    count,
+    cpu_ms,
+    throughput(cpu_ms),
+    gpu_ms,
+    throughput(gpu_ms),
+    cpu_ms / gpu_ms,
+    matches ? "" : " MISMATCH");
+  return matches;
+}
+
+// Makes a copy done before the measured part visible to the primitives
+static void transfer_barrier(vk::CommandBuffer cmd_buf)
+{
+  vk::MemoryBarrier2 barrier{
+    .srcStageMask = vk::PipelineStageFlagBits2::eTransfer,
+    .srcAccessMask = vk::AccessFlagBits2::eTransferWrite,
+    .dstStageMask = vk::PipelineStageFlagBits2::eComputeShader,
+    .dstAccessMask =
+      vk::AccessFlagBits2::eShaderStorageRead | vk::AccessFlagBits2::eShaderStorageWrite,
+  };
+  cmd_buf.pipelineBarrier2(vk::DependencyInfo{
+    .memoryBarrierCount = 1,
+    .pMemoryBarriers = &barrier,
+  });
+}
+
+float SimpleCompute::measureGpu(
+  const std::function<void(vk::CommandBuffer)>& prepare,
+  const std::function<void(vk::CommandBuffer)>& work)
+{
+  float best = std::numeric_limits<float>::max();
+  for (int run = 0; run < GPU_RUNS; ++run)
+  {
+    // All earlier submissions were waited on, so their descriptor sets may be recycled
+    etna::begin_frame();
+
+    auto cmdBuf = cmdMgr->start();
+    ETNA_CHECK_VK_RESULT(cmdBuf.begin(vk::CommandBufferBeginInfo{}));
+
+    if (prepare)
+      prepare(cmdBuf);
+
+    cmdBuf.resetQueryPool(timestamps.get(), 0, 2);
+    cmdBuf.writeTimestamp2(vk::PipelineStageFlagBits2::eAllCommands, timestamps.get(), 0);
+    work(cmdBuf);
+    cmdBuf.writeTimestamp2(vk::PipelineStageFlagBits2::eAllCommands, timestamps.get(), 1);
+
+    ETNA_CHECK_VK_RESULT(cmdBuf.end());
+    cmdMgr->submitAndWait(std::move(cmdBuf));
+    etna::end_frame();
+
+    std::array<std::uint64_t, 2> ticks{};
+    ETNA_CHECK_VK_RESULT(context->getDevice().getQueryPoolResults(
+      timestamps.get(),
+      0,
+      2,
+      sizeof(ticks),
+      ticks.data(),
+      sizeof(std::uint64_t),
+      vk::QueryResultFlagBits::e64 | vk::QueryResultFlagBits::eWait));
+
+    best = std::min(best, static_cast<float>(ticks[1] - ticks[0]) * nsPerTick * 1e-6f);
+  }
+  return best;
+}
+
+bool SimpleCompute::benchmark(std::uint32_t max_exponent)
+{
+  std::uint32_t maxCount = 1;
+  for (std::uint32_t i = 0; i < max_exponent; ++i)
+    maxCount *= 10;
+
+  primitives = std::make_unique<ComputePrimitives>(ComputePrimitives::CreateInfo{
+    .maxCount = maxCount,
+  });
+
+  nsPerTick = context->getPhysicalDevice().getProperties().limits.timestampPeriod;
+  timestamps =
+    etna::unwrap_vk_result(context->getDevice().createQueryPoolUnique(vk::QueryPoolCreateInfo{
+      .queryType = vk::QueryType::eTimestamp,
+      .queryCount = 2,
+    }));
+
+  const auto createBuffer = [this](vk::DeviceSize size, const char* name) {
+    return context->createBuffer(etna::Buffer::CreateInfo{
+      .size = size,
+      .bufferUsage = vk::BufferUsageFlagBits::eStorageBuffer |
+        vk::BufferUsageFlagBits::eTransferSrc | vk::BufferUsageFlagBits::eTransferDst,
+      .memoryUsage = VMA_MEMORY_USAGE_GPU_ONLY,
+      .name = name,
+    });
+  };
+  auto input = createBuffer(maxCount * sizeof(std::uint32_t), "bench_input");
+  auto flags = createBuffer(maxCount * sizeof(std::uint32_t), "bench_flags");
+  auto output = createBuffer(maxCount * sizeof(std::uint32_t), "bench_output");
+  auto values = createBuffer(maxCount * sizeof(std::uint32_t), "bench_values");
+  auto result = createBuffer(sizeof(std::uint32_t), "bench_result");
+
+  std::mt19937 rng{42};
+  const auto isKept = [](std::uint32_t key) { return (key & 1u) != 0; };
+
+  spdlog::info("Compute primitives vs CPU, GPU time is the best of {} runs", GPU_RUNS);
+  std::size_t mismatches = 0;
+
+  for (std::uint64_t size = 1000; size <= maxCount; size *= 10)
+  {
+    const auto count = static_cast<std::uint32_t>(size);
+
+    std::vector<std::uint32_t> keys(count);
+    std::ranges::generate(keys, [&rng]() { return static_cast<std::uint32_t>(rng()); });
+    std::vector<std::uint32_t> keep(count);
+    std::ranges::transform(
+      keys, keep.begin(), [&](std::uint32_t key) { return isKept(key) ? 1u : 0u; });
+
+    transferHelper->uploadBuffer<std::uint32_t>(*cmdMgr, input, 0, keys);
+    transferHelper->uploadBuffer<std::uint32_t>(*cmdMgr, flags, 0, keep);
+
+    std::vector<std::uint32_t> expected(count);
+    std::vector<std::uint32_t> actual(count);
+
+    {
+      std::uint32_t expectedSum = 0;
+      const float cpuMs =
+        measure_cpu([&]() { expectedSum = std::reduce(keys.begin(), keys.end(), 0u); });
+      const float gpuMs = measureGpu(
+        {}, [&](vk::CommandBuffer cmd_buf) { primitives->reduce(cmd_buf, input, result, count); });
+
+      std::uint32_t actualSum = 0;
+      transferHelper->readbackBuffer<std::uint32_t>(
+        *cmdMgr, std::span{&actualSum, 1}, result, 0);
+      if (!report("reduce", count, cpuMs, gpuMs, actualSum == expectedSum))
+        ++mismatches;
+    }
+
+    {
+      const float cpuMs = measure_cpu(
+        [&]() { std::exclusive_scan(keys.begin(), keys.end(), expected.begin(), 0u); });
+      const float gpuMs = measureGpu({}, [&](vk::CommandBuffer cmd_buf) {
+        primitives->exclusiveScan(cmd_buf, input, output, count);
+      });
+
+      transferHelper->readbackBuffer<std::uint32_t>(*cmdMgr, actual, output, 0);
+      if (!report("scan", count, cpuMs, gpuMs, actual == expected))
+        ++mismatches;
+    }
+
+    {
+      // Capacity is already there, so this doesn't measure allocations
+      expected.clear();
+      const float cpuMs = measure_cpu(
+        [&]() { std::ranges::copy_if(keys, std::back_inserter(expected), isKept); });
+      const float gpuMs = measureGpu({}, [&](vk::CommandBuffer cmd_buf) {
+        primitives->compact(cmd_buf, input, flags, output, result, count);
+      });
+
+      std::uint32_t keptCount = 0;
+      transferHelper->readbackBuffer<std::uint32_t>(
+        *cmdMgr, std::span{&keptCount, 1}, result, 0);
+      bool matches = keptCount == expected.size();
+      if (matches)
+      {
+        actual.resize(keptCount);
+        transferHelper->readbackBuffer<std::uint32_t>(*cmdMgr, actual, output, 0);
+        matches = actual == expected;
+      }
+      if (!report("compact", count, cpuMs, gpuMs, matches))
+        ++mismatches;
+    }
+
+    {
+      expected.assign(keys.begin(), keys.end());
+      const float cpuMs = measure_cpu([&]() { std::ranges::sort(expected); });
+      const float gpuMs = measureGpu(
+        [&](vk::CommandBuffer cmd_buf) {
+          // Sorting is in-place, so every run starts from a fresh copy
+          cmd_buf.copyBuffer(
+            input.get(), output.get(), vk::BufferCopy{.size = count * sizeof(std::uint32_t)});
+          transfer_barrier(cmd_buf);
+        },
+        [&](vk::CommandBuffer cmd_buf) {
+          primitives->radixSort(cmd_buf, output, nullptr, count);
+        });
+
+      actual.resize(count);
+      transferHelper->readbackBuffer<std::uint32_t>(*cmdMgr, actual, output, 0);
+      if (!report("sort", count, cpuMs, gpuMs, actual == expected))
+        ++mismatches;
+    }
+
+    {
+      // Few distinct keys, so that plenty of them tie and stability matters.
+      // Values are the original positions, which makes them unique.
+      using KeyValue = std::pair<std::uint32_t, std::uint32_t>;
+      std::vector<KeyValue> pairs(count);
+      std::vector<std::uint32_t> tiedKeys(count);
+      std::vector<std::uint32_t> positions(count);
+      for (std::uint32_t i = 0; i < count; ++i)
+      {
+        tiedKeys[i] = keys[i] >> 20;
+        positions[i] = i;
+        pairs[i] = {tiedKeys[i], i};
+      }
+      // The input buffers are refilled by the next size anyway
+      transferHelper->uploadBuffer<std::uint32_t>(*cmdMgr, input, 0, tiedKeys);
+      transferHelper->uploadBuffer<std::uint32_t>(*cmdMgr, flags, 0, positions);
+
+      const float cpuMs =
+        measure_cpu([&]() { std::ranges::stable_sort(pairs, {}, &KeyValue::first); });
+      const float gpuMs = measureGpu(
+        [&](vk::CommandBuffer cmd_buf) {
+          const vk::BufferCopy region{.size = count * sizeof(std::uint32_t)};
+          cmd_buf.copyBuffer(input.get(), output.get(), region);
+          cmd_buf.copyBuffer(flags.get(), values.get(), region);
+          transfer_barrier(cmd_buf);
+        },
+        [&](vk::CommandBuffer cmd_buf) {
+          primitives->radixSort(cmd_buf, output, &values, count);
+        });
+
+      actual.resize(count);
+      transferHelper->readbackBuffer<std::uint32_t>(*cmdMgr, actual, output, 0);
+      std::vector<std::uint32_t> actualValues(count);
+      transferHelper->readbackBuffer<std::uint32_t>(*cmdMgr, actualValues, values, 0);
+
+      bool matches = true;
+      for (std::uint32_t i = 0; i < count && matches; ++i)
+        matches = actual[i] == pairs[i].first && actualValues[i] == pairs[i].second;
+      if (!report("sort kv", count, cpuMs, gpuMs, matches))
+        ++mismatches;
+    }
+  }
+
+  if (mismatches != 0)
+    spdlog::error("{} primitive runs did not match the CPU", mismatches);
+  return mismatches == 0;
+}
@@ -18,6 +18,7 @@ void SimpleCompute::init()
 
   transferHelper =
     std::make_unique<etna::BlockingTransferHelper>(etna::BlockingTransferHelper::CreateInfo{
-      .stagingSize = static_cast<std::uint32_t>(length * sizeof(float)),
+      // Large enough for benchmark inputs to go through in a reasonable number of chunks
+      .stagingSize = 16 * 1024 * 1024,
     });
 }
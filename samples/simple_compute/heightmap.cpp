@@ -0,0 +1,188 @@
+#include "simple_compute.h"
+
+#include <array>
+#include <chrono>
+#include <cstring>
+#include <vector>
+
+#include <etna/Etna.hpp>
+#include <tracy/Tracy.hpp>
+
+#include "render_utils/HeightmapGenerator.hpp"
+#include "threading/WorkerPool.hpp"
+
+
+template <class F>
+static float measure_ms(F&& func)
+{
+  const auto start = std::chrono::steady_clock::now();
+  func();
+  return std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Bit exact comparison, heights must not merely be close
+static bool same_rows(
+  std::span<const float> region,
+  std::span<const float> map,
+  std::uint32_t map_width,
+  const HeightmapGenerator::Region& where)
+{
+  for (std::uint32_t y = 0; y < where.extent.y; ++y)
+  {
+    const float* expected =
+      map.data() + std::size_t{where.origin.y + y} * map_width + where.origin.x;
+    const float* actual = region.data() + std::size_t{y} * where.extent.x;
+    if (std::memcmp(expected, actual, where.extent.x * sizeof(float)) != 0)
+      return false;
+  }
+  return true;
+}
+
+bool SimpleCompute::benchmarkHeightmap(std::uint32_t size, std::uint32_t tile_size)
+{
+  ZoneScoped;
+
+  HeightmapGenerator generator{HeightmapGenerator::CreateInfo{}};
+  WorkerPool workers;
+  // Chunked lane loops without threads, to tell SIMD gains apart from threading ones
+  WorkerPool singleThread{1};
+
+  const HeightmapGenerator::Region whole{.origin = {0, 0}, .extent = {size, size}};
+  // Somewhere in the middle, not aligned to lattice cells
+  const HeightmapGenerator::Region tile{
+    .origin = glm::uvec2{size / 3},
+    .extent = glm::uvec2{tile_size},
+  };
+  const std::size_t texelCount = std::size_t{size} * size;
+
+  auto image = context->createImage(etna::Image::CreateInfo{
+    .extent = vk::Extent3D{size, size, 1},
+    .name = "bench_heightmap",
+    .format = vk::Format::eR32Sfloat,
+    .imageUsage = vk::ImageUsageFlagBits::eStorage | vk::ImageUsageFlagBits::eTransferSrc |
+      vk::ImageUsageFlagBits::eTransferDst,
+  });
+  auto readbackBuffer = context->createBuffer(etna::Buffer::CreateInfo{
+    .size = texelCount * sizeof(float),
+    .bufferUsage = vk::BufferUsageFlagBits::eTransferSrc | vk::BufferUsageFlagBits::eTransferDst,
+    .memoryUsage = VMA_MEMORY_USAGE_GPU_ONLY,
+    .name = "bench_heightmap_readback",
+  });
+
+  const auto readback = [&](std::vector<float>& heights) {
+    auto cmdBuf = cmdMgr->start();
+    ETNA_CHECK_VK_RESULT(cmdBuf.begin(vk::CommandBufferBeginInfo{}));
+    etna::set_state(
+      cmdBuf,
+      image.get(),
+      vk::PipelineStageFlagBits2::eTransfer,
+      vk::AccessFlagBits2::eTransferRead,
+      vk::ImageLayout::eTransferSrcOptimal,
+      vk::ImageAspectFlagBits::eColor);
+    etna::flush_barriers(cmdBuf);
+    cmdBuf.copyImageToBuffer(
+      image.get(),
+      vk::ImageLayout::eTransferSrcOptimal,
+      readbackBuffer.get(),
+      {vk::BufferImageCopy{
+        .bufferOffset = 0,
+        .bufferRowLength = 0,
+        .bufferImageHeight = 0,
+        .imageSubresource =
+          {
+            .aspectMask = vk::ImageAspectFlagBits::eColor,
+            .mipLevel = 0,
+            .baseArrayLayer = 0,
+            .layerCount = 1,
+          },
+        .imageOffset = {0, 0, 0},
+        .imageExtent = {size, size, 1},
+      }});
+    ETNA_CHECK_VK_RESULT(cmdBuf.end());
+    cmdMgr->submitAndWait(std::move(cmdBuf));
+
+    heights.resize(texelCount);
+    transferHelper->readbackBuffer<float>(*cmdMgr, heights, readbackBuffer, 0);
+  };
+
+  std::vector<float> scalar(texelCount);
+  std::vector<float> chunked(texelCount);
+  std::vector<float> cpu(texelCount);
+  std::vector<float> gpu;
+
+  const float scalarMs = measure_ms([&]() {
+    for (std::uint32_t y = 0; y < size; ++y)
+      for (std::uint32_t x = 0; x < size; ++x)
+        scalar[std::size_t{y} * size + x] = generator.sample({x, y});
+  });
+  const float chunkedMs = measure_ms([&]() { generator.generate(singleThread, whole, chunked); });
+  const float cpuMs = measure_ms([&]() { generator.generate(workers, whole, cpu); });
+  const float gpuMs = measureGpu(
+    {}, [&](vk::CommandBuffer cmd_buf) { generator.generate(cmd_buf, image, whole); });
+  readback(gpu);
+
+  const bool cpuMatches = scalar == chunked && scalar == cpu;
+  const bool gpuMatches = std::memcmp(cpu.data(), gpu.data(), texelCount * sizeof(float)) == 0;
+  spdlog::info(
+    "Heightmap {}x{}: scalar {:.1f} ms, chunked {:.1f} ms, cpu {:.1f} ms on {} threads, "
+    "gpu {:.3f} ms{}{}",
+    size,
+    size,
+    scalarMs,
+    chunkedMs,
+    cpuMs,
+    workers.threadCount(),
+    gpuMs,
+    cpuMatches ? "" : " CPU MISMATCH",
+    gpuMatches ? "" : " GPU MISMATCH");
+
+  // Regenerated tiles must match the whole map they are a part of
+  std::vector<float> cpuTile(std::size_t{tile_size} * tile_size);
+  const float cpuTileMs = measure_ms([&]() { generator.generate(workers, tile, cpuTile); });
+  const float gpuTileMs = measureGpu(
+    [&](vk::CommandBuffer cmd_buf) {
+      // Anything outside of the tile that is left over would go unnoticed otherwise
+      etna::set_state(
+        cmd_buf,
+        image.get(),
+        vk::PipelineStageFlagBits2::eTransfer,
+        vk::AccessFlagBits2::eTransferWrite,
+        vk::ImageLayout::eTransferDstOptimal,
+        vk::ImageAspectFlagBits::eColor);
+      etna::flush_barriers(cmd_buf);
+      cmd_buf.clearColorImage(
+        image.get(),
+        vk::ImageLayout::eTransferDstOptimal,
+        vk::ClearColorValue{std::array{0.0f, 0.0f, 0.0f, 0.0f}},
+        {vk::ImageSubresourceRange{
+          .aspectMask = vk::ImageAspectFlagBits::eColor,
+          .baseMipLevel = 0,
+          .levelCount = 1,
+          .baseArrayLayer = 0,
+          .layerCount = 1,
+        }});
+    },
+    [&](vk::CommandBuffer cmd_buf) { generator.generate(cmd_buf, image, tile); });
+  readback(gpu);
+
+  std::vector<float> gpuTile;
+  gpuTile.reserve(cpuTile.size());
+  for (std::uint32_t y = 0; y < tile_size; ++y)
+  {
+    const auto row = gpu.begin() + std::size_t{tile.origin.y + y} * size + tile.origin.x;
+    gpuTile.insert(gpuTile.end(), row, row + tile_size);
+  }
+
+  const bool cpuTileMatches = same_rows(cpuTile, cpu, size, tile);
+  const bool gpuTileMatches = same_rows(gpuTile, cpu, size, tile);
+  spdlog::info(
+    "Heightmap tile {}x{}: cpu {:.3f} ms, gpu {:.3f} ms{}{}",
+    tile_size,
+    tile_size,
+    cpuTileMs,
+    gpuTileMs,
+    cpuTileMatches ? "" : " CPU MISMATCH",
+    gpuTileMatches ? "" : " GPU MISMATCH");
+
+  return cpuMatches && gpuMatches && cpuTileMatches && gpuTileMatches;
+}
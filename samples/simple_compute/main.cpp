@@ -1,17 +1,87 @@
 #include "simple_compute.h"
 #include <etna/Etna.hpp>
 
-int main()
+#include <charconv>
+#include <cstdio>
+#include <optional>
+#include <string_view>
+
+
+static void print_usage()
+{
+  std::printf(
+    "Usage: simple_compute [--benchmark[=MAX_EXPONENT]] [--stream] [--heightmap]\n"
+    "  --benchmark  compares compute primitives against the CPU on 10^3..10^MAX_EXPONENT\n"
+    "               elements, MAX_EXPONENT is 3..8 and defaults to 8\n"
+    "  --stream     streams batches through one and three sets of buffers\n"
+    "  --heightmap  generates a heightmap with scalar code, on all cores and on the GPU\n"
+    "Exits with 1 if any GPU result doesn't match the CPU.\n");
+}
+
+// The whole string has to be a number, std::atoi would take "5abc" and return 0 on "abc"
+static std::optional<std::uint32_t> parse_exponent(std::string_view str)
+{
+  std::uint32_t value = 0;
+  const auto [end, error] = std::from_chars(str.data(), str.data() + str.size(), value);
+  if (error != std::errc{} || end != str.data() + str.size() || value < 3 || value > 8)
+    return std::nullopt;
+  return value;
+}
+
+int main(int argc, char** argv)
 {
+  // 10^8 elements take a couple of gigabytes, pass a lower exponent if that's too much
+  std::optional<std::uint32_t> benchmarkExponent;
+  bool stream = false;
+  bool heightmap = false;
+
+  for (int i = 1; i < argc; ++i)
+  {
+    const std::string_view arg{argv[i]};
+    constexpr std::string_view BENCHMARK_PREFIX = "--benchmark=";
+
+    bool valid = true;
+    if (arg == "--benchmark")
+      benchmarkExponent = 8;
+    else if (arg.starts_with(BENCHMARK_PREFIX))
+    {
+      benchmarkExponent = parse_exponent(arg.substr(BENCHMARK_PREFIX.size()));
+      valid = benchmarkExponent.has_value();
+    }
+    else if (arg == "--stream")
+      stream = true;
+    else if (arg == "--heightmap")
+      heightmap = true;
+    else
+      valid = false;
+
+    if (!valid)
+    {
+      std::fprintf(stderr, "Invalid argument: %s\n", argv[i]);
+      print_usage();
+      return 1;
+    }
+  }
+
+  bool matches = true;
   {
     SimpleCompute app;
 
     app.init();
     app.execute();
+    if (benchmarkExponent.has_value())
+      matches = app.benchmark(*benchmarkExponent) && matches;
+    if (stream)
+    {
+      matches = app.stream(256, 1 << 20, 1) && matches;
+      matches = app.stream(256, 1 << 20, 3) && matches;
+    }
+    if (heightmap)
+      matches = app.benchmarkHeightmap(4096, 256) && matches;
   }
 
   if (etna::is_initilized())
     etna::shutdown();
 
-  return 0;
+  return matches ? 0 : 1;
 }
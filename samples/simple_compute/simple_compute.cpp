@@ -5,6 +5,11 @@
 #include <etna/Etna.hpp>
 #include <etna/PipelineManager.hpp>
 
+#include "render_utils/WorkgroupTuner.hpp"
+
+// Our own 16 elements are way too few to tell workgroup sizes apart
+static constexpr std::uint32_t TUNING_LENGTH = 1 << 22;
+
 SimpleCompute::SimpleCompute()
   : length{16}
 {
@@ -56,6 +61,72 @@ void SimpleCompute::setup()
 
   // Compute pipeline creation
   pipeline = context->getPipelineManager().createComputePipeline("simple_compute", {});
+  tuneWorkgroupSize();
+}
+
+void SimpleCompute::tuneWorkgroupSize()
+{
+  // Every candidate workgroup size is a pipeline of its own, reruns should not compile them again
+  pipelineCache = std::make_unique<PersistentPipelineCache>("simple_compute_pipeline_cache.bin");
+  variants = std::make_unique<ComputeVariantCache>(ComputeVariantCache::CreateInfo{
+    .programName = "simple_compute",
+    .spirvPath = SIMPLE_COMPUTE_SHADERS_ROOT "simple.comp.spv",
+    .pipelineCache = pipelineCache->get(),
+  });
+
+  WorkgroupTuner tuner{"simple_compute_workgroups.txt"};
+
+  const auto createBuffer = [this](const char* name) {
+    return context->createBuffer(etna::Buffer::CreateInfo{
+      .size = sizeof(float) * TUNING_LENGTH,
+      .bufferUsage = vk::BufferUsageFlagBits::eStorageBuffer,
+      .memoryUsage = VMA_MEMORY_USAGE_GPU_ONLY,
+      .name = name,
+    });
+  };
+  auto a = createBuffer("tuning_a");
+  auto b = createBuffer("tuning_b");
+  auto sum = createBuffer("tuning_sum");
+
+  const auto size = tuner.tune(WorkgroupTuner::Kernel{
+    .name = "simple_compute",
+    .variants = variants.get(),
+    .constants = [](glm::uvec2 group_size) { return ComputeVariantCache::Constants{group_size.x}; },
+    .candidates = {{32, 1}, {64, 1}, {128, 1}, {256, 1}, {512, 1}, {1024, 1}},
+    .record =
+      [&](vk::CommandBuffer cmd_buf, vk::Pipeline variant, glm::uvec2 group_size) {
+        auto set = etna::create_descriptor_set(
+          etna::get_shader_program("simple_compute").getDescriptorLayoutId(0),
+          cmd_buf,
+          {
+            etna::Binding{0, a.genBinding()},
+            etna::Binding{1, b.genBinding()},
+            etna::Binding{2, sum.genBinding()},
+          });
+        vk::DescriptorSet vkSet = set.getVkSet();
+
+        cmd_buf.bindPipeline(vk::PipelineBindPoint::eCompute, variant);
+        cmd_buf.bindDescriptorSets(
+          vk::PipelineBindPoint::eCompute,
+          pipeline.getVkPipelineLayout(),
+          0,
+          1,
+          &vkSet,
+          0,
+          nullptr);
+        cmd_buf.pushConstants(
+          pipeline.getVkPipelineLayout(),
+          vk::ShaderStageFlagBits::eCompute,
+          0,
+          sizeof(TUNING_LENGTH),
+          &TUNING_LENGTH);
+        cmd_buf.dispatch((TUNING_LENGTH + group_size.x - 1) / group_size.x, 1, 1);
+      },
+  });
+
+  workgroupSize = size.x;
+  tunedPipeline = variants->getBlocking({workgroupSize});
+  spdlog::info("simple.comp runs with {} invocations per workgroup", workgroupSize);
 }
 
 void SimpleCompute::buildCommandBuffer(vk::CommandBuffer cmd_buf)
@@ -75,7 +146,7 @@ void SimpleCompute::buildCommandBuffer(vk::CommandBuffer cmd_buf)
 
   vk::DescriptorSet vkSet = set.getVkSet();
 
-  cmd_buf.bindPipeline(vk::PipelineBindPoint::eCompute, pipeline.getVkPipeline());
+  cmd_buf.bindPipeline(vk::PipelineBindPoint::eCompute, tunedPipeline);
   cmd_buf.bindDescriptorSets(
     vk::PipelineBindPoint::eCompute, pipeline.getVkPipelineLayout(), 0, 1, &vkSet, 0, nullptr);
 
@@ -84,7 +155,7 @@ void SimpleCompute::buildCommandBuffer(vk::CommandBuffer cmd_buf)
 
   etna::flush_barriers(cmd_buf);
 
-  cmd_buf.dispatch(1, 1, 1);
+  cmd_buf.dispatch((length + workgroupSize - 1) / workgroupSize, 1, 1);
 
   ETNA_CHECK_VK_RESULT(cmd_buf.end());
 }
@@ -1,6 +1,7 @@
 #ifndef SIMPLE_COMPUTE_H
 #define SIMPLE_COMPUTE_H
 
+#include <functional>
 #include <memory>
 
 #include <etna/GlobalContext.hpp>
@@ -8,6 +9,10 @@
 #include <etna/OneShotCmdMgr.hpp>
 #include <etna/BlockingTransferHelper.hpp>
 
+#include "render_utils/ComputePrimitives.hpp"
+#include "render_utils/ComputeVariantCache.hpp"
+#include "render_utils/PersistentPipelineCache.hpp"
+
 
 class SimpleCompute
 {
@@ -16,6 +21,16 @@ public:
 
   void init();
   void execute();
+  // Compares compute primitives against the CPU on 10^3..10^max_exponent elements,
+  // returns false on any mismatch
+  bool benchmark(std::uint32_t max_exponent);
+  // Pushes batches through slot_count sets of buffers, so that the CPU fills and checks
+  // batches while the GPU works on others. A single slot runs everything back to back.
+  // Returns false if any batch doesn't match the CPU.
+  bool stream(std::uint32_t batch_count, std::uint32_t batch_size, std::uint32_t slot_count);
+  // Generates a size^2 heightmap with scalar code, on all cores and on the GPU, then
+  // regenerates a tile of it, and returns whether all of them agree bit for bit
+  bool benchmarkHeightmap(std::uint32_t size, std::uint32_t tile_size);
 
   //////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 private:
@@ -27,14 +42,30 @@ private:
   std::uint32_t length;
 
   etna::ComputePipeline pipeline;
+  // NOTE: declared before variants, which might still be compiling with it on destruction
+  std::unique_ptr<PersistentPipelineCache> pipelineCache;
+  // Variants of simple.comp with different workgroup sizes, the tuned one is used
+  std::unique_ptr<ComputeVariantCache> variants;
+  vk::Pipeline tunedPipeline;
+  std::uint32_t workgroupSize = 32;
 
   etna::Buffer bufA;
   etna::Buffer bufB;
   etna::Buffer bufResult;
 
+  std::unique_ptr<ComputePrimitives> primitives;
+  vk::UniqueQueryPool timestamps;
+  float nsPerTick = 1;
+
   void setup();
+  void tuneWorkgroupSize();
   void buildCommandBuffer(vk::CommandBuffer cmd_buf);
   void readback();
+
+  // Runs the recorded work on its own and returns its GPU time
+  float measureGpu(
+    const std::function<void(vk::CommandBuffer)>& prepare,
+    const std::function<void(vk::CommandBuffer)>& work);
 };
 
 
@@ -0,0 +1,240 @@
+#include "simple_compute.h"
+
+#include <chrono>
+#include <limits>
+#include <optional>
+#include <vector>
+
+#include <etna/Etna.hpp>
+#include <etna/DescriptorSet.hpp>
+#include <tracy/Tracy.hpp>
+
+#include "render_utils/HostReadback.hpp"
+
+
+namespace
+{
+
+// Everything a batch needs from upload to readback, reused once its fence is signaled
+struct StreamSlot
+{
+  vk::UniqueCommandPool pool;
+  vk::UniqueCommandBuffer cmdBuf;
+  vk::UniqueFence done;
+
+  // Persistently mapped, both inputs go into a single upload buffer one after another
+  etna::Buffer upload;
+  etna::Buffer readback;
+  float* uploadData = nullptr;
+  const float* readbackData = nullptr;
+
+  etna::Buffer a;
+  etna::Buffer b;
+  etna::Buffer result;
+  vk::DescriptorSet set;
+
+  // Batch whose results are on their way to readback
+  std::optional<std::uint32_t> batch;
+};
+
+} // namespace
+
+// Cheap to generate, and all sums are exact in floats
+static float input_a(std::uint32_t batch, std::uint32_t i)
+{
+  return static_cast<float>((batch + i) % 4096);
+}
+
+static float input_b(std::uint32_t batch, std::uint32_t)
+{
+  return static_cast<float>(batch % 17);
+}
+
+static void memory_barrier(
+  vk::CommandBuffer cmd_buf,
+  vk::PipelineStageFlags2 src_stage,
+  vk::AccessFlags2 src_access,
+  vk::PipelineStageFlags2 dst_stage,
+  vk::AccessFlags2 dst_access)
+{
+  const vk::MemoryBarrier2 barrier{
+    .srcStageMask = src_stage,
+    .srcAccessMask = src_access,
+    .dstStageMask = dst_stage,
+    .dstAccessMask = dst_access,
+  };
+  cmd_buf.pipelineBarrier2(vk::DependencyInfo{
+    .memoryBarrierCount = 1,
+    .pMemoryBarriers = &barrier,
+  });
+}
+
+bool SimpleCompute::stream(
+  std::uint32_t batch_count, std::uint32_t batch_size, std::uint32_t slot_count)
+{
+  ZoneScoped;
+
+  auto device = context->getDevice();
+  const vk::DeviceSize batchBytes = batch_size * sizeof(float);
+
+  const auto createBuffer =
+    [this](vk::DeviceSize size, vk::BufferUsageFlags usage, VmaMemoryUsage memory) {
+      return context->createBuffer(etna::Buffer::CreateInfo{
+        .size = size,
+        .bufferUsage = usage,
+        .memoryUsage = memory,
+        .name = "stream",
+      });
+    };
+
+  // Sets come from etna's per-frame pool, which is left alone until streaming is over
+  etna::begin_frame();
+  auto programInfo = etna::get_shader_program("simple_compute");
+
+  std::vector<StreamSlot> slots(slot_count);
+  for (auto& slot : slots)
+  {
+    slot.pool = etna::unwrap_vk_result(device.createCommandPoolUnique(vk::CommandPoolCreateInfo{
+      .flags = vk::CommandPoolCreateFlagBits::eResetCommandBuffer,
+      .queueFamilyIndex = context->getQueueFamilyIdx(),
+    }));
+    auto buffers =
+      etna::unwrap_vk_result(device.allocateCommandBuffersUnique(vk::CommandBufferAllocateInfo{
+        .commandPool = slot.pool.get(),
+        .level = vk::CommandBufferLevel::ePrimary,
+        .commandBufferCount = 1,
+      }));
+    slot.cmdBuf = std::move(buffers.front());
+    slot.done = etna::unwrap_vk_result(
+      device.createFenceUnique(vk::FenceCreateInfo{.flags = vk::FenceCreateFlagBits::eSignaled}));
+
+    slot.upload = createBuffer(
+      2 * batchBytes, vk::BufferUsageFlagBits::eTransferSrc, VMA_MEMORY_USAGE_CPU_ONLY);
+    slot.readback = create_readback_buffer(batchBytes, "stream_readback");
+    slot.uploadData = reinterpret_cast<float*>(slot.upload.map());
+    slot.readbackData = reinterpret_cast<const float*>(slot.readback.map());
+
+    const auto storage = vk::BufferUsageFlagBits::eStorageBuffer;
+    slot.a = createBuffer(
+      batchBytes, storage | vk::BufferUsageFlagBits::eTransferDst, VMA_MEMORY_USAGE_GPU_ONLY);
+    slot.b = createBuffer(
+      batchBytes, storage | vk::BufferUsageFlagBits::eTransferDst, VMA_MEMORY_USAGE_GPU_ONLY);
+    slot.result = createBuffer(
+      batchBytes, storage | vk::BufferUsageFlagBits::eTransferSrc, VMA_MEMORY_USAGE_GPU_ONLY);
+
+    slot.set = etna::create_descriptor_set(
+                 programInfo.getDescriptorLayoutId(0),
+                 slot.cmdBuf.get(),
+                 {
+                   etna::Binding{0, slot.a.genBinding()},
+                   etna::Binding{1, slot.b.genBinding()},
+                   etna::Binding{2, slot.result.genBinding()},
+                 })
+                 .getVkSet();
+  }
+
+  std::size_t mismatches = 0;
+  std::chrono::steady_clock::duration waited{};
+
+  // Waits for the slot's previous batch and checks its results
+  const auto retire = [&](StreamSlot& slot) {
+    ZoneScopedN("retire");
+
+    const auto waitStart = std::chrono::steady_clock::now();
+    ETNA_CHECK_VK_RESULT(
+      device.waitForFences({slot.done.get()}, VK_TRUE, std::numeric_limits<std::uint64_t>::max()));
+    waited += std::chrono::steady_clock::now() - waitStart;
+
+    if (!slot.batch.has_value())
+      return;
+
+    const auto batch = *slot.batch;
+    for (std::uint32_t i = 0; i < batch_size; ++i)
+      if (slot.readbackData[i] != input_a(batch, i) + input_b(batch, i))
+        ++mismatches;
+    slot.batch.reset();
+  };
+
+  const auto start = std::chrono::steady_clock::now();
+
+  for (std::uint32_t batch = 0; batch < batch_count; ++batch)
+  {
+    auto& slot = slots[batch % slot_count];
+    retire(slot);
+
+    {
+      ZoneScopedN("fill");
+      for (std::uint32_t i = 0; i < batch_size; ++i)
+      {
+        slot.uploadData[i] = input_a(batch, i);
+        slot.uploadData[batch_size + i] = input_b(batch, i);
+      }
+    }
+
+    auto cmdBuf = slot.cmdBuf.get();
+    ETNA_CHECK_VK_RESULT(cmdBuf.reset());
+    ETNA_CHECK_VK_RESULT(cmdBuf.begin(vk::CommandBufferBeginInfo{
+      .flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit,
+    }));
+
+    cmdBuf.copyBuffer(
+      slot.upload.get(), slot.a.get(), vk::BufferCopy{.srcOffset = 0, .size = batchBytes});
+    cmdBuf.copyBuffer(
+      slot.upload.get(), slot.b.get(), vk::BufferCopy{.srcOffset = batchBytes, .size = batchBytes});
+    memory_barrier(
+      cmdBuf,
+      vk::PipelineStageFlagBits2::eTransfer,
+      vk::AccessFlagBits2::eTransferWrite,
+      vk::PipelineStageFlagBits2::eComputeShader,
+      vk::AccessFlagBits2::eShaderStorageRead);
+
+    cmdBuf.bindPipeline(vk::PipelineBindPoint::eCompute, tunedPipeline);
+    cmdBuf.bindDescriptorSets(
+      vk::PipelineBindPoint::eCompute, pipeline.getVkPipelineLayout(), 0, 1, &slot.set, 0, nullptr);
+    cmdBuf.pushConstants(
+      pipeline.getVkPipelineLayout(),
+      vk::ShaderStageFlagBits::eCompute,
+      0,
+      sizeof(batch_size),
+      &batch_size);
+    cmdBuf.dispatch((batch_size + workgroupSize - 1) / workgroupSize, 1, 1);
+
+    memory_barrier(
+      cmdBuf,
+      vk::PipelineStageFlagBits2::eComputeShader,
+      vk::AccessFlagBits2::eShaderStorageWrite,
+      vk::PipelineStageFlagBits2::eTransfer,
+      vk::AccessFlagBits2::eTransferRead);
+    cmdBuf.copyBuffer(slot.result.get(), slot.readback.get(), vk::BufferCopy{.size = batchBytes});
+    make_writes_host_visible(cmdBuf);
+
+    ETNA_CHECK_VK_RESULT(cmdBuf.end());
+
+    ETNA_CHECK_VK_RESULT(device.resetFences({slot.done.get()}));
+    const vk::CommandBufferSubmitInfo cmdInfo{.commandBuffer = cmdBuf};
+    ETNA_CHECK_VK_RESULT(context->getQueue().submit2(
+      {vk::SubmitInfo2{.commandBufferInfoCount = 1, .pCommandBufferInfos = &cmdInfo}},
+      slot.done.get()));
+    slot.batch = batch;
+  }
+
+  // Whatever is still in flight, oldest first
+  for (std::uint32_t i = 0; i < slot_count; ++i)
+    retire(slots[(batch_count + i) % slot_count]);
+  etna::end_frame();
+
+  const float seconds =
+    std::chrono::duration<float>(std::chrono::steady_clock::now() - start).count();
+  const float waitedSeconds = std::chrono::duration<float>(waited).count();
+
+  spdlog::info(
+    "Streaming through {} slot(s): {} batches of {} elements, {:.1f} M elements/s, "
+    "{:.0f}% of the time waiting for the GPU, {} mismatches",
+    slot_count,
+    batch_count,
+    batch_size,
+    static_cast<float>(batch_count) * static_cast<float>(batch_size) / seconds * 1e-6f,
+    100.0f * waitedSeconds / seconds,
+    mismatches);
+  return mismatches == 0;
+}
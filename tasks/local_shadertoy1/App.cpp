@@ -1,9 +1,60 @@
 #include "App.hpp"
 
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <span>
+#include <string_view>
+
 #include <etna/Etna.hpp>
 #include <etna/GlobalContext.hpp>
 #include <etna/PipelineManager.hpp>
+#include <etna/DescriptorSet.hpp>
+#include <imgui.h>
+
+#include "render_utils/WorkgroupTuner.hpp"
+
+
+namespace
+{
+
+struct QualityPreset
+{
+  const char* name;
+  // Max march steps, shadow steps, whether AO is enabled, see toy.comp
+  ComputeVariantCache::Constants constants;
+};
+
+const std::array<QualityPreset, 4> QUALITY_PRESETS{
+  QualityPreset{"Low", {64, 16, 0}},
+  QualityPreset{"Medium", {96, 32, 1}},
+  QualityPreset{"High", {128, 48, 1}},
+  QualityPreset{"Ultra", {256, 96, 1}},
+};
+
+// Quality constants are followed by the workgroup size
+ComputeVariantCache::Constants trace_constants(const QualityPreset& preset, glm::uvec2 group_size)
+{
+  auto constants = preset.constants;
+  constants.push_back(group_size.x);
+  constants.push_back(group_size.y);
+  return constants;
+}
+
+// How many trace invocations a frame needs, see traced_pixel in toy_common.glsl
+glm::uvec2 traced_grid(const ToyParams& params)
+{
+  if (!params.historyValid || params.traceMode == TOY_TRACE_FULL)
+    return params.resolution;
+  if (params.traceMode == TOY_TRACE_CHECKERBOARD)
+    return {(params.resolution.x + 1) / 2, params.resolution.y};
+  return (params.resolution + 1u) / 2u;
+}
 
+const std::array<const char*, 3> TRACE_MODE_NAMES{"all", "checkerboard", "one in four"};
+
+} // namespace
 
 App::App()
   : resolution{1280, 720}
@@ -73,8 +124,90 @@ App::App()
   // How it is actually performed is not trivial, but we can skip this for now.
   commandManager = etna::get_context().createPerFrameCmdMgr();
 
+  computeQueue = std::make_unique<AsyncComputeQueue>();
+
+  etna::create_program("trace", {LOCAL_SHADERTOY1_SHADERS_ROOT "toy.comp.spv"});
+  etna::create_program("resolve", {LOCAL_SHADERTOY1_SHADERS_ROOT "resolve.comp.spv"});
+  toyPipeline = etna::get_context().getPipelineManager().createComputePipeline("trace", {});
+  etna::create_program("bake", {LOCAL_SHADERTOY1_SHADERS_ROOT "bake.comp.spv"});
+  resolvePipeline =
+    etna::get_context().getPipelineManager().createComputePipeline("resolve", {});
+  bakePipeline = etna::get_context().getPipelineManager().createComputePipeline("bake", {});
+
+  // NOTE: etna's PipelineManager can't be given a pipeline cache, so this only
+  // covers pipelines we create ourselves: the quality variants and the GUI.
+  pipelineCache =
+    std::make_unique<PersistentPipelineCache>("local_shadertoy1_pipeline_cache.bin");
+  traceVariants = std::make_unique<ComputeVariantCache>(ComputeVariantCache::CreateInfo{
+    .programName = "trace",
+    .spirvPath = LOCAL_SHADERTOY1_SHADERS_ROOT "toy.comp.spv",
+    .pipelineCache = pipelineCache->get(),
+  });
+  constexpr std::size_t fineCells = TOY_VOLUME_SIZE_X * TOY_VOLUME_SIZE_Y * TOY_VOLUME_SIZE_Z;
+  constexpr std::size_t coarseCells =
+    fineCells / (TOY_BRICK_SIZE * TOY_BRICK_SIZE * TOY_BRICK_SIZE);
+  volume = etna::get_context().createBuffer(etna::Buffer::CreateInfo{
+    .size = (fineCells + coarseCells) * sizeof(float),
+    .bufferUsage = vk::BufferUsageFlagBits::eStorageBuffer,
+    .memoryUsage = VMA_MEMORY_USAGE_GPU_ONLY,
+    .name = "toy_volume",
+  });
+
+  staticScene = ToyStaticScene{
+    .pillars = {4.0f, 1.5f, 0.25f, 8.0f},
+    .torus = {1.6f, 0.25f, -0.6f, 0.0f},
+    .boundsMin = {},
+    .boundsMax = {},
+  };
+
+  frameRing = std::make_unique<FrameRingAllocator>(FrameRingAllocator::CreateInfo{
+    .sizePerFrame = 4096,
+    .name = "toy_params",
+  });
+
+  toyImage = etna::get_context().createImage(etna::Image::CreateInfo{
+    .extent = vk::Extent3D{resolution.x, resolution.y, 1},
+    .name = "toy_result",
+    .format = vk::Format::eR8G8B8A8Unorm,
+    .imageUsage = vk::ImageUsageFlagBits::eStorage | vk::ImageUsageFlagBits::eTransferSrc,
+  });
+  for (auto& target : history)
+  {
+    target.color = etna::get_context().createImage(etna::Image::CreateInfo{
+      .extent = vk::Extent3D{resolution.x, resolution.y, 1},
+      .name = "toy_history_color",
+      .format = vk::Format::eR16G16B16A16Sfloat,
+      .imageUsage = vk::ImageUsageFlagBits::eStorage,
+    });
+    target.hit = etna::get_context().createImage(etna::Image::CreateInfo{
+      .extent = vk::Extent3D{resolution.x, resolution.y, 1},
+      .name = "toy_history_hit",
+      .format = vk::Format::eR32G32Sfloat,
+      .imageUsage = vk::ImageUsageFlagBits::eStorage,
+    });
+  }
+  traceResolution = resolution;
+
+  gpuProfiler = std::make_unique<GpuTimestampProfiler>();
+  tracedModes.emplace(
+    etna::get_context().getMainWorkCount(), [](std::size_t) { return TOY_TRACE_FULL; });
+  resolutionController =
+    std::make_unique<DynamicResolutionController>(DynamicResolutionController::CreateInfo{
+      .targetMs = 8.0f,
+      .minScale = 0.4f,
+      .maxScale = 1.0f,
+    });
+
+  guiRenderer =
+    std::make_unique<ImGuiRenderer>(vkWindow->getCurrentFormat(), pipelineCache->get());
+  ImGuiRenderer::enableImGuiForWindow(osWindow->native());
+
+  tuneTrace();
+  // Nobody waits for them, but switching presets later is instant
+  for (const auto& preset : QUALITY_PRESETS)
+    traceVariants->get(trace_constants(preset, traceGroupSize));
 
-  // TODO: Initialize any additional resources you require here!
+  startTime = std::chrono::steady_clock::now();
 }
 
 App::~App()
@@ -98,6 +231,15 @@ void App::run()
 
 void App::drawFrame()
 {
+  const auto now = std::chrono::steady_clock::now();
+  if (lastFrameTime.has_value())
+  {
+    frameIntervals[frameIntervalCount % frameIntervals.size()] =
+      std::chrono::duration<float, std::milli>(now - *lastFrameTime).count();
+    ++frameIntervalCount;
+  }
+  lastFrameTime = now;
+
   // First, get a command buffer to write GPU commands into.
   auto currentCmdBuf = commandManager->acquireNext();
 
@@ -107,12 +249,21 @@ void App::drawFrame()
   // And now get the image we should be rendering the picture into.
   auto nextSwapchainImage = vkWindow->acquireNext();
 
+  // The frame fence waited on by acquireNext above also covers compute work of this frame slot
+  computeQueue->beginFrame();
+
   // When window is minimized, we can't render anything in Windows
   // because it kills the swapchain, so we skip frames in this case.
   if (nextSwapchainImage)
   {
     auto [backbuffer, backbufferView, backbufferAvailableSem] = *nextSwapchainImage;
 
+    drawGui();
+
+    // Tracing does not depend on the backbuffer, so it is submitted separately
+    // before we start recording the rest of the frame.
+    traceToy();
+
     ETNA_CHECK_VK_RESULT(currentCmdBuf.begin(vk::CommandBufferBeginInfo{}));
     {
       // First of all, we need to "initialize" th "backbuffer", aka the current swapchain
@@ -137,8 +288,50 @@ void App::drawFrame()
       // and blit/copy operations.
       etna::flush_barriers(currentCmdBuf);
 
+      etna::set_state(
+        currentCmdBuf,
+        toyImage.get(),
+        vk::PipelineStageFlagBits2::eTransfer,
+        vk::AccessFlagBits2::eTransferRead,
+        vk::ImageLayout::eTransferSrcOptimal,
+        vk::ImageAspectFlagBits::eColor);
+      etna::flush_barriers(currentCmdBuf);
 
-      // TODO: Record your commands here!
+      const std::array srcOffsets{
+        vk::Offset3D{0, 0, 0},
+        vk::Offset3D{
+          static_cast<int32_t>(traceResolution.x), static_cast<int32_t>(traceResolution.y), 1},
+      };
+      const std::array dstOffsets{
+        vk::Offset3D{0, 0, 0},
+        vk::Offset3D{static_cast<int32_t>(resolution.x), static_cast<int32_t>(resolution.y), 1},
+      };
+      const vk::ImageSubresourceLayers layers{
+        .aspectMask = vk::ImageAspectFlagBits::eColor,
+        .mipLevel = 0,
+        .baseArrayLayer = 0,
+        .layerCount = 1,
+      };
+      currentCmdBuf.blitImage(
+        toyImage.get(),
+        vk::ImageLayout::eTransferSrcOptimal,
+        backbuffer,
+        vk::ImageLayout::eTransferDstOptimal,
+        {vk::ImageBlit{
+          .srcSubresource = layers,
+          .srcOffsets = srcOffsets,
+          .dstSubresource = layers,
+          .dstOffsets = dstOffsets,
+        }},
+        // Blits can't sharpen, bilinear is the best we get without an extra pass
+        linearUpscale ? vk::Filter::eLinear : vk::Filter::eNearest);
+
+      guiRenderer->render(
+        currentCmdBuf,
+        {{0, 0}, {resolution.x, resolution.y}},
+        backbuffer,
+        backbufferView,
+        ImGui::GetDrawData());
 
 
       // At the end of "rendering", we are required to change how the pixels of the
@@ -183,3 +376,375 @@ void App::drawFrame()
     ETNA_VERIFY((resolution == glm::uvec2{w, h}));
   }
 }
+
+void App::drawGui()
+{
+  guiRenderer->nextFrame();
+  ImGui::NewFrame();
+
+  ImGui::Begin("Dynamic resolution");
+
+  bool enabled = resolutionController->isEnabled();
+  if (ImGui::Checkbox("Enabled", &enabled))
+    resolutionController->setEnabled(enabled);
+
+  float targetMs = resolutionController->getTargetMs();
+  if (ImGui::SliderFloat("Target, ms", &targetMs, 1.0f, 33.0f))
+    resolutionController->setTargetMs(targetMs);
+
+  ImGui::Checkbox("Bilinear upscale", &linearUpscale);
+  ImGui::Combo("Traced pixels", &traceMode, "All\0Checkerboard\0One in four\0");
+
+  ImGui::Text("Scale: %.2f", resolutionController->getScale());
+  ImGui::Text("Trace resolution: %ux%u", traceResolution.x, traceResolution.y);
+  ImGui::Text("Trace: %.3f ms, resolve: %.3f ms", traceMs, resolveMs);
+  // Switching modes back and forth compares them on the same view
+  for (std::size_t mode = 0; mode < TRACE_MODE_NAMES.size(); ++mode)
+    ImGui::Text("  last trace of %s: %.3f ms", TRACE_MODE_NAMES[mode], traceMsByMode[mode]);
+  ImGui::Text("Last bake: %.3f ms, %u bakes total", bakeMs, bakeCount);
+  ImGui::Text("Smoothed total: %.3f ms", resolutionController->getSmoothedMs());
+
+  ImGui::End();
+
+  ImGui::Begin("Frame pacing");
+  const std::size_t intervalCount = std::min(frameIntervalCount, frameIntervals.size());
+  if (intervalCount > 1)
+  {
+    const auto intervals = std::span{frameIntervals}.first(intervalCount);
+    // The oldest interval once the ring is full
+    const std::size_t oldest = frameIntervalCount % intervals.size();
+    float sum = 0;
+    float worst = 0;
+    float jitter = 0;
+    for (std::size_t i = 0; i < intervals.size(); ++i)
+    {
+      const float interval = intervals[(oldest + i) % intervals.size()];
+      sum += interval;
+      worst = std::max(worst, interval);
+      // Mean difference between consecutive frames, that's what stutter looks like
+      if (i > 0)
+        jitter += std::abs(interval - intervals[(oldest + i - 1) % intervals.size()]);
+    }
+    ImGui::Text(
+      "Frame interval: %.2f ms average, %.2f ms worst, %.2f ms jitter",
+      sum / float(intervals.size()),
+      worst,
+      jitter / float(intervals.size() - 1));
+    ImGui::PlotLines(
+      "Intervals, ms",
+      intervals.data(),
+      static_cast<int>(intervals.size()),
+      static_cast<int>(oldest),
+      nullptr,
+      0.0f,
+      2.0f * worst,
+      ImVec2{0, 60});
+  }
+  ImGui::End();
+
+  ImGui::Begin("Scene");
+  ImGui::Combo(
+    "Quality",
+    &qualityPreset,
+    [](void*, int index) { return QUALITY_PRESETS[static_cast<std::size_t>(index)].name; },
+    nullptr,
+    static_cast<int>(QUALITY_PRESETS.size()));
+  ImGui::Text(
+    "Variants: %zu ready, %zu compiling",
+    traceVariants->getReadyCount(),
+    traceVariants->getPendingCount());
+  ImGui::Checkbox("March through baked volume", &useVolume);
+  ImGui::SliderFloat("Pillar ring radius", &staticScene.pillars.x, 2.5f, 6.0f);
+  ImGui::SliderFloat("Pillar height", &staticScene.pillars.y, 0.5f, 3.0f);
+  ImGui::SliderFloat("Pillar width", &staticScene.pillars.z, 0.1f, 0.6f);
+  int pillarCount = static_cast<int>(staticScene.pillars.w);
+  if (ImGui::SliderInt("Pillar count", &pillarCount, 3, 16))
+    staticScene.pillars.w = static_cast<float>(pillarCount);
+  ImGui::SliderFloat2("Torus radii", &staticScene.torus.x, 0.1f, 2.5f);
+  ImGui::SliderFloat("Torus height", &staticScene.torus.z, -0.9f, 2.0f);
+  ImGui::End();
+
+  ImGui::Render();
+}
+
+// The volume only has to cover static geometry, tight bounds give finer cells
+static void update_bounds(ToyStaticScene& scene)
+{
+  constexpr float FLOOR_HEIGHT = -1.0f;
+  constexpr float ROUNDING = 0.1f;
+  constexpr float MARGIN = 0.1f;
+
+  // Pillars are rotated, so their corners reach further than the half width
+  const float pillarReach = scene.pillars.x + std::sqrt(2.0f) * scene.pillars.z + ROUNDING;
+  const float torusReach = scene.torus.x + scene.torus.y;
+  const float reach = std::max(pillarReach, torusReach) + MARGIN;
+
+  const float bottom =
+    std::min(FLOOR_HEIGHT - ROUNDING, scene.torus.z - scene.torus.y) - MARGIN;
+  const float pillarTop = FLOOR_HEIGHT + 2.0f * scene.pillars.y + ROUNDING;
+  const float top = std::max(pillarTop, scene.torus.z + scene.torus.y) + MARGIN;
+
+  scene.boundsMin = {-reach, bottom, -reach, 0.0f};
+  scene.boundsMax = {reach, top, reach, 0.0f};
+}
+
+// Bounds are derived from the rest, so they don't need to be compared
+static bool same_static_scene(const ToyStaticScene& a, const ToyStaticScene& b)
+{
+  return a.pillars == b.pillars && a.torus == b.torus;
+}
+
+// Passes of the toy use images in the general layout and a buffer, neither
+// of which make etna insert barriers, so dependencies between them are explicit.
+static void storage_barrier(vk::CommandBuffer cmd_buf)
+{
+  const vk::MemoryBarrier2 barrier{
+    .srcStageMask = vk::PipelineStageFlagBits2::eComputeShader,
+    .srcAccessMask = vk::AccessFlagBits2::eShaderStorageWrite,
+    .dstStageMask = vk::PipelineStageFlagBits2::eComputeShader,
+    .dstAccessMask =
+      vk::AccessFlagBits2::eShaderStorageRead | vk::AccessFlagBits2::eShaderStorageWrite,
+  };
+  cmd_buf.pipelineBarrier2(vk::DependencyInfo{
+    .memoryBarrierCount = 1,
+    .pMemoryBarriers = &barrier,
+  });
+}
+
+static ToyCamera make_camera(float time, float aspect)
+{
+  // Slowly orbits around the scene
+  const float angle = time * 0.15f;
+  const glm::vec3 position{7.0f * std::sin(angle), 2.5f, -7.0f * std::cos(angle)};
+  const glm::vec3 target{0.0f, 0.2f, 0.0f};
+
+  const glm::vec3 forward = glm::normalize(target - position);
+  const glm::vec3 right = glm::normalize(glm::cross(forward, glm::vec3{0.0f, 1.0f, 0.0f}));
+  const glm::vec3 up = glm::cross(right, forward);
+
+  const float tanHalfFov = std::tan(glm::radians(60.0f) * 0.5f);
+  return ToyCamera{
+    .position = glm::vec4(position, 1.0f),
+    .forward = glm::vec4(forward, 0.0f),
+    .right = glm::vec4(right * tanHalfFov * aspect, 0.0f),
+    .up = glm::vec4(up * tanHalfFov, 0.0f),
+  };
+}
+
+void App::tuneTrace()
+{
+  // A regular frame, except that every pixel is traced at the full resolution
+  ToyStaticScene scene = staticScene;
+  update_bounds(scene);
+  const ToyCamera camera = make_camera(0.0f, float(resolution.x) / float(resolution.y));
+  const ToyParams params{
+    .scene = scene,
+    .camera = camera,
+    .prevCamera = camera,
+    .resolution = resolution,
+    .time = 0.0f,
+    .frameIndex = 0,
+    .traceMode = TOY_TRACE_FULL,
+    .historyValid = false,
+    // Nothing is baked yet
+    .useVolume = false,
+  };
+
+  auto paramsBuffer = etna::get_context().createBuffer(etna::Buffer::CreateInfo{
+    .size = sizeof(params),
+    .bufferUsage = vk::BufferUsageFlagBits::eUniformBuffer,
+    .memoryUsage = VMA_MEMORY_USAGE_CPU_ONLY,
+    .name = "toy_tuning_params",
+  });
+  std::memcpy(paramsBuffer.map(), &params, sizeof(params));
+  paramsBuffer.unmap();
+
+  WorkgroupTuner tuner{"local_shadertoy1_workgroups.txt"};
+
+  const auto& preset = QUALITY_PRESETS[static_cast<std::size_t>(qualityPreset)];
+  traceGroupSize = tuner.tune(WorkgroupTuner::Kernel{
+    .name = "toy_trace",
+    .variants = traceVariants.get(),
+    .constants = [&preset](glm::uvec2 group_size) { return trace_constants(preset, group_size); },
+    .candidates = {{8, 8}, {16, 8}, {8, 16}, {16, 16}, {32, 4}, {32, 8}, {64, 1}},
+    .record =
+      [this, &paramsBuffer](
+        vk::CommandBuffer cmd_buf, vk::Pipeline variant, glm::uvec2 group_size) {
+        const auto& target = history.front();
+        auto set = etna::create_descriptor_set(
+          etna::get_shader_program("trace").getDescriptorLayoutId(0),
+          cmd_buf,
+          {
+            etna::Binding{0, target.color.genBinding({}, vk::ImageLayout::eGeneral)},
+            etna::Binding{1, target.hit.genBinding({}, vk::ImageLayout::eGeneral)},
+            etna::Binding{2, paramsBuffer.genBinding()},
+            etna::Binding{3, volume.genBinding()},
+          });
+        vk::DescriptorSet vkSet = set.getVkSet();
+
+        cmd_buf.bindPipeline(vk::PipelineBindPoint::eCompute, variant);
+        cmd_buf.bindDescriptorSets(
+          vk::PipelineBindPoint::eCompute,
+          toyPipeline.getVkPipelineLayout(),
+          0,
+          1,
+          &vkSet,
+          0,
+          nullptr);
+        etna::flush_barriers(cmd_buf);
+
+        cmd_buf.dispatch(
+          (resolution.x + group_size.x - 1) / group_size.x,
+          (resolution.y + group_size.y - 1) / group_size.y,
+          1);
+      },
+  });
+}
+
+void App::traceToy()
+{
+  auto cmdBuf = computeQueue->beginCommands();
+
+  frameRing->beginFrame();
+
+  // Reads back results of the last frame that used this slot
+  gpuProfiler->beginFrame(cmdBuf);
+  auto& tracedMode = tracedModes->get();
+  if (gpuProfiler->getResultsVersion() != lastProfilerVersion)
+  {
+    lastProfilerVersion = gpuProfiler->getResultsVersion();
+    for (const auto& zone : gpuProfiler->getResults())
+    {
+      if (std::string_view{zone.name} == "trace")
+      {
+        traceMs = zone.ms;
+        traceMsByMode[static_cast<std::size_t>(tracedMode)] = zone.ms;
+      }
+      else if (std::string_view{zone.name} == "resolve")
+        resolveMs = zone.ms;
+      else if (std::string_view{zone.name} == "bake")
+        bakeMs = zone.ms;
+    }
+    resolutionController->update(traceMs + resolveMs);
+  }
+  traceResolution = resolutionController->getResolution(resolution, TOY_GROUP_SIZE);
+
+  update_bounds(staticScene);
+  const bool rebake = !bakedScene.has_value() || !same_static_scene(*bakedScene, staticScene);
+
+  const float time =
+    std::chrono::duration<float>(std::chrono::steady_clock::now() - startTime).count();
+  const ToyParams params{
+    .scene = staticScene,
+    .camera = make_camera(time, float(resolution.x) / float(resolution.y)),
+    .prevCamera = prevCamera,
+    .resolution = traceResolution,
+    .time = time,
+    .frameIndex = frameIndex,
+    .traceMode = static_cast<shader_uint>(traceMode),
+    // Pixels of the previous frame don't map onto the current ones after a resize
+    .historyValid = frameIndex > 0 && prevTraceResolution == traceResolution && !rebake,
+    .useVolume = useVolume,
+  };
+  const auto paramsAllocation = frameRing->uploadUniform(params);
+  // Frames without history trace every pixel, whatever the mode says
+  tracedMode = params.historyValid ? traceMode : TOY_TRACE_FULL;
+
+  const auto& current = history[frameIndex % 2];
+  const auto& previous = history[(frameIndex + 1) % 2];
+
+  ++frameIndex;
+  prevCamera = params.camera;
+  prevTraceResolution = traceResolution;
+
+  const auto dispatch = [this, cmdBuf](
+                          vk::Pipeline pipeline,
+                          const char* program,
+                          std::vector<etna::Binding> bindings,
+                          glm::uvec3 group_count) {
+    auto info = etna::get_shader_program(program);
+    auto set =
+      etna::create_descriptor_set(info.getDescriptorLayoutId(0), cmdBuf, std::move(bindings));
+    vk::DescriptorSet vkSet = set.getVkSet();
+
+    cmdBuf.bindPipeline(vk::PipelineBindPoint::eCompute, pipeline);
+    cmdBuf.bindDescriptorSets(
+      vk::PipelineBindPoint::eCompute, info.getPipelineLayout(), 0, 1, &vkSet, 0, nullptr);
+
+    etna::flush_barriers(cmdBuf);
+
+    GpuTimestampProfiler::Scope zone{gpuProfiler.get(), cmdBuf, program};
+    cmdBuf.dispatch(group_count.x, group_count.y, group_count.z);
+  };
+  const glm::uvec3 screenGroups{
+    (traceResolution.x + TOY_GROUP_SIZE - 1) / TOY_GROUP_SIZE,
+    (traceResolution.y + TOY_GROUP_SIZE - 1) / TOY_GROUP_SIZE,
+    1,
+  };
+
+  if (rebake)
+  {
+    // Earlier frames might still be marching through the old volume
+    storage_barrier(cmdBuf);
+    dispatch(
+      bakePipeline.getVkPipeline(),
+      "bake",
+      {
+        etna::Binding{0, frameRing->genBinding(paramsAllocation)},
+        etna::Binding{1, volume.genBinding()},
+      },
+      {
+        TOY_VOLUME_SIZE_X / TOY_BAKE_GROUP_SIZE,
+        TOY_VOLUME_SIZE_Y / TOY_BAKE_GROUP_SIZE,
+        TOY_VOLUME_SIZE_Z / TOY_BAKE_GROUP_SIZE,
+      });
+
+    storage_barrier(cmdBuf);
+
+    bakedScene = staticScene;
+    ++bakeCount;
+  }
+
+  vk::Pipeline tracePipeline = traceVariants->get(trace_constants(
+    QUALITY_PRESETS[static_cast<std::size_t>(qualityPreset)], traceGroupSize));
+  glm::uvec2 traceGroup = traceGroupSize;
+  if (!tracePipeline)
+  {
+    tracePipeline = toyPipeline.getVkPipeline();
+    traceGroup = {TOY_GROUP_SIZE, TOY_GROUP_SIZE};
+  }
+
+  // Profiler zones are named after programs
+  const glm::uvec2 tracedPixels = traced_grid(params);
+  dispatch(
+    tracePipeline,
+    "trace",
+    {
+      etna::Binding{0, current.color.genBinding({}, vk::ImageLayout::eGeneral)},
+      etna::Binding{1, current.hit.genBinding({}, vk::ImageLayout::eGeneral)},
+      etna::Binding{2, frameRing->genBinding(paramsAllocation)},
+      etna::Binding{3, volume.genBinding()},
+    },
+    {
+      (tracedPixels.x + traceGroup.x - 1) / traceGroup.x,
+      (tracedPixels.y + traceGroup.y - 1) / traceGroup.y,
+      1,
+    });
+
+  storage_barrier(cmdBuf);
+
+  dispatch(
+    resolvePipeline.getVkPipeline(),
+    "resolve",
+    {
+      etna::Binding{0, current.color.genBinding({}, vk::ImageLayout::eGeneral)},
+      etna::Binding{1, current.hit.genBinding({}, vk::ImageLayout::eGeneral)},
+      etna::Binding{2, previous.color.genBinding({}, vk::ImageLayout::eGeneral)},
+      etna::Binding{3, previous.hit.genBinding({}, vk::ImageLayout::eGeneral)},
+      etna::Binding{4, toyImage.genBinding({}, vk::ImageLayout::eGeneral)},
+      etna::Binding{5, frameRing->genBinding(paramsAllocation)},
+    },
+    screenGroups);
+
+  computeQueue->submit(cmdBuf);
+}
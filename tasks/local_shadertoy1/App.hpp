@@ -1,11 +1,25 @@
 #pragma once
 
+#include <array>
+#include <chrono>
+#include <optional>
+
 #include <etna/Window.hpp>
 #include <etna/PerFrameCmdMgr.hpp>
 #include <etna/ComputePipeline.hpp>
 #include <etna/Image.hpp>
+#include <etna/Buffer.hpp>
+#include <etna/GpuSharedResource.hpp>
 
 #include "wsi/OsWindowingManager.hpp"
+#include "render_utils/AsyncComputeQueue.hpp"
+#include "render_utils/ComputeVariantCache.hpp"
+#include "render_utils/DynamicResolutionController.hpp"
+#include "render_utils/FrameRingAllocator.hpp"
+#include "render_utils/GpuTimestampProfiler.hpp"
+#include "render_utils/PersistentPipelineCache.hpp"
+#include "gui/ImGuiRenderer.hpp"
+#include "shaders/ToyParams.h"
 
 
 class App
@@ -18,6 +32,11 @@ public:
 
 private:
   void drawFrame();
+  void drawGui();
+  // Picks the trace pass workgroup size for this device, or loads the cached pick
+  void tuneTrace();
+  // Records and submits the shadertoy pass
+  void traceToy();
 
 private:
   OsWindowingManager windowing;
@@ -28,4 +47,61 @@ private:
 
   std::unique_ptr<etna::Window> vkWindow;
   std::unique_ptr<etna::PerFrameCmdMgr> commandManager;
+
+  std::unique_ptr<AsyncComputeQueue> computeQueue;
+  // NOTE: declared before traceVariants, which might still be compiling with it on destruction
+  std::unique_ptr<PersistentPipelineCache> pipelineCache;
+  etna::ComputePipeline toyPipeline;
+  // Quality presets of the trace pass, toyPipeline is used until they are compiled
+  std::unique_ptr<ComputeVariantCache> traceVariants;
+  int qualityPreset = 2;
+  // Picked by WorkgroupTuner, only applies to traceVariants
+  glm::uvec2 traceGroupSize{TOY_GROUP_SIZE, TOY_GROUP_SIZE};
+  etna::ComputePipeline resolvePipeline;
+  etna::ComputePipeline bakePipeline;
+  std::unique_ptr<FrameRingAllocator> frameRing;
+
+  // Everything is allocated at the full resolution,
+  // dynamic resolution only uses the top left corner.
+  etna::Image toyImage;
+
+  // Traced and reprojected pixels, ping-ponged between frames
+  struct History
+  {
+    etna::Image color;
+    etna::Image hit;
+  };
+  std::array<History, 2> history;
+
+  // Conservative distance bounds of the static scene, only rebaked when it changes
+  etna::Buffer volume;
+  ToyStaticScene staticScene{};
+  std::optional<ToyStaticScene> bakedScene;
+  bool useVolume = true;
+  std::uint32_t bakeCount = 0;
+
+  int traceMode = TOY_TRACE_CHECKERBOARD;
+  std::uint32_t frameIndex = 0;
+  ToyCamera prevCamera{};
+  glm::uvec2 prevTraceResolution{0, 0};
+
+  std::unique_ptr<GpuTimestampProfiler> gpuProfiler;
+  std::unique_ptr<DynamicResolutionController> resolutionController;
+  std::uint64_t lastProfilerVersion = 0;
+  float traceMs = 0;
+  // Indexed by the trace mode, frames without history count as tracing everything
+  std::array<float, 3> traceMsByMode{};
+  std::optional<etna::GpuSharedResource<int>> tracedModes;
+  float resolveMs = 0;
+  float bakeMs = 0;
+  glm::uvec2 traceResolution;
+  bool linearUpscale = true;
+
+  // CPU side intervals between frame starts, a ring of the most recent ones
+  std::array<float, 128> frameIntervals{};
+  std::size_t frameIntervalCount = 0;
+  std::optional<std::chrono::steady_clock::time_point> lastFrameTime;
+
+  std::unique_ptr<ImGuiRenderer> guiRenderer;
+  std::chrono::steady_clock::time_point startTime;
 };
@@ -0,0 +1,61 @@
+#ifndef TOY_PARAMS_H_INCLUDED
+#define TOY_PARAMS_H_INCLUDED
+
+#include "cpp_glsl_compat.h"
+
+
+#define TOY_GROUP_SIZE 8
+
+// Which pixels get traced every frame, the rest is reprojected from the previous frame
+#define TOY_TRACE_FULL 0
+#define TOY_TRACE_CHECKERBOARD 1
+#define TOY_TRACE_QUARTER 2
+
+// Static part of the scene is baked into a volume of conservative distance bounds,
+// the finest level is made of bricks that each form a single cell of the coarse level.
+#define TOY_VOLUME_SIZE_X 64
+#define TOY_VOLUME_SIZE_Y 32
+#define TOY_VOLUME_SIZE_Z 64
+#define TOY_BRICK_SIZE 8
+#define TOY_BAKE_GROUP_SIZE 4
+
+// Parameters of everything that never moves, changing them triggers a rebake
+struct ToyStaticScene
+{
+  // Ring radius, half height, half width, count
+  shader_vec4 pillars;
+  // Major radius, minor radius, height
+  shader_vec4 torus;
+  // Bounds of all static geometry, also the area covered by the volume
+  shader_vec4 boundsMin;
+  shader_vec4 boundsMax;
+};
+
+// Right and up are pre-scaled by the frustum size, so that
+// a ray through ndc is forward + ndc.x * right + ndc.y * up
+struct ToyCamera
+{
+  shader_vec4 position;
+  shader_vec4 forward;
+  shader_vec4 right;
+  shader_vec4 up;
+};
+
+struct ToyParams
+{
+  ToyStaticScene scene;
+  ToyCamera camera;
+  ToyCamera prevCamera;
+  // Resolution the scene is traced at, might be lower than the window's
+  shader_uvec2 resolution;
+  shader_float time;
+  shader_uint frameIndex;
+  shader_uint traceMode;
+  // False when the previous frame can't be reprojected, e.g. after a resolution change
+  shader_bool historyValid;
+  // Whether marching takes steps through the baked volume
+  shader_bool useVolume;
+};
+
+
+#endif // TOY_PARAMS_H_INCLUDED
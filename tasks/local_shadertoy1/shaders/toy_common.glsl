@@ -0,0 +1,67 @@
+#ifndef TOY_COMMON_GLSL_INCLUDED
+#define TOY_COMMON_GLSL_INCLUDED
+
+#include "ToyParams.h"
+
+
+// Material ids of the scene, written next to the hit distance
+const float MATERIAL_FLOOR = 0.0;
+const float MATERIAL_STATIC = 1.0;
+const float MATERIAL_DYNAMIC = 2.0;
+
+vec3 camera_ray(ToyCamera camera, ivec2 pixel, uvec2 resolution)
+{
+  vec2 ndc = (vec2(pixel) + 0.5) / vec2(resolution) * 2.0 - 1.0;
+  ndc.y = -ndc.y;
+  return normalize(camera.forward.xyz + ndc.x * camera.right.xyz + ndc.y * camera.up.xyz);
+}
+
+// Inverse of camera_ray, returns false if the point is behind the camera or off screen
+bool project_to_pixel(ToyCamera camera, vec3 point, uvec2 resolution, out ivec2 pixel)
+{
+  vec3 d = point - camera.position.xyz;
+  float z = dot(d, camera.forward.xyz);
+  if (z <= 0.0)
+    return false;
+
+  vec2 ndc = vec2(
+    dot(d, camera.right.xyz) / dot(camera.right.xyz, camera.right.xyz),
+    dot(d, camera.up.xyz) / dot(camera.up.xyz, camera.up.xyz)) / z;
+  ndc.y = -ndc.y;
+
+  pixel = ivec2(floor((ndc * 0.5 + 0.5) * vec2(resolution)));
+  return all(greaterThanEqual(pixel, ivec2(0))) && all(lessThan(pixel, ivec2(resolution)));
+}
+
+// Every 2x2 quad traces one of its pixels, diagonals go first so that
+// any two consecutive frames together cover the quad evenly.
+const int QUARTER_ORDER[4] = int[4](0, 3, 1, 2);
+
+bool is_traced(ToyParams params, ivec2 pixel)
+{
+  if (!params.historyValid || params.traceMode == TOY_TRACE_FULL)
+    return true;
+
+  if (params.traceMode == TOY_TRACE_CHECKERBOARD)
+    return ((pixel.x + pixel.y + int(params.frameIndex)) & 1) == 0;
+
+  return (pixel.x & 1) + 2 * (pixel.y & 1) == QUARTER_ORDER[params.frameIndex & 3u];
+}
+
+// The inverse of is_traced, maps a trace invocation onto the pixel it traces, so that
+// only traced pixels are dispatched. Might land outside of the resolution on odd sizes.
+// The grid is computed by traced_grid in App.cpp.
+ivec2 traced_pixel(ToyParams params, ivec2 id)
+{
+  if (!params.historyValid || params.traceMode == TOY_TRACE_FULL)
+    return id;
+
+  // Every row is packed to half the width, the offset alternates between rows and frames
+  if (params.traceMode == TOY_TRACE_CHECKERBOARD)
+    return ivec2(2 * id.x + ((id.y + int(params.frameIndex)) & 1), id.y);
+
+  int quadPixel = QUARTER_ORDER[params.frameIndex & 3u];
+  return 2 * id + ivec2(quadPixel & 1, quadPixel >> 1);
+}
+
+#endif // TOY_COMMON_GLSL_INCLUDED
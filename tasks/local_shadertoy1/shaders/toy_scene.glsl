@@ -0,0 +1,74 @@
+#ifndef TOY_SCENE_GLSL_INCLUDED
+#define TOY_SCENE_GLSL_INCLUDED
+
+#include "ToyParams.h"
+
+
+const float FLOOR_HEIGHT = -1.0;
+
+float sd_sphere(vec3 p, float r)
+{
+  return length(p) - r;
+}
+
+float sd_box(vec3 p, vec3 b)
+{
+  vec3 q = abs(p) - b;
+  return length(max(q, 0.0)) + min(max(q.x, max(q.y, q.z)), 0.0);
+}
+
+float sd_round_box(vec3 p, vec3 b, float r)
+{
+  return sd_box(p, b) - r;
+}
+
+float sd_torus(vec3 p, vec2 t)
+{
+  vec2 q = vec2(length(p.xz) - t.x, p.y);
+  return length(q) - t.y;
+}
+
+float smooth_min(float a, float b, float k)
+{
+  float h = clamp(0.5 + 0.5 * (b - a) / k, 0.0, 1.0);
+  return mix(b, a, h) - k * h * (1.0 - h);
+}
+
+// Everything that never moves, i.e. a ring of pillars with a torus in the middle.
+// The floor is kept separate as it is infinite and trivial to evaluate.
+float static_sdf(ToyStaticScene scene, vec3 p)
+{
+  // Fold the ring of pillars into a single sector
+  const float sector = 6.2831853 / scene.pillars.w;
+  float angle = mod(atan(p.z, p.x) + sector * 0.5, sector) - sector * 0.5;
+  vec3 q = vec3(length(p.xz) * cos(angle), p.y, length(p.xz) * sin(angle));
+  float pillars = sd_round_box(
+    q - vec3(scene.pillars.x, FLOOR_HEIGHT + scene.pillars.y, 0.0),
+    scene.pillars.zyz,
+    0.1);
+
+  float ring = sd_torus(p - vec3(0.0, scene.torus.z, 0.0), scene.torus.xy);
+  return min(pillars, ring);
+}
+
+vec3 volume_cell_size(ToyStaticScene scene)
+{
+  return (scene.boundsMax.xyz - scene.boundsMin.xyz) /
+    vec3(TOY_VOLUME_SIZE_X, TOY_VOLUME_SIZE_Y, TOY_VOLUME_SIZE_Z);
+}
+
+uint volume_fine_index(ivec3 cell)
+{
+  return uint(cell.x + TOY_VOLUME_SIZE_X * (cell.y + TOY_VOLUME_SIZE_Y * cell.z));
+}
+
+// Coarse level is stored right after the fine one
+uint volume_coarse_index(ivec3 brick)
+{
+  const ivec3 size = ivec3(TOY_VOLUME_SIZE_X, TOY_VOLUME_SIZE_Y, TOY_VOLUME_SIZE_Z);
+  const ivec3 bricks = size / TOY_BRICK_SIZE;
+  return uint(size.x * size.y * size.z) +
+    uint(brick.x + bricks.x * (brick.y + bricks.y * brick.z));
+}
+
+#endif // TOY_SCENE_GLSL_INCLUDED
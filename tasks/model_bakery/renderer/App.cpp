@@ -2,38 +2,71 @@
 
 #include <tracy/Tracy.hpp>
 
+#include "scene/CameraPathBenchmark.hpp"
 
-App::App()
+
+static constexpr float BENCHMARK_FRAME_TIME = 1.0f / 60.0f;
+static const glm::uvec2 INITIAL_RESOLUTION = {1280, 720};
+
+
+App::App(Options app_options)
+  : options{std::move(app_options)}
 {
-  glm::uvec2 initialRes = {1280, 720};
-  mainWindow = windowing.createWindow(OsWindow::CreateInfo{
-    .resolution = initialRes,
+  if (options.headless)
+    initHeadless();
+  else
+    initWindowed();
+
+  mainCam.lookAt({0, 10, 10}, {0, 0, 0}, {0, 1, 0});
+
+  renderer->loadScene(GRAPHICS_COURSE_RESOURCES_ROOT "/scenes/low_poly_dark_town/scene.gltf");
+}
+
+void App::initWindowed()
+{
+  windowing = std::make_unique<OsWindowingManager>();
+  mainWindow = windowing->createWindow(OsWindow::CreateInfo{
+    .resolution = INITIAL_RESOLUTION,
   });
 
-  renderer.reset(new Renderer(initialRes));
+  renderer.reset(new Renderer(INITIAL_RESOLUTION));
 
-  auto instExts = windowing.getRequiredVulkanInstanceExtensions();
+  auto instExts = windowing->getRequiredVulkanInstanceExtensions();
   renderer->initVulkan(instExts);
 
   auto surface = mainWindow->createVkSurface(etna::get_context().getInstance());
 
-  renderer->initFrameDelivery(std::move(surface), [this]() { return mainWindow->getResolution(); });
-
-  mainCam.lookAt({0, 10, 10}, {0, 0, 0}, {0, 1, 0});
+  // Frame times of a benchmark capped by the display refresh rate would be meaningless
+  const bool vsync = options.benchmarkPath.empty();
+  renderer->initFrameDelivery(
+    std::move(surface), [this]() { return mainWindow->getResolution(); }, vsync);
+}
 
-  renderer->loadScene(GRAPHICS_COURSE_RESOURCES_ROOT "/scenes/low_poly_dark_town/scene.gltf");
+void App::initHeadless()
+{
+  renderer.reset(new Renderer(INITIAL_RESOLUTION));
+  renderer->initVulkan({}, true);
+  renderer->initHeadlessFrameDelivery();
 }
 
 void App::run()
 {
-  double lastTime = windowing.getTime();
+  if (options.benchmarkPath.empty())
+    runInteractive();
+  else
+    runBenchmark();
+}
+
+void App::runInteractive()
+{
+  double lastTime = windowing->getTime();
   while (!mainWindow->isBeingClosed())
   {
-    const double currTime = windowing.getTime();
+    const double currTime = windowing->getTime();
     const float diffTime = static_cast<float>(currTime - lastTime);
     lastTime = currTime;
 
-    windowing.poll();
+    windowing->poll();
 
     processInput(diffTime);
 
@@ -43,6 +76,30 @@ void App::run()
   }
 }
 
+void App::runBenchmark()
+{
+  const CameraPathBenchmark benchmark{CameraPathBenchmark::CreateInfo{
+    .cameraPath = options.benchmarkPath,
+    .warmupFrames = options.warmupFrames,
+    .output = options.benchmarkOutput,
+    .frameTime = BENCHMARK_FRAME_TIME,
+  }};
+
+  benchmark.run(renderer->getGpuProfiler(), [this](const Camera& camera, float time) {
+    if (mainWindow != nullptr)
+    {
+      windowing->poll();
+      if (mainWindow->isBeingClosed())
+        return false;
+    }
+
+    fixedTime = time;
+    mainCam = camera;
+    drawFrame();
+    return true;
+  });
+}
+
 void App::processInput(float dt)
 {
   ZoneScoped;
@@ -71,7 +128,7 @@ void App::drawFrame()
 
   renderer->update(FramePacket{
     .mainCam = mainCam,
-    .currentTime = static_cast<float>(windowing.getTime()),
+    .currentTime = fixedTime.has_value() ? *fixedTime : static_cast<float>(windowing->getTime()),
   });
   renderer->drawFrame();
 }
@@ -1,5 +1,9 @@
 #pragma once
 
+#include <filesystem>
+#include <memory>
+#include <optional>
+
 #include "wsi/OsWindowingManager.hpp"
 #include "scene/Camera.hpp"
 
@@ -9,11 +13,28 @@
 class App
 {
 public:
-  App();
+  struct Options
+  {
+    // Replays a camera path and writes frame time statistics instead of running interactively
+    std::filesystem::path benchmarkPath;
+    std::uint32_t warmupFrames = 60;
+    // CSV or JSON, depending on the extension
+    std::filesystem::path benchmarkOutput = "benchmark.csv";
+    // Benchmark into an offscreen image without creating a window
+    bool headless = false;
+  };
+
+  explicit App(Options options);
 
   void run();
 
 private:
+  void initWindowed();
+  void initHeadless();
+
+  void runInteractive();
+  void runBenchmark();
+
   void processInput(float dt);
   void drawFrame();
 
@@ -21,7 +42,8 @@ private:
   void rotateCam(Camera& cam, const Mouse& ms, float dt);
 
 private:
-  OsWindowingManager windowing;
+  // Neither of these exist in headless mode
+  std::unique_ptr<OsWindowingManager> windowing;
   std::unique_ptr<OsWindow> mainWindow;
 
   float camMoveSpeed = 1;
@@ -30,4 +52,9 @@ private:
   Camera mainCam;
 
   std::unique_ptr<Renderer> renderer;
+
+  Options options;
+
+  // Benchmarks advance time by a fixed step every frame to be reproducible
+  std::optional<float> fixedTime;
 };
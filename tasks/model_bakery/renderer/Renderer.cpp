@@ -12,7 +12,7 @@ Renderer::Renderer(glm::uvec2 res)
 {
 }
 
-void Renderer::initVulkan(std::span<const char*> instance_extensions)
+void Renderer::initVulkan(std::span<const char*> instance_extensions, bool headless_mode)
 {
   std::vector<const char*> instanceExtensions;
 
@@ -21,7 +21,9 @@ void Renderer::initVulkan(std::span<const char*> instance_extensions)
 
   std::vector<const char*> deviceExtensions;
 
-  deviceExtensions.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+  // Software rasterizers on CI machines might not even support presenting
+  if (!headless_mode)
+    deviceExtensions.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
 
   etna::initialize(etna::InitParams{
     .applicationName = "model_bakery_renderer",
@@ -34,9 +36,11 @@ void Renderer::initVulkan(std::span<const char*> instance_extensions)
   });
 }
 
-void Renderer::initFrameDelivery(vk::UniqueSurfaceKHR a_surface, ResolutionProvider res_provider)
+void Renderer::initFrameDelivery(
+  vk::UniqueSurfaceKHR a_surface, ResolutionProvider res_provider, bool vsync)
 {
   resolutionProvider = std::move(res_provider);
+  useVsync = vsync;
 
   auto& ctx = etna::get_context();
 
@@ -53,11 +57,28 @@ void Renderer::initFrameDelivery(vk::UniqueSurfaceKHR a_surface, ResolutionProvi
 
   resolution = {w, h};
 
+  initWorldRenderer(window->getCurrentFormat());
+}
+
+void Renderer::initHeadlessFrameDelivery()
+{
+  headless = std::make_unique<HeadlessFrameDelivery>(HeadlessFrameDelivery::CreateInfo{
+    .resolution = resolution,
+  });
+
+  initWorldRenderer(headless->getFormat());
+}
+
+void Renderer::initWorldRenderer(vk::Format target_format)
+{
+  gpuProfiler = std::make_unique<GpuTimestampProfiler>();
+
   worldRenderer = std::make_unique<WorldRenderer>();
+  worldRenderer->setGpuProfiler(gpuProfiler.get());
 
   worldRenderer->allocateResources(resolution);
   worldRenderer->loadShaders();
-  worldRenderer->setupPipelines(window->getCurrentFormat());
+  worldRenderer->setupPipelines(target_format);
 }
 
 void Renderer::loadScene(std::filesystem::path path)
@@ -93,6 +114,12 @@ void Renderer::drawFrame()
 {
   ZoneScoped;
 
+  if (headless)
+  {
+    drawFrameHeadless();
+    return;
+  }
+
   auto currentCmdBuf = commandManager->acquireNext();
 
   etna::begin_frame();
@@ -104,8 +131,10 @@ void Renderer::drawFrame()
     auto [image, view, availableSem] = *nextSwapchainImage;
 
     ETNA_CHECK_VK_RESULT(currentCmdBuf.begin(vk::CommandBufferBeginInfo{}));
+    gpuProfiler->beginFrame(currentCmdBuf);
     {
       ETNA_PROFILE_GPU(currentCmdBuf, renderFrame);
+      GpuTimestampProfiler::Scope frameZone{gpuProfiler.get(), currentCmdBuf, "frame"};
 
       worldRenderer->renderWorld(currentCmdBuf, image, view);
 
@@ -143,6 +172,30 @@ void Renderer::drawFrame()
   etna::end_frame();
 }
 
+void Renderer::drawFrameHeadless()
+{
+  auto currentCmdBuf = headless->acquireNext();
+
+  etna::begin_frame();
+
+  ETNA_CHECK_VK_RESULT(currentCmdBuf.begin(vk::CommandBufferBeginInfo{}));
+  gpuProfiler->beginFrame(currentCmdBuf);
+  {
+    ETNA_PROFILE_GPU(currentCmdBuf, renderFrame);
+    GpuTimestampProfiler::Scope frameZone{gpuProfiler.get(), currentCmdBuf, "frame"};
+
+    const auto& target = headless->getColorImage();
+    worldRenderer->renderWorld(currentCmdBuf, target.get(), target.getView({}));
+
+    ETNA_READ_BACK_GPU_PROFILING(currentCmdBuf);
+  }
+  ETNA_CHECK_VK_RESULT(currentCmdBuf.end());
+
+  headless->submit(currentCmdBuf);
+
+  etna::end_frame();
+}
+
 Renderer::~Renderer()
 {
   ETNA_CHECK_VK_RESULT(etna::get_context().getDevice().waitIdle());
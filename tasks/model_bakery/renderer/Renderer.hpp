@@ -5,6 +5,8 @@
 #include <glm/glm.hpp>
 #include <function2/function2.hpp>
 
+#include "render_utils/GpuTimestampProfiler.hpp"
+#include "render_utils/HeadlessFrameDelivery.hpp"
 #include "wsi/Keyboard.hpp"
 
 #include "FramePacket.hpp"
@@ -19,8 +21,12 @@ public:
   explicit Renderer(glm::uvec2 resolution);
   ~Renderer();
 
-  void initVulkan(std::span<const char*> instance_extensions);
-  void initFrameDelivery(vk::UniqueSurfaceKHR surface, ResolutionProvider res_provider);
+  void initVulkan(std::span<const char*> instance_extensions, bool headless_mode = false);
+  void initFrameDelivery(
+    vk::UniqueSurfaceKHR surface, ResolutionProvider res_provider, bool vsync = true);
+  // Alternative to initFrameDelivery, frames are rendered into an offscreen image.
+  // Requires initVulkan to be called with headless = true.
+  void initHeadlessFrameDelivery();
   void recreateSwapchain(glm::uvec2 res);
   void loadScene(std::filesystem::path path);
 
@@ -28,14 +34,24 @@ public:
   void update(const FramePacket& packet);
   void drawFrame();
 
+  const GpuTimestampProfiler& getGpuProfiler() const { return *gpuProfiler; }
+
+private:
+  void initWorldRenderer(vk::Format target_format);
+  void drawFrameHeadless();
+
 private:
   ResolutionProvider resolutionProvider;
 
   std::unique_ptr<etna::Window> window;
   std::unique_ptr<etna::PerFrameCmdMgr> commandManager;
 
+  // Replaces both of the above in headless mode
+  std::unique_ptr<HeadlessFrameDelivery> headless;
+
   glm::uvec2 resolution;
   bool useVsync = true;
 
   std::unique_ptr<WorldRenderer> worldRenderer;
+  std::unique_ptr<GpuTimestampProfiler> gpuProfiler;
 };
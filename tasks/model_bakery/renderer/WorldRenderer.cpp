@@ -92,28 +92,32 @@ void WorldRenderer::renderScene(
   cmd_buf.bindVertexBuffers(0, {sceneMgr->getVertexBuffer()}, {0});
   cmd_buf.bindIndexBuffer(sceneMgr->getIndexBuffer(), 0, vk::IndexType::eUint32);
 
-  pushConst2M.projView = glob_tm;
+  pushConst.projView = glob_tm;
+
+  cmd_buf.pushConstants<PushConstants>(
+    pipeline_layout, vk::ShaderStageFlagBits::eVertex, 0, {pushConst});
 
   auto instanceMeshes = sceneMgr->getInstanceMeshes();
-  auto instanceMatrices = sceneMgr->getInstanceMatrices();
 
   auto meshes = sceneMgr->getMeshes();
   auto relems = sceneMgr->getRenderElements();
 
   for (std::size_t instIdx = 0; instIdx < instanceMeshes.size(); ++instIdx)
   {
-    pushConst2M.model = instanceMatrices[instIdx];
-
-    cmd_buf.pushConstants<PushConstants>(
-      pipeline_layout, vk::ShaderStageFlagBits::eVertex, 0, {pushConst2M});
-
     const auto meshIdx = instanceMeshes[instIdx];
 
     for (std::size_t j = 0; j < meshes[meshIdx].relemCount; ++j)
     {
       const auto relemIdx = meshes[meshIdx].firstRelem + j;
       const auto& relem = relems[relemIdx];
-      cmd_buf.drawIndexed(relem.indexCount, 1, relem.indexOffset, relem.vertexOffset, 0);
+      // The vertex shader fetches the instance's transform by gl_InstanceIndex,
+      // which starts at firstInstance.
+      cmd_buf.drawIndexed(
+        relem.indexCount,
+        1,
+        relem.indexOffset,
+        relem.vertexOffset,
+        static_cast<std::uint32_t>(instIdx));
     }
   }
 }
@@ -126,6 +130,14 @@ void WorldRenderer::renderWorld(
   // draw final scene to screen
   {
     ETNA_PROFILE_GPU(cmd_buf, renderForward);
+    GpuTimestampProfiler::Scope gpuZone{gpuProfiler, cmd_buf, "forward"};
+
+    auto staticMeshInfo = etna::get_shader_program("static_mesh_material");
+
+    auto set = etna::create_descriptor_set(
+      staticMeshInfo.getDescriptorLayoutId(0),
+      cmd_buf,
+      {etna::Binding{0, sceneMgr->getInstanceTransformBuffer().genBinding()}});
 
     etna::RenderTargetState renderTargets(
       cmd_buf,
@@ -134,6 +146,13 @@ void WorldRenderer::renderWorld(
       {.image = mainViewDepth.get(), .view = mainViewDepth.getView({})});
 
     cmd_buf.bindPipeline(vk::PipelineBindPoint::eGraphics, staticMeshPipeline.getVkPipeline());
+    cmd_buf.bindDescriptorSets(
+      vk::PipelineBindPoint::eGraphics,
+      staticMeshPipeline.getVkPipelineLayout(),
+      0,
+      {set.getVkSet()},
+      {});
+
     renderScene(cmd_buf, worldViewProj, staticMeshPipeline.getVkPipelineLayout());
   }
 }
@@ -7,6 +7,7 @@
 #include <glm/glm.hpp>
 
 #include "scene/SceneManager.hpp"
+#include "render_utils/GpuTimestampProfiler.hpp"
 #include "wsi/Keyboard.hpp"
 
 #include "FramePacket.hpp"
@@ -23,6 +24,9 @@ public:
   void allocateResources(glm::uvec2 swapchain_resolution);
   void setupPipelines(vk::Format swapchain_format);
 
+  // Used for benchmarking, may be null
+  void setGpuProfiler(GpuTimestampProfiler* profiler) { gpuProfiler = profiler; }
+
   void debugInput(const Keyboard& kb);
   void update(const FramePacket& packet);
   void drawGui();
@@ -40,16 +44,19 @@ private:
   etna::Image mainViewDepth;
   etna::Buffer constants;
 
+  // Model matrices are not pushed per-draw, they are
+  // read from SceneManager's instance transform buffer.
   struct PushConstants
   {
     glm::mat4x4 projView;
-    glm::mat4x4 model;
-  } pushConst2M;
+  } pushConst;
 
   glm::mat4x4 worldViewProj;
   glm::mat4x4 lightMatrix;
 
   etna::GraphicsPipeline staticMeshPipeline{};
 
+  GpuTimestampProfiler* gpuProfiler = nullptr;
+
   glm::uvec2 resolution;
 };
@@ -1,10 +1,60 @@
+#include <charconv>
+#include <cstdio>
+#include <string>
+#include <string_view>
+
 #include "App.hpp"
 
 
-int main()
+static void print_usage()
+{
+  std::printf(
+    "Usage: model_bakery_renderer [--benchmark CAMERA_PATH] [--warmup N]"
+    " [--benchmark-output FILE] [--headless]\n"
+    "--headless only works together with --benchmark\n");
+}
+
+int main(int argc, char** argv)
 {
+  App::Options options;
+  for (int i = 1; i < argc; ++i)
+  {
+    const std::string_view arg{argv[i]};
+    const bool hasValue = i + 1 < argc;
+
+    bool valid = true;
+    if (arg == "--benchmark" && hasValue)
+      options.benchmarkPath = argv[++i];
+    else if (arg == "--warmup" && hasValue)
+    {
+      const std::string_view value{argv[++i]};
+      const auto [end, error] =
+        std::from_chars(value.data(), value.data() + value.size(), options.warmupFrames);
+      valid = error == std::errc{} && end == value.data() + value.size();
+    }
+    else if (arg == "--benchmark-output" && hasValue)
+      options.benchmarkOutput = argv[++i];
+    else if (arg == "--headless")
+      options.headless = true;
+    else
+      valid = false;
+
+    if (!valid)
+    {
+      print_usage();
+      return 1;
+    }
+  }
+
+  // There is nothing to look at without a window
+  if (options.headless && options.benchmarkPath.empty())
+  {
+    print_usage();
+    return 1;
+  }
+
   {
-    App app;
+    App app{options};
     app.run();
   }
 
@@ -3,6 +3,7 @@
 #extension GL_GOOGLE_include_directive : require
 
 #include "unpack_attributes.glsl"
+#include "instance_transform.glsl"
 
 
 layout(location = 0) in vec4 vPosNorm;
@@ -11,9 +12,13 @@ layout(location = 1) in vec4 vTexCoordAndTang;
 layout(push_constant) uniform params_t
 {
   mat4 mProjView;
-  mat4 mModel;
 } params;
 
+layout(binding = 0, set = 0) readonly buffer InstanceTransforms
+{
+  InstanceTransform instanceTransforms[];
+};
+
 
 layout (location = 0 ) out VS_OUT
 {
@@ -30,9 +35,12 @@ void main(void)
   const vec4 wNorm = vec4(decode_normal(floatBitsToInt(vPosNorm.w)),     0.0f);
   const vec4 wTang = vec4(decode_normal(floatBitsToInt(vTexCoordAndTang.z)), 0.0f);
 
-  vOut.wPos   = (params.mModel * vec4(vPosNorm.xyz, 1.0f)).xyz;
-  vOut.wNorm  = normalize(mat3(transpose(inverse(params.mModel))) * wNorm.xyz);
-  vOut.wTangent = normalize(mat3(transpose(inverse(params.mModel))) * wTang.xyz);
+  // Instances are drawn with firstInstance set to their index
+  const InstanceTransform transform = instanceTransforms[gl_InstanceIndex];
+
+  vOut.wPos = transform_point(transform, vPosNorm.xyz);
+  vOut.wNorm = normalize(transform_normal(transform, wNorm.xyz));
+  vOut.wTangent = normalize(transform_direction(transform, wTang.xyz));
   vOut.texCoord = vTexCoordAndTang.xy;
 
   gl_Position   = params.mProjView * vec4(vOut.wPos, 1.0);